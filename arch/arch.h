@@ -63,7 +63,7 @@ static inline __uint64_t arm64_read_ ## _name (void)			\
 #define _DEFINE_SYSREG_WRITE_FUNC(_name, _sysreg)				\
 static inline void arm64_write_ ## _name (__uint64_t v)			\
 {																\
-	__asm__ __volatile__("msr " #_sysreg ", %0" : "=r" (v));	\
+	__asm__ __volatile__("msr " #_sysreg ", %0" : : "r" (v));	\
 }
 
 /* System Registers */
@@ -105,6 +105,7 @@ typedef struct {
 	uint64_t	far;
 	uint64_t	esr;
 	uint64_t	elr;
+	uint64_t	spsr;
 } arm64_exception_frame_t;
 
 /**
@@ -220,6 +221,7 @@ DEFINE_SYSOP_TYPE_FUNC(dmb, sy)
 DEFINE_SYSOP_TYPE_FUNC(dmb, st)
 DEFINE_SYSOP_TYPE_FUNC(dmb, ish)
 DEFINE_SYSOP_TYPE_FUNC(dmb, ishst)
+DEFINE_SYSOP_TYPE_FUNC(dmb, ishld)
 DEFINE_SYSOP_TYPE_FUNC(dmb, nsh)
 DEFINE_SYSOP_TYPE_FUNC(dmb, nshst)
 DEFINE_SYSOP_TYPE_FUNC(dmb, osh)
@@ -229,13 +231,19 @@ DEFINE_SYSOP_TYPE_FUNC(dmb, oshst)
 DEFINE_SYSOP_TYPE_FUNC(isb, sy)
 DEFINE_SYSOP_FUNC(isb)
 
+/* Hint that this is a spin-wait loop */
+static inline void cpu_relax(void)
+{
+	__asm__ __volatile__("yield" : : : "memory");
+}
+
 /* Debug */
 #define debug_barrier()	\
 	__asm__ __volatile__("brk #1")
 
 // tmp
-extern void arm64_timer_init(uint64_t);
-extern void arm64_timer_reset(uint64_t);
 extern uint64_t arm64_timer_get_current();
+extern void arm64_vtimer_init(uint64_t);
+extern void arm64_vtimer_reset(uint64_t);
 
 #endif /* __aarch64_arch_h__ */
@@ -42,7 +42,8 @@
 
 #define sysreg_write(__req, __val)										\
 ({																		\
-	__asm__ __volatile__("msr " __STRING(__req) ", %0" : "=r" (__val));	\
+	__asm__ __volatile__("msr " __STRING(__req) ", %0"					\
+		: : "r" ((uint64_t) (__val)) : "memory");							\
 })
 
 /*******************************************************************************
@@ -782,6 +783,130 @@
 #define MPIDR_AFFLVL3_VAL(mpidr) \
 		(0)
 
+/*******************************************************************************
+ * Name:	Performance Monitors
+*******************************************************************************/
+
+/* ID_AA64DFR0_EL1.PMUVer, Bits [11:8]. 0x0 or 0xf if not implemented */
+#define ID_AA64DFR0_PMUVER_SHIFT	8
+#define ID_AA64DFR0_PMUVER_MASK		(0xf)
+#define ID_AA64DFR0_PMUVER_NONE		(0x0)
+#define ID_AA64DFR0_PMUVER_IMPDEF	(0xf)
+
+/* Performance Monitors Control Register */
+#define PMCR_EL0_E					(1 << 0)	/* Enable all counters */
+#define PMCR_EL0_P					(1 << 1)	/* Reset event counters */
+#define PMCR_EL0_C					(1 << 2)	/* Reset cycle counter */
+#define PMCR_EL0_LC					(1 << 6)	/* 64-bit cycle counter */
+#define PMCR_EL0_N_SHIFT			11			/* Number of event counters */
+#define PMCR_EL0_N_MASK				(0x1f)
+
+/* Performance Monitors Count Enable Set, cycle counter */
+#define PMCNTENSET_EL0_C			(1U << 31)
+
+/**
+ * Event Type Registers, PMEVTYPER<n>_EL0 and PMCCFILTR_EL0. The filter bits
+ * exclude counting at a level, with none set events are counted at EL0 and EL1.
+*/
+#define PMEVTYPER_P					(1U << 31)	/* Don't count at EL1 */
+#define PMEVTYPER_U					(1U << 30)	/* Don't count at EL0 */
+#define PMEVTYPER_EVTCOUNT_MASK		(0xffff)
+
+/*******************************************************************************
+ * Name:	AArch64 ID Registers
+ * Desc:	Feature fields are four bits wide. Most are unsigned, with zero
+ * 			meaning not implemented and higher values adding to lower ones.
+ * 			The FP and AdvSIMD fields are signed, with 0xf for none.
+*******************************************************************************/
+
+#define ID_AA64_FIELD_MASK			(0xf)
+#define ID_AA64_FIELD(__reg, __shift)	(((__reg) >> (__shift)) & ID_AA64_FIELD_MASK)
+/* signed fields, where 0xf (-1) means not implemented */
+#define ID_AA64_SFIELD(__reg, __shift)	\
+	((int64_t) ((uint64_t) (__reg) << (60 - (__shift))) >> 60)
+
+/* ID_AA64MMFR2_EL1 is an ARMv8.2 name, so use its encoding */
+#define ID_AA64MMFR2_EL1			s3_0_c0_c7_2
+
+/* ID_AA64ISAR0_EL1, Instruction Set Attribute Register 0 */
+#define ID_AA64ISAR0_AES_SHIFT		4		/* 1 AES, 2 AES and PMULL */
+#define ID_AA64ISAR0_SHA1_SHIFT		8
+#define ID_AA64ISAR0_SHA2_SHIFT		12		/* 1 SHA256, 2 SHA256 and SHA512 */
+#define ID_AA64ISAR0_CRC32_SHIFT	16
+#define ID_AA64ISAR0_ATOMIC_SHIFT	20		/* 2 LSE atomics */
+#define ID_AA64ISAR0_RDM_SHIFT		28
+#define ID_AA64ISAR0_SHA3_SHIFT		32
+#define ID_AA64ISAR0_SM3_SHIFT		36
+#define ID_AA64ISAR0_SM4_SHIFT		40
+#define ID_AA64ISAR0_DP_SHIFT		44
+#define ID_AA64ISAR0_FHM_SHIFT		48
+#define ID_AA64ISAR0_TS_SHIFT		52
+#define ID_AA64ISAR0_TLB_SHIFT		56		/* 1 TLBI outer shareable, 2 and range */
+#define ID_AA64ISAR0_RNDR_SHIFT		60
+
+/* ID_AA64ISAR1_EL1, Instruction Set Attribute Register 1 */
+#define ID_AA64ISAR1_DPB_SHIFT		0
+#define ID_AA64ISAR1_APA_SHIFT		4
+#define ID_AA64ISAR1_API_SHIFT		8
+#define ID_AA64ISAR1_JSCVT_SHIFT	12
+#define ID_AA64ISAR1_FCMA_SHIFT		16
+#define ID_AA64ISAR1_LRCPC_SHIFT	20
+#define ID_AA64ISAR1_FRINTTS_SHIFT	32
+#define ID_AA64ISAR1_SB_SHIFT		36
+#define ID_AA64ISAR1_BF16_SHIFT		44
+#define ID_AA64ISAR1_I8MM_SHIFT		52
+
+/* ID_AA64PFR0_EL1, Processor Feature Register 0 */
+#define ID_AA64PFR0_FP_SHIFT		16		/* signed, 1 adds half-precision */
+#define ID_AA64PFR0_ADVSIMD_SHIFT	20		/* signed, 1 adds half-precision */
+#define ID_AA64PFR0_GIC_SHIFT		24
+#define ID_AA64PFR0_RAS_SHIFT		28
+#define ID_AA64PFR0_SVE_SHIFT		32
+#define ID_AA64PFR0_DIT_SHIFT		48
+#define ID_AA64PFR0_FP_NONE			(0xf)
+
+/* ID_AA64MMFR0_EL1, Memory Model Feature Register 0 */
+#define ID_AA64MMFR0_PARANGE_SHIFT	0
+#define ID_AA64MMFR0_ASIDBITS_SHIFT	4		/* 0 8 bits, 2 16 bits */
+#define ID_AA64MMFR0_TGRAN16_SHIFT	20		/* 1 if 16KB granule supported */
+#define ID_AA64MMFR0_TGRAN64_SHIFT	24		/* 0 if 64KB granule supported */
+#define ID_AA64MMFR0_TGRAN4_SHIFT	28		/* signed, >= 0 if 4KB granule supported */
+#define ID_AA64MMFR0_ECV_SHIFT		60
+
+/* ID_AA64MMFR1_EL1, Memory Model Feature Register 1 */
+#define ID_AA64MMFR1_HAFDBS_SHIFT	0		/* 1 access flag, 2 and dirty state */
+#define ID_AA64MMFR1_VH_SHIFT		8
+#define ID_AA64MMFR1_LO_SHIFT		16
+#define ID_AA64MMFR1_PAN_SHIFT		20
+#define ID_AA64MMFR1_XNX_SHIFT		28
+
+/* ID_AA64MMFR2_EL1, Memory Model Feature Register 2 */
+#define ID_AA64MMFR2_CNP_SHIFT		0
+#define ID_AA64MMFR2_UAO_SHIFT		4
+#define ID_AA64MMFR2_AT_SHIFT		32		/* LSE2 single-copy atomicity */
+#define ID_AA64MMFR2_TTL_SHIFT		48
+#define ID_AA64MMFR2_BBM_SHIFT		52
+#define ID_AA64MMFR2_E0PD_SHIFT		60
+
+/*******************************************************************************
+ * Name:	Floating-point and Advanced SIMD
+*******************************************************************************/
+
+/* Architectural Feature Access Control Register, FPEN Bits [21:20] */
+#define CPACR_EL1_FPEN_SHIFT		20
+#define CPACR_EL1_FPEN_MASK			(0x3 << CPACR_EL1_FPEN_SHIFT)
+#define CPACR_EL1_FPEN_TRAP_ALL		(0x0 << CPACR_EL1_FPEN_SHIFT)
+#define CPACR_EL1_FPEN_ENABLE		(0x3 << CPACR_EL1_FPEN_SHIFT)
+
+/*******************************************************************************
+ * Name:	Physical Timer Definitions
+*******************************************************************************/
+
+/* Physical Timer Control Register */
+#define CNTP_CTL_EL0_ISTATUS	(1 << 2)
+#define CNTP_CTL_EL0_IMASKED	(1 << 1)
+#define CNTP_CTL_EL0_ENABLE		(1 << 0)
+
 /*******************************************************************************
  * Name:	Virtual Timer Definitions
 *******************************************************************************/
@@ -49,6 +49,15 @@ struct gicv3_data {
 	struct gicv3_dist_frame		*dist;
 	struct gicv3_redist_frame	*redist;
 
+	/**
+	 * Per-CPU state, indexed by cpu_number_t. The redistributor for each CPU is
+	 * looked up once when that CPU initialises its interface, and the affinity
+	 * is kept in GICD_IROUTER format so SPIs can be routed to any CPU that has
+	 * come online.
+	*/
+	struct gicv3_redist_frame	*redist_cpu[DEFAULTS_MACHINE_MAX_CPUS];
+	uint64_t					affinity_cpu[DEFAULTS_MACHINE_MAX_CPUS];
+
 	uint32_t		flags;
 };
 
@@ -89,6 +98,25 @@ static uint32_t gic_get_redist_id(uint32_t affinity)
 	return 0xffffffff;
 }
 
+/**
+ * Name:	gic_get_redist
+ * Desc:	Get the cached redistributor frame for the current CPU.
+*/
+static inline struct gicv3_redist_frame *gic_get_redist()
+{
+	return gic_data.redist_cpu[machine_get_cpu_num()];
+}
+
+/**
+ * Name:	gic_dist_wait_for_rwp
+ * Desc:	Wait for a write to GICD_CTLR or GICD_ICENABLER<n> to take effect.
+*/
+static inline void gic_dist_wait_for_rwp()
+{
+	while (gic_data.dist->ctlr & GICD_CTLR_RWP_BIT)
+		;
+}
+
 static int gic_get_version()
 {
 	int version;
@@ -128,32 +156,41 @@ void gic_dist_init ()
 
 void gic_redist_init ()
 {
+	struct gicv3_redist_frame *redist;
 	cpu_number_t cpu_num;
 	uint32_t redist_id;
 
 	/**
-	 * Configure the Redistributor for the currently executing CPU. This will
-	 * need slight changes when SMP is implemented.
+	 * Configure the Redistributor for the currently executing CPU. Secondary
+	 * CPUs call this again from their own context once SMP is implemented.
 	*/
 	cpu_num = machine_get_cpu_num();
 	gic_data.max_redist_idx = machine_get_max_cpu_num();
 
 	/**
-	 * Obtain the redistributor index for the above MPIDR_EL1 value, and use it
-	 * to configure the correct redistributor.
+	 * Obtain the redistributor index for the above MPIDR_EL1 value. This is
+	 * the only time the redistributor region is scanned, the frame is cached
+	 * for the CPU so the interrupt paths never have to search for it.
 	*/
 	redist_id = gic_get_redist_id(arm64_read_affinity());
-	gic_data.redist[redist_id].lpis.waker &= ~GICR_WAKER_PS_BIT;
+	if (redist_id > gic_data.max_redist_idx)
+		panic("gicv3: failed to obtain redistributor for cpu: %d\n", cpu_num);
+
+	redist = &gic_data.redist[redist_id];
+	gic_data.redist_cpu[cpu_num] = redist;
+	gic_data.affinity_cpu[cpu_num] = sysreg_read(mpidr_el1) & GICD_IROUTER_AFF_MASK;
+
+	redist->lpis.waker &= ~GICR_WAKER_PS_BIT;
 
 	/**
 	 * Poll GICR_WAKER.ChildrenAsleep until it reads 0, once it does the Redist
 	 * has woken up.
 	*/
-	while (gic_data.redist[redist_id].lpis.waker & GICR_WAKER_CA_BIT)
+	while (redist->lpis.waker & GICR_WAKER_CA_BIT)
 		pr_info("CPU%d: waiting for Redistributor to wake up\n", cpu_num);
 	
 	pr_info("CPU%d: found redistributor '%d' region: 0x%llx\n",
-		cpu_num, redist_id, &gic_data.redist[redist_id]);
+		cpu_num, redist_id, redist);
 
 	dsbsy();
 	isb();
@@ -161,7 +198,7 @@ void gic_redist_init ()
 
 void gic_cpuif_init ()
 {
-	uint64_t sre_val, pmr_val, igrpen_val;
+	uint64_t sre_val, pmr_val, ctlr_val, igrpen_val, pri_bits;
 
 	/**
 	 * Configure the CPU Interface for the currently executing CPU.
@@ -172,6 +209,28 @@ void gic_cpuif_init ()
 	pmr_val = 0xff;
 	sysreg_write(icc_pmr_el1, pmr_val);
 
+	/**
+	 * Split completion of interrupts into two steps. A write to EOIR1 only
+	 * drops the running priority, and the interrupt remains active until it's
+	 * written to DIR. This lets a threaded handler finish long after the top
+	 * half has returned, without blocking other interrupts in the meantime.
+	*/
+	ctlr_val = sysreg_read(icc_ctlr_el1) & ~ICC_CTLR_EL1_EOImode_MASK;
+	sysreg_write(icc_ctlr_el1, ctlr_val | ICC_CTLR_EL1_EOImode_drop);
+
+	/**
+	 * Set the binary point so the group priority, which decides whether one
+	 * interrupt can preempt another, is formed from the top bits used by the
+	 * priority classes. Warn if the GIC implements too few bits to tell the
+	 * classes apart.
+	*/
+	pri_bits = ((ctlr_val & ICC_CTLR_EL1_PRI_BITS_MASK) >>
+		ICC_CTLR_EL1_PRI_BITS_SHIFT) + 1;
+	if (pri_bits < (8 - IRQ_PRIORITY_BINARY_POINT))
+		pr_warn("only %d priority bits implemented\n", pri_bits);
+
+	sysreg_write(icc_bpr1_el1, IRQ_PRIORITY_BINARY_POINT);
+
 	igrpen_val = sysreg_read(icc_igrpen1_el1) | 0x1;
 	sysreg_write(icc_igrpen1_el1, igrpen_val);
 
@@ -210,66 +269,183 @@ kern_return_t gic_interface_init(vm_address_t dist_base, vm_address_t redist_bas
 
 static void __gic_irq_control(uint32_t intid, int ctrl)
 {
-	if (intid < 31) {
-		uint32_t redist_id, id;
+	uint32_t id;
+
+	/* Figure out which bit within the registers to modify */
+	id = 1 << (intid & 0x1f);
 
-		/* Grab the redistributor and check it's within range */
-		redist_id = gic_get_redist_id(arm64_read_affinity());
-		if (redist_id > gic_data.max_redist_idx)
+	/**
+	 * The enable registers are write-1-to-set/clear, so only the bit for this
+	 * interrupt is written. SGIs and PPIs are banked in the redistributor of
+	 * the current CPU, SPIs are enabled through the distributor.
+	*/
+	if (intid < GIC_INTID_SPI_BASE) {
+		struct gicv3_redist_frame *redist = gic_get_redist();
+
+		if (redist == NULL)
 			panic("irq: failed to obtain redistributor for cpu: %d\n",
 				cpu_get_current()->cpu_num);
 
-		/* Figure out which bit within the registers to modify */
-		id = 1 << (intid & 0x1f);
+		if (ctrl == GIC_IRQ_CONTROL_ENABLE)
+			redist->sgis.isenabler[0] = id;
+		else if (ctrl == GIC_IRQ_CONTROL_DISABLE)
+			redist->sgis.icenabler[0] = id;
 
-		/* Enable the interrupt */
+	} else if (intid <= GIC_INTID_SPI_MAX) {
 		if (ctrl == GIC_IRQ_CONTROL_ENABLE)
-			gic_data.redist[redist_id].sgis.isenabler[0] |= id;
+			gic_data.dist->isenabler[intid / 32] = id;
 		else if (ctrl == GIC_IRQ_CONTROL_DISABLE) {
-			gic_data.redist[redist_id].sgis.icenabler[0] |= id;
+			gic_data.dist->icenabler[intid / 32] = id;
+			gic_dist_wait_for_rwp();
 		}
-
-		dmbst();
-		isb();
 	}
+
+	dmbst();
+	isb();
 }
 
 /*******************************************************************************
  * GICv3 Interrupt Configuration
 *******************************************************************************/
 
+kern_return_t gic_irq_set_priority(uint32_t intid, uint32_t priority)
+{
+	struct gicv3_redist_frame *redist;
+
+	/* Priority registers are byte-accessible on both frames */
+	if (intid < GIC_INTID_SPI_BASE) {
+		redist = gic_get_redist();
+		if (redist == NULL)
+			return KERN_RETURN_FAIL;
+
+		redist->sgis.ipriorityr[intid] = priority;
+	} else if (intid <= GIC_INTID_SPI_MAX) {
+		gic_data.dist->ipriorityr[intid] = priority;
+	} else {
+		return KERN_RETURN_FAIL;
+	}
+
+	return KERN_RETURN_SUCCESS;
+}
+
+kern_return_t gic_irq_set_trigger(uint32_t intid, uint32_t trigger)
+{
+	struct gicv3_redist_frame *redist;
+	volatile uint32_t *icfgr;
+	uint32_t bit;
+
+	/**
+	 * Each interrupt has a 2-bit field in the ICFGR registers, where the upper
+	 * bit selects edge (1) or level (0) triggering. SGIs are always edge, so
+	 * their fields are read-only.
+	*/
+	if (intid < 16)
+		return (trigger == GIC_IRQ_TRIGGER_EDGE) ? KERN_RETURN_SUCCESS :
+			KERN_RETURN_FAIL;
+
+	if (intid < GIC_INTID_SPI_BASE) {
+		redist = gic_get_redist();
+		if (redist == NULL)
+			return KERN_RETURN_FAIL;
+
+		icfgr = &redist->sgis.icfgr[intid / 16];
+	} else if (intid <= GIC_INTID_SPI_MAX) {
+		icfgr = &gic_data.dist->icfgr[intid / 16];
+	} else {
+		return KERN_RETURN_FAIL;
+	}
+
+	bit = 1 << (((intid % 16) * 2) + 1);
+	if (trigger == GIC_IRQ_TRIGGER_EDGE)
+		*icfgr |= bit;
+	else
+		*icfgr &= ~bit;
+
+	return KERN_RETURN_SUCCESS;
+}
+
+kern_return_t gic_irq_set_affinity(uint32_t intid, unsigned int cpu)
+{
+	/* SGIs and PPIs are private to each CPU and can't be routed */
+	if (intid < GIC_INTID_SPI_BASE || intid > GIC_INTID_SPI_MAX)
+		return KERN_RETURN_FAIL;
+
+	if (cpu >= DEFAULTS_MACHINE_MAX_CPUS || !gic_cpu_online(cpu))
+		return KERN_RETURN_FAIL;
+
+	/**
+	 * Route the SPI to exactly one CPU (IRM=0). GICD_IROUTER can be written
+	 * while the interrupt is enabled, the new route applies to the next time
+	 * the interrupt is signalled.
+	*/
+	gic_data.dist->irouter[intid - GIC_INTID_SPI_BASE] =
+		gic_data.affinity_cpu[cpu];
+
+	dsbsy();
+	return KERN_RETURN_SUCCESS;
+}
+
+bool gic_cpu_online(unsigned int cpu)
+{
+	return (gic_data.redist_cpu[cpu] != NULL);
+}
+
+uint32_t gic_cpu_get_pmr(void)
+{
+	return sysreg_read(icc_pmr_el1) & ICC_PMR_EL1_MASK;
+}
+
+void gic_cpu_set_pmr(uint32_t pmr)
+{
+	/**
+	 * A PMR write is self-synchronising with respect to interrupts being
+	 * signalled, but the dsb makes sure any interrupt that is now masked
+	 * isn't taken after this returns.
+	*/
+	sysreg_write(icc_pmr_el1, pmr);
+	dsbsy();
+}
+
+uint32_t gic_cpu_running_priority(void)
+{
+	return sysreg_read(icc_rpr_el1) & ICC_PMR_EL1_MASK;
+}
+
 kern_return_t gic_irq_register(uint32_t intid, uint32_t priority)
 {
+	uint32_t id;
+
 	/**
 	 * The configuration of the interrupt depends on the type, i.e. SGI/PPI or
 	 * SPI. SGI/PPI are configured on the Redistributor, whereas SPIs are 
 	 * configured on the Distributor.
 	*/
-	if (intid < 31) {
-		uint32_t redist_id, group, mod, id;
+	if (intid < GIC_INTID_SPI_BASE) {
+		struct gicv3_redist_frame *redist;
+		uint32_t group, mod;
 
-		/* Grab the redistributor and check it's within range */
-		redist_id = gic_get_redist_id(arm64_read_affinity());
-		if (redist_id > gic_data.max_redist_idx)
+		/* Grab the cached redistributor for this CPU */
+		redist = gic_get_redist();
+		if (redist == NULL)
 			return KERN_RETURN_FAIL;
 
 		/* Set the interrupts priority */
-		gic_data.redist[redist_id].sgis.ipriorityr[intid] = priority;
+		gic_irq_set_priority(intid, priority);
 
 		/* Figure out which bit within the registers to modify */
 		id = 1 << (intid & 0x1f);
 
 		/* Calculate which field within the following registers to modify */
-		group = gic_data.redist[redist_id].sgis.igroupr[0];
-		mod = gic_data.redist[redist_id].sgis.igrpmodr[0];
+		group = redist->sgis.igroupr[0];
+		mod = redist->sgis.igrpmodr[0];
 
 		/* Only Non-secure Group 1 are supported */
 		group = (group | id);
 		mod = (mod & ~id);
 
 		/* Write the Group and Mod values back */
-		gic_data.redist[redist_id].sgis.igroupr[0] = group;
-		gic_data.redist[redist_id].sgis.igrpmodr[0] = mod;
+		redist->sgis.igroupr[0] = group;
+		redist->sgis.igrpmodr[0] = mod;
 
 		/* Enable the interrupt */
 		__gic_irq_control(intid, GIC_IRQ_CONTROL_ENABLE);
@@ -277,9 +453,30 @@ kern_return_t gic_irq_register(uint32_t intid, uint32_t priority)
 		dsbsy();
 		isb();
 
-	} else if (intid < 1020) {
-		pr_info("INTID '%d' is not configurable\n", intid);
-		return KERN_RETURN_FAIL;
+	} else if (intid <= GIC_INTID_SPI_MAX) {
+
+		/**
+		 * SPIs are disabled while they're reconfigured. They default to being
+		 * level-triggered and routed to the registering CPU, the caller can
+		 * change either once the interrupt has been registered.
+		*/
+		__gic_irq_control(intid, GIC_IRQ_CONTROL_DISABLE);
+
+		gic_irq_set_priority(intid, priority);
+
+		/* Only Non-secure Group 1 are supported */
+		id = 1 << (intid & 0x1f);
+		gic_data.dist->igroupr[intid / 32] |= id;
+		gic_data.dist->igrpmodr[intid / 32] &= ~id;
+
+		gic_irq_set_trigger(intid, GIC_IRQ_TRIGGER_LEVEL);
+		gic_irq_set_affinity(intid, machine_get_cpu_num());
+
+		__gic_irq_control(intid, GIC_IRQ_CONTROL_ENABLE);
+
+		dsbsy();
+		isb();
+
 	} else {
 		pr_info("Extended interrupt range not supported\n");
 		return KERN_RETURN_FAIL;
@@ -323,8 +520,6 @@ void gic_send_sgi(uint64_t intid, uint64_t target)
 	aff3 = MPIDR_AFFLVL3_VAL(mpidr);
 
 	sgi_val = CREATE_SGIR_VALUE(aff3, aff2, aff1, intid, (uint64_t)GIC_IRM_DISABLE, target);
-	pr_info("Generating INTID '%d' for affinity %d.%d.%d.%d (SGI: 0x%llx)\n",
-		intid, aff3, aff2, aff1, target, sgi_val);
 
 	/* Write the SGI value to trigger the interrupt */
 	sysreg_write(icc_sgi1r_el1, sgi_val);
@@ -333,12 +528,96 @@ void gic_send_sgi(uint64_t intid, uint64_t target)
 	isb();
 }
 
-/*
-	TODO:
-	gic_irq_acknowledge
-	gic_irq_eoi
+/**
+ * gic_send_sgi_mask
+ *
+ * Send an SGI to each CPU in a mask of logical cpu numbers. CPUs that share
+ * Aff3.Aff2.Aff1 and range selector are named in one target list, so a whole
+ * cluster is signalled with a single write to ICC_SGI1R_EL1.
+*/
+void gic_send_sgi_mask(uint64_t intid, uint64_t cpumask)
+{
+	uint64_t aff, cluster, other, tlist, sgi_val;
+	unsigned int cpu, i;
+
+	/* make our stores visible before the target can take the interrupt */
+	dsbishst();
+
+	while (cpumask) {
+		cpu = __builtin_ctzll(cpumask);
+		aff = gic_data.affinity_cpu[cpu];
+
+		/* everything but the low four bits of Aff0 picks the target list */
+		cluster = aff & ~0xfULL;
+		tlist = 0;
+
+		for (i = cpu; i < DEFAULTS_MACHINE_MAX_CPUS; i++) {
+			if (!(cpumask & BIT_64(i)))
+				continue;
+
+			other = gic_data.affinity_cpu[i];
+			if ((other & ~0xfULL) != cluster)
+				continue;
+
+			tlist |= BIT_64(other & 0xf);
+			cpumask &= ~BIT_64(i);
+		}
+
+		sgi_val = CREATE_SGIR_VALUE((uint64_t) MPIDR_AFFLVL3_VAL(aff),
+			(uint64_t) MPIDR_AFFLVL2_VAL(aff), (uint64_t) MPIDR_AFFLVL1_VAL(aff),
+			intid, (uint64_t) GIC_IRM_DISABLE, tlist);
+		sgi_val |= (MPIDR_AFFLVL0_VAL(aff) >> 4) << ICC_SGI1R_RS_SHIFT;
+
+		sysreg_write(icc_sgi1r_el1, sgi_val);
+	}
+
+	isb();
+}
+
+/**
+ * gic_send_sgi_others
+ *
+ * Send an SGI to every other CPU with Interrupt Routing Mode set, letting the
+ * redistributors do the fan-out from a single register write.
+*/
+void gic_send_sgi_others(uint64_t intid)
+{
+	uint64_t sgi_val;
+
+	dsbishst();
+
+	sgi_val = CREATE_SGIR_VALUE(0UL, 0UL, 0UL, intid, (uint64_t) GIC_IRM_ENABLE, 0UL);
+	sysreg_write(icc_sgi1r_el1, sgi_val);
 
+	isb();
+}
+
+uint32_t gic_irq_acknowledge(void)
+{
+	uint32_t intid;
+
+	/* Reading IAR1 also raises the running priority to that of the IRQ */
+	intid = sysreg_read(icc_iar1_el1);
+	dsbsy();
+
+	return intid;
+}
+
+/**
+ * With ICC_CTLR_EL1.EOImode set, this is a priority drop only. The interrupt
+ * stays active, and can't be signalled again, until gic_irq_deactivate().
 */
+void gic_irq_eoi(uint32_t intid)
+{
+	sysreg_write(icc_eoir1_el1, intid);
+	isb();
+}
+
+void gic_irq_deactivate(uint32_t intid)
+{
+	sysreg_write(icc_dir_el1, intid);
+	isb();
+}
 
 /* GICv3 Interface */
 //static struct irq_interface gic_interface = {
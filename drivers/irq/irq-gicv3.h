@@ -41,6 +41,35 @@ extern kern_return_t gic_irq_register(uint32_t intid, uint32_t priority);
 extern void gic_irq_enable(uint64_t intid);
 extern void gic_irq_disable(uint64_t intid);
 extern void gic_send_sgi(uint64_t intid, uint64_t target);
+extern void gic_send_sgi_mask(uint64_t intid, uint64_t cpumask);
+extern void gic_send_sgi_others(uint64_t intid);
+
+extern kern_return_t gic_irq_set_priority(uint32_t intid, uint32_t priority);
+extern kern_return_t gic_irq_set_trigger(uint32_t intid, uint32_t trigger);
+extern kern_return_t gic_irq_set_affinity(uint32_t intid, unsigned int cpu);
+
+extern uint32_t gic_irq_acknowledge(void);
+extern void gic_irq_eoi(uint32_t intid);
+extern void gic_irq_deactivate(uint32_t intid);
+
+extern bool gic_cpu_online(unsigned int cpu);
+
+extern uint32_t gic_cpu_get_pmr(void);
+extern void gic_cpu_set_pmr(uint32_t pmr);
+extern uint32_t gic_cpu_running_priority(void);
+
+/**
+ * Interrupt trigger types, as programmed into GICD_ICFGR/GICR_ICFGR.
+*/
+#define GIC_IRQ_TRIGGER_LEVEL		0
+#define GIC_IRQ_TRIGGER_EDGE		1
+
+/**
+ * INTID ranges
+*/
+#define GIC_INTID_SPI_BASE			32
+#define GIC_INTID_SPI_MAX			1019
+#define GIC_INTID_SPURIOUS			1023
 
 /*******************************************************************************
  * GICv3 Distributor Registers and Bit Definitions
@@ -100,7 +129,7 @@ struct gicv3_dist_frame
 	uint32_t 	isactiver[32]; 			/* 0x0300 - RW - Interrupt Set-Active Registers */
 	uint32_t 	icactiver[32]; 			/* 0x0380 - RW - Interrupt Clear-Active Registers */
 
-	uint32_t 	ipriorityr[256]; 		/* 0x0400 - RW - Interrupt Priority Registers */
+	uint8_t 	ipriorityr[1024]; 		/* 0x0400 - RW - Interrupt Priority Registers */
 	
 	uint32_t 	itargetsr[256]; 		/* 0x0800 - RW - Interrupt Processor Targets Registers */
 	uint32_t 	icfgr[64]; 				/* 0x0C00 - RW - Interrupt Configuration Registers */
@@ -132,9 +161,9 @@ struct gicv3_dist_frame
 
 	GICV3_DIST_FRAME_RESERVED(8, 2688);	/* 0x3700 - RESERVED */
 
-	uint32_t	irouter[1024];			/* 0x6100 */
+	uint64_t	irouter[988];			/* 0x6100 - RW - Interrupt Routing Registers (SPIs 32-1019) */
 
-	GICV3_DIST_FRAME_RESERVED(9, 9146);
+	GICV3_DIST_FRAME_RESERVED(9, 8194);	/* 0x7FE0 - RESERVED */
 
 	uint32_t	pidr2;					/* 0xFFE8 */
 };
@@ -144,6 +173,13 @@ struct gicv3_dist_frame
  * GICv3 Redistributor Registers and Bit Definitions
  ******************************************************************************/
 
+/**
+ * GICD_IROUTER, Interrupt Routing Register Bits. The affinity fields are in the
+ * same positions as MPIDR_EL1, so the register value can be taken from there.
+*/
+#define GICD_IROUTER_IRM_BIT		BIT_64(31)
+#define GICD_IROUTER_AFF_MASK		(0xff00ffffffULL)
+
 /**
  * GICR_CTLR, Redistributor Control Register Bits
 */
@@ -21,30 +21,221 @@
 //===----------------------------------------------------------------------===//
 
 /**
- * 	Name:	pl011.h
- * 	Desc:	Arm PL011 Serial driver.
+ * 	Name:	pl011.c
+ * 	Desc:	Arm PL011 Serial driver. Polled during early boot, and then
+ * 			interrupt driven, with software buffers behind the hardware fifos.
  */
 
 #include <drivers/pl011/pl011.h>
+#include <kern/machine/machine-irq.h>
 
 static uint64_t pl011_base;
 static uint64_t pl011_baud;
 static uint64_t pl011_clock;
 
+/**
+ * Software buffers. The indices only ever increase and are masked on access,
+ * so `head - tail` is the amount of data buffered. Both are only touched with
+ * interrupts disabled, or from the interrupt handler.
+ */
+static char pl011_tx_buf[PL011_TX_BUF_SIZE];
+static uint64_t pl011_tx_head, pl011_tx_tail;
+static char pl011_rx_buf[PL011_RX_BUF_SIZE];
+static uint64_t pl011_rx_head, pl011_rx_tail;
+static uint64_t pl011_rx_overruns;
+
+/* whether the interrupt is registered, and the driver isn't forced to poll */
+static int pl011_irq_enabled = 0;
+
+/* called from the interrupt handler once a full writer can continue */
+static void (*pl011_tx_callback) (void *) = NULL;
+static void *pl011_tx_callback_arg;
+static int pl011_tx_waiting = 0;
+
+static inline struct pl011_regs *pl011_regs(void)
+{
+	return (struct pl011_regs *) ((uintptr_t) pl011_base);
+}
+
+/**
+ * Move as much of the transmit buffer into the hardware fifo as it will take.
+ * Returns non-zero if there is data left over.
+ */
+static int __pl011_tx_fill(struct pl011_regs *regs)
+{
+	while (pl011_tx_tail != pl011_tx_head) {
+		if (mmio_read(&regs->fr) & SERIAL_PL011_FR_TXFF)
+			return 1;
+		mmio_write(&regs->dr, pl011_tx_buf[pl011_tx_tail++ & (PL011_TX_BUF_SIZE - 1)]);
+	}
+	return 0;
+}
+
+/**
+ * Empty the receive fifo into the receive buffer. If the buffer is full the
+ * character is dropped, as the fifo would overflow anyway.
+ */
+static void __pl011_rx_drain(struct pl011_regs *regs)
+{
+	char c;
+
+	while (!(mmio_read(&regs->fr) & SERIAL_PL011_FR_RXFE)) {
+		c = mmio_read(&regs->dr);
+		if (pl011_rx_head - pl011_rx_tail == PL011_RX_BUF_SIZE) {
+			pl011_rx_overruns++;
+			continue;
+		}
+		pl011_rx_buf[pl011_rx_head++ & (PL011_RX_BUF_SIZE - 1)] = c;
+	}
+}
+
+/**
+ * pl011_irq_handler
+ *
+ * Service the uart. The transmit interrupt fires once the fifo drains to the
+ * programmed level, so each interrupt refills it in a single burst rather than
+ * a byte at a time. It's masked again once there's nothing left to send.
+ */
+static irq_return_t pl011_irq_handler(intid_t irq, void *data)
+{
+	struct pl011_regs *regs = pl011_regs();
+	void (*callback) (void *) = NULL;
+	uint32_t status;
+
+	status = mmio_read(&regs->mis);
+	if (status == 0)
+		return IRQ_NONE;
+
+	mmio_write(&regs->icr, status);
+
+	if (status & (SERIAL_PL011_IMSC_RXIM | SERIAL_PL011_IMSC_RTIM))
+		__pl011_rx_drain(regs);
+
+	if (status & SERIAL_PL011_IMSC_TXIM) {
+		if (!__pl011_tx_fill(regs))
+			mmio_write(&regs->imsc, mmio_read(&regs->imsc) & ~SERIAL_PL011_IMSC_TXIM);
+
+		/* let a writer that ran out of room continue once half is free */
+		if (pl011_tx_waiting &&
+				pl011_tx_head - pl011_tx_tail <= PL011_TX_BUF_SIZE / 2) {
+			pl011_tx_waiting = 0;
+			callback = pl011_tx_callback;
+		}
+	}
+
+	if (callback != NULL)
+		callback(pl011_tx_callback_arg);
+
+	return IRQ_HANDLED;
+}
+
+/**
+ * pl011_write
+ *
+ * Queue up to `len` bytes for transmission without waiting. Returns the number
+ * of bytes accepted, which is less than `len` if the transmit buffer is full.
+ * Until the interrupt is available this falls back to writing synchronously.
+ */
+int pl011_write(const char *buf, size_t len)
+{
+	struct pl011_regs *regs = pl011_regs();
+	uint64_t flags;
+	size_t n;
+
+	if (!pl011_irq_enabled) {
+		for (n = 0; n < len; n++)
+			pl011_putc(buf[n]);
+		return len;
+	}
+
+	flags = machine_irq_save();
+
+	for (n = 0; n < len; n++) {
+		if (pl011_tx_head - pl011_tx_tail == PL011_TX_BUF_SIZE)
+			break;
+		pl011_tx_buf[pl011_tx_head++ & (PL011_TX_BUF_SIZE - 1)] = buf[n];
+	}
+	if (n < len)
+		pl011_tx_waiting = 1;
+
+	/* start the transfer, the interrupt takes over if it doesn't all fit */
+	if (__pl011_tx_fill(regs))
+		mmio_write(&regs->imsc, mmio_read(&regs->imsc) | SERIAL_PL011_IMSC_TXIM);
+
+	machine_irq_restore(flags);
+	return n;
+}
+
+/**
+ * pl011_read
+ *
+ * Return up to `len` bytes of received data without waiting.
+ */
+int pl011_read(char *buf, size_t len)
+{
+	struct pl011_regs *regs = pl011_regs();
+	uint64_t flags;
+	size_t n;
+
+	if (!pl011_irq_enabled) {
+		for (n = 0; n < len; n++) {
+			if (mmio_read(&regs->fr) & SERIAL_PL011_FR_RXFE)
+				break;
+			buf[n] = mmio_read(&regs->dr);
+		}
+		return n;
+	}
+
+	flags = machine_irq_save();
+	for (n = 0; n < len && pl011_rx_tail != pl011_rx_head; n++)
+		buf[n] = pl011_rx_buf[pl011_rx_tail++ & (PL011_RX_BUF_SIZE - 1)];
+	machine_irq_restore(flags);
+
+	return n;
+}
+
+/**
+ * pl011_flush
+ *
+ * Synchronously write out everything in the transmit buffer, and wait for the
+ * fifo to drain.
+ */
+void pl011_flush(void)
+{
+	struct pl011_regs *regs = pl011_regs();
+	uint64_t flags = 0;
+
+	if (pl011_irq_enabled)
+		flags = machine_irq_save();
+
+	while (__pl011_tx_fill(regs))
+		;
+	while (mmio_read(&regs->fr) & SERIAL_PL011_FR_BUSY)
+		;
+
+	if (pl011_irq_enabled)
+		machine_irq_restore(flags);
+}
+
+/**
+ * Write a single character, waiting for room in the fifo. Anything still in
+ * the transmit buffer is sent first, so output stays in order.
+ */
 int pl011_putc(const char c)
 {
-	struct pl011_regs *regs = (struct pl011_regs *) ((uintptr_t) pl011_base);
+	struct pl011_regs *regs = pl011_regs();
+
+	if (pl011_tx_tail != pl011_tx_head)
+		pl011_flush();
 
-	/* wait for the data buffer to be full */
-	while (mmio_read(&regs->fr) & 0x20) {}
+	/* wait for room in the fifo */
+	while (mmio_read(&regs->fr) & SERIAL_PL011_FR_TXFF) {}
 	mmio_write(&regs->dr, c);
 	return 0;
 }
 
 int pl011_puts(const char *s)
 {
-	struct pl011_regs *regs = (struct pl011_regs *) ((uintptr_t) pl011_base);
-
 	while (*s) {
 		pl011_putc(*s);
 		s++;
@@ -54,12 +245,69 @@ int pl011_puts(const char *s)
 
 int pl011_getc()
 {
-	struct pl011_regs *regs = (struct pl011_regs *) ((uintptr_t) pl011_base);
+	struct pl011_regs *regs = pl011_regs();
+	char c;
 
-	while (mmio_read(&regs->fr) & 0x10) {}
+	if (pl011_irq_enabled) {
+		while (pl011_read(&c, 1) == 0)
+			__asm__ volatile ("wfi");
+		return c;
+	}
+
+	while (mmio_read(&regs->fr) & SERIAL_PL011_FR_RXFE) {}
 	return mmio_read(&regs->dr);
 }
 
+/**
+ * pl011_set_tx_callback
+ *
+ * Register a function for the interrupt handler to call when pl011_write() has
+ * previously run out of room, and there is now space again.
+ */
+void pl011_set_tx_callback(void (*fn) (void *), void *arg)
+{
+	pl011_tx_callback_arg = arg;
+	pl011_tx_callback = fn;
+}
+
+/**
+ * pl011_set_polled
+ *
+ * Go back to polling, for the panic handler. The uart interrupt is masked, and
+ * pl011_putc() drains whatever was queued without disabling interrupts again.
+ */
+void pl011_set_polled(void)
+{
+	struct pl011_regs *regs = pl011_regs();
+
+	pl011_irq_enabled = 0;
+	mmio_write(&regs->imsc, 0);
+}
+
+/**
+ * pl011_irq_init
+ *
+ * Register the uart interrupt and switch the driver from polling to buffered
+ * transmit and receive. Must be called once the interrupt controller is up.
+ */
+int pl011_irq_init(uint32_t intid)
+{
+	struct pl011_regs *regs = pl011_regs();
+
+	if (machine_register_interrupt(intid, IRQ_PRIORITY_LOW, pl011_irq_handler,
+			NULL) != KERN_RETURN_SUCCESS)
+		return -1;
+
+	/* pick up anything that arrived while polling */
+	__pl011_rx_drain(regs);
+
+	pl011_irq_enabled = 1;
+	mmio_write(&regs->icr, SERIAL_PL011_IMSC_ALL);
+	mmio_write(&regs->imsc, (SERIAL_PL011_IMSC_RXIM | SERIAL_PL011_IMSC_RTIM));
+
+	return 0;
+}
+
 int pl011_init(uint64_t base, uint64_t baud, uint64_t clock)
 {
 	struct pl011_regs *regs;
@@ -77,8 +325,19 @@ int pl011_init(uint64_t base, uint64_t baud, uint64_t clock)
 	mmio_write(&regs->ibrd, divider >> 6);
 	mmio_write(&regs->fbrd, divider & 0x3f);
 
-	mmio_write(&regs->lcr_h, SERIAL_PL011_LCRH_WLEN_8);
-	mmio_write(&regs->imsc, (SERIAL_PL011_IMSC_RXIM | SERIAL_PL011_IMSC_RTIM));
+	/**
+	 * Enable the fifos. Transmit interrupts are raised once the fifo is down to
+	 * 1/8 full, so each refill is a burst of most of the fifo, and receive
+	 * interrupts at 1/2 full, with the timeout interrupt picking up the rest.
+	 */
+	mmio_write(&regs->lcr_h, (SERIAL_PL011_LCRH_WLEN_8 | SERIAL_PL011_LCRH_FEN));
+	mmio_write(&regs->ifls,
+		(SERIAL_PL011_IFLS_1_8 << SERIAL_PL011_IFLS_TX_SHIFT) |
+		(SERIAL_PL011_IFLS_1_2 << SERIAL_PL011_IFLS_RX_SHIFT));
+
+	/* polled until pl011_irq_init() */
+	mmio_write(&regs->imsc, 0);
+	mmio_write(&regs->icr, SERIAL_PL011_IMSC_ALL);
 	mmio_write(&regs->cr, (SERIAL_PL011_CR_UARTEN | SERIAL_PL011_CR_TXE | 
 						    SERIAL_PL011_CR_RXE));
 
@@ -29,6 +29,8 @@
 #define __DRIVER_PL011_H__
 
 #include <tinylibc/stdint.h>
+#include <tinylibc/stddef.h>
+#include <kern/defaults.h>
 
 /* memory-mapped io read/write */
 #define mmio_write(register, val)		*(volatile uint32_t *) register = val
@@ -53,13 +55,46 @@ struct pl011_regs
 	uint32_t	cr;			/* Control Register (UARTCR) */
 	uint32_t	ifls;		/* Interrupt FIFO Level Select (UARTIFLS) */
 	uint32_t	imsc;		/* Interrupt Mask Set/Clear (UARTIMSC) */
+	uint32_t	ris;		/* Raw Interrupt Status (UARTRIS) */
+	uint32_t	mis;		/* Masked Interrupt Status (UARTMIS) */
+	uint32_t	icr;		/* Interrupt Clear Register (UARTICR) */
+	uint32_t	dmacr;		/* DMA Control Register (UARTDMACR) */
 };
 
-/* APIs */
+/* software buffers, must be powers of two */
+#define PL011_TX_BUF_SIZE				DEFAULTS_KERNEL_DEBUG_UART_TXBUF
+#define PL011_RX_BUF_SIZE				UL(256)
+
+/* depth of the hardware fifos */
+#define PL011_FIFO_SIZE					32
+
+/**
+ * The driver starts out polled. Once pl011_irq_init() has registered the
+ * interrupt, pl011_write() queues data in the transmit buffer and returns
+ * straight away, and the interrupt handler keeps the fifo topped up. Received
+ * data is buffered by the handler and returned by pl011_read().
+ */
 int pl011_init(uint64_t base, uint64_t baud, uint64_t clock);
+int pl011_irq_init(uint32_t intid);
+void pl011_set_tx_callback(void (*fn) (void *), void *arg);
+void pl011_set_polled(void);
+
+/* non-blocking */
+int pl011_write(const char *buf, size_t len);
+int pl011_read(char *buf, size_t len);
+
+/* blocking */
 int pl011_putc(const char c);
 int pl011_puts(const char *s);
 int pl011_getc();
+void pl011_flush(void);
+
+/* Flag Register (UARTFR) bits */
+#define SERIAL_PL011_FR_TXFE			(1 << 7)
+#define SERIAL_PL011_FR_RXFF			(1 << 6)
+#define SERIAL_PL011_FR_TXFF			(1 << 5)
+#define SERIAL_PL011_FR_RXFE			(1 << 4)
+#define SERIAL_PL011_FR_BUSY			(1 << 3)
 
 /* Control Register (UARTCR) bits */
 #define SERIAL_PL011_CR_CTSEN			(1 << 15)
@@ -87,7 +122,19 @@ int pl011_getc();
 #define SERIAL_PL011_LCRH_PEN			(1 << 1)
 #define SERIAL_PL011_LCRH_BRK			(1 << 0)
 
-/* Interrupt Mask Set/Clear Register (UARTIMSC) */
+/* Interrupt FIFO Level Select Register (UARTIFLS) */
+#define SERIAL_PL011_IFLS_RX_SHIFT		3
+#define SERIAL_PL011_IFLS_TX_SHIFT		0
+#define SERIAL_PL011_IFLS_1_8			0
+#define SERIAL_PL011_IFLS_1_4			1
+#define SERIAL_PL011_IFLS_1_2			2
+#define SERIAL_PL011_IFLS_3_4			3
+#define SERIAL_PL011_IFLS_7_8			4
+
+/**
+ * Interrupt Mask Set/Clear Register (UARTIMSC). The same bits are used by the
+ * RIS, MIS and ICR registers.
+ */
 #define SERIAL_PL011_IMSC_OEIM			(1 << 10)
 #define SERIAL_PL011_IMSC_BEIM			(1 << 9)
 #define SERIAL_PL011_IMSC_PEIM			(1 << 8)
@@ -100,4 +147,10 @@ int pl011_getc();
 #define SERIAL_PL011_IMSC_CTSMIM		(1 << 1)
 #define SERIAL_PL011_IMSC_RIMIM			(1 << 0)
 
+#define SERIAL_PL011_IMSC_ERRORS		(SERIAL_PL011_IMSC_OEIM | \
+										 SERIAL_PL011_IMSC_BEIM | \
+										 SERIAL_PL011_IMSC_PEIM | \
+										 SERIAL_PL011_IMSC_FEIM)
+#define SERIAL_PL011_IMSC_ALL			(0x7ff)
+
 #endif /* __driver_pl011_h__ */
\ No newline at end of file
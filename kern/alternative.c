@@ -0,0 +1,79 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	alternative.c
+ * Desc:	Alternative instruction patching. See alternative.h.
+*/
+
+#define pr_fmt(fmt)	"alternative: " fmt
+
+#include <kern/alternative.h>
+#include <kern/machine/machine_patch.h>
+#include <kern/machine/machine-irq.h>
+#include <kern/trace/printk.h>
+#include <kern/defaults.h>
+#include <libkern/panic.h>
+
+/* alternative sites, from the linker script */
+extern struct alt_instr __alt_instructions_start[];
+extern struct alt_instr __alt_instructions_end[];
+
+/**
+ * alternative_init
+ *
+ * Copy in the replacement of every site whose feature the boot CPU has. This
+ * runs once, after cpu_feature_init() and before interrupts or other CPUs can
+ * run the sites, since a sequence is patched an instruction at a time.
+ */
+void alternative_init(void)
+{
+	struct alt_instr *alt;
+	uint32_t *orig, *repl;
+	unsigned int i, patched = 0, total = 0;
+	uint64_t flags;
+
+#if !DEFAULTS_SET(DEFAULTS_KERNEL_ALTERNATIVES)
+	pr_info("disabled\n");
+	return;
+#endif
+
+	flags = machine_irq_save();
+
+	for (alt = __alt_instructions_start; alt < __alt_instructions_end; alt++) {
+		total++;
+		if (!cpu_has_feature(alt->feature))
+			continue;
+
+		if (alt->orig_len != alt->repl_len || (alt->orig_len & 3))
+			panic("alternative_init: bad site at 0x%llx\n", alt->orig);
+
+		orig = (uint32_t *) alt->orig;
+		repl = (uint32_t *) alt->repl;
+		for (i = 0; i < alt->orig_len / sizeof (uint32_t); i++)
+			machine_patch_text(&orig[i], repl[i]);
+		patched++;
+	}
+
+	machine_irq_restore(flags);
+	pr_info("patched %d of %d sites\n", patched, total);
+}
@@ -0,0 +1,107 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	alternative.h
+ * Desc:	Alternative instruction sequences. A site is assembled with code
+ * 			that runs on any ARMv8.0 CPU, and a replacement of the same length
+ * 			that needs a CPU feature. If the boot CPU has the feature, the
+ * 			replacement is copied over the original by alternative_init(), so
+ * 			one kernel image uses the fastest sequence the CPU supports.
+ *
+ * 			__asm__ volatile(ALTERNATIVE("ldaxr ...", "ldaddal ...",
+ * 				CPU_FEATURE_LSE) : ...);
+ *
+ * 			Replacements are copied verbatim, so they can't contain branches
+ * 			or anything else PC-relative. Pad the shorter sequence with NOPs,
+ * 			a length mismatch is an assembler error.
+*/
+
+#ifndef __KERN_ALTERNATIVE_H__
+#define __KERN_ALTERNATIVE_H__
+
+#include <tinylibc/stdint.h>
+
+#include <libkern/types.h>
+#include <kern/cpufeature.h>
+#include <kern/vm/vm_types.h>
+
+/**
+ * Alternative site, one per use of ALTERNATIVE, placed in .altinstructions.
+ * `orig` is the sequence in the kernel text, and `repl` the replacement in
+ * .altinstr_replacement.
+ */
+struct alt_instr {
+	vm_address_t		orig;
+	vm_address_t		repl;
+	uint16_t			feature;
+	uint8_t				orig_len;
+	uint8_t				repl_len;
+	uint32_t			reserved;
+};
+
+#define __ALT_STRING(__x)	__STRING(__x)
+
+/**
+ * ALTERNATIVE(orig, repl, feature)
+ *
+ * The site, as a string for inline assembly. The .org directives fail to
+ * assemble if either sequence is longer than the other.
+ */
+#define ALTERNATIVE(__orig, __repl, __feature)								\
+	"661:\n"																\
+	__orig "\n"																\
+	"662:\n"																\
+	"	.pushsection .altinstructions, \"a\"\n"							\
+	"	.balign 8\n"														\
+	"	.quad 661b, 663f\n"													\
+	"	.hword " __ALT_STRING(__feature) "\n"								\
+	"	.byte 662b - 661b, 664f - 663f\n"									\
+	"	.word 0\n"															\
+	"	.popsection\n"														\
+	"	.pushsection .altinstr_replacement, \"ax\"\n"						\
+	"663:\n"																\
+	__repl "\n"																\
+	"664:\n"																\
+	"	.org . - (664b - 663b) + (662b - 661b)\n"							\
+	"	.popsection\n"														\
+	"	.org . - (662b - 661b) + (664b - 663b)\n"
+
+/**
+ * alternative_has_feature(feature)
+ *
+ * cpu_has_feature() for hot paths, a single MOV patched to match the boot
+ * CPU. It reads false until alternative_init() has run.
+ */
+#define alternative_has_feature(__feature)									\
+	({																		\
+		uint32_t __alt_ret;													\
+																			\
+		__asm__ __volatile__(ALTERNATIVE("mov %w0, #0", "mov %w0, #1",		\
+			__feature) : "=r" (__alt_ret));									\
+		__alt_ret;															\
+	})
+
+/* Alternatives API */
+extern void alternative_init(void);
+
+#endif /* __kern_alternative_h__ */
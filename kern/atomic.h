@@ -0,0 +1,200 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	atomic.h
+ * Desc:	Atomic read-modify-write operations with acquire and release
+ * 			ordering. Each is an LDAXR/STLXR loop that any ARMv8.0 CPU can
+ * 			run, patched at boot to the single LSE instruction where the CPU
+ * 			has them, which doesn't retry under contention. See alternative.h.
+ *
+ * 			Also the WFE based waits the locks in spinlock.h spin with.
+*/
+
+#ifndef __KERN_ATOMIC_H__
+#define __KERN_ATOMIC_H__
+
+#include <tinylibc/stdint.h>
+
+#include <kern/alternative.h>
+
+/* the LSE replacements need the assembler to accept them on ARMv8.0 */
+#define __LSE_PREAMBLE		"	.arch_extension lse\n"
+
+/**
+ * atomic_fetch_add_{32,64}(ptr, val)
+ *
+ * Add `val` to *ptr, returning the previous value.
+ */
+#define __ATOMIC_FETCH_ADD(__name, __type, __w)								\
+static inline __type __name(volatile __type *ptr, __type val)				\
+{																			\
+	__type old, tmp;														\
+	uint32_t fail;															\
+																			\
+	__asm__ __volatile__(ALTERNATIVE(										\
+		"1:	ldaxr	%" __w "[old], %[v]\n"									\
+		"	add		%" __w "[tmp], %" __w "[old], %" __w "[val]\n"			\
+		"	stlxr	%w[fail], %" __w "[tmp], %[v]\n"						\
+		"	cbnz	%w[fail], 1b",											\
+		__LSE_PREAMBLE														\
+		"	ldaddal	%" __w "[val], %" __w "[old], %[v]\n"					\
+		"	nop\n"															\
+		"	nop\n"															\
+		"	nop",															\
+		CPU_FEATURE_LSE)													\
+		: [old] "=&r" (old), [tmp] "=&r" (tmp), [fail] "=&r" (fail),		\
+		  [v] "+Q" (*ptr)													\
+		: [val] "r" (val)													\
+		: "memory");														\
+	return old;																\
+}
+
+/**
+ * atomic_fetch_or_{32,64}(ptr, val)
+ *
+ * Set the bits of `val` in *ptr, returning the previous value.
+ */
+#define __ATOMIC_FETCH_OR(__name, __type, __w)								\
+static inline __type __name(volatile __type *ptr, __type val)				\
+{																			\
+	__type old, tmp;														\
+	uint32_t fail;															\
+																			\
+	__asm__ __volatile__(ALTERNATIVE(										\
+		"1:	ldaxr	%" __w "[old], %[v]\n"									\
+		"	orr		%" __w "[tmp], %" __w "[old], %" __w "[val]\n"			\
+		"	stlxr	%w[fail], %" __w "[tmp], %[v]\n"						\
+		"	cbnz	%w[fail], 1b",											\
+		__LSE_PREAMBLE														\
+		"	ldsetal	%" __w "[val], %" __w "[old], %[v]\n"					\
+		"	nop\n"															\
+		"	nop\n"															\
+		"	nop",															\
+		CPU_FEATURE_LSE)													\
+		: [old] "=&r" (old), [tmp] "=&r" (tmp), [fail] "=&r" (fail),		\
+		  [v] "+Q" (*ptr)													\
+		: [val] "r" (val)													\
+		: "memory");														\
+	return old;																\
+}
+
+/**
+ * atomic_cmpxchg_{32,64}(ptr, expected, new)
+ *
+ * Store `new` to *ptr if it holds `expected`. Returns the value *ptr held,
+ * which is `expected` if the store happened.
+ */
+#define __ATOMIC_CMPXCHG(__name, __type, __w)								\
+static inline __type __name(volatile __type *ptr, __type expected,			\
+		__type new)															\
+{																			\
+	__type old;																\
+	uint32_t fail;															\
+																			\
+	__asm__ __volatile__(ALTERNATIVE(										\
+		"1:	ldaxr	%" __w "[old], %[v]\n"									\
+		"	cmp		%" __w "[old], %" __w "[exp]\n"							\
+		"	b.ne	2f\n"													\
+		"	stlxr	%w[fail], %" __w "[new], %[v]\n"						\
+		"	cbnz	%w[fail], 1b\n"											\
+		"2:",																\
+		__LSE_PREAMBLE														\
+		"	mov		%" __w "[old], %" __w "[exp]\n"							\
+		"	casal	%" __w "[old], %" __w "[new], %[v]\n"					\
+		"	nop\n"															\
+		"	nop\n"															\
+		"	nop",															\
+		CPU_FEATURE_LSE)													\
+		: [old] "=&r" (old), [fail] "=&r" (fail), [v] "+Q" (*ptr)			\
+		: [exp] "r" (expected), [new] "r" (new)								\
+		: "cc", "memory");													\
+	return old;																\
+}
+
+/**
+ * atomic_xchg_{32,64}(ptr, new)
+ *
+ * Store `new` to *ptr, returning the previous value.
+ */
+#define __ATOMIC_XCHG(__name, __type, __w)									\
+static inline __type __name(volatile __type *ptr, __type new)				\
+{																			\
+	__type old;																\
+	uint32_t fail;															\
+																			\
+	__asm__ __volatile__(ALTERNATIVE(										\
+		"1:	ldaxr	%" __w "[old], %[v]\n"									\
+		"	stlxr	%w[fail], %" __w "[new], %[v]\n"						\
+		"	cbnz	%w[fail], 1b",											\
+		__LSE_PREAMBLE														\
+		"	swpal	%" __w "[new], %" __w "[old], %[v]\n"					\
+		"	nop\n"															\
+		"	nop",															\
+		CPU_FEATURE_LSE)													\
+		: [old] "=&r" (old), [fail] "=&r" (fail), [v] "+Q" (*ptr)			\
+		: [new] "r" (new)													\
+		: "memory");														\
+	return old;																\
+}
+
+/**
+ * __cmpwait_{16,32,64}(ptr, val)
+ *
+ * Wait for *ptr to stop holding `val`, in a low-power state rather than by
+ * spinning on it. Loading the location with LDXR arms the exclusive monitor,
+ * and the write that clears it generates the event that wakes WFE. SEVL and
+ * the first WFE consume any event left over from earlier, so the second only
+ * wakes for something after the load. WFE can also wake spuriously, so callers
+ * reload the value and wait again if it's still not what they want.
+ */
+#define __CMPWAIT(__name, __type, __w, __sfx)								\
+static inline void __name(volatile __type *ptr, uint64_t val)				\
+{																			\
+	uint64_t tmp;															\
+																			\
+	__asm__ __volatile__(													\
+		"	sevl\n"															\
+		"	wfe\n"															\
+		"	ldxr" __sfx "	%" __w "[tmp], %[v]\n"							\
+		"	eor		%" __w "[tmp], %" __w "[tmp], %" __w "[val]\n"			\
+		"	cbnz	%" __w "[tmp], 1f\n"										\
+		"	wfe\n"															\
+		"1:"																\
+		: [tmp] "=&r" (tmp), [v] "+Q" (*ptr)								\
+		: [val] "r" (val)													\
+		: "memory");														\
+}
+
+__ATOMIC_FETCH_ADD(atomic_fetch_add_32, uint32_t, "w")
+__ATOMIC_FETCH_ADD(atomic_fetch_add_64, uint64_t, "x")
+__ATOMIC_FETCH_OR(atomic_fetch_or_32, uint32_t, "w")
+__ATOMIC_FETCH_OR(atomic_fetch_or_64, uint64_t, "x")
+__ATOMIC_CMPXCHG(atomic_cmpxchg_32, uint32_t, "w")
+__ATOMIC_CMPXCHG(atomic_cmpxchg_64, uint64_t, "x")
+__ATOMIC_XCHG(atomic_xchg_32, uint32_t, "w")
+__ATOMIC_XCHG(atomic_xchg_64, uint64_t, "x")
+__CMPWAIT(__cmpwait_16, uint16_t, "w", "h")
+__CMPWAIT(__cmpwait_32, uint32_t, "w", "")
+__CMPWAIT(__cmpwait_64, uint64_t, "x", "")
+
+#endif /* __kern_atomic_h__ */
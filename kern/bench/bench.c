@@ -0,0 +1,190 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	bench.c
+ * Desc:	In-kernel micro-benchmark framework. Timing uses the PMU cycle
+ * 			counter where one is implemented, otherwise the kernel clock, and
+ * 			instructions and L1D refills are counted alongside it if they can
+ * 			be.
+*/
+
+#define pr_fmt(fmt)	"bench: " fmt
+
+#include <kern/bench/bench.h>
+#include <kern/machine/machine_pmu.h>
+#include <kern/trace/printk.h>
+#include <kern/defaults.h>
+#include <kern/clock.h>
+
+#include <arch/arch.h>
+
+static const uint16_t bench_events[BENCH_EVENTS] = {
+	[BENCH_CYCLES]			= PMU_EVENT_CPU_CYCLES,
+	[BENCH_INSTRUCTIONS]	= PMU_EVENT_INST_RETIRED,
+	[BENCH_L1D_REFILLS]		= PMU_EVENT_L1D_CACHE_REFILL,
+};
+
+/* system-wide counters, a counter that couldn't be started is left unused */
+static pmu_counter_t bench_counters[BENCH_EVENTS];
+
+/* set if the cycle counter is being used, rather than the kernel clock */
+static int bench_use_pmu = 0;
+
+static inline int __bench_counting(int event)
+{
+	return bench_counters[event].idx >= 0;
+}
+
+/**
+ * bench_init
+ *
+ * Start a counter for each event the PMU implements, on this CPU, so the
+ * benchmarks must stay on it.
+*/
+void bench_init(void)
+{
+	for (int i = 0; i < BENCH_EVENTS; i++) {
+		bench_counters[i].idx = -1;
+		if (pmu_counter_init(&bench_counters[i], bench_events[i],
+				PMU_COUNTER_SYSTEM) == KERN_RETURN_SUCCESS)
+			pmu_counter_start(&bench_counters[i]);
+	}
+
+	bench_use_pmu = __bench_counting(BENCH_CYCLES);
+	if (!bench_use_pmu)
+		pr_info("no PMU, timing with the kernel clock\n");
+}
+
+static uint64_t __bench_read(int event)
+{
+	/* don't let the read be speculated ahead of the code being measured */
+	isb();
+
+	if (__bench_counting(event))
+		return pmu_counter_read(&bench_counters[event]);
+	if (event == BENCH_CYCLES)
+		return ktime_get_ns();
+	return 0;
+}
+
+uint64_t bench_cycles(void)
+{
+	return __bench_read(BENCH_CYCLES);
+}
+
+int bench_using_pmu(void)
+{
+	return bench_use_pmu;
+}
+
+void bench_result_init(bench_result_t *result, const char *name)
+{
+	result->name = name;
+	result->iterations = 0;
+	result->total = 0;
+	result->min = UINT64_MAX;
+	result->max = 0;
+	result->instructions = 0;
+	result->refills = 0;
+}
+
+void bench_result_add(bench_result_t *result, uint64_t cycles)
+{
+	result->iterations += 1;
+	result->total += cycles;
+
+	if (cycles < result->min)
+		result->min = cycles;
+	if (cycles > result->max)
+		result->max = cycles;
+}
+
+/**
+ * bench_begin
+ *
+ * Start an iteration, ended by bench_end(). The cycle counter is read last
+ * here and first there, so it covers as little of the other reads as it can.
+*/
+void bench_begin(bench_result_t *result)
+{
+	result->begin[BENCH_INSTRUCTIONS] = __bench_read(BENCH_INSTRUCTIONS);
+	result->begin[BENCH_L1D_REFILLS] = __bench_read(BENCH_L1D_REFILLS);
+	result->begin[BENCH_CYCLES] = __bench_read(BENCH_CYCLES);
+}
+
+void bench_end(bench_result_t *result)
+{
+	uint64_t cycles;
+
+	cycles = __bench_read(BENCH_CYCLES) - result->begin[BENCH_CYCLES];
+	result->instructions += __bench_read(BENCH_INSTRUCTIONS) -
+		result->begin[BENCH_INSTRUCTIONS];
+	result->refills += __bench_read(BENCH_L1D_REFILLS) -
+		result->begin[BENCH_L1D_REFILLS];
+
+	bench_result_add(result, cycles);
+}
+
+void bench_report(bench_result_t *result)
+{
+	uint64_t ipc;
+
+	if (result->iterations == 0) {
+		pr_info("%s: no iterations\n", result->name);
+		return;
+	}
+
+	pr_info("%s: %lld iterations, min: %lld avg: %lld max: %lld %s\n",
+		result->name, result->iterations, result->min,
+		result->total / result->iterations, result->max,
+		bench_use_pmu ? "cycles" : "ns");
+
+	/* no floating point in the kernel, so IPC is shown to two places */
+	if (bench_use_pmu && __bench_counting(BENCH_INSTRUCTIONS) && result->total) {
+		ipc = (result->instructions * 100) / result->total;
+		pr_info("%s: %lld instructions, ipc: %lld.%02lld\n", result->name,
+			result->instructions / result->iterations, ipc / 100, ipc % 100);
+	}
+
+	if (__bench_counting(BENCH_L1D_REFILLS))
+		pr_info("%s: %lld L1D refills\n", result->name,
+			result->refills / result->iterations);
+}
+
+/**
+ * bench_run
+ *
+ * Run each of the kernel's benchmarks. This must be called from a thread, with
+ * interrupts enabled.
+*/
+void bench_run(void)
+{
+	bench_init();
+
+	bench_irq_entry();
+	bench_mem();
+
+	for (int i = 0; i < BENCH_EVENTS; i++)
+		if (__bench_counting(i))
+			pmu_counter_stop(&bench_counters[i]);
+}
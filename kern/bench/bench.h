@@ -0,0 +1,70 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	bench.h
+ * Desc:	In-kernel micro-benchmarks. These are run once at boot when
+ * 			DEFAULTS_KERNEL_BENCH is enabled, and print their results.
+*/
+
+#ifndef __KERN_BENCH_H__
+#define __KERN_BENCH_H__
+
+#include <tinylibc/stdint.h>
+#include <libkern/types.h>
+
+/* Events counted by each benchmark, where the PMU implements them */
+#define BENCH_CYCLES			0	/* or nanoseconds without a PMU */
+#define BENCH_INSTRUCTIONS		1
+#define BENCH_L1D_REFILLS		2
+#define BENCH_EVENTS			3
+
+/* Result of a single benchmark, in cycles (or nanoseconds without a PMU) */
+typedef struct bench_result {
+	const char		*name;
+	uint64_t		iterations;
+	uint64_t		total;
+	uint64_t		min;
+	uint64_t		max;
+
+	/* other events over every iteration, and their values at bench_begin() */
+	uint64_t		instructions;
+	uint64_t		refills;
+	uint64_t		begin[BENCH_EVENTS];
+} bench_result_t;
+
+/* Benchmark framework */
+extern void bench_init(void);
+extern uint64_t bench_cycles(void);
+extern int bench_using_pmu(void);
+extern void bench_result_init(bench_result_t *result, const char *name);
+extern void bench_result_add(bench_result_t *result, uint64_t cycles);
+extern void bench_begin(bench_result_t *result);
+extern void bench_end(bench_result_t *result);
+extern void bench_report(bench_result_t *result);
+extern void bench_run(void);
+
+/* Benchmarks */
+extern kern_return_t bench_irq_entry(void);
+extern kern_return_t bench_mem(void);
+
+#endif /* __kern_bench_h__ */
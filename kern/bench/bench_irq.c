@@ -0,0 +1,93 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	bench_irq.c
+ * Desc:	Interrupt entry and exit benchmark. An SGI is sent to the current
+ * 			CPU and the time taken until its handler has run and returned is
+ * 			measured, first on the fast path that only saves the caller-saved
+ * 			registers, and again with the handler forcing the full exception
+ * 			frame, which is what every interrupt used to pay for.
+*/
+
+#define pr_fmt(fmt)	"bench: " fmt
+
+#include <kern/bench/bench.h>
+#include <kern/machine.h>
+#include <kern/defaults.h>
+#include <kern/cpu.h>
+
+#include <arch/arch.h>
+
+/* SGI used by the benchmark */
+#define BENCH_IRQ_SGI		1
+
+static volatile uint64_t bench_irq_count;
+static int bench_irq_full_frame;
+
+static irq_return_t bench_irq_handler(intid_t intid, void *data)
+{
+	if (bench_irq_full_frame)
+		cpu_set_flag(machine_get_cpu_num(), CPU_FLAG_IRQ_FULL_FRAME);
+
+	bench_irq_count += 1;
+	return IRQ_HANDLED;
+}
+
+static void __bench_irq_entry(const char *name, int full_frame)
+{
+	bench_result_t result;
+	uint64_t seen, target;
+	unsigned int i;
+
+	bench_result_init(&result, name);
+	bench_irq_full_frame = full_frame;
+
+	/* SGI target list for the current CPU */
+	target = 1 << MPIDR_AFFLVL0_VAL(sysreg_read(mpidr_el1));
+
+	for (i = 0; i < DEFAULTS_KERNEL_BENCH_ITERATIONS; i++) {
+		seen = bench_irq_count;
+
+		bench_begin(&result);
+		machine_send_interrupt(BENCH_IRQ_SGI, target);
+		while (bench_irq_count == seen)
+			;
+		bench_end(&result);
+	}
+
+	bench_report(&result);
+}
+
+kern_return_t bench_irq_entry(void)
+{
+	if (machine_register_interrupt(BENCH_IRQ_SGI, IRQ_PRIORITY_NORMAL,
+			bench_irq_handler, NULL) != KERN_RETURN_SUCCESS) {
+		pr_err("irq-entry: failed to register SGI %d\n", BENCH_IRQ_SGI);
+		return KERN_RETURN_FAIL;
+	}
+
+	__bench_irq_entry("irq-entry-fast", 0);
+	__bench_irq_entry("irq-entry-full", 1);
+
+	return KERN_RETURN_SUCCESS;
+}
@@ -0,0 +1,163 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	bench_mem.c
+ * Desc:	Memory routine benchmarks. memcpy, memmove, memset, memcmp, the
+ * 			scanning routines and checksums are timed at sizes from a byte up
+ * 			to DEFAULTS_KERNEL_BENCH_MEM_MAX, with aligned and misaligned
+ * 			buffers, and reported in bytes per cycle alongside the usual
+ * 			figures.
+*/
+
+#define pr_fmt(fmt)	"bench: " fmt
+
+#include <kern/bench/bench.h>
+#include <kern/trace/printk.h>
+#include <kern/defaults.h>
+
+#include <libkern/checksum.h>
+
+#include <tinylibc/string.h>
+#include <tinylibc/stdio.h>
+
+/* room either side of a buffer, for misaligned and overlapping runs */
+#define BENCH_MEM_SLACK		UL(64)
+#define BENCH_MEM_SIZE		(DEFAULTS_KERNEL_BENCH_MEM_MAX + BENCH_MEM_SLACK)
+
+enum {
+	BENCH_MEMCPY,
+	BENCH_MEMCPY_UNALIGNED,
+	BENCH_MEMMOVE,
+	BENCH_MEMSET,
+	BENCH_MEMSET_ZERO,
+	BENCH_MEMCMP,
+	BENCH_MEMCHR,
+	BENCH_STRLEN,
+	BENCH_CRC32,
+	BENCH_ADLER32,
+	BENCH_MEM_OPS,
+};
+
+static const char *bench_mem_names[BENCH_MEM_OPS] = {
+	[BENCH_MEMCPY]				= "memcpy",
+	[BENCH_MEMCPY_UNALIGNED]	= "memcpy-unaligned",
+	[BENCH_MEMMOVE]				= "memmove",
+	[BENCH_MEMSET]				= "memset",
+	[BENCH_MEMSET_ZERO]			= "memset-zero",
+	[BENCH_MEMCMP]				= "memcmp",
+	[BENCH_MEMCHR]				= "memchr",
+	[BENCH_STRLEN]				= "strlen",
+	[BENCH_CRC32]				= "crc32",
+	[BENCH_ADLER32]				= "adler32",
+};
+
+static uint8_t bench_mem_src[BENCH_MEM_SIZE] __attribute__((aligned(64)));
+static uint8_t bench_mem_dst[BENCH_MEM_SIZE] __attribute__((aligned(64)));
+
+/* keeps the results of the routines that only read live */
+static volatile uint64_t bench_mem_sink;
+
+static void __bench_mem_op(int op, size_t size)
+{
+	switch (op) {
+	case BENCH_MEMCPY:
+		memcpy(bench_mem_dst, bench_mem_src, size);
+		break;
+	case BENCH_MEMCPY_UNALIGNED:
+		memcpy(bench_mem_dst, bench_mem_src + 3, size);
+		break;
+	case BENCH_MEMMOVE:
+		/* overlapping, so it has to copy backwards */
+		memmove(bench_mem_dst + 8, bench_mem_dst, size);
+		break;
+	case BENCH_MEMSET:
+		memset(bench_mem_dst, 0x5a, size);
+		break;
+	case BENCH_MEMSET_ZERO:
+		memset(bench_mem_dst, 0, size);
+		break;
+	case BENCH_MEMCMP:
+		bench_mem_sink = memcmp(bench_mem_dst, bench_mem_src, size);
+		break;
+	case BENCH_MEMCHR:
+		bench_mem_sink = (uint64_t) memchr(bench_mem_src, 0, size);
+		break;
+	case BENCH_STRLEN:
+		bench_mem_sink = strlen((const char *) bench_mem_dst);
+		break;
+	case BENCH_CRC32:
+		bench_mem_sink = crc32(0, bench_mem_src, size);
+		break;
+	case BENCH_ADLER32:
+		bench_mem_sink = adler32(1, bench_mem_src, size);
+		break;
+	}
+}
+
+static void __bench_mem(int op, size_t size)
+{
+	bench_result_t result;
+	uint64_t bpc;
+	char name[32];
+
+	snprintf(name, sizeof(name), "%s-%lld", bench_mem_names[op], size);
+	bench_result_init(&result, name);
+
+	/* memcmp has to scan the whole buffer to be a fair measure */
+	if (op == BENCH_MEMCMP)
+		memcpy(bench_mem_dst, bench_mem_src, size);
+
+	/* and strlen finds the terminator in its last byte */
+	if (op == BENCH_STRLEN) {
+		memset(bench_mem_dst, 'a', size);
+		bench_mem_dst[size - 1] = '\0';
+	}
+
+	for (unsigned int i = 0; i < DEFAULTS_KERNEL_BENCH_ITERATIONS; i++) {
+		bench_begin(&result);
+		__bench_mem_op(op, size);
+		bench_end(&result);
+	}
+
+	bench_report(&result);
+
+	/* bytes per cycle, to two places */
+	if (result.total) {
+		bpc = (size * result.iterations * 100) / result.total;
+		pr_info("%s: %lld.%02lld bytes/%s\n", name, bpc / 100, bpc % 100,
+			bench_using_pmu() ? "cycle" : "ns");
+	}
+}
+
+kern_return_t bench_mem(void)
+{
+	size_t size;
+
+	memset(bench_mem_src, 0xa5, sizeof(bench_mem_src));
+
+	for (int op = 0; op < BENCH_MEM_OPS; op++)
+		for (size = 1; size <= DEFAULTS_KERNEL_BENCH_MEM_MAX; size *= 4)
+			__bench_mem(op, size);
+
+	return KERN_RETURN_SUCCESS;
+}
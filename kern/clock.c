@@ -0,0 +1,244 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	clock.c
+ * Desc:	Kernel clock.
+ *
+ * 			CNTFRQ_EL0 is read once at boot, and a mult/shift pair is worked out
+ * 			so that converting counter cycles to nanoseconds is a multiply and a
+ * 			shift, rather than a division. The pair is only accurate for deltas
+ * 			up to CLOCK_MAX_DELTA_SEC, so the clock keeps a base, the counter
+ * 			and nanosecond values at its last update, which is moved forward by
+ * 			the scheduler tick. The base and the wall clock offset are read
+ * 			under a seqcount latch, so the clock can be read from anywhere,
+ * 			including pseudo-NMIs.
+*/
+
+#define pr_fmt(fmt)	"clock: " fmt
+
+#include <kern/clock.h>
+#include <kern/seqlock.h>
+#include <kern/trace/printk.h>
+
+#include <arch/arch.h>
+
+/* Longest delta the mult/shift pair has to handle without overflowing */
+#define CLOCK_MAX_DELTA_SEC		600
+
+struct clock_data {
+	uint64_t		cycle_last;		/* counter at the last update */
+	uint64_t		ns_last;		/* monotonic time at the last update */
+	uint64_t		real_offset;	/* wall clock minus monotonic time */
+};
+
+static struct clock_data	clock_latch[2];
+static seqcount_t			clock_seq = SEQCOUNT_INIT;
+
+static uint64_t				clock_frequency;
+static uint64_t				clock_boot_cycles;
+static uint64_t				clock_max_cycles;
+static uint32_t				clock_mult;
+static uint32_t				clock_shift;
+
+/**
+ * clock_calc_mult_shift
+ *
+ * Find the largest shift, and matching mult, so that (cycles * mult) >> shift
+ * converts `from` Hz to `to` Hz, and doesn't overflow for up to `maxsec`
+ * seconds worth of cycles.
+*/
+static void clock_calc_mult_shift(uint32_t *mult, uint32_t *shift,
+		uint64_t from, uint64_t to, uint64_t maxsec)
+{
+	uint32_t sft, sftacc = 32;
+	uint64_t tmp;
+
+	/* bits of headroom the multiply needs for maxsec */
+	tmp = (maxsec * from) >> 32;
+	while (tmp) {
+		tmp >>= 1;
+		sftacc--;
+	}
+
+	for (sft = 32; sft > 0; sft--) {
+		tmp = (to << sft) + (from / 2);
+		tmp /= from;
+		if ((tmp >> sftacc) == 0)
+			break;
+	}
+
+	*mult = tmp;
+	*shift = sft;
+}
+
+/* exact conversions, rounded down and up respectively */
+uint64_t clock_cycles_to_ns(uint64_t cycles)
+{
+	if (clock_frequency == 0)
+		return 0;
+
+	return (cycles / clock_frequency) * NSEC_PER_SEC +
+		((cycles % clock_frequency) * NSEC_PER_SEC) / clock_frequency;
+}
+
+uint64_t clock_ns_to_cycles(uint64_t ns)
+{
+	return (ns / NSEC_PER_SEC) * clock_frequency +
+		((ns % NSEC_PER_SEC) * clock_frequency + NSEC_PER_SEC - 1) /
+		NSEC_PER_SEC;
+}
+
+/* counter value at which the monotonic clock reaches `ktime` */
+uint64_t clock_ktime_to_counter(uint64_t ktime)
+{
+	return clock_boot_cycles + clock_ns_to_cycles(ktime);
+}
+
+uint64_t clock_get_counter(void)
+{
+	isb();
+	return sysreg_read(cntpct_el0);
+}
+
+uint64_t clock_get_frequency(void)
+{
+	return clock_frequency;
+}
+
+static void __clock_write(struct clock_data *data)
+{
+	write_seqcount_latch(&clock_seq);
+	clock_latch[0] = *data;
+	write_seqcount_latch(&clock_seq);
+	clock_latch[1] = *data;
+}
+
+static void __clock_read(struct clock_data *data)
+{
+	uint32_t seq;
+
+	do {
+		seq = read_seqcount_latch(&clock_seq);
+		*data = clock_latch[seq & 1];
+	} while (read_seqcount_latch_retry(&clock_seq, seq));
+}
+
+/**
+ * clock_init
+ *
+ * Read the counter frequency and start the monotonic clock from zero. Must be
+ * called early, before anything wants a timestamp.
+*/
+void clock_init(void)
+{
+	struct clock_data data;
+
+	clock_frequency = sysreg_read(cntfrq_el0);
+	clock_calc_mult_shift(&clock_mult, &clock_shift, clock_frequency,
+		NSEC_PER_SEC, CLOCK_MAX_DELTA_SEC);
+	clock_max_cycles = CLOCK_MAX_DELTA_SEC * clock_frequency;
+
+	clock_boot_cycles = clock_get_counter();
+
+	data.cycle_last = clock_boot_cycles;
+	data.ns_last = 0;
+	data.real_offset = 0;
+	__clock_write(&data);
+}
+
+/**
+ * clock_update
+ *
+ * Move the clock's base up to the current counter value. The base time is
+ * worked out exactly from the boot counter value, so error from the mult/shift
+ * never accumulates. Called from the scheduler tick.
+*/
+void clock_update(void)
+{
+	struct clock_data data;
+	uint64_t flags;
+
+	flags = machine_irq_save();
+
+	__clock_read(&data);
+	data.cycle_last = clock_get_counter();
+	data.ns_last = clock_cycles_to_ns(data.cycle_last - clock_boot_cycles);
+	__clock_write(&data);
+
+	machine_irq_restore(flags);
+}
+
+/* time since boot now, from a snapshot of the clock's base */
+static uint64_t __ktime_ns(const struct clock_data *data)
+{
+	uint64_t delta;
+
+	delta = clock_get_counter() - data->cycle_last;
+	if (delta > clock_max_cycles)
+		return data->ns_last + clock_cycles_to_ns(delta);
+
+	return data->ns_last + ((delta * clock_mult) >> clock_shift);
+}
+
+uint64_t ktime_get_ns(void)
+{
+	struct clock_data data;
+
+	__clock_read(&data);
+	return __ktime_ns(&data);
+}
+
+/* seconds since boot */
+uint64_t ktime_get_uptime(void)
+{
+	return ktime_get_ns() / NSEC_PER_SEC;
+}
+
+uint64_t ktime_get_real_ns(void)
+{
+	struct clock_data data;
+
+	/* the offset and the base it applies to come from the same snapshot */
+	__clock_read(&data);
+	return __ktime_ns(&data) + data.real_offset;
+}
+
+/**
+ * ktime_set_real_ns
+ *
+ * Set the wall clock, in nanoseconds since the epoch. There's no RTC driver
+ * yet, so until this is called the wall clock is the same as uptime.
+*/
+void ktime_set_real_ns(uint64_t ns)
+{
+	struct clock_data data;
+	uint64_t flags;
+
+	flags = machine_irq_save();
+
+	__clock_read(&data);
+	data.real_offset = ns - ktime_get_ns();
+	__clock_write(&data);
+
+	machine_irq_restore(flags);
+}
@@ -0,0 +1,59 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	clock.h
+ * Desc:	Kernel clock. A monotonic nanosecond clock since boot, derived from
+ * 			the generic timer's physical counter, and a wall clock kept as an
+ * 			offset from it. Everything that needs a timestamp should use this,
+ * 			rather than reading the counter itself.
+*/
+
+#ifndef __KERN_CLOCK_H__
+#define __KERN_CLOCK_H__
+
+#include <tinylibc/stdint.h>
+#include <libkern/types.h>
+#include <libkern/compiler.h>
+
+#define NSEC_PER_USEC			UL(1000)
+#define NSEC_PER_MSEC			UL(1000000)
+#define NSEC_PER_SEC			UL(1000000000)
+
+/* Clock setup, and the counter behind it */
+extern void clock_init(void);
+extern void clock_update(void);
+extern uint64_t clock_get_counter(void);
+extern uint64_t clock_get_frequency(void);
+
+/* Conversion between durations in counter cycles and nanoseconds */
+extern uint64_t clock_cycles_to_ns(uint64_t cycles);
+extern uint64_t clock_ns_to_cycles(uint64_t ns);
+extern uint64_t clock_ktime_to_counter(uint64_t ktime);
+
+/* Monotonic time since boot, and wall clock time, in nanoseconds */
+extern uint64_t ktime_get_ns(void);
+extern uint64_t ktime_get_uptime(void);
+extern uint64_t ktime_get_real_ns(void);
+extern void ktime_set_real_ns(uint64_t ns);
+
+#endif /* __kern_clock_h__ */
@@ -30,6 +30,8 @@
 
 #include <kern/defaults.h>
 #include <kern/machine.h>
+#include <kern/cpufeature.h>
+#include <kern/alternative.h>
 #include <kern/vm/pmap.h>
 #include <libkern/panic.h>
 #include <tinylibc/string.h>
@@ -99,6 +101,8 @@ kern_return_t cpu_create(cpu_t *cpu_data_ptr, vm_address_t excepstack,
 	cpu_data_ptr->intstack_top = (vm_address_t) intstack;
 
 	cpu_data_ptr->cpu_num = machine_get_cpu_num();
+	cpu_data_ptr->interrupt_pmr = IRQ_PRIORITY_MASK_NONE;
+	cpu_data_ptr->interrupt_nmi = MACHINE_IRQ_SPURIOUS;
 	// todo: do cpu type, flag discovery
 
 	// todo: setup interrupt fields, once that system has been reworked so the
@@ -115,6 +119,9 @@ kern_return_t cpu_create(cpu_t *cpu_data_ptr, vm_address_t excepstack,
 */
 void cpu_init(void)
 {
+	/* decode the ID registers, then patch in sequences that need them */
+	cpu_feature_init();
+	alternative_init();
 }
 
 /**
@@ -147,6 +154,14 @@ kern_return_t cpu_read_flag(cpu_number_t cpuid, uint32_t flag)
 		KERN_RETURN_FAIL : KERN_RETURN_SUCCESS;
 }
 
+kern_return_t cpu_clear_flag(cpu_number_t cpuid, uint32_t flag)
+{
+	CPU_ASSERT_VALID_ID(cpuid);
+
+	CpuDataEntries[cpuid].cpu_flags &= ~flag;
+	return KERN_RETURN_SUCCESS;
+}
+
 kern_return_t cpu_set_active_stack(cpu_number_t cpuid, vm_address_t stack)
 {
 	CPU_ASSERT_VALID_ID(cpuid);
@@ -27,7 +27,7 @@
  *
  */
 
-#ifndef __KERN_CPU_H_
+#ifndef __KERN_CPU_H__
 #define __KERN_CPU_H__
 
 #include <kern/thread.h>
@@ -50,9 +50,8 @@ typedef int			cpu_type_t;
 
 /* CPU Flags */
 #define CPU_FLAG_THREADING_ENABLED	(1 << 0)	/* Has threading been enabled yet? */
-
-/** TOOD: Move to interrupt handler header */
-typedef void (*irq_handler_t) (unsigned int source);
+#define CPU_FLAG_NEED_RESCHED		(1 << 1)	/* Reschedule on interrupt exit */
+#define CPU_FLAG_IRQ_FULL_FRAME		(1 << 2)	/* Complete the frame on exit */
 
 /**
  * CPU Data
@@ -74,7 +73,11 @@ typedef struct cpu_data
 
 	unsigned int		interrupt_source;
 	unsigned int		interrupt_state;
-	irq_handler_t		interrupt_handler;
+	unsigned int		interrupt_nesting;
+	uint64_t			interrupt_count;
+	uint32_t			interrupt_pmr;		/* PMR while unmasked, pseudo-NMI */
+	unsigned int		interrupt_nmi;		/* NMI awaiting the full frame */
+	unsigned int		interrupt_nmi_nesting;
 
 	/* Reset */
 	vm_address_t		cpu_reset_handler;
@@ -106,6 +109,7 @@ extern kern_return_t cpu_set_boot_cpu(cpu_t *cpu);
 
 extern kern_return_t cpu_set_flag(cpu_number_t cpuid, uint32_t flag);
 extern kern_return_t cpu_read_flag(cpu_number_t cpuid, uint32_t flag);
+extern kern_return_t cpu_clear_flag(cpu_number_t cpuid, uint32_t flag);
 
 extern kern_return_t cpu_set_active_thread(cpu_number_t cpuid, thread_t *thread);
 extern kern_return_t cpu_set_active_stack(cpu_number_t cpuid, vm_address_t stack);
@@ -0,0 +1,228 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	cpufeature.c
+ * Desc:	CPU feature detection. See cpufeature.h.
+*/
+
+#define pr_fmt(fmt)	"cpu: " fmt
+
+#include <kern/cpufeature.h>
+#include <kern/trace/printk.h>
+#include <kern/defaults.h>
+
+#include <tinylibc/stdio.h>
+
+/**
+ * A feature is implemented when its field is at least `min`. Signed fields
+ * use 0xf for not implemented, so anything else at least `min` counts.
+*/
+struct cpu_feature_field {
+	uint8_t			reg;
+	uint8_t			shift;
+	uint8_t			min;
+	uint8_t			sign;
+	uint16_t		feature;
+	const char		*name;
+};
+
+#define FIELD(__reg, __field, __min, __feature, __name)						\
+	{ CPU_ID_##__reg, ID_AA64##__reg##_##__field##_SHIFT, __min, 0,		\
+	  CPU_FEATURE_##__feature, __name }
+#define FIELD_SIGNED(__reg, __field, __min, __feature, __name)				\
+	{ CPU_ID_##__reg, ID_AA64##__reg##_##__field##_SHIFT, __min, 1,		\
+	  CPU_FEATURE_##__feature, __name }
+
+static const struct cpu_feature_field cpu_feature_fields[] = {
+	FIELD(ISAR0, AES, 1, AES, "AES"),
+	FIELD(ISAR0, AES, 2, PMULL, "PMULL"),
+	FIELD(ISAR0, SHA1, 1, SHA1, "SHA1"),
+	FIELD(ISAR0, SHA2, 1, SHA256, "SHA256"),
+	FIELD(ISAR0, SHA2, 2, SHA512, "SHA512"),
+	FIELD(ISAR0, CRC32, 1, CRC32, "CRC32"),
+	FIELD(ISAR0, ATOMIC, 2, LSE, "Atomic"),
+	FIELD(ISAR0, RDM, 1, RDM, "RDM"),
+	FIELD(ISAR0, SHA3, 1, SHA3, "SHA3"),
+	FIELD(ISAR0, SM3, 1, SM3, "SM3"),
+	FIELD(ISAR0, SM4, 1, SM4, "SM4"),
+	FIELD(ISAR0, DP, 1, DOTPROD, "DP"),
+	FIELD(ISAR0, FHM, 1, FHM, "FHM"),
+	FIELD(ISAR0, TS, 1, FLAGM, "FlagM"),
+	FIELD(ISAR0, TLB, 1, TLBIOS, "TLBI-OS"),
+	FIELD(ISAR0, TLB, 2, TLBIRANGE, "TLBI-Range"),
+	FIELD(ISAR0, RNDR, 1, RNDR, "RNDR"),
+
+	FIELD(ISAR1, DPB, 1, DPB, "DCPoP"),
+	FIELD(ISAR1, APA, 1, PAUTH, "PAC-QARMA"),
+	FIELD(ISAR1, API, 1, PAUTH, "PAC-Impl"),
+	FIELD(ISAR1, JSCVT, 1, JSCVT, "JSCVT"),
+	FIELD(ISAR1, FCMA, 1, FCMA, "FCMA"),
+	FIELD(ISAR1, LRCPC, 1, LRCPC, "RCPC"),
+	FIELD(ISAR1, FRINTTS, 1, FRINTTS, "FRINTTS"),
+	FIELD(ISAR1, SB, 1, SB, "SB"),
+	FIELD(ISAR1, BF16, 1, BF16, "BF16"),
+	FIELD(ISAR1, I8MM, 1, I8MM, "I8MM"),
+
+	FIELD_SIGNED(PFR0, FP, 0, FP, "FP"),
+	FIELD_SIGNED(PFR0, ADVSIMD, 0, ASIMD, "AdvSIMD"),
+	FIELD_SIGNED(PFR0, FP, 1, FP16, "FP16"),
+	FIELD(PFR0, GIC, 1, GIC_SYSREG, "GIC"),
+	FIELD(PFR0, RAS, 1, RAS, "RAS"),
+	FIELD(PFR0, SVE, 1, SVE, "SVE"),
+	FIELD(PFR0, DIT, 1, DIT, "DIT"),
+
+	FIELD(MMFR0, ECV, 1, ECV, "ECV"),
+
+	FIELD(MMFR1, HAFDBS, 1, HAFDBS, "HAF"),
+	FIELD(MMFR1, VH, 1, VHE, "VHE"),
+	FIELD(MMFR1, LO, 1, LOR, "LOR"),
+	FIELD(MMFR1, PAN, 1, PAN, "PAN"),
+	FIELD(MMFR1, XNX, 1, XNX, "XNX"),
+
+	FIELD(MMFR2, CNP, 1, CNP, "CnP"),
+	FIELD(MMFR2, UAO, 1, UAO, "UAO"),
+	FIELD(MMFR2, AT, 1, LSE2, "LSE2"),
+	FIELD(MMFR2, TTL, 1, TTL, "TTL"),
+	FIELD(MMFR2, BBM, 1, BBM, "BBM"),
+	FIELD(MMFR2, E0PD, 1, E0PD, "E0PD"),
+};
+
+static const char *cpu_id_names[CPU_ID_NR] = {
+	[CPU_ID_ISAR0]		= "Instruction Set Attributes 0",
+	[CPU_ID_ISAR1]		= "Instruction Set Attributes 1",
+	[CPU_ID_PFR0]		= "Processor Features 0",
+	[CPU_ID_MMFR0]		= "Memory Model Features 0",
+	[CPU_ID_MMFR1]		= "Memory Model Features 1",
+	[CPU_ID_MMFR2]		= "Memory Model Features 2",
+};
+
+/* ID_AA64MMFR0_EL1.PARange */
+static const uint8_t cpu_parange_bits[] = { 32, 36, 40, 42, 44, 48, 52 };
+
+static uint64_t cpu_id_regs[CPU_ID_NR];
+static uint64_t cpu_features[(CPU_FEATURE_NR + 63) / 64];
+
+static int __cpu_field_present(const struct cpu_feature_field *field)
+{
+	uint64_t val = ID_AA64_FIELD(cpu_id_regs[field->reg], field->shift);
+
+	if (field->sign && val == ID_AA64PFR0_FP_NONE)
+		return 0;
+	return val >= field->min;
+}
+
+/* append to a line being built for the feature print */
+static size_t __cpu_append(char *buf, size_t len, size_t size, const char *str)
+{
+	int n;
+
+	if (len >= size)
+		return len;
+
+	n = snprintf(buf + len, size - len, "%s%s", len ? "," : "", str);
+	return (n > 0) ? len + n : len;
+}
+
+/**
+ * Print each ID register as FreeBSD does, the raw value and the names of the
+ * features found in it, plus the fields of MMFR0 that aren't features.
+ */
+static void __cpu_feature_print(void)
+{
+	char line[192], tmp[24];
+	uint64_t mmfr0;
+	size_t len;
+	unsigned int reg, i;
+
+	for (reg = 0; reg < CPU_ID_NR; reg++) {
+		len = 0;
+		line[0] = '\0';
+
+		if (reg == CPU_ID_MMFR0) {
+			mmfr0 = cpu_id_regs[CPU_ID_MMFR0];
+
+			i = ID_AA64_FIELD(mmfr0, ID_AA64MMFR0_PARANGE_SHIFT);
+			if (i < sizeof (cpu_parange_bits)) {
+				snprintf(tmp, sizeof (tmp), "PA %d-bit", cpu_parange_bits[i]);
+				len = __cpu_append(line, len, sizeof (line), tmp);
+			}
+			snprintf(tmp, sizeof (tmp), "ASID %d-bit",
+				ID_AA64_FIELD(mmfr0, ID_AA64MMFR0_ASIDBITS_SHIFT) == 2 ? 16 : 8);
+			len = __cpu_append(line, len, sizeof (line), tmp);
+
+			/* 1 is 4K with 52-bit addresses, FEAT_LPA2 */
+			if (ID_AA64_SFIELD(mmfr0, ID_AA64MMFR0_TGRAN4_SHIFT) >= 0)
+				len = __cpu_append(line, len, sizeof (line), "4K");
+			if (ID_AA64_FIELD(mmfr0, ID_AA64MMFR0_TGRAN16_SHIFT) != 0)
+				len = __cpu_append(line, len, sizeof (line), "16K");
+			if (ID_AA64_FIELD(mmfr0, ID_AA64MMFR0_TGRAN64_SHIFT) == 0)
+				len = __cpu_append(line, len, sizeof (line), "64K");
+		}
+
+		for (i = 0; i < sizeof (cpu_feature_fields) / sizeof (cpu_feature_fields[0]); i++)
+			if (cpu_feature_fields[i].reg == reg &&
+					__cpu_field_present(&cpu_feature_fields[i]))
+				len = __cpu_append(line, len, sizeof (line),
+					cpu_feature_fields[i].name);
+
+		pr_info("%s = <%s> (0x%016llx)\n", cpu_id_names[reg], line,
+			cpu_id_regs[reg]);
+	}
+}
+
+/**
+ * cpu_feature_init
+ *
+ * Read the boot CPU's ID registers and decode them into the feature bitmap.
+ * Must run before anything tests a feature, including alternative_init().
+ */
+void cpu_feature_init(void)
+{
+	unsigned int i;
+
+	cpu_id_regs[CPU_ID_ISAR0] = sysreg_read(id_aa64isar0_el1);
+	cpu_id_regs[CPU_ID_ISAR1] = sysreg_read(id_aa64isar1_el1);
+	cpu_id_regs[CPU_ID_PFR0] = sysreg_read(id_aa64pfr0_el1);
+	cpu_id_regs[CPU_ID_MMFR0] = sysreg_read(id_aa64mmfr0_el1);
+	cpu_id_regs[CPU_ID_MMFR1] = sysreg_read(id_aa64mmfr1_el1);
+	cpu_id_regs[CPU_ID_MMFR2] = sysreg_read(ID_AA64MMFR2_EL1);
+
+	for (i = 0; i < sizeof (cpu_feature_fields) / sizeof (cpu_feature_fields[0]); i++)
+		if (__cpu_field_present(&cpu_feature_fields[i]))
+			cpu_features[cpu_feature_fields[i].feature / 64] |=
+				(1ULL << (cpu_feature_fields[i].feature % 64));
+
+	__cpu_feature_print();
+}
+
+int cpu_has_feature(unsigned int feature)
+{
+	if (feature >= CPU_FEATURE_NR)
+		return 0;
+	return (cpu_features[feature / 64] >> (feature % 64)) & 1;
+}
+
+uint64_t cpu_feature_id_reg(unsigned int reg)
+{
+	return (reg < CPU_ID_NR) ? cpu_id_regs[reg] : 0;
+}
@@ -0,0 +1,110 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	cpufeature.h
+ * Desc:	CPU features. The AArch64 ID registers are read once at boot and
+ * 			decoded into a bitmap of capabilities, which code can test with
+ * 			cpu_has_feature(), or have patched in at boot with an alternative
+ * 			(see alternative.h). Feature numbers are plain defines so they can
+ * 			be stringified into the alternatives table.
+*/
+
+#ifndef __KERN_CPUFEATURE_H__
+#define __KERN_CPUFEATURE_H__
+
+#include <tinylibc/stdint.h>
+
+#include <libkern/types.h>
+
+/* ID_AA64ISAR0_EL1 */
+#define CPU_FEATURE_AES				0
+#define CPU_FEATURE_PMULL			1
+#define CPU_FEATURE_SHA1			2
+#define CPU_FEATURE_SHA256			3
+#define CPU_FEATURE_SHA512			4
+#define CPU_FEATURE_CRC32			5
+#define CPU_FEATURE_LSE				6	/* CAS, LDADD, SWP and friends */
+#define CPU_FEATURE_RDM				7
+#define CPU_FEATURE_SHA3			8
+#define CPU_FEATURE_SM3				9
+#define CPU_FEATURE_SM4				10
+#define CPU_FEATURE_DOTPROD			11
+#define CPU_FEATURE_FHM				12
+#define CPU_FEATURE_FLAGM			13
+#define CPU_FEATURE_TLBIOS			14
+#define CPU_FEATURE_TLBIRANGE		15	/* TLBI RVA* range invalidation */
+#define CPU_FEATURE_RNDR			16
+
+/* ID_AA64ISAR1_EL1 */
+#define CPU_FEATURE_DPB				17
+#define CPU_FEATURE_PAUTH			18
+#define CPU_FEATURE_JSCVT			19
+#define CPU_FEATURE_FCMA			20
+#define CPU_FEATURE_LRCPC			21
+#define CPU_FEATURE_FRINTTS			22
+#define CPU_FEATURE_SB				23
+#define CPU_FEATURE_BF16			24
+#define CPU_FEATURE_I8MM			25
+
+/* ID_AA64PFR0_EL1 */
+#define CPU_FEATURE_FP				26
+#define CPU_FEATURE_ASIMD			27
+#define CPU_FEATURE_FP16			28
+#define CPU_FEATURE_GIC_SYSREG		29
+#define CPU_FEATURE_RAS				30
+#define CPU_FEATURE_SVE				31
+#define CPU_FEATURE_DIT				32
+
+/* ID_AA64MMFR0_EL1 - ID_AA64MMFR2_EL1 */
+#define CPU_FEATURE_ECV				33
+#define CPU_FEATURE_HAFDBS			34
+#define CPU_FEATURE_VHE				35
+#define CPU_FEATURE_LOR				36
+#define CPU_FEATURE_PAN				37
+#define CPU_FEATURE_XNX				38
+#define CPU_FEATURE_CNP				39
+#define CPU_FEATURE_UAO				40
+#define CPU_FEATURE_LSE2			41
+#define CPU_FEATURE_TTL				42
+#define CPU_FEATURE_BBM				43
+#define CPU_FEATURE_E0PD			44
+
+#define CPU_FEATURE_NR				45
+
+/* The ID registers, as read from the boot CPU */
+enum {
+	CPU_ID_ISAR0,
+	CPU_ID_ISAR1,
+	CPU_ID_PFR0,
+	CPU_ID_MMFR0,
+	CPU_ID_MMFR1,
+	CPU_ID_MMFR2,
+	CPU_ID_NR,
+};
+
+/* CPU feature API */
+extern void cpu_feature_init(void);
+extern int cpu_has_feature(unsigned int feature);
+extern uint64_t cpu_feature_id_reg(unsigned int reg);
+
+#endif /* __kern_cpufeature_h__ */
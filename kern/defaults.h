@@ -45,6 +45,27 @@
 #define DEFAULTS_KERNEL_IMAGEINFO_HEADER	DEFAULTS_ENABLE
 
 #define DEFAULTS_KERNEL_LOGLEVEL			3	/* everything */
+#define DEFAULTS_KERNEL_PRINTK_RB_SIZE		UL(16384)	/* per-CPU, power of two */
+#define DEFAULTS_KERNEL_PRINTK_BINARY		DEFAULTS_DISABLE	/* binary pr_info/debug */
+#define DEFAULTS_KERNEL_TRACE				DEFAULTS_DISABLE	/* enable all events at boot */
+#define DEFAULTS_KERNEL_TRACE_EXPORT_MS		UL(100)	/* trace buffer export period */
+#define DEFAULTS_KERNEL_DYNDBG				""	/* pr_debug prefixes, e.g. "sched,zalloc" */
+
+/* function graph tracer, enabled by building with FGRAPH, see the Makefile */
+#ifdef KERNEL_FGRAPH
+#define DEFAULTS_KERNEL_FGRAPH				DEFAULTS_ENABLE
+#else
+#define DEFAULTS_KERNEL_FGRAPH				DEFAULTS_DISABLE
+#endif
+#define DEFAULTS_KERNEL_FGRAPH_ENTRIES		UL(2048)	/* calls recorded per CPU */
+#define DEFAULTS_KERNEL_FGRAPH_DEPTH		UL(32)		/* shadow stack depth */
+
+/* sampling profiler, needs DEFAULTS_MACHINE_IRQ_PSEUDO_NMI */
+#define DEFAULTS_KERNEL_PROFILE				DEFAULTS_DISABLE	/* sample from boot */
+#define DEFAULTS_KERNEL_PROFILE_HZ			UL(997)		/* off the scheduler tick */
+#define DEFAULTS_KERNEL_PROFILE_CYCLES		UL(0)		/* sample on the PMU instead */
+#define DEFAULTS_KERNEL_PROFILE_SAMPLES		UL(512)		/* per CPU, between exports */
+#define DEFAULTS_KERNEL_PROFILE_DEPTH		UL(16)		/* frames per sample */
 
 /* Kernel - memory */
 #define DEFAULTS_KERNEL_VM_STACK_SIZE		UL(16386)
@@ -53,12 +74,34 @@
 #define DEFAULTS_KERNEL_VM_PERIPH_BASE		UL(0xffffffff10000000)
 
 #define DEFAULTS_KERNEL_VM_USE_L3_TABLE		DEFAULTS_DISABLE
+#define DEFAULTS_KERNEL_VM_TLB_FLUSH_MAX	UL(512)	/* pages before flushing all */
 
 /* Kernel - debug */
 #define DEFAULTS_KERNEL_DEBUG_UART_BAUD		115200
 #define DEFAULTS_KERNEL_DEBUG_UART_CLK		0x16e3600
+#define DEFAULTS_KERNEL_DEBUG_UART_IRQ		UL(33)		/* SPI 1 */
+#define DEFAULTS_KERNEL_DEBUG_UART_TXBUF	UL(4096)	/* power of two */
 
-#define DEFAULTS_KERNEL_SCHED_DEBUG_MSG		DEFAULTS_DISABLE
+#define DEFAULTS_KERNEL_ALTERNATIVES		DEFAULTS_ENABLE	/* patch for CPU features */
+
+#define DEFAULTS_KERNEL_SCHED_DEBUG_MSG		DEFAULTS_DISABLE	/* initial state, a static key */
+#define DEFAULTS_KERNEL_LOCK_STAT			DEFAULTS_DISABLE	/* per lock class statistics */
+#define DEFAULTS_KERNEL_MUTEX_SPIN			DEFAULTS_ENABLE	/* spin while the owner runs */
+#define DEFAULTS_KERNEL_MUTEX_SPIN_MAX		UL(1000)	/* spins before blocking */
+
+#define DEFAULTS_KERNEL_IPI_SGI				UL(0)	/* carries every IPI message */
+#define DEFAULTS_KERNEL_IPI_STOP_SGI		UL(15)	/* stop as a pseudo-NMI */
+#define DEFAULTS_KERNEL_IPI_STOP_TIMEOUT_MS	UL(100)	/* wait for other cpus to stop */
+
+#define DEFAULTS_KERNEL_WATCHDOG			DEFAULTS_ENABLE
+#define DEFAULTS_KERNEL_WATCHDOG_THRESH		UL(10)	/* seconds without a tick */
+
+#define DEFAULTS_KERNEL_TIMER_HEAP_SIZE		UL(64)	/* near timers per CPU */
+#define DEFAULTS_KERNEL_TIMER_SLACK_NS		UL(50000)
+
+#define DEFAULTS_KERNEL_BENCH				DEFAULTS_DISABLE	/* run at boot */
+#define DEFAULTS_KERNEL_BENCH_ITERATIONS	UL(1000)
+#define DEFAULTS_KERNEL_BENCH_MEM_MAX		UL(65536)	/* largest memory routine run */
 
 /* Machine */
 #define DEFAULTS_MACHINE_MAX_CPUS			UL(16)
@@ -66,8 +109,20 @@
 
 #define DEFAULTS_MACHINE_LIBFDT_WORKAROUND	DEFAULTS_ENABLE
 
+#define DEFAULTS_MACHINE_MAX_IRQS			UL(128)	/* SGIs, PPIs and SPIs 32-127 */
+#define DEFAULTS_MACHINE_IRQ_BALANCE		DEFAULTS_ENABLE
+#define DEFAULTS_MACHINE_IRQ_BALANCE_TICKS	UL(8)	/* timer ticks between passes */
+#define DEFAULTS_MACHINE_IRQ_BALANCE_MIN	UL(16)	/* minimum imbalance to act on */
+#define DEFAULTS_MACHINE_IRQ_PSEUDO_NMI		DEFAULTS_ENABLE	/* mask via ICC_PMR_EL1 */
+#define DEFAULTS_MACHINE_TIMER_NMI_HZ		UL(10)	/* watchdog NMI rate */
+#define DEFAULTS_MACHINE_TIMER_TICK_HZ		UL(100)	/* scheduler tick rate */
+#define DEFAULTS_MACHINE_KERNEL_NEON		DEFAULTS_ENABLE	/* NEON string routines */
+#define DEFAULTS_MACHINE_KERNEL_NEON_MIN	UL(256)	/* smallest length worth a section */
+
 /* Platform */
-#define DEFAULTS_PLAT_DEVICETREE_CELL_SIZE	2
+#define DEFAULTS_PLAT_DEVICETREE_ARENA		UL(65536)	/* unflattened tree */
+#define DEFAULTS_PLAT_DEVICETREE_HASH_SIZE	64			/* buckets per index */
+#define DEFAULTS_PLAT_STATIC				DEFAULTS_DISABLE	/* platform from the build, not the DT */
 
 /* Boot Arguments */
 #define DEFAULTS_BA_OFFSET_VIRTBASE			UL(8)
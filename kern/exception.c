@@ -57,7 +57,12 @@ typedef int				fault_type_t;
 void arm64_handler_synchronous (arm64_exception_frame_t *);
 void arm64_handler_serror (arm64_exception_frame_t *);
 void arm64_handler_fiq (arm64_exception_frame_t *);
-void arm64_handler_irq (arm64_exception_frame_t *);
+int arm64_handler_irq (arm64_exception_frame_t *);
+void arm64_handler_irq_full (arm64_exception_frame_t *);
+
+/* arm64_handler_irq return values, see __irq_fast64 */
+#define ARM64_IRQ_EXIT_FAST		0	/* only caller-saved registers were saved */
+#define ARM64_IRQ_EXIT_FULL		1	/* complete the frame, then call _full */
 
 /**
  * Second-stage Exception Handlers
@@ -440,6 +445,12 @@ void arm64_handler_synchronous(arm64_exception_frame_t *frame)
 			cpu_halt();
 			break;
 
+		/* FP/SIMD access while CPACR_EL1.FPEN traps */
+		case ESR_EC_TRAP_SIMD_FP:
+			panic_with_thread_state(frame, "FP/SIMD used outside kernel_neon_begin()");
+			cpu_halt();
+			break;
+
 		/* Undefined Instruction */
 		case ESR_EC_UNCATEGORIZED:
 			handle_undefined_instruction(frame);
@@ -462,37 +473,116 @@ void arm64_handler_serror(arm64_exception_frame_t *frame)
 
 void arm64_handler_fiq(arm64_exception_frame_t *frame)
 {
-	uint32_t intid = sysreg_read(icc_iar1_el1);
-	sysreg_write(icc_eoir1_el1, intid);
+	uint32_t intid = machine_irq_acknowledge();
+	if (intid >= MACHINE_IRQ_SPURIOUS)
+		return;
+
+	machine_irq_eoi(intid);
+	machine_irq_deactivate(intid);
 
 	kprintf("arm64_handler_fiq: intid: %d\n", intid);
 }
 
-int irq_count = 0;
-
-void arm64_handler_irq(arm64_exception_frame_t *frame)
+/**
+ * arm64_handler_irq
+ *
+ * Handle an interrupt on the fast path, where only the caller-saved registers
+ * are in the exception frame. Anything that needs the rest of the frame, either
+ * to switch threads or to inspect the interrupted state, is deferred to
+ * arm64_handler_irq_full() by returning ARM64_IRQ_EXIT_FULL.
+*/
+int arm64_handler_irq(arm64_exception_frame_t *frame)
 {
-	uint32_t intid = sysreg_read(icc_iar1_el1);
-	sysreg_write(icc_eoir1_el1, intid);
+	uint32_t pmr;
+	intid_t intid;
+	cpu_t *cpu;
+
+	intid = machine_irq_acknowledge();
+	if (intid >= MACHINE_IRQ_SPURIOUS)
+		return ARM64_IRQ_EXIT_FAST;
+
+	cpu = cpu_get_current();
+
+	/**
+	 * Pseudo-NMIs may have interrupted anything, so bypass the rest. They're
+	 * handed the interrupted frame, so are always run on the full path, which
+	 * is fine as they're rare. Interrupts stay masked until then.
+	*/
+	if (machine_irq_is_nmi(intid)) {
+		cpu->interrupt_nmi = intid;
+		return ARM64_IRQ_EXIT_FULL;
+	}
+
+	if (static_branch_unlikely(&sched_debug_msg)) {
+		kprintf("==== SYSTEM IRQ HANDLER ====\n");
+		kprintf ("arm64_handler_irq(%lld): intid: %d\n", cpu->interrupt_count, intid);
+		kprintf("==== SYSTEM IRQ HANDLER ====\n");
+	}
+
+	/**
+	 * Raise the PMR to the priority of this interrupt before dropping the
+	 * running priority, so that only more urgent interrupts can preempt the
+	 * handler. The interrupt stays active until it's deactivated, either once
+	 * the handler returns or by its handler thread.
+	*/
+	pmr = machine_irq_priority_raise(machine_irq_running_priority());
+	machine_irq_eoi(intid);
+
+	/* run the handler with interrupts unmasked, so it can be preempted */
+	cpu->interrupt_nesting += 1;
+	machine_irq_enable();
+
+	machine_handle_interrupt(intid);
 
 	machine_irq_disable();
+	cpu->interrupt_nesting -= 1;
+	machine_irq_priority_restore(pmr);
 
-#if DEFAULTS_KERNEL_SCHED_DEBUG_MSG
-	kprintf("==== SYSTEM IRQ HANDLER ====\n");
-	kprintf ("arm64_handler_irq(%d): intid: %d\n", irq_count, intid);
-#endif
+	/* a reschedule happens as the outermost interrupt exits */
+	if (cpu->interrupt_nesting == 0 && preemptible() &&
+			cpu_read_flag(cpu->cpu_num, CPU_FLAG_NEED_RESCHED))
+		return ARM64_IRQ_EXIT_FULL;
 
-	irq_count++;
+	if (cpu_read_flag(cpu->cpu_num, CPU_FLAG_IRQ_FULL_FRAME))
+		return ARM64_IRQ_EXIT_FULL;
 
-#if DEFAULTS_KERNEL_SCHED_DEBUG_MSG
-	kprintf("==== SYSTEM IRQ HANDLER ====\n");
-#endif
+	return ARM64_IRQ_EXIT_FAST;
+}
 
-	if (intid == 30) {
-#if DEFAULTS_KERNEL_SCHED_DEBUG_MSG
-		kprintf("machine_timer_reset(%d)\n", MACHINE_TIMER_RESET_VALUE);
-#endif
-		machine_timer_reset(MACHINE_TIMER_RESET_VALUE);
+/**
+ * arm64_handler_irq_full
+ *
+ * Second half of an interrupt that needed the complete exception frame. The
+ * interrupt itself has been handled and its priority dropped, so this runs with
+ * interrupts masked, as the interrupted context's mask is restored on eret.
+*/
+void arm64_handler_irq_full(arm64_exception_frame_t *frame)
+{
+	intid_t intid;
+	cpu_t *cpu;
+
+	cpu = cpu_get_current();
+	cpu_clear_flag(cpu->cpu_num, CPU_FLAG_IRQ_FULL_FRAME);
+
+	if (cpu->interrupt_nmi != MACHINE_IRQ_SPURIOUS) {
+		intid = cpu->interrupt_nmi;
+		cpu->interrupt_nmi = MACHINE_IRQ_SPURIOUS;
+
+		machine_handle_nmi(intid, frame);
+		return;
+	}
+
+	/**
+	 * When this thread is next selected, __schedule() returns and the frame is
+	 * restored. A reschedule only happens from the outermost interrupt, so the
+	 * interrupted context had nothing masked, but the thread that switched back
+	 * may have left interrupts disabled through the PMR. A thread holding a
+	 * spinlock isn't switched out, it takes the reschedule in preempt_enable().
+	*/
+	if (cpu->interrupt_nesting == 0 && preemptible() &&
+			cpu_read_flag(cpu->cpu_num, CPU_FLAG_NEED_RESCHED)) {
+		cpu_clear_flag(cpu->cpu_num, CPU_FLAG_NEED_RESCHED);
 		__schedule(frame);
+		machine_irq_priority_restore(IRQ_PRIORITY_MASK_NONE);
 	}
 }
@@ -0,0 +1,485 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#define pr_fmt(fmt)	"ipi: " fmt
+
+#include <kern/ipi.h>
+#include <kern/atomic.h>
+#include <kern/machine.h>
+#include <kern/sched.h>
+#include <kern/clock.h>
+#include <kern/cpu.h>
+#include <kern/trace/printk.h>
+
+#include <libkern/panic.h>
+#include <arch/arch.h>
+
+/**
+ * Per-cpu IPI state. The call slots are the ones this cpu sends with, one per
+ * target, while everything else is written by senders and read by the owner.
+*/
+struct ipi_cpu {
+	volatile uint32_t		pending;		/* IPI_* bits not yet handled */
+	volatile uint32_t		stopped;
+	struct smp_call *volatile	queue;		/* calls to run, newest first */
+	volatile uint64_t		tlb_req;		/* shootdowns requested */
+	volatile uint64_t		tlb_done;		/* requests covered by a flush */
+	struct smp_call			calls[DEFAULTS_MACHINE_MAX_CPUS];
+} __attribute__((aligned(64)));
+
+static struct ipi_cpu ipi_cpus[DEFAULTS_MACHINE_MAX_CPUS];
+static volatile uint64_t ipi_online_mask;
+static int ipi_stop_nmi;
+
+/* Targets of a cross-cpu request: online, and not ourselves */
+static inline uint64_t __ipi_others(uint64_t cpumask, unsigned int self)
+{
+	return cpumask & ipi_online_mask & ~BIT_64(self);
+}
+
+/**
+ * Waiting on another cpu that may itself be spinning with interrupts off,
+ * waiting on us, never finishes.
+*/
+static void __ipi_might_wait(const char *func)
+{
+	if (machine_irq_disabled() || cpu_get_current()->interrupt_nesting != 0)
+		panic("%s: cross-cpu call from atomic context", func);
+}
+
+/**
+ * __ipi_raise
+ *
+ * Mark `type` pending on each cpu in the mask, and send the SGI to those that
+ * had nothing pending. The others already have one on the way, and will see
+ * this message when they take it.
+*/
+static void __ipi_raise(uint64_t cpumask, ipi_type_t type)
+{
+	uint64_t raise = 0;
+	unsigned int cpu;
+
+	for (cpu = 0; cpu < DEFAULTS_MACHINE_MAX_CPUS; cpu++) {
+		if (!(cpumask & BIT_64(cpu)))
+			continue;
+
+		if (atomic_fetch_or_32(&ipi_cpus[cpu].pending, 1U << type) == 0)
+			raise |= BIT_64(cpu);
+	}
+
+	if (raise == 0)
+		return;
+
+	/* everyone else is one write with IRM, rather than one per cluster */
+	if (raise == __ipi_others(~0UL, machine_get_cpu_num()) &&
+			__builtin_popcountll(raise) > 1)
+		machine_send_interrupt_others(DEFAULTS_KERNEL_IPI_SGI);
+	else
+		machine_send_interrupt_mask(DEFAULTS_KERNEL_IPI_SGI, raise);
+}
+
+/******************************************************************************
+ * Function Calls
+ *****************************************************************************/
+
+/* Wait for the last call through `call` to be taken off the target's queue */
+static void __smp_call_sync(struct smp_call *call)
+{
+	uint32_t flags;
+
+	while ((flags = __atomic_load_n(&call->flags, __ATOMIC_ACQUIRE)) &
+			SMP_CALL_LOCKED)
+		__cmpwait_32(&call->flags, flags);
+}
+
+static void __smp_call_queue(struct ipi_cpu *target, struct smp_call *call)
+{
+	uint64_t head, prev;
+
+	head = (uint64_t) target->queue;
+	for (;;) {
+		call->next = (struct smp_call *) head;
+		prev = atomic_cmpxchg_64((volatile uint64_t *) &target->queue, head,
+			(uint64_t) call);
+		if (prev == head)
+			break;
+		head = prev;
+	}
+}
+
+/**
+ * __smp_call_run
+ *
+ * Run everything queued for this cpu. The whole queue is taken with one swap,
+ * so however many calls were batched behind the SGI cost one atomic here.
+*/
+static void __smp_call_run(struct ipi_cpu *ipi)
+{
+	struct smp_call *list, *call, *next, *order = NULL;
+	smp_call_func_t func;
+	uint32_t flags;
+	void *info;
+
+	list = (struct smp_call *) atomic_xchg_64((volatile uint64_t *) &ipi->queue, 0);
+
+	/* the queue is newest first, run them in the order they were sent */
+	while (list != NULL) {
+		next = list->next;
+		list->next = order;
+		order = list;
+		list = next;
+	}
+
+	for (call = order; call != NULL; call = next) {
+		/* once it's unlocked the sender may reuse it, so read it all first */
+		next = call->next;
+		func = call->func;
+		info = call->info;
+		flags = call->flags;
+
+		if (flags & SMP_CALL_WAIT) {
+			func(info);
+			__atomic_store_n(&call->flags, 0, __ATOMIC_RELEASE);
+		} else {
+			__atomic_store_n(&call->flags, 0, __ATOMIC_RELEASE);
+			func(info);
+		}
+	}
+}
+
+static void __smp_call_send(unsigned int self, uint64_t cpumask,
+		smp_call_func_t func, void *info, int wait)
+{
+	struct smp_call *call;
+	unsigned int cpu;
+
+	for (cpu = 0; cpu < DEFAULTS_MACHINE_MAX_CPUS; cpu++) {
+		if (!(cpumask & BIT_64(cpu)))
+			continue;
+
+		call = &ipi_cpus[self].calls[cpu];
+		__smp_call_sync(call);
+
+		call->func = func;
+		call->info = info;
+		call->flags = SMP_CALL_LOCKED | (wait ? SMP_CALL_WAIT : 0);
+		__smp_call_queue(&ipi_cpus[cpu], call);
+	}
+
+	__ipi_raise(cpumask, IPI_CALL_FUNC);
+}
+
+static void __smp_call_wait(unsigned int self, uint64_t cpumask)
+{
+	unsigned int cpu;
+
+	for (cpu = 0; cpu < DEFAULTS_MACHINE_MAX_CPUS; cpu++) {
+		if (cpumask & BIT_64(cpu))
+			__smp_call_sync(&ipi_cpus[self].calls[cpu]);
+	}
+}
+
+/* Run `func` here, as it would be run on the other cpus from the handler */
+static void __smp_call_local(smp_call_func_t func, void *info)
+{
+	uint64_t flags;
+
+	flags = machine_irq_save();
+	func(info);
+	machine_irq_restore(flags);
+}
+
+/**
+ * smp_call_function_many
+ *
+ * Run `func(info)` on each other online cpu in the mask, from their IPI
+ * handler. With `wait` set, return only once every one of them has returned.
+ * The calling cpu is never included, see on_each_cpu().
+*/
+void smp_call_function_many(uint64_t cpumask, smp_call_func_t func,
+		void *info, int wait)
+{
+	unsigned int self;
+
+	preempt_disable();
+	self = machine_get_cpu_num();
+
+	cpumask = __ipi_others(cpumask, self);
+	if (cpumask != 0) {
+		__ipi_might_wait(__func__);
+		__smp_call_send(self, cpumask, func, info, wait);
+		if (wait)
+			__smp_call_wait(self, cpumask);
+	}
+
+	preempt_enable();
+}
+
+void smp_call_function_single(unsigned int cpu, smp_call_func_t func,
+		void *info, int wait)
+{
+	preempt_disable();
+
+	if (cpu == machine_get_cpu_num())
+		__smp_call_local(func, info);
+	else
+		smp_call_function_many(BIT_64(cpu), func, info, wait);
+
+	preempt_enable();
+}
+
+void smp_call_function(smp_call_func_t func, void *info, int wait)
+{
+	smp_call_function_many(~0UL, func, info, wait);
+}
+
+/**
+ * on_each_cpu
+ *
+ * Run `func(info)` on every online cpu, this one included. The others are
+ * sent the call first, so they run it while we run our own copy.
+*/
+void on_each_cpu(smp_call_func_t func, void *info, int wait)
+{
+	unsigned int self;
+	uint64_t cpumask;
+
+	preempt_disable();
+	self = machine_get_cpu_num();
+
+	cpumask = __ipi_others(~0UL, self);
+	if (cpumask != 0) {
+		__ipi_might_wait(__func__);
+		__smp_call_send(self, cpumask, func, info, wait);
+	}
+
+	__smp_call_local(func, info);
+
+	if (cpumask != 0 && wait)
+		__smp_call_wait(self, cpumask);
+
+	preempt_enable();
+}
+
+/******************************************************************************
+ * Typed Messages
+ *****************************************************************************/
+
+void ipi_send(unsigned int cpu, ipi_type_t type)
+{
+	ipi_send_mask(BIT_64(cpu), type);
+}
+
+void ipi_send_mask(uint64_t cpumask, ipi_type_t type)
+{
+	__ipi_raise(cpumask & ipi_online_mask, type);
+}
+
+uint64_t ipi_online_cpus(void)
+{
+	return ipi_online_mask;
+}
+
+void smp_send_reschedule(unsigned int cpu)
+{
+	ipi_send(cpu, IPI_RESCHEDULE);
+}
+
+static inline void __ipi_tlb_flush_local(void)
+{
+	__asm__ volatile(
+		"	dsb		ishst\n"
+		"	tlbi	vmalle1\n"
+		"	dsb		nsh\n"
+		"	isb"
+		: : : "memory");
+}
+
+/* A flush covers every request made before it started */
+static void __ipi_tlb_flush(struct ipi_cpu *ipi)
+{
+	uint64_t req;
+
+	req = __atomic_load_n(&ipi->tlb_req, __ATOMIC_ACQUIRE);
+	__ipi_tlb_flush_local();
+	__atomic_store_n(&ipi->tlb_done, req, __ATOMIC_RELEASE);
+}
+
+/**
+ * smp_tlb_shootdown
+ *
+ * Invalidate the EL1 TLB of each cpu in the mask, returning once they all
+ * have. Page table updates use the inner shareable TLBI, which needs none of
+ * this; a shootdown is for invalidations a cpu can only make locally.
+ *
+ * Each request takes a ticket from the target's request counter, and is done
+ * once a flush that started after it completes. Requests from several cpus
+ * that arrive together are therefore covered by the same flush.
+*/
+void smp_tlb_shootdown(uint64_t cpumask)
+{
+	uint64_t seq[DEFAULTS_MACHINE_MAX_CPUS], done;
+	unsigned int self, cpu;
+
+	preempt_disable();
+	self = machine_get_cpu_num();
+
+	if (cpumask & BIT_64(self))
+		__ipi_tlb_flush_local();
+
+	cpumask = __ipi_others(cpumask, self);
+	if (cpumask == 0)
+		goto out;
+
+	__ipi_might_wait(__func__);
+
+	for (cpu = 0; cpu < DEFAULTS_MACHINE_MAX_CPUS; cpu++) {
+		if (cpumask & BIT_64(cpu))
+			seq[cpu] = atomic_fetch_add_64(&ipi_cpus[cpu].tlb_req, 1) + 1;
+	}
+
+	__ipi_raise(cpumask, IPI_TLB_SHOOTDOWN);
+
+	for (cpu = 0; cpu < DEFAULTS_MACHINE_MAX_CPUS; cpu++) {
+		if (!(cpumask & BIT_64(cpu)))
+			continue;
+
+		while ((done = __atomic_load_n(&ipi_cpus[cpu].tlb_done,
+				__ATOMIC_ACQUIRE)) < seq[cpu])
+			__cmpwait_64(&ipi_cpus[cpu].tlb_done, done);
+	}
+
+out:
+	preempt_enable();
+}
+
+static void __ipi_stop(struct ipi_cpu *ipi)
+{
+	machine_irq_mask_all();
+	__atomic_store_n(&ipi->stopped, 1, __ATOMIC_RELEASE);
+
+	for (;;)
+		__asm__ volatile ("wfi");
+}
+
+static void ipi_stop_nmi_handler(intid_t intid, arm64_exception_frame_t *frame,
+		void *data)
+{
+	__ipi_stop(&ipi_cpus[machine_get_cpu_num()]);
+}
+
+/**
+ * smp_send_stop
+ *
+ * Park every other cpu, for a panic. Sent as a pseudo-NMI where possible so
+ * that a cpu stuck with interrupts disabled stops too. This doesn't take any
+ * locks, and gives up waiting on cpus that don't respond.
+*/
+void smp_send_stop(void)
+{
+	uint64_t others, deadline;
+	unsigned int cpu;
+
+	others = __ipi_others(~0UL, machine_get_cpu_num());
+	if (others == 0)
+		return;
+
+	if (ipi_stop_nmi)
+		machine_send_interrupt_mask(DEFAULTS_KERNEL_IPI_STOP_SGI, others);
+	else
+		__ipi_raise(others, IPI_STOP);
+
+	deadline = clock_get_counter() +
+		clock_ns_to_cycles(DEFAULTS_KERNEL_IPI_STOP_TIMEOUT_MS * NSEC_PER_MSEC);
+
+	for (cpu = 0; cpu < DEFAULTS_MACHINE_MAX_CPUS; cpu++) {
+		if (!(others & BIT_64(cpu)))
+			continue;
+
+		while (!__atomic_load_n(&ipi_cpus[cpu].stopped, __ATOMIC_ACQUIRE) &&
+				clock_get_counter() < deadline)
+			cpu_relax();
+
+		if (!ipi_cpus[cpu].stopped)
+			pr_warn("cpu %d did not stop\n", cpu);
+	}
+}
+
+/******************************************************************************
+ * Handler
+ *****************************************************************************/
+
+static irq_return_t ipi_handler(intid_t intid, void *data)
+{
+	cpu_number_t cpu = machine_get_cpu_num();
+	struct ipi_cpu *ipi = &ipi_cpus[cpu];
+	uint32_t pending;
+
+	/**
+	 * Messages raised while we're here are handled on the next pass. Their
+	 * senders saw an empty mask and sent an SGI too, which finds nothing.
+	*/
+	while ((pending = atomic_xchg_32(&ipi->pending, 0)) != 0) {
+		if (pending & (1U << IPI_STOP))
+			__ipi_stop(ipi);
+
+		if (pending & (1U << IPI_TLB_SHOOTDOWN))
+			__ipi_tlb_flush(ipi);
+
+		if (pending & (1U << IPI_CALL_FUNC))
+			__smp_call_run(ipi);
+
+		/* acted on by the reschedule check as the interrupt returns */
+		if (pending & (1U << IPI_RESCHEDULE))
+			cpu_set_flag(cpu, CPU_FLAG_NEED_RESCHED);
+	}
+
+	return IRQ_HANDLED;
+}
+
+/**
+ * ipi_init
+ *
+ * Register the IPI handlers on the calling cpu and mark it as a target. Each
+ * cpu calls this once its interrupt controller interface is up.
+*/
+kern_return_t ipi_init(void)
+{
+	cpu_number_t cpu = machine_get_cpu_num();
+
+	if (machine_register_interrupt(DEFAULTS_KERNEL_IPI_SGI,
+			IRQ_PRIORITY_CRITICAL, ipi_handler, NULL) != KERN_RETURN_SUCCESS) {
+		pr_err("failed to register IPI handler\n");
+		return KERN_RETURN_FAIL;
+	}
+
+	if (machine_irq_nmi_enabled() &&
+			machine_register_nmi(DEFAULTS_KERNEL_IPI_STOP_SGI,
+				ipi_stop_nmi_handler, NULL) == KERN_RETURN_SUCCESS)
+		ipi_stop_nmi = 1;
+
+	atomic_fetch_or_64(&ipi_online_mask, BIT_64(cpu));
+
+	pr_info("cpu %d: IPIs on SGI %d, stop as %s\n", cpu,
+		(int) DEFAULTS_KERNEL_IPI_SGI, ipi_stop_nmi ? "NMI" : "IRQ");
+	return KERN_RETURN_SUCCESS;
+}
@@ -0,0 +1,91 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	ipi.h
+ * Desc:	Inter-processor interrupts. Every message type shares one SGI: the
+ * 			sender sets the type in the target's pending mask and only raises
+ * 			the SGI if the mask was empty, so messages sent while the target
+ * 			hasn't yet taken the interrupt are batched into it. Function calls
+ * 			go on a lock-free per-cpu queue that the handler drains in one go.
+ *
+ * 			Waiting for another cpu with interrupts disabled can deadlock with
+ * 			a cpu waiting for us, so function calls and shootdowns to other
+ * 			cpus panic if made with interrupts disabled or from a handler.
+*/
+
+#ifndef __KERN_IPI_H__
+#define __KERN_IPI_H__
+
+#include <tinylibc/stdint.h>
+
+#include <libkern/types.h>
+#include <kern/defaults.h>
+
+/* Message types, as bits in each cpu's pending mask */
+typedef enum ipi_type {
+	IPI_RESCHEDULE = 0,
+	IPI_CALL_FUNC,
+	IPI_TLB_SHOOTDOWN,
+	IPI_STOP,
+
+	IPI_NR,
+} ipi_type_t;
+
+typedef void (*smp_call_func_t) (void *info);
+
+/**
+ * A queued function call. Each cpu has one per target, which is reused once
+ * the previous call through it has run.
+*/
+struct smp_call {
+	struct smp_call		*next;
+	smp_call_func_t		func;
+	void				*info;
+	volatile uint32_t	flags;
+};
+
+#define SMP_CALL_LOCKED		(1 << 0)	/* queued or running */
+#define SMP_CALL_WAIT		(1 << 1)	/* sender waits for it to return */
+
+/* Initialise IPIs for the calling cpu */
+extern kern_return_t ipi_init(void);
+
+/* Raw messages */
+extern void ipi_send(unsigned int cpu, ipi_type_t type);
+extern void ipi_send_mask(uint64_t cpumask, ipi_type_t type);
+extern uint64_t ipi_online_cpus(void);
+
+/* Function calls */
+extern void smp_call_function_single(unsigned int cpu, smp_call_func_t func,
+		void *info, int wait);
+extern void smp_call_function_many(uint64_t cpumask, smp_call_func_t func,
+		void *info, int wait);
+extern void smp_call_function(smp_call_func_t func, void *info, int wait);
+extern void on_each_cpu(smp_call_func_t func, void *info, int wait);
+
+/* Typed messages */
+extern void smp_send_reschedule(unsigned int cpu);
+extern void smp_tlb_shootdown(uint64_t cpumask);
+extern void smp_send_stop(void);
+
+#endif /* __kern_ipi_h__ */
@@ -28,6 +28,20 @@ KERNEL_SOURCES	+=	kern/main.o						\
 					kern/sched.o					\
 					kern/machine.o					\
 					kern/panic.o					\
+					kern/watchdog.o					\
+					kern/timer.o					\
+					kern/clock.o					\
+					kern/static_key.o				\
+					kern/cpufeature.o				\
+					kern/alternative.o				\
+					kern/spinlock.o					\
+					kern/mutex.o					\
+					kern/semaphore.o				\
+					kern/ipi.o						\
+					kern/ksym.o						\
+					kern/bench/bench.o				\
+					kern/bench/bench_irq.o			\
+					kern/bench/bench_mem.o			\
 					kern/mm/zalloc.o				\
 					kern/mm/stack.o					\
 					kern/vm/vm.o					\
@@ -35,5 +49,15 @@ KERNEL_SOURCES	+=	kern/main.o						\
 					kern/vm/vm_map.o				\
 					kern/vm/pmap.o					\
 					kern/trace/printk.o				\
+					kern/trace/printk_ringbuffer.o	\
+					kern/trace/blog.o				\
+					kern/trace/trace.o				\
+					kern/trace/trace_events.o		\
+					kern/trace/dyndbg.o				\
+					kern/trace/fgraph.o				\
+					kern/trace/profile.o			\
 					kern/machine/machine_timer.o	\
+					kern/machine/machine_patch.o	\
+					kern/machine/machine_pmu.o		\
+					kern/machine/machine_fpsimd.o	\
 					kern/machine/machine-irq.o
@@ -0,0 +1,118 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	ksym.c
+ * Desc:	Kernel symbol table lookup. See ksym.h.
+*/
+
+#include <kern/ksym.h>
+
+#include <tinylibc/string.h>
+#include <tinylibc/stdio.h>
+
+/**
+ * The table, generated into kern/ksym_table.S. Symbols are sorted by address,
+ * and stored as 32-bit offsets from ksym_base. The first link has an empty
+ * table, and as only .text symbols are recorded, and the table comes after
+ * .text, its size in the second link can't move them.
+*/
+extern const uint64_t ksym_base;
+extern const uint32_t ksym_nr;
+extern const uint32_t ksym_offsets[];
+extern const uint32_t ksym_markers[];
+extern const uint8_t ksym_names[];
+
+/* from the linker script */
+extern char __text_start[];
+extern char __text_end[];
+
+/* decode the name of symbol `idx`, starting from the marker before it */
+static void __ksym_name(uint32_t idx, char *buf, size_t len)
+{
+	char name[KSYM_NAME_MAX];
+	const uint8_t *p;
+	unsigned int prefix, n;
+	uint32_t i;
+
+	p = ksym_names + ksym_markers[idx / KSYM_MARKER_STRIDE];
+	for (i = idx - (idx % KSYM_MARKER_STRIDE); ; i++) {
+		prefix = p[0];
+		n = p[1];
+		memcpy(name + prefix, p + 2, n);
+		name[prefix + n] = '\0';
+		p += 2 + n;
+
+		if (i == idx)
+			break;
+	}
+	strlcpy(buf, name, len);
+}
+
+/**
+ * ksym_lookup
+ *
+ * Find the function containing `addr`, writing its name to `name` and the
+ * offset of `addr` into it to `offset`. Fails if `addr` isn't in the kernel's
+ * text, or comes before its first symbol.
+*/
+kern_return_t ksym_lookup(vm_address_t addr, char *name, size_t len,
+		vm_offset_t *offset)
+{
+	uint32_t lo, hi, mid, target;
+
+	if (ksym_nr == 0 || addr < (vm_address_t) __text_start ||
+			addr >= (vm_address_t) __text_end || addr < ksym_base)
+		return KERN_RETURN_FAIL;
+
+	/* the last symbol starting at or below the address */
+	target = (uint32_t) (addr - ksym_base);
+	lo = 0;
+	hi = ksym_nr;
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (ksym_offsets[mid] <= target)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	__ksym_name(lo, name, len);
+	if (offset)
+		*offset = target - ksym_offsets[lo];
+	return KERN_RETURN_SUCCESS;
+}
+
+/**
+ * ksym_snprint
+ *
+ * Format `addr` as "name+0x1c", or as a bare address if it can't be named.
+*/
+int ksym_snprint(char *buf, size_t len, vm_address_t addr)
+{
+	char name[KSYM_NAME_MAX];
+	vm_offset_t offset;
+
+	if (ksym_lookup(addr, name, sizeof (name), &offset) != KERN_RETURN_SUCCESS)
+		return snprintf(buf, len, "0x%llx", addr);
+	return snprintf(buf, len, "%s+0x%llx", name, offset);
+}
@@ -0,0 +1,58 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	ksym.h
+ * Desc:	Kernel symbol table. The build links the kernel twice, and
+ * 			scripts/ksym_gen.py turns the function symbols of the first link
+ * 			into a table that's linked into the second, so addresses can be
+ * 			named at runtime without the ELF.
+*/
+
+#ifndef __KERN_KSYM_H__
+#define __KERN_KSYM_H__
+
+#include <tinylibc/stdint.h>
+#include <tinylibc/stddef.h>
+
+#include <libkern/types.h>
+#include <kern/vm/vm_types.h>
+
+/* longest name kept, including the terminator */
+#define KSYM_NAME_MAX				128
+
+/**
+ * Names are prefix compressed against the one before, and every
+ * KSYM_MARKER_STRIDE names is written in full, with its offset in the names
+ * blob recorded, so a lookup only decodes from the nearest marker. Must match
+ * scripts/ksym_gen.py.
+*/
+#define KSYM_MARKER_STRIDE			16
+
+/* formatted "name+0x1c", or the bare address if it's not in the kernel's text */
+#define KSYM_STRING_MAX				(KSYM_NAME_MAX + 20)
+
+extern kern_return_t ksym_lookup(vm_address_t addr, char *name, size_t len,
+	vm_offset_t *offset);
+extern int ksym_snprint(char *buf, size_t len, vm_address_t addr);
+
+#endif /* __kern_ksym_h__ */
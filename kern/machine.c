@@ -26,6 +26,10 @@
 #include <platform/devicetree.h>
 #include <libkern/assert.h>
 
+#if DEFAULTS_SET(DEFAULTS_PLAT_STATIC)
+#include <platform/platform_static.h>
+#endif
+
 #include <tinylibc/byteswap.h>
 #include <tinylibc/string.h>
 
@@ -91,6 +95,57 @@ char *machine_get_name()
 	return machine;
 }
 
+#if DEFAULTS_SET(DEFAULTS_PLAT_STATIC)
+/**
+ *	machine_static_cpu_topology
+ *
+ *	Build the topology from the platform header rather than the device tree.
+ *	The table is in cpu-map order, so logical ids are assigned the same way.
+ */
+static kern_return_t machine_static_cpu_topology(cpu_number_t boot_cpu)
+{
+	_Static_assert(PLATFORM_STATIC_NUM_CPUS <= DEFAULTS_MACHINE_MAX_CPUS,
+		"too many cpus in the platform header");
+	_Static_assert(PLATFORM_STATIC_NUM_CLUSTERS <= DEFAULTS_MACHINE_MAX_CPU_CLUSTERS,
+		"too many clusters in the platform header");
+
+	for (unsigned int i = 0; i < PLATFORM_STATIC_NUM_CLUSTERS; i++) {
+		clusters[i].cluster_id = i;
+		clusters[i].num_cpus = 0;
+	}
+
+	for (unsigned int i = 0; i < PLATFORM_STATIC_NUM_CPUS; i++) {
+		const struct platform_cpu *pcpu = &platform_static_cpus[i];
+		machine_topology_cluster_t *cluster = &clusters[pcpu->cluster_id];
+
+		if (cluster->num_cpus == 0)
+			cluster->first_cpu_id = i;
+		cluster->num_cpus += 1;
+		cluster->cpu_mask |= (1ULL << i);
+
+		cpus[i].cpu_id = i;
+		cpus[i].cpu_phys_id = pcpu->phys_id;
+		cpus[i].cluster_id = pcpu->cluster_id;
+
+		if (pcpu->phys_id == boot_cpu) {
+			topology_info.boot_cpu = &cpus[i];
+			topology_info.boot_cluster = cluster;
+		}
+	}
+
+	topology_info.num_cpus = PLATFORM_STATIC_NUM_CPUS;
+	topology_info.num_clusters = PLATFORM_STATIC_NUM_CLUSTERS;
+	topology_info.max_cpu_id = PLATFORM_STATIC_NUM_CPUS - 1;
+	topology_info.max_cluster_id = PLATFORM_STATIC_NUM_CLUSTERS - 1;
+	topology_info.clusters = clusters;
+	topology_info.cpus = cpus;
+
+	assert(topology_info.boot_cpu != NULL);
+
+	return KERN_RETURN_SUCCESS;
+}
+#endif
+
 kern_return_t machine_parse_cpu_topology(void)
 {
 	DTNode parent, node, subnode;
@@ -103,6 +158,10 @@ kern_return_t machine_parse_cpu_topology(void)
 	/* the cpu topology should only ever be called on the boot cpu */
 	boot_cpu = MPIDR_TO_CPU_NUM(sysreg_read(mpidr_el1));
 
+#if DEFAULTS_SET(DEFAULTS_PLAT_STATIC)
+	return machine_static_cpu_topology(boot_cpu);
+#endif
+
 	/**
 	 * the following is a workaround for an issue with libfdt. once the kernel
 	 * is running with KVAs, meaning in high memory, when libfdt tries to do
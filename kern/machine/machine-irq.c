@@ -25,6 +25,8 @@
  * 	Desc:	Kernel Machine Interface.
  */
 
+#define pr_fmt(fmt)	"irq: " fmt
+
 #include <arch/arch.h>
 
 #include <kern/defaults.h>
@@ -34,48 +36,67 @@
 
 #include <kern/vm/pmap.h>
 
+#include <kern/thread.h>
+#include <kern/task.h>
+#include <kern/trace/events.h>
+
 #include <drivers/irq/irq-gicv3.h>
+#include <platform/platform.h>
+
+#include <tinylibc/string.h>
+#include <tinylibc/stdio.h>
+
+/**
+ * Interrupt descriptor table, indexed by INTID. SGIs and PPIs are banked per
+ * CPU in the GIC, but share a descriptor here, their counts are still kept
+ * per-CPU.
+*/
+static struct irq_desc		irq_descs[DEFAULTS_MACHINE_MAX_IRQS];
+
 
+#if DEFAULTS_SET(DEFAULTS_MACHINE_IRQ_PSEUDO_NMI)
+/* set once the CPU interface is up and the PMR can be used for masking */
+static int irq_pseudo_nmi_active = 0;
+
+/**
+ * machine_irq_nmi_init
+ *
+ * Switch the current CPU over to masking interrupts through the PMR. This is
+ * called during boot with PSTATE.I set, so the PMR starts out masked and the
+ * first machine_irq_enable() opens both.
+*/
+static void machine_irq_nmi_init(void)
+{
+	cpu_t *cpu = cpu_get_current();
+
+	cpu->interrupt_pmr = IRQ_PRIORITY_MASK_NONE;
+	gic_cpu_set_pmr(IRQ_PRIORITY_IRQ_OFF);
+	irq_pseudo_nmi_active = 1;
+
+	pr_info("pseudo-NMI enabled, masking interrupts via ICC_PMR_EL1\n");
+}
+#endif
 
 kern_return_t machine_init_interrupts()
 {
 	vm_address_t gic_region_virt_base, gicd_virt_base, gicr_virt_base;
-	phys_addr_t gic_region_base, gicd_phys_base, gicr_phys_base;
-	uint64_t gicd_size, gicr_size;
+	struct platform_gicv3 gic;
+	kern_return_t ret;
 
 	/**
-	 * TODO:	Read the base addresses from the device tree
-	 * 
-	 * Currently we're manually setting these addresses. This needs to move to
-	 * reading them from the device tree, and even using the device tree to look
-	 * at what interrupt controller is actually present - it might not be gic,
-	 * although that's all that is supported atm.
-	 * 
-	 * The DT node for gic looks like this:
-	 * 
-	 * intc@8000000 {
-	 *	compatible = "arm,gic-v3";
-	 *	#interrupt-cells = <0x03>;
-	 *	#address-cells = <0x02>;
-	 *	#size-cells = <0x02>;
-	 *	ranges;
-	 *	interrupt-controller;
-	 *	reg = 	<0x00 0x8000000 0x00 0x10000>,	// GICD
-	 *			<0x00 0x80a0000 0x00 0xf60000>;	// GICR
-	 *	...
-	 * }
+	 * The distributor and redistributors come from the device tree, or the
+	 * platform header. Only GICv3 is supported, so anything else is fatal.
+	 * Both are mapped into one window, at the same distance apart as they are
+	 * physically.
 	*/
+	ret = platform_get_gicv3(&gic);
+	assert(ret == KERN_RETURN_SUCCESS);
+	assert(gic.gicr_base > gic.gicd_base);
 
 	gic_region_virt_base = 0xffffffff11000000;
-	gic_region_base = (phys_addr_t) 0x8000000;
-
-	gicd_virt_base = (vm_address_t) (gic_region_virt_base + 0x0);
-	gicd_phys_base = (phys_addr_t) (gic_region_base + 0x0);
-	gicd_size = 0x10000;
 
-	gicr_virt_base = (vm_address_t) (gic_region_virt_base + 0xa0000);
-	gicr_phys_base = (phys_addr_t) (gic_region_base + 0xa0000);
-	gicr_size = 0xf60000;
+	gicd_virt_base = (vm_address_t) gic_region_virt_base;
+	gicr_virt_base = (vm_address_t) (gic_region_virt_base + (gic.gicr_base - gic.gicd_base));
 
 	/**
 	 * TODO: 	Use proper mapping api
@@ -87,29 +108,539 @@ kern_return_t machine_init_interrupts()
 	 * or whatever the api ends up being, rather than directly calling the pmap
 	 * api.
 	*/
-	pmap_tt_create_tte(kernel_tte, gicd_phys_base, gicd_virt_base, gicd_size, PMAP_ACCESS_READWRITE);
-	pmap_tt_create_tte(kernel_tte, gicr_phys_base, gicr_virt_base, gicr_size, PMAP_ACCESS_READWRITE);
+	pmap_tt_create_tte(kernel_tte, gic.gicd_base, gicd_virt_base, gic.gicd_size, PMAP_ACCESS_READWRITE);
+	pmap_tt_create_tte(kernel_tte, gic.gicr_base, gicr_virt_base, gic.gicr_size, PMAP_ACCESS_READWRITE);
 
 	gic_interface_init(gicd_virt_base, gicr_virt_base);
+
+#if DEFAULTS_SET(DEFAULTS_MACHINE_IRQ_PSEUDO_NMI)
+	machine_irq_nmi_init();
+#endif
 	return KERN_RETURN_SUCCESS;
 }
 
+int machine_irq_nmi_enabled(void)
+{
+#if DEFAULTS_SET(DEFAULTS_MACHINE_IRQ_PSEUDO_NMI)
+	return irq_pseudo_nmi_active;
+#else
+	return 0;
+#endif
+}
+
 void machine_irq_enable()
 {
+#if DEFAULTS_SET(DEFAULTS_MACHINE_IRQ_PSEUDO_NMI)
+	if (irq_pseudo_nmi_active)
+		gic_cpu_set_pmr(cpu_get_current()->interrupt_pmr);
+#endif
 	__asm__ volatile("msr daifclr, #2" : : : "memory");
 }
 
 void machine_irq_disable()
 {
+#if DEFAULTS_SET(DEFAULTS_MACHINE_IRQ_PSEUDO_NMI)
+	if (irq_pseudo_nmi_active) {
+		gic_cpu_set_pmr(IRQ_PRIORITY_IRQ_OFF);
+		return;
+	}
+#endif
 	__asm__ volatile("msr daifset, #2" : : : "memory");
 }
 
-kern_return_t machine_register_interrupt(uint32_t intid, uint32_t priority)
+/**
+ * machine_irq_disabled
+ *
+ * Whether interrupts are disabled on this CPU, by PSTATE.I or, with pseudo-NMIs,
+ * by the PMR.
+*/
+int machine_irq_disabled(void)
+{
+	if (sysreg_read(daif) & DAIF_MASK_IRQ)
+		return 1;
+
+#if DEFAULTS_SET(DEFAULTS_MACHINE_IRQ_PSEUDO_NMI)
+	if (irq_pseudo_nmi_active)
+		return gic_cpu_get_pmr() <= IRQ_PRIORITY_IRQ_OFF;
+#endif
+	return 0;
+}
+
+/**
+ * machine_irq_mask_all
+ *
+ * Mask every interrupt, including pseudo-NMIs. Only meant for paths which are
+ * never going to unmask again, i.e. panic.
+*/
+void machine_irq_mask_all(void)
+{
+	__asm__ volatile("msr daifset, #2" : : : "memory");
+}
+
+struct irq_desc *machine_irq_get_desc(intid_t intid)
+{
+	if (intid >= DEFAULTS_MACHINE_MAX_IRQS)
+		return NULL;
+	return &irq_descs[intid];
+}
+
+/**
+ * machine_irq_save
+ *
+ * Disable interrupts, returning the previous state for machine_irq_restore().
+ * With pseudo-NMIs the state is the PMR, otherwise it's DAIF.
+*/
+uint64_t machine_irq_save(void)
+{
+	uint64_t flags;
+
+#if DEFAULTS_SET(DEFAULTS_MACHINE_IRQ_PSEUDO_NMI)
+	if (irq_pseudo_nmi_active) {
+		flags = gic_cpu_get_pmr();
+		machine_irq_disable();
+		return flags;
+	}
+#endif
+	flags = sysreg_read(daif);
+	machine_irq_disable();
+
+	return flags;
+}
+
+void machine_irq_restore(uint64_t flags)
+{
+#if DEFAULTS_SET(DEFAULTS_MACHINE_IRQ_PSEUDO_NMI)
+	/**
+	 * PSTATE.I is always clear outside of the exception entry and exit paths,
+	 * but a thread can be switched back in from an interrupt's exit path, where
+	 * it's still set.
+	*/
+	if (irq_pseudo_nmi_active) {
+		gic_cpu_set_pmr((uint32_t) flags);
+		__asm__ volatile("msr daifclr, #2" : : : "memory");
+		return;
+	}
+#endif
+	sysreg_write(daif, flags);
+}
+
+uint32_t machine_irq_running_priority(void)
 {
-	return gic_irq_register(intid, priority);
+	return gic_cpu_running_priority();
+}
+
+/**
+ * machine_irq_priority_raise
+ *
+ * Mask interrupts at or below `priority`, leaving more urgent ones able to
+ * preempt. The PMR is never lowered, so a nested raise from a more urgent
+ * handler can't unmask anything. Returns the previous mask.
+ *
+ * With pseudo-NMIs the PMR is also how interrupts are disabled, so instead
+ * this raises the value machine_irq_enable() will write to it.
+*/
+uint32_t machine_irq_priority_raise(uint32_t priority)
+{
+	uint32_t pmr;
+
+#if DEFAULTS_SET(DEFAULTS_MACHINE_IRQ_PSEUDO_NMI)
+	if (irq_pseudo_nmi_active) {
+		cpu_t *cpu = cpu_get_current();
+
+		pmr = cpu->interrupt_pmr;
+		if (priority < pmr)
+			cpu->interrupt_pmr = priority;
+		return pmr;
+	}
+#endif
+	pmr = gic_cpu_get_pmr();
+	if (priority < pmr)
+		gic_cpu_set_pmr(priority);
+
+	return pmr;
+}
+
+/**
+ * machine_irq_priority_restore
+ *
+ * Restore the mask returned by machine_irq_priority_raise(). With pseudo-NMIs
+ * this is on the way out of an interrupt, so PSTATE.I is set first to stop an
+ * interrupt being taken before the eret, which clears it again.
+*/
+void machine_irq_priority_restore(uint32_t pmr)
+{
+#if DEFAULTS_SET(DEFAULTS_MACHINE_IRQ_PSEUDO_NMI)
+	if (irq_pseudo_nmi_active) {
+		__asm__ volatile("msr daifset, #2" : : : "memory");
+		cpu_get_current()->interrupt_pmr = pmr;
+	}
+#endif
+	gic_cpu_set_pmr(pmr);
+}
+
+static kern_return_t __machine_register_interrupt(struct irq_desc *desc,
+		uint32_t priority, uint32_t flags, irq_handler_t handler,
+		irq_handler_t thread_fn, struct thread *thread, void *data)
+{
+	/* the handlers must be in place before the GIC enables the interrupt */
+	desc->priority = priority;
+	desc->handler = handler;
+	desc->thread_fn = thread_fn;
+	desc->thread = thread;
+	desc->data = data;
+	desc->target_cpu = machine_get_cpu_num();
+	desc->flags = IRQ_FLAG_REGISTERED | flags;
+
+	if (gic_irq_register(desc->irq, priority) != KERN_RETURN_SUCCESS) {
+		desc->flags = 0;
+		return KERN_RETURN_FAIL;
+	}
+
+	return KERN_RETURN_SUCCESS;
+}
+
+kern_return_t machine_register_interrupt(intid_t intid, uint32_t priority,
+		irq_handler_t handler, void *data)
+{
+	struct irq_desc *desc;
+
+	desc = machine_irq_get_desc(intid);
+	if (desc == NULL) {
+		pr_err("cannot register INTID '%d': out of range\n", intid);
+		return KERN_RETURN_FAIL;
+	}
+
+	desc->irq = intid;
+	desc->nmi_handler = NULL;
+	return __machine_register_interrupt(desc, priority, 0, handler, NULL,
+		NULL, data);
+}
+
+/**
+ * machine_register_nmi
+ *
+ * Register an interrupt to be delivered as a pseudo-NMI. It's given the most
+ * urgent priority, which is the only one left unmasked while interrupts are
+ * disabled, so this is only possible in pseudo-NMI mode.
+*/
+kern_return_t machine_register_nmi(intid_t intid, nmi_handler_t handler,
+		void *data)
+{
+	struct irq_desc *desc;
+
+	desc = machine_irq_get_desc(intid);
+	if (desc == NULL || handler == NULL) {
+		pr_err("cannot register NMI '%d'\n", intid);
+		return KERN_RETURN_FAIL;
+	}
+
+	if (!machine_irq_nmi_enabled()) {
+		pr_warn("cannot register NMI '%d': pseudo-NMI not enabled\n", intid);
+		return KERN_RETURN_FAIL;
+	}
+
+	desc->irq = intid;
+	desc->nmi_handler = handler;
+	return __machine_register_interrupt(desc, IRQ_PRIORITY_NMI,
+		IRQ_FLAG_NMI | IRQ_FLAG_AFFINITY_PINNED, NULL, NULL, NULL, data);
+}
+
+/**
+ * machine_irq_thread
+ *
+ * Body of the handler thread for a threaded interrupt. The top half leaves the
+ * interrupt active, so it can't be signalled again until the threaded handler
+ * has finished and the interrupt is deactivated here.
+*/
+static void machine_irq_thread(void *arg)
+{
+	struct irq_desc *desc = (struct irq_desc *) arg;
+
+	while (1) {
+		thread_wait();
+
+		desc->thread_fn(desc->irq, desc->data);
+		machine_irq_deactivate(desc->irq);
+	}
+}
+
+/**
+ * machine_register_threaded_interrupt
+ *
+ * Register an interrupt whose handling is split in two. `handler` runs in
+ * interrupt context, and may be NULL, in which case the thread is always woken.
+ * If it returns IRQ_WAKE_THREAD, `thread_fn` is run in a dedicated kernel
+ * thread named "irq/<intid>". Must be called once threads are available.
+*/
+kern_return_t machine_register_threaded_interrupt(intid_t intid,
+		uint32_t priority, irq_handler_t handler, irq_handler_t thread_fn,
+		void *data)
+{
+	char name[THREAD_NAME_MAX_LEN];
+	struct irq_desc *desc;
+	thread_t *thread;
+
+	desc = machine_irq_get_desc(intid);
+	if (desc == NULL || thread_fn == NULL) {
+		pr_err("cannot register threaded INTID '%d'\n", intid);
+		return KERN_RETURN_FAIL;
+	}
+
+	snprintf(name, sizeof (name), "irq/%u", intid);
+
+	thread = thread_create(kernel_task, THREAD_PRIORITY_MAX,
+		(thread_entry_t) machine_irq_thread, name);
+	if (thread == THREAD_NULL)
+		return KERN_RETURN_FAIL;
+
+	thread->args = desc;
+	desc->irq = intid;
+	desc->nmi_handler = NULL;
+
+	return __machine_register_interrupt(desc, priority, IRQ_FLAG_THREADED,
+		handler, thread_fn, thread, data);
+}
+
+kern_return_t machine_irq_set_trigger(intid_t intid, uint32_t trigger)
+{
+	return gic_irq_set_trigger(intid, trigger);
+}
+
+/**
+ * machine_irq_set_affinity
+ *
+ * Route an SPI to a given CPU. An explicitly set affinity is treated as a
+ * request from the driver, so the balancer will leave the interrupt alone.
+*/
+kern_return_t machine_irq_set_affinity(intid_t intid, unsigned int cpu)
+{
+	struct irq_desc *desc;
+
+	desc = machine_irq_get_desc(intid);
+	if (desc == NULL || !MACHINE_IRQ_IS_SPI(intid))
+		return KERN_RETURN_FAIL;
+
+	if (gic_irq_set_affinity(intid, cpu) != KERN_RETURN_SUCCESS)
+		return KERN_RETURN_FAIL;
+
+	desc->target_cpu = cpu;
+	desc->flags |= IRQ_FLAG_AFFINITY_PINNED;
+	return KERN_RETURN_SUCCESS;
 }
 
 void machine_send_interrupt(uint32_t intid, uint32_t target)
 {
 	gic_send_sgi(intid, target);
-}
\ No newline at end of file
+}
+
+/* Send an SGI to each logical cpu in `cpumask` */
+void machine_send_interrupt_mask(uint32_t intid, uint64_t cpumask)
+{
+	gic_send_sgi_mask(intid, cpumask);
+}
+
+/* Send an SGI to every cpu but this one */
+void machine_send_interrupt_others(uint32_t intid)
+{
+	gic_send_sgi_others(intid);
+}
+
+intid_t machine_irq_acknowledge(void)
+{
+	return gic_irq_acknowledge();
+}
+
+void machine_irq_eoi(intid_t intid)
+{
+	gic_irq_eoi(intid);
+}
+
+void machine_irq_deactivate(intid_t intid)
+{
+	gic_irq_deactivate(intid);
+}
+
+/**
+ * machine_handle_interrupt
+ *
+ * Dispatch an acknowledged interrupt to its registered handler, and account
+ * for it on the current CPU. The running priority has already been dropped, so
+ * the interrupt is deactivated here once it's been handled, unless it has been
+ * passed on to its handler thread. Interrupts without a handler are disabled
+ * so a level-triggered source can't keep firing.
+*/
+void machine_handle_interrupt(intid_t intid)
+{
+	struct irq_desc *desc;
+	unsigned int source;
+	irq_return_t ret;
+	cpu_t *cpu;
+
+	cpu = cpu_get_current();
+	source = cpu->interrupt_source;
+	cpu->interrupt_source = intid;
+	cpu->interrupt_count += 1;
+
+	trace_irq_entry(intid);
+
+	ret = IRQ_NONE;
+	desc = machine_irq_get_desc(intid);
+	if (desc == NULL || !(desc->flags & IRQ_FLAG_REGISTERED) ||
+			(desc->handler == NULL && !(desc->flags & IRQ_FLAG_THREADED))) {
+		pr_warn("no handler for INTID '%d', disabling\n", intid);
+		gic_irq_disable(intid);
+		machine_irq_deactivate(intid);
+		goto out;
+	}
+
+	desc->count[cpu->cpu_num] += 1;
+
+	ret = (desc->handler != NULL) ? desc->handler(intid, desc->data) :
+		IRQ_WAKE_THREAD;
+
+	/* the handler thread deactivates the interrupt once it's done */
+	if (ret == IRQ_WAKE_THREAD && (desc->flags & IRQ_FLAG_THREADED)) {
+		thread_wakeup(desc->thread);
+		cpu_set_flag(cpu->cpu_num, CPU_FLAG_NEED_RESCHED);
+		goto out;
+	}
+
+	if (ret == IRQ_NONE)
+		desc->spurious += 1;
+
+	machine_irq_deactivate(intid);
+
+out:
+	trace_irq_exit(intid, ret);
+
+	/* restore the source of the interrupt this one may have preempted */
+	cpu->interrupt_source = source;
+}
+
+int machine_irq_is_nmi(intid_t intid)
+{
+	struct irq_desc *desc;
+
+	desc = machine_irq_get_desc(intid);
+	return (desc != NULL && (desc->flags & IRQ_FLAG_NMI));
+}
+
+/**
+ * machine_handle_nmi
+ *
+ * Dispatch an acknowledged pseudo-NMI. This can interrupt code that has
+ * interrupts disabled, so unlike machine_handle_interrupt() it doesn't touch the
+ * CPU's interrupt state, and runs with everything masked until it returns.
+*/
+void machine_handle_nmi(intid_t intid, arm64_exception_frame_t *frame)
+{
+	struct irq_desc *desc = &irq_descs[intid];
+
+	cpu_t *cpu = cpu_get_current();
+
+	machine_irq_eoi(intid);
+
+	cpu->interrupt_nmi_nesting += 1;
+	desc->count[cpu->cpu_num] += 1;
+	desc->nmi_handler(intid, frame, desc->data);
+	cpu->interrupt_nmi_nesting -= 1;
+
+	machine_irq_deactivate(intid);
+}
+
+/**
+ * machine_irq_in_nmi
+ *
+ * Whether the current cpu is running a pseudo-NMI handler. Code that can be
+ * reached from one, like printk, uses this to avoid anything that relies on
+ * masking interrupts.
+*/
+int machine_irq_in_nmi(void)
+{
+	return cpu_get_current()->interrupt_nmi_nesting != 0;
+}
+
+/**
+ * machine_irq_balance
+ *
+ * Spread SPIs across the online CPUs using the per-CPU delivery counts. Each
+ * pass measures how many interrupts every SPI raised since the previous pass,
+ * sums those onto the CPU the SPI is currently routed to, and then moves at
+ * most one SPI from the busiest CPU to the least busy one. The SPI is chosen
+ * so that the gap between the two CPUs shrinks the most, and moving a single
+ * interrupt per pass keeps the routing from oscillating.
+*/
+void machine_irq_balance(void)
+{
+	uint64_t load[DEFAULTS_MACHINE_MAX_CPUS];
+	struct irq_desc *desc, *candidate;
+	uint64_t total, imbalance, gap, best_gap;
+	unsigned int cpu, busiest, idlest;
+	intid_t intid;
+
+	memset(load, 0, sizeof(load));
+
+	for (intid = MACHINE_IRQ_SPI_BASE; intid < DEFAULTS_MACHINE_MAX_IRQS; intid++) {
+		desc = &irq_descs[intid];
+		if (!(desc->flags & IRQ_FLAG_REGISTERED))
+			continue;
+
+		total = 0;
+		for (cpu = 0; cpu < DEFAULTS_MACHINE_MAX_CPUS; cpu++)
+			total += desc->count[cpu];
+
+		desc->balance_delta = total - desc->balance_snapshot;
+		desc->balance_snapshot = total;
+		load[desc->target_cpu] += desc->balance_delta;
+	}
+
+	/* only CPUs which have brought up their GIC interface can take SPIs */
+	busiest = idlest = DEFAULTS_MACHINE_MAX_CPUS;
+	for (cpu = 0; cpu < DEFAULTS_MACHINE_MAX_CPUS; cpu++) {
+		if (!gic_cpu_online(cpu))
+			continue;
+		if (busiest == DEFAULTS_MACHINE_MAX_CPUS || load[cpu] > load[busiest])
+			busiest = cpu;
+		if (idlest == DEFAULTS_MACHINE_MAX_CPUS || load[cpu] < load[idlest])
+			idlest = cpu;
+	}
+
+	if (busiest == idlest || busiest == DEFAULTS_MACHINE_MAX_CPUS)
+		return;
+
+	imbalance = load[busiest] - load[idlest];
+	if (imbalance < DEFAULTS_MACHINE_IRQ_BALANCE_MIN)
+		return;
+
+	/**
+	 * Moving an SPI with delta d changes the gap to |imbalance - 2d|, so only
+	 * SPIs with 0 < d < imbalance improve things. Pick the one closest to half.
+	*/
+	candidate = NULL;
+	best_gap = imbalance;
+	for (intid = MACHINE_IRQ_SPI_BASE; intid < DEFAULTS_MACHINE_MAX_IRQS; intid++) {
+		desc = &irq_descs[intid];
+		if (!(desc->flags & IRQ_FLAG_REGISTERED) ||
+				(desc->flags & IRQ_FLAG_AFFINITY_PINNED) ||
+				desc->target_cpu != busiest || desc->balance_delta == 0)
+			continue;
+
+		gap = (imbalance > 2 * desc->balance_delta) ?
+			imbalance - 2 * desc->balance_delta :
+			2 * desc->balance_delta - imbalance;
+
+		if (gap < best_gap) {
+			best_gap = gap;
+			candidate = desc;
+		}
+	}
+
+	if (candidate == NULL)
+		return;
+
+	if (gic_irq_set_affinity(candidate->irq, idlest) == KERN_RETURN_SUCCESS) {
+		pr_debug("moved INTID '%d' from cpu%d to cpu%d (%lld/%lld)\n",
+			candidate->irq, busiest, idlest, load[busiest], load[idlest]);
+		candidate->target_cpu = idlest;
+	}
+}
@@ -38,9 +38,105 @@
 
 #include <libkern/types.h>
 #include <kern/vm/vm_types.h>
+#include <kern/defaults.h>
+
+#include <arch/arch.h>
 
 typedef uint32_t		intid_t;
 
+/* Interrupt ID ranges */
+#define MACHINE_IRQ_SGI_BASE		0
+#define MACHINE_IRQ_PPI_BASE		16
+#define MACHINE_IRQ_SPI_BASE		32
+#define MACHINE_IRQ_SPURIOUS		1020	/* 1020-1023 are special INTIDs */
+
+#define MACHINE_IRQ_IS_SPI(_intid)											\
+	((_intid) >= MACHINE_IRQ_SPI_BASE && (_intid) < MACHINE_IRQ_SPURIOUS)
+
+/* Interrupt trigger types */
+#define MACHINE_IRQ_TRIGGER_LEVEL	0
+#define MACHINE_IRQ_TRIGGER_EDGE	1
+
+/**
+ * Interrupt priority classes. Lower values are more urgent. The CPU interface
+ * is configured so that only the top three bits form the group priority used
+ * for preemption, so each class is 0x20 apart and an interrupt can only be
+ * preempted by one from a more urgent class. Handlers run with the PMR raised
+ * to their own class rather than with interrupts fully masked.
+*/
+#define IRQ_PRIORITY_NMI			0x00	/* pseudo-NMIs */
+#define IRQ_PRIORITY_CRITICAL		0x20	/* IPIs */
+#define IRQ_PRIORITY_TIMER			0x40	/* scheduler and hrtimers */
+#define IRQ_PRIORITY_HIGH			0x60	/* latency-sensitive devices */
+#define IRQ_PRIORITY_NORMAL			0x80	/* default for devices */
+#define IRQ_PRIORITY_LOW			0xa0	/* bulk/background devices */
+#define IRQ_PRIORITY_MASK_NONE		0xff	/* PMR value that masks nothing */
+
+#define IRQ_PRIORITY_BINARY_POINT	5		/* group priority is bits [7:5] */
+
+/**
+ * Pseudo-NMI. With DEFAULTS_MACHINE_IRQ_PSEUDO_NMI, disabling interrupts writes
+ * IRQ_PRIORITY_IRQ_OFF to the PMR instead of setting PSTATE.I, so interrupts in
+ * the IRQ_PRIORITY_NMI class are still taken while the kernel has interrupts
+ * disabled. PSTATE.I is then only set between exception entry and the point
+ * the handler unmasks, and on the way back out.
+*/
+#define IRQ_PRIORITY_IRQ_OFF		IRQ_PRIORITY_CRITICAL
+
+/* Interrupt descriptor flags */
+#define IRQ_FLAG_REGISTERED			(1 << 0)	/* Descriptor is in use */
+#define IRQ_FLAG_AFFINITY_PINNED	(1 << 1)	/* Never moved by the balancer */
+#define IRQ_FLAG_THREADED			(1 << 2)	/* Has a handler thread */
+#define IRQ_FLAG_NMI				(1 << 3)	/* Delivered as a pseudo-NMI */
+
+/* Interrupt handler return values */
+typedef enum {
+	IRQ_NONE = 0,		/* Interrupt was not from this device */
+	IRQ_HANDLED,		/* Interrupt was handled */
+	IRQ_WAKE_THREAD,	/* Run the threaded handler, keep the IRQ active */
+} irq_return_t;
+
+typedef irq_return_t (*irq_handler_t) (intid_t irq, void *data);
+
+/**
+ * Pseudo-NMI handlers are given the interrupted frame. They may run while any
+ * other kernel code holds interrupts disabled, so must not take locks, block,
+ * or touch scheduler state.
+*/
+typedef void (*nmi_handler_t) (intid_t irq, arm64_exception_frame_t *frame,
+							   void *data);
+
+/**
+ * Interrupt Descriptor
+ *
+ * One of these exists for each INTID the kernel can handle, and holds the
+ * handler along with per-CPU delivery counts which are used by the balancer to
+ * decide where SPIs should be routed.
+*/
+struct irq_desc {
+	intid_t			irq;
+	uint32_t		flags;
+	uint32_t		priority;
+	unsigned int	target_cpu;
+
+	irq_handler_t	handler;
+	void			*data;
+
+	/* threaded handler, runs in its own kernel thread */
+	irq_handler_t	thread_fn;
+	struct thread	*thread;
+
+	/* pseudo-NMI handler, used instead of handler */
+	nmi_handler_t	nmi_handler;
+
+	uint64_t		count[DEFAULTS_MACHINE_MAX_CPUS];
+	uint64_t		spurious;
+
+	/* balancer state, updated on each pass */
+	uint64_t		balance_snapshot;
+	uint64_t		balance_delta;
+};
+
 struct irq_data {
 	intid_t		irq;
 	void		*data;		/* chip-specific data, i.e. GICv3 */
@@ -64,9 +160,40 @@ kern_return_t gic_interface_init(vm_address_t dist_base, vm_address_t redist_bas
 kern_return_t machine_init_interrupts();
 void machine_irq_enable();
 void machine_irq_disable();
+uint64_t machine_irq_save(void);
+void machine_irq_restore(uint64_t flags);
+int machine_irq_disabled(void);
+void machine_irq_mask_all(void);
+
+uint32_t machine_irq_running_priority(void);
+uint32_t machine_irq_priority_raise(uint32_t priority);
+void machine_irq_priority_restore(uint32_t pmr);
 
-kern_return_t machine_register_interrupt(uint32_t intid, uint32_t priority);
+kern_return_t machine_register_interrupt(intid_t intid, uint32_t priority,
+										 irq_handler_t handler, void *data);
+kern_return_t machine_register_threaded_interrupt(intid_t intid,
+										 uint32_t priority, irq_handler_t handler,
+										 irq_handler_t thread_fn, void *data);
+kern_return_t machine_register_nmi(intid_t intid, nmi_handler_t handler,
+										 void *data);
+kern_return_t machine_irq_set_trigger(intid_t intid, uint32_t trigger);
+kern_return_t machine_irq_set_affinity(intid_t intid, unsigned int cpu);
 void machine_send_interrupt(uint32_t intid, uint32_t target);
+void machine_send_interrupt_mask(uint32_t intid, uint64_t cpumask);
+void machine_send_interrupt_others(uint32_t intid);
+
+intid_t machine_irq_acknowledge(void);
+void machine_irq_eoi(intid_t intid);
+void machine_irq_deactivate(intid_t intid);
+void machine_handle_interrupt(intid_t intid);
+
+int machine_irq_nmi_enabled(void);
+int machine_irq_is_nmi(intid_t intid);
+int machine_irq_in_nmi(void);
+void machine_handle_nmi(intid_t intid, arm64_exception_frame_t *frame);
+
+struct irq_desc *machine_irq_get_desc(intid_t intid);
+void machine_irq_balance(void);
 
 //kern_return_t machine_configure_interrupts ();
 //kern_return_t machine_enable_interrupts ();
@@ -0,0 +1,220 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * 	Name:	machine/machine_fpsimd.c
+ * 	Desc:	Kernel-mode FP and Advanced SIMD. See machine_fpsimd.h.
+ */
+
+#define pr_fmt(fmt)	"fpsimd: " fmt
+
+#include <arch/arch.h>
+#include <kern/machine/machine_fpsimd.h>
+#include <kern/machine/machine-irq.h>
+#include <kern/trace/printk.h>
+#include <kern/defaults.h>
+#include <kern/machine.h>
+#include <kern/thread.h>
+#include <kern/cpu.h>
+#include <kern/cpufeature.h>
+#include <libkern/panic.h>
+
+static int fpsimd_present = 0;
+
+/**
+ * A section opened by an interrupt handler, and the registers of the thread it
+ * interrupted, if that thread had a section of its own open. Handlers that
+ * nest inside it can't open another.
+*/
+static struct {
+	int					irq_active;
+	int					irq_saved;
+	struct fpsimd_state	save;
+} fpsimd_cpus[CPU_NUMBER_MAX];
+
+static inline void __fpsimd_enable(void)
+{
+	uint64_t cpacr = sysreg_read(cpacr_el1);
+
+	sysreg_write(cpacr_el1, (cpacr & ~CPACR_EL1_FPEN_MASK) |
+		CPACR_EL1_FPEN_ENABLE);
+	isb();
+}
+
+static inline void __fpsimd_disable(void)
+{
+	uint64_t cpacr = sysreg_read(cpacr_el1);
+
+	sysreg_write(cpacr_el1, (cpacr & ~CPACR_EL1_FPEN_MASK) |
+		CPACR_EL1_FPEN_TRAP_ALL);
+	isb();
+}
+
+/**
+ * machine_fpsimd_init
+ *
+ * Check cpu_init() found both FP and Advanced SIMD, and leave them trapping
+ * until something opens a section. Until this succeeds kernel_neon_usable() is
+ * false and the string routines stay scalar.
+*/
+kern_return_t machine_fpsimd_init(void)
+{
+#if !DEFAULTS_SET(DEFAULTS_MACHINE_KERNEL_NEON)
+	pr_info("disabled\n");
+	return KERN_RETURN_FAIL;
+#endif
+
+	if (!cpu_has_feature(CPU_FEATURE_FP) || !cpu_has_feature(CPU_FEATURE_ASIMD)) {
+		pr_info("not implemented\n");
+		return KERN_RETURN_FAIL;
+	}
+
+	__fpsimd_disable();
+	fpsimd_present = 1;
+	pr_info("kernel-mode NEON enabled\n");
+	return KERN_RETURN_SUCCESS;
+}
+
+int machine_fpsimd_present(void)
+{
+	return fpsimd_present;
+}
+
+/**
+ * machine_fpsimd_switch
+ *
+ * Save the registers of `prev` if it's in a section, and restore those of
+ * `next` if it is. Threads outside a section don't own any FP state, so
+ * switching between them costs nothing.
+*/
+void machine_fpsimd_switch(struct thread *prev, struct thread *next)
+{
+	int prev_neon = (prev != THREAD_NULL && prev->neon);
+
+	if (!prev_neon && !next->neon)
+		return;
+
+	if (prev_neon)
+		fpsimd_save_state(&prev->fpsimd);
+
+	if (next->neon) {
+		__fpsimd_enable();
+		fpsimd_load_state(&next->fpsimd);
+	} else {
+		__fpsimd_disable();
+	}
+}
+
+/**
+ * kernel_neon_usable
+ *
+ * Whether the caller can open a section. Pseudo-NMIs never can, as they may
+ * interrupt a begin or end half way through, and interrupt handlers can only
+ * while no other handler on the CPU has one open.
+*/
+int kernel_neon_usable(void)
+{
+	cpu_t *cpu;
+
+	if (!fpsimd_present)
+		return 0;
+
+	cpu = cpu_get_current();
+	if (cpu->interrupt_nmi_nesting)
+		return 0;
+	if (cpu->interrupt_nesting)
+		return !fpsimd_cpus[cpu->cpu_num].irq_active;
+
+	return cpu->cpu_active_thread != THREAD_NULL &&
+		!cpu->cpu_active_thread->neon;
+}
+
+/**
+ * kernel_neon_begin
+ *
+ * Open a section, after which the vector registers can be used until the
+ * matching kernel_neon_end(). The caller must have checked kernel_neon_usable().
+ *
+ * From a thread the section is simply marked on the thread, it can be
+ * preempted and the registers are saved with it. From an interrupt handler the
+ * interrupted thread's registers are saved here first if it had a section
+ * open, and put back at the end.
+*/
+void kernel_neon_begin(void)
+{
+	cpu_t *cpu;
+	thread_t *thread;
+	uint64_t flags;
+
+	flags = machine_irq_save();
+	cpu = cpu_get_current();
+	thread = cpu->cpu_active_thread;
+
+	if (cpu->interrupt_nesting) {
+		if (fpsimd_cpus[cpu->cpu_num].irq_active)
+			panic("kernel_neon_begin: nested in interrupt context\n");
+
+		/* the thread's section has FP enabled already */
+		if (thread != THREAD_NULL && thread->neon) {
+			fpsimd_save_state(&fpsimd_cpus[cpu->cpu_num].save);
+			fpsimd_cpus[cpu->cpu_num].irq_saved = 1;
+		}
+		fpsimd_cpus[cpu->cpu_num].irq_active = 1;
+	} else {
+		if (thread == THREAD_NULL || thread->neon)
+			panic("kernel_neon_begin: no thread, or nested\n");
+		thread->neon = 1;
+	}
+
+	__fpsimd_enable();
+	machine_irq_restore(flags);
+}
+
+/**
+ * kernel_neon_end
+ *
+ * Close the section opened by kernel_neon_begin(), putting back the registers
+ * of an interrupted thread's section, or making FP trap again.
+*/
+void kernel_neon_end(void)
+{
+	cpu_t *cpu;
+	uint64_t flags;
+
+	flags = machine_irq_save();
+	cpu = cpu_get_current();
+
+	if (cpu->interrupt_nesting) {
+		if (fpsimd_cpus[cpu->cpu_num].irq_saved) {
+			fpsimd_load_state(&fpsimd_cpus[cpu->cpu_num].save);
+			fpsimd_cpus[cpu->cpu_num].irq_saved = 0;
+		} else {
+			__fpsimd_disable();
+		}
+		fpsimd_cpus[cpu->cpu_num].irq_active = 0;
+	} else {
+		cpu->cpu_active_thread->neon = 0;
+		__fpsimd_disable();
+	}
+
+	machine_irq_restore(flags);
+}
@@ -0,0 +1,63 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * 	Name:	machine/machine_fpsimd.h
+ * 	Desc:	Kernel-mode FP and Advanced SIMD. The kernel is built with
+ * 			-mgeneral-regs-only and leaves CPACR_EL1.FPEN trapping, so the
+ * 			vector registers belong to whoever has a section open between
+ * 			kernel_neon_begin() and kernel_neon_end(). A thread's section is
+ * 			saved and restored as it's switched, and an interrupt handler's
+ * 			section saves the registers of the thread it interrupted.
+ */
+
+#ifndef __MACHINE_FPSIMD_H__
+#define __MACHINE_FPSIMD_H__
+
+#include <tinylibc/stdint.h>
+
+#include <libkern/types.h>
+
+struct thread;
+
+/* V0-V31, FPSR and FPCR, as saved by fpsimd_save_state */
+struct fpsimd_state {
+	uint64_t		vregs[64];
+	uint32_t		fpsr;
+	uint32_t		fpcr;
+};
+
+/* Machine FP/SIMD */
+extern kern_return_t machine_fpsimd_init(void);
+extern void machine_fpsimd_switch(struct thread *prev, struct thread *next);
+extern int machine_fpsimd_present(void);
+
+/* Kernel-mode NEON sections, which don't nest */
+extern int kernel_neon_usable(void);
+extern void kernel_neon_begin(void);
+extern void kernel_neon_end(void);
+
+/* support.S */
+extern void fpsimd_save_state(struct fpsimd_state *state);
+extern void fpsimd_load_state(const struct fpsimd_state *state);
+
+#endif /* __machine_fpsimd_h__ */
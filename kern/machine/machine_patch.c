@@ -0,0 +1,75 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * 	Name:	machine/machine_patch.c
+ * 	Desc:	Kernel text patching.
+ */
+
+#include <arch/arch.h>
+#include <kern/machine/machine_patch.h>
+#include <kern/machine/machine-irq.h>
+#include <libkern/panic.h>
+
+/**
+ * machine_insn_branch
+ *
+ * Encode an unconditional branch from `pc` to `target`.
+*/
+uint32_t machine_insn_branch(vm_address_t pc, vm_address_t target)
+{
+	int64_t offset = (int64_t) (target - pc);
+
+	if (offset < -MACHINE_INSN_B_RANGE || offset >= MACHINE_INSN_B_RANGE ||
+			(offset & 3))
+		panic("machine_insn_branch: 0x%lx out of range of 0x%lx\n", target, pc);
+
+	return MACHINE_INSN_B | ((offset >> 2) & MACHINE_INSN_B_IMM_MASK);
+}
+
+/**
+ * machine_patch_text
+ *
+ * Replace the instruction at `addr`. Kernel text is mapped writable, so this
+ * is an aligned 32-bit store followed by cache maintenance: clean the line to
+ * the point of unification so instruction fetch can see it, invalidate any
+ * stale copy in the instruction cache, and synchronise this CPU's pipeline.
+ *
+ * A NOP and a B may be swapped while another CPU is executing them, so patch
+ * sites don't need to be stopped first, but another CPU is only guaranteed to
+ * see the change after its next context synchronisation event.
+*/
+void machine_patch_text(uint32_t *addr, uint32_t insn)
+{
+	uint64_t flags;
+
+	flags = machine_irq_save();
+
+	__atomic_store_n(addr, insn, __ATOMIC_RELAXED);
+	__asm__ __volatile__ ("dc cvau, %0" : : "r" (addr) : "memory");
+	dsbish();
+	__asm__ __volatile__ ("ic ivau, %0" : : "r" (addr) : "memory");
+	dsbish();
+	isb();
+
+	machine_irq_restore(flags);
+}
@@ -0,0 +1,48 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * 	Name:	machine/machine_patch.h
+ * 	Desc:	Kernel text patching. Used to switch code paths at runtime by
+ * 			rewriting a single instruction in place.
+ */
+
+#ifndef __MACHINE_PATCH_H__
+#define __MACHINE_PATCH_H__
+
+#include <tinylibc/stdint.h>
+#include <libkern/types.h>
+#include <libkern/compiler.h>
+#include <kern/vm/vm_types.h>
+
+/* A64 encodings */
+#define MACHINE_INSN_NOP			UL(0xd503201f)
+#define MACHINE_INSN_B				UL(0x14000000)
+#define MACHINE_INSN_B_IMM_MASK		UL(0x03ffffff)
+
+/* branch range, +/-128MB from the instruction */
+#define MACHINE_INSN_B_RANGE		(1L << 27)
+
+extern uint32_t machine_insn_branch(vm_address_t pc, vm_address_t target);
+extern void machine_patch_text(uint32_t *addr, uint32_t insn);
+
+#endif /* __machine_patch_h__ */
@@ -0,0 +1,471 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * 	Name:	machine/machine_pmu.c
+ * 	Desc:	ARMv8 Performance Monitors. See machine_pmu.h.
+ */
+
+#define pr_fmt(fmt)	"pmu: " fmt
+
+#include <arch/arch.h>
+#include <kern/machine/machine_pmu.h>
+#include <kern/machine/machine-irq.h>
+#include <kern/trace/printk.h>
+#include <kern/machine.h>
+#include <kern/thread.h>
+#include <kern/cpu.h>
+
+/* PMCCNTR_EL0 is counter 31 in the enable, interrupt and overflow registers */
+#define PMU_CYCLE_IDX			31
+#define PMU_SLOTS				32
+
+static int pmu_present = 0;
+static unsigned int pmu_nr_counters;
+
+/* common events 0x00-0x3f the CPU implements, from PMCEID0/1_EL0 */
+static uint64_t pmu_events;
+
+/**
+ * The counter in each hardware slot on each CPU, and the value the slot held
+ * when it was last folded into the counter's count.
+*/
+static struct {
+	pmu_counter_t	*slots[PMU_SLOTS];
+	uint64_t		start[PMU_SLOTS];
+} pmu_cpus[CPU_NUMBER_MAX];
+
+/**
+ * The overflow interrupt can be a pseudo-NMI, which would still be taken with
+ * interrupts disabled the usual way. PSTATE.I holds it off too, so the slots
+ * are only changed with that set.
+*/
+static inline uint64_t __pmu_lock(void)
+{
+	uint64_t flags = sysreg_read(daif);
+
+	__asm__ volatile("msr daifset, #2" : : : "memory");
+	return flags;
+}
+
+static inline void __pmu_unlock(uint64_t flags)
+{
+	sysreg_write(daif, flags);
+}
+
+/* event counters are 32 bits, the cycle counter 64 with PMCR_EL0.LC */
+static inline uint64_t __pmu_mask(int idx)
+{
+	return (idx == PMU_CYCLE_IDX) ? UINT64_MAX : UINT32_MAX;
+}
+
+static uint64_t __pmu_read_hw(int idx)
+{
+	if (idx == PMU_CYCLE_IDX)
+		return sysreg_read(pmccntr_el0);
+
+	sysreg_write(pmselr_el0, idx);
+	isb();
+	return sysreg_read(pmxevcntr_el0);
+}
+
+static void __pmu_write_hw(int idx, uint64_t val)
+{
+	if (idx == PMU_CYCLE_IDX) {
+		sysreg_write(pmccntr_el0, val);
+		return;
+	}
+
+	sysreg_write(pmselr_el0, idx);
+	isb();
+	sysreg_write(pmxevcntr_el0, val);
+}
+
+/* where a counter with a period starts, so it overflows after `period` events */
+static inline uint64_t __pmu_reload(pmu_counter_t *counter, int idx)
+{
+	return counter->period ? (__pmu_mask(idx) - counter->period + 1) &
+		__pmu_mask(idx) : 0;
+}
+
+/* fold the events since the last update into the counter */
+static void __pmu_update(cpu_number_t cpu, int idx)
+{
+	pmu_counter_t *counter = pmu_cpus[cpu].slots[idx];
+	uint64_t now;
+
+	now = __pmu_read_hw(idx);
+	counter->count += (now - pmu_cpus[cpu].start[idx]) & __pmu_mask(idx);
+	pmu_cpus[cpu].start[idx] = now;
+}
+
+/* find a free slot, using the cycle counter for cycles where possible */
+static int __pmu_alloc(cpu_number_t cpu, pmu_counter_t *counter)
+{
+	unsigned int i;
+
+	if (counter->event == PMU_EVENT_CPU_CYCLES &&
+			pmu_cpus[cpu].slots[PMU_CYCLE_IDX] == NULL)
+		return PMU_CYCLE_IDX;
+
+	for (i = 0; i < pmu_nr_counters; i++)
+		if (pmu_cpus[cpu].slots[i] == NULL)
+			return i;
+	return -1;
+}
+
+static void __pmu_program(cpu_number_t cpu, int idx, pmu_counter_t *counter)
+{
+	uint64_t type = 0;
+
+	if (counter->flags & PMU_COUNTER_EXCLUDE_EL0)
+		type |= PMEVTYPER_U;
+	if (counter->flags & PMU_COUNTER_EXCLUDE_EL1)
+		type |= PMEVTYPER_P;
+
+	if (idx == PMU_CYCLE_IDX) {
+		sysreg_write(pmccfiltr_el0, type);
+	} else {
+		sysreg_write(pmselr_el0, idx);
+		isb();
+		sysreg_write(pmxevtyper_el0, type | counter->event);
+	}
+
+	pmu_cpus[cpu].slots[idx] = counter;
+	pmu_cpus[cpu].start[idx] = __pmu_reload(counter, idx);
+	__pmu_write_hw(idx, pmu_cpus[cpu].start[idx]);
+	counter->idx = idx;
+
+	/* the interrupt is always on, it's how event counters reach 64 bits */
+	sysreg_write(pmovsclr_el0, 1UL << idx);
+	sysreg_write(pmintenset_el1, 1UL << idx);
+	sysreg_write(pmcntenset_el0, 1UL << idx);
+	isb();
+}
+
+static void __pmu_release(cpu_number_t cpu, pmu_counter_t *counter)
+{
+	int idx = counter->idx;
+
+	sysreg_write(pmcntenclr_el0, 1UL << idx);
+	sysreg_write(pmintenclr_el1, 1UL << idx);
+	isb();
+
+	__pmu_update(cpu, idx);
+	sysreg_write(pmovsclr_el0, 1UL << idx);
+
+	pmu_cpus[cpu].slots[idx] = NULL;
+	counter->idx = -1;
+}
+
+/**
+ * Handle the overflow of each slot that's flagged. The count is brought up to
+ * date first, then a counter with a period has its callback run, and is set
+ * back to overflow after another period.
+*/
+static void __pmu_overflow(arm64_exception_frame_t *frame)
+{
+	cpu_number_t cpu = machine_get_cpu_num();
+	pmu_counter_t *counter;
+	uint64_t ovs;
+	int idx;
+
+	ovs = sysreg_read(pmovsclr_el0);
+	sysreg_write(pmovsclr_el0, ovs);
+
+	for (idx = 0; idx < PMU_SLOTS; idx++) {
+		counter = pmu_cpus[cpu].slots[idx];
+		if (!(ovs & (1UL << idx)) || counter == NULL)
+			continue;
+
+		__pmu_update(cpu, idx);
+		if (counter->period == 0)
+			continue;
+
+		if (counter->fn)
+			counter->fn(counter, frame, counter->arg);
+
+		/* the callback may have stopped the counter */
+		if (pmu_cpus[cpu].slots[idx] != counter)
+			continue;
+		pmu_cpus[cpu].start[idx] = __pmu_reload(counter, idx);
+		__pmu_write_hw(idx, pmu_cpus[cpu].start[idx]);
+	}
+}
+
+static void machine_pmu_nmi_handler(intid_t intid,
+		arm64_exception_frame_t *frame, void *data)
+{
+	__pmu_overflow(frame);
+}
+
+static irq_return_t machine_pmu_handler(intid_t intid, void *data)
+{
+	uint64_t flags = __pmu_lock();
+
+	__pmu_overflow(NULL);
+	__pmu_unlock(flags);
+	return IRQ_HANDLED;
+}
+
+int machine_pmu_present(void)
+{
+	return pmu_present;
+}
+
+/* the cycle counter is always there, other events only if PMCEID says so */
+int pmu_event_supported(uint16_t event)
+{
+	if (!pmu_present)
+		return 0;
+	if (event == PMU_EVENT_CPU_CYCLES)
+		return 1;
+	return (event < 64) && (pmu_events & (1ULL << event));
+}
+
+/**
+ * machine_pmu_init
+ *
+ * Find out what the PMU implements, reset it, and register the overflow
+ * interrupt, as a pseudo-NMI if they're enabled so callbacks can sample code
+ * running with interrupts disabled. Counters are only started on demand.
+*/
+kern_return_t machine_pmu_init(void)
+{
+	uint64_t pmuver;
+	kern_return_t ret;
+
+	pmuver = (sysreg_read(id_aa64dfr0_el1) >> ID_AA64DFR0_PMUVER_SHIFT) &
+		ID_AA64DFR0_PMUVER_MASK;
+	if (pmuver == ID_AA64DFR0_PMUVER_NONE || pmuver == ID_AA64DFR0_PMUVER_IMPDEF) {
+		pr_info("not implemented\n");
+		return KERN_RETURN_FAIL;
+	}
+
+	pmu_nr_counters = (sysreg_read(pmcr_el0) >> PMCR_EL0_N_SHIFT) &
+		PMCR_EL0_N_MASK;
+	pmu_events = (sysreg_read(pmceid0_el0) & UINT32_MAX) |
+		(sysreg_read(pmceid1_el0) << 32);
+
+	/* everything off and zeroed, then enabled, with counters started singly */
+	sysreg_write(pmcntenclr_el0, UINT32_MAX);
+	sysreg_write(pmintenclr_el1, UINT32_MAX);
+	sysreg_write(pmovsclr_el0, UINT32_MAX);
+	sysreg_write(pmuserenr_el0, 0);
+	sysreg_write(pmcr_el0, PMCR_EL0_E | PMCR_EL0_P | PMCR_EL0_C | PMCR_EL0_LC);
+	isb();
+
+	if (machine_irq_nmi_enabled())
+		ret = machine_register_nmi(MACHINE_PMU_IRQ_ID,
+			machine_pmu_nmi_handler, NULL);
+	else
+		ret = machine_register_interrupt(MACHINE_PMU_IRQ_ID,
+			IRQ_PRIORITY_HIGH, machine_pmu_handler, NULL);
+	if (ret != KERN_RETURN_SUCCESS) {
+		pr_err("failed to register overflow interrupt\n");
+		return KERN_RETURN_FAIL;
+	}
+
+	pmu_present = 1;
+	pr_info("PMUv3 (0x%llx), %d counters, events: 0x%llx\n", pmuver,
+		pmu_nr_counters, pmu_events);
+	return KERN_RETURN_SUCCESS;
+}
+
+/**
+ * machine_pmu_switch
+ *
+ * Save the counters following `prev` and restore those following `next`. The
+ * hardware slots are shared with system counters, so a thread's counter that
+ * doesn't get one while it's switched in simply misses those events.
+*/
+void machine_pmu_switch(struct thread *prev, struct thread *next)
+{
+	cpu_number_t cpu;
+	unsigned int i;
+	uint64_t flags;
+	int idx;
+
+	if ((prev == THREAD_NULL || prev->pmu.nr == 0) && next->pmu.nr == 0)
+		return;
+
+	flags = __pmu_lock();
+	cpu = machine_get_cpu_num();
+
+	if (prev != THREAD_NULL) {
+		for (i = 0; i < prev->pmu.nr; i++)
+			if (prev->pmu.counters[i]->idx >= 0)
+				__pmu_release(cpu, prev->pmu.counters[i]);
+	}
+
+	for (i = 0; i < next->pmu.nr; i++) {
+		idx = __pmu_alloc(cpu, next->pmu.counters[i]);
+		if (idx >= 0)
+			__pmu_program(cpu, idx, next->pmu.counters[i]);
+	}
+
+	__pmu_unlock(flags);
+}
+
+/**
+ * pmu_counter_init
+ *
+ * Set up a counter for `event`. With PMU_COUNTER_SYSTEM it counts everything
+ * on the CPU it's started on, otherwise it follows the thread that starts it.
+*/
+kern_return_t pmu_counter_init(pmu_counter_t *counter, uint16_t event,
+		uint32_t flags)
+{
+	if (!pmu_event_supported(event))
+		return KERN_RETURN_FAIL;
+
+	counter->event = event;
+	counter->flags = flags;
+	counter->idx = -1;
+	counter->cpu = -1;
+	counter->thread = THREAD_NULL;
+	counter->count = 0;
+	counter->period = 0;
+	counter->fn = NULL;
+	counter->arg = NULL;
+	return KERN_RETURN_SUCCESS;
+}
+
+/**
+ * pmu_counter_set_overflow
+ *
+ * Call `fn` every `period` events, from the overflow interrupt. Must be set
+ * before the counter is started.
+*/
+kern_return_t pmu_counter_set_overflow(pmu_counter_t *counter,
+		uint64_t period, pmu_overflow_fn_t fn, void *arg)
+{
+	/* a period has to fit in any counter the event could be given */
+	if (counter->idx >= 0 || period == 0 || period > UINT32_MAX)
+		return KERN_RETURN_FAIL;
+
+	counter->period = period;
+	counter->fn = fn;
+	counter->arg = arg;
+	return KERN_RETURN_SUCCESS;
+}
+
+/**
+ * pmu_counter_start
+ *
+ * Start counting, either on this CPU or in the current thread. This fails if
+ * every hardware counter is already taken.
+*/
+kern_return_t pmu_counter_start(pmu_counter_t *counter)
+{
+	kern_return_t ret = KERN_RETURN_FAIL;
+	struct pmu_thread *pmu = NULL;
+	thread_t *thread = THREAD_NULL;
+	cpu_number_t cpu;
+	uint64_t flags;
+	int idx;
+
+	if (!pmu_present || counter->idx >= 0 || counter->thread != THREAD_NULL)
+		return KERN_RETURN_FAIL;
+
+	flags = __pmu_lock();
+	cpu = machine_get_cpu_num();
+
+	if (!(counter->flags & PMU_COUNTER_SYSTEM)) {
+		thread = cpu_get_current()->cpu_active_thread;
+		if (!cpu_read_flag(cpu, CPU_FLAG_THREADING_ENABLED) ||
+				thread == THREAD_NULL || thread->pmu.nr >= PMU_THREAD_COUNTERS)
+			goto out;
+		pmu = &thread->pmu;
+	}
+
+	idx = __pmu_alloc(cpu, counter);
+	if (idx < 0)
+		goto out;
+
+	if (pmu) {
+		counter->thread = thread;
+		pmu->counters[pmu->nr++] = counter;
+	}
+	counter->cpu = cpu;
+	__pmu_program(cpu, idx, counter);
+	ret = KERN_RETURN_SUCCESS;
+
+out:
+	__pmu_unlock(flags);
+	return ret;
+}
+
+/**
+ * pmu_counter_stop
+ *
+ * Stop counting, leaving the final value in the counter. A system counter must
+ * be stopped on the CPU it was started on, and a thread's by that thread.
+*/
+void pmu_counter_stop(pmu_counter_t *counter)
+{
+	struct pmu_thread *pmu;
+	uint64_t flags;
+	unsigned int i;
+
+	flags = __pmu_lock();
+
+	if (counter->idx >= 0)
+		__pmu_release(machine_get_cpu_num(), counter);
+
+	if (counter->thread != THREAD_NULL) {
+		pmu = &counter->thread->pmu;
+		for (i = 0; i < pmu->nr; i++) {
+			if (pmu->counters[i] != counter)
+				continue;
+			pmu->counters[i] = pmu->counters[--pmu->nr];
+			break;
+		}
+		counter->thread = THREAD_NULL;
+	}
+
+	__pmu_unlock(flags);
+}
+
+/**
+ * pmu_counter_read
+ *
+ * The number of events counted so far. A counter that's live on this CPU is
+ * brought up to date, otherwise this is its value when it was last switched
+ * out or overflowed.
+*/
+uint64_t pmu_counter_read(pmu_counter_t *counter)
+{
+	cpu_number_t cpu;
+	uint64_t flags;
+	uint64_t count;
+
+	flags = __pmu_lock();
+	cpu = machine_get_cpu_num();
+
+	if (counter->idx >= 0 && pmu_cpus[cpu].slots[counter->idx] == counter)
+		__pmu_update(cpu, counter->idx);
+	count = counter->count;
+
+	__pmu_unlock(flags);
+	return count;
+}
@@ -0,0 +1,113 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * 	Name:	machine/machine_pmu.h
+ * 	Desc:	ARMv8 Performance Monitors. Counters are allocated from the
+ * 			cycle counter and the PMCR_EL0.N event counters, and extended to
+ * 			64 bits in software using the overflow interrupt. A counter either
+ * 			follows a thread, being saved and restored as it's switched, or
+ * 			counts everything on a CPU.
+ */
+
+#ifndef __MACHINE_PMU_H__
+#define __MACHINE_PMU_H__
+
+#include <tinylibc/stdint.h>
+
+#include <libkern/types.h>
+#include <arch/arch.h>
+#include <kern/machine/machine-irq.h>
+
+/* Performance monitor overflow interrupt, PPI 7 */
+#define MACHINE_PMU_IRQ_ID			23
+
+/* Common architectural events, where the CPU implements them (see PMCEID0) */
+#define PMU_EVENT_SW_INCR			0x00
+#define PMU_EVENT_L1I_CACHE_REFILL	0x01
+#define PMU_EVENT_L1I_TLB_REFILL	0x02
+#define PMU_EVENT_L1D_CACHE_REFILL	0x03
+#define PMU_EVENT_L1D_CACHE			0x04
+#define PMU_EVENT_L1D_TLB_REFILL	0x05
+#define PMU_EVENT_INST_RETIRED		0x08
+#define PMU_EVENT_EXC_TAKEN			0x09
+#define PMU_EVENT_BR_MIS_PRED		0x10
+#define PMU_EVENT_CPU_CYCLES		0x11
+#define PMU_EVENT_L2D_CACHE_REFILL	0x17
+
+/* Counter flags */
+#define PMU_COUNTER_SYSTEM			(1 << 0)	/* count everything on the CPU */
+#define PMU_COUNTER_EXCLUDE_EL0		(1 << 1)
+#define PMU_COUNTER_EXCLUDE_EL1		(1 << 2)
+
+/* counters a thread can have following it */
+#define PMU_THREAD_COUNTERS			4
+
+struct thread;
+struct pmu_counter;
+
+/**
+ * Called from the overflow interrupt each time a counter with a period counts
+ * through it. This is a pseudo-NMI where they're enabled, with the interrupted
+ * frame, and the same restrictions as any other NMI handler. Otherwise it's an
+ * ordinary interrupt, and `frame` is NULL.
+*/
+typedef void (*pmu_overflow_fn_t) (struct pmu_counter *counter,
+								   arm64_exception_frame_t *frame, void *arg);
+
+typedef struct pmu_counter {
+	uint16_t			event;
+	uint16_t			flags;
+	int16_t				idx;		/* hardware counter, -1 while not counting */
+	int16_t				cpu;		/* CPU a system counter was started on */
+
+	struct thread		*thread;	/* owner, for a thread's counter */
+	uint64_t			count;		/* up to the last time it was read */
+
+	/* overflow callback, every `period` events */
+	uint64_t			period;
+	pmu_overflow_fn_t	fn;
+	void				*arg;
+} pmu_counter_t;
+
+/* A thread's counters, switched in and out with it */
+struct pmu_thread {
+	unsigned int		nr;
+	pmu_counter_t		*counters[PMU_THREAD_COUNTERS];
+};
+
+/* Machine PMU */
+extern kern_return_t machine_pmu_init(void);
+extern void machine_pmu_switch(struct thread *prev, struct thread *next);
+extern int machine_pmu_present(void);
+extern int pmu_event_supported(uint16_t event);
+
+/* Counter API */
+extern kern_return_t pmu_counter_init(pmu_counter_t *counter, uint16_t event,
+	uint32_t flags);
+extern kern_return_t pmu_counter_set_overflow(pmu_counter_t *counter,
+	uint64_t period, pmu_overflow_fn_t fn, void *arg);
+extern kern_return_t pmu_counter_start(pmu_counter_t *counter);
+extern void pmu_counter_stop(pmu_counter_t *counter);
+extern uint64_t pmu_counter_read(pmu_counter_t *counter);
+
+#endif /* __machine_pmu_h__ */
@@ -29,17 +29,242 @@
 #include <kern/machine.h>
 #include <kern/machine/machine_timer.h>
 #include <kern/machine/machine-irq.h>
+#include <kern/defaults.h>
+#include <kern/timer.h>
+#include <kern/sched.h>
+#include <kern/clock.h>
+#include <kern/cpu.h>
 
 #include <libkern/types.h>
 
+/* Number of timer ticks taken on each CPU */
+static uint64_t machine_timer_ticks[DEFAULTS_MACHINE_MAX_CPUS];
+
+/* Scheduler tick timer, and its next deadline, for each CPU */
+static timer_t machine_timer_tick[DEFAULTS_MACHINE_MAX_CPUS];
+static uint64_t machine_timer_tick_next[DEFAULTS_MACHINE_MAX_CPUS];
+
+#define MACHINE_TIMER_TICK_NS	(NSEC_PER_SEC / DEFAULTS_MACHINE_TIMER_TICK_HZ)
+
+/**
+ * Pseudo-NMI timer clients, each with its own period in counter ticks, and
+ * next deadline on each CPU. A client with no period is paused.
+*/
+static struct {
+	nmi_handler_t	handler;
+	void			*data;
+	uint64_t		period;
+	uint64_t		next[DEFAULTS_MACHINE_MAX_CPUS];
+} machine_timer_nmi_clients[MACHINE_TIMER_NMI_MAX_CLIENTS];
+static unsigned int machine_timer_nmi_nr_clients = 0;
+
+/**
+ * machine_timer_tick
+ *
+ * The scheduler tick, run from a kernel timer. Rather than switching threads
+ * from within the handler, request a reschedule so it happens once the
+ * interrupt has been completed. The next deadline follows on from the last
+ * one, rather than from now, so the tick doesn't drift.
+*/
+static void machine_timer_tick_fn(timer_t *timer, void *arg)
+{
+	cpu_number_t cpu_num = machine_get_cpu_num();
+
+	if (static_branch_unlikely(&sched_debug_msg))
+		kprintf("machine_timer_tick(%lld)\n", machine_timer_ticks[cpu_num]);
+	machine_timer_ticks[cpu_num] += 1;
+
+	/* the clock is global, so only needs moving forward from one CPU */
+	if (cpu_num == (cpu_number_t) machine_get_boot_cpu_num())
+		clock_update();
+
+	machine_timer_tick_next[cpu_num] += MACHINE_TIMER_TICK_NS;
+	timer_arm(timer, machine_timer_tick_next[cpu_num], machine_timer_tick_fn,
+		NULL);
+
+#if DEFAULTS_SET(DEFAULTS_MACHINE_IRQ_BALANCE)
+	/* the balancer only needs to run from one CPU */
+	if (cpu_num == (cpu_number_t) machine_get_boot_cpu_num() &&
+			(machine_timer_ticks[cpu_num] % DEFAULTS_MACHINE_IRQ_BALANCE_TICKS) == 0)
+		machine_irq_balance();
+#endif
+
+	cpu_set_flag(cpu_num, CPU_FLAG_NEED_RESCHED);
+}
+
+/* The EL1 physical timer interrupt runs the kernel timers */
+static irq_return_t machine_timer_handler(intid_t intid, void *data)
+{
+	timer_interrupt();
+	return IRQ_HANDLED;
+}
+
 kern_return_t machine_init_timers()
 {
-	/* Register the interrupt and enable the timer */
-	machine_register_interrupt(MACHINE_TIMER_EL1PHYS_IRQ_ID, 0);
-	arm64_timer_init(MACHINE_TIMER_RESET_VALUE);
+	cpu_number_t cpu_num = machine_get_cpu_num();
+
+	timer_init();
+
+	/* Register the interrupt, the timer is enabled once something is armed */
+	machine_register_interrupt(MACHINE_TIMER_EL1PHYS_IRQ_ID,
+		IRQ_PRIORITY_TIMER, machine_timer_handler, NULL);
+
+	timer_setup(&machine_timer_tick[cpu_num]);
+	machine_timer_tick_next[cpu_num] = ktime_get_ns() + MACHINE_TIMER_TICK_NS;
+	timer_arm(&machine_timer_tick[cpu_num], machine_timer_tick_next[cpu_num],
+		machine_timer_tick_fn, NULL);
+
+	return KERN_RETURN_SUCCESS;
 }
 
-kern_return_t machine_timer_reset(uint64_t reset)
+/**
+ * machine_timer_program
+ *
+ * Set the EL1 physical timer to fire once the counter reaches `cval`, or turn
+ * it off if `cval` is UINT64_MAX. A value in the past fires immediately.
+*/
+void machine_timer_program(uint64_t cval)
 {
-	arm64_timer_reset(reset);
-}
\ No newline at end of file
+	if (cval == UINT64_MAX) {
+		sysreg_write(cntp_ctl_el0, 0);
+		return;
+	}
+
+	sysreg_write(cntp_cval_el0, cval);
+	sysreg_write(cntp_ctl_el0, CNTP_CTL_EL0_ENABLE);
+	isb();
+}
+
+uint64_t machine_timer_get_ticks(cpu_number_t cpu)
+{
+	return machine_timer_ticks[cpu];
+}
+
+static inline uint64_t __machine_timer_nmi_now(void)
+{
+	isb();
+	return sysreg_read(cntvct_el0);
+}
+
+/**
+ * program the virtual timer for the earliest deadline of the running clients
+ * on this CPU, or turn it off if they're all paused
+*/
+static void __machine_timer_nmi_program(cpu_number_t cpu)
+{
+	uint64_t next = UINT64_MAX;
+	unsigned int i;
+
+	for (i = 0; i < machine_timer_nmi_nr_clients; i++)
+		if (machine_timer_nmi_clients[i].period &&
+				machine_timer_nmi_clients[i].next[cpu] < next)
+			next = machine_timer_nmi_clients[i].next[cpu];
+
+	if (next == UINT64_MAX) {
+		sysreg_write(cntv_ctl_el0, 0);
+		return;
+	}
+
+	sysreg_write(cntv_cval_el0, next);
+	sysreg_write(cntv_ctl_el0, CNTV_CTL_EL0_ENABLE);
+	isb();
+}
+
+/**
+ * Run each client whose deadline has passed. A client that has fallen more than
+ * a period behind, e.g. while NMIs were masked, skips the missed deadlines
+ * rather than running back-to-back to catch up.
+*/
+static void machine_timer_nmi_handler(intid_t intid,
+		arm64_exception_frame_t *frame, void *data)
+{
+	cpu_number_t cpu = machine_get_cpu_num();
+	uint64_t now, period;
+	unsigned int i;
+
+	now = __machine_timer_nmi_now();
+	for (i = 0; i < machine_timer_nmi_nr_clients; i++) {
+		period = machine_timer_nmi_clients[i].period;
+		if (period == 0 || machine_timer_nmi_clients[i].next[cpu] > now)
+			continue;
+
+		machine_timer_nmi_clients[i].handler(intid, frame,
+			machine_timer_nmi_clients[i].data);
+
+		machine_timer_nmi_clients[i].next[cpu] += period;
+		if (machine_timer_nmi_clients[i].next[cpu] <= now)
+			machine_timer_nmi_clients[i].next[cpu] = now + period;
+	}
+
+	__machine_timer_nmi_program(cpu);
+}
+
+/**
+ * machine_timer_register_nmi
+ *
+ * Call `handler` from the virtual timer pseudo-NMI `hz` times a second,
+ * regardless of whether the CPU has interrupts disabled. A rate of zero
+ * registers the client paused, see machine_timer_nmi_set_rate(). The timer is
+ * started by the first registration.
+*/
+kern_return_t machine_timer_register_nmi(nmi_handler_t handler, void *data,
+		uint64_t hz)
+{
+	unsigned int n = machine_timer_nmi_nr_clients;
+	cpu_number_t cpu;
+
+	if (n >= MACHINE_TIMER_NMI_MAX_CLIENTS || hz > clock_get_frequency())
+		return KERN_RETURN_FAIL;
+
+	if (n == 0 && machine_register_nmi(MACHINE_TIMER_EL1VIRT_IRQ_ID,
+			machine_timer_nmi_handler, NULL) != KERN_RETURN_SUCCESS)
+		return KERN_RETURN_FAIL;
+
+	cpu = machine_get_cpu_num();
+	machine_timer_nmi_clients[n].handler = handler;
+	machine_timer_nmi_clients[n].data = data;
+	machine_timer_nmi_clients[n].period = hz ? clock_get_frequency() / hz : 0;
+	machine_timer_nmi_clients[n].next[cpu] = __machine_timer_nmi_now() +
+		machine_timer_nmi_clients[n].period;
+
+	/* publish the client once it's complete, the NMI may already be running */
+	barrier();
+	machine_timer_nmi_nr_clients = n + 1;
+
+	__machine_timer_nmi_program(cpu);
+	return KERN_RETURN_SUCCESS;
+}
+
+/**
+ * machine_timer_nmi_set_rate
+ *
+ * Change how often a registered client is called, or pause it with a rate of
+ * zero. This takes effect on the calling CPU straight away, and on others at
+ * their next NMI.
+*/
+kern_return_t machine_timer_nmi_set_rate(nmi_handler_t handler, uint64_t hz)
+{
+	cpu_number_t cpu = machine_get_cpu_num();
+	unsigned int i;
+	uint64_t flags;
+
+	if (hz > clock_get_frequency())
+		return KERN_RETURN_FAIL;
+
+	for (i = 0; i < machine_timer_nmi_nr_clients; i++) {
+		if (machine_timer_nmi_clients[i].handler != handler)
+			continue;
+
+		/* PSTATE.I holds off the NMI as well, unlike machine_irq_save() */
+		flags = sysreg_read(daif);
+		__asm__ volatile("msr daifset, #2" : : : "memory");
+		machine_timer_nmi_clients[i].period =
+			hz ? clock_get_frequency() / hz : 0;
+		machine_timer_nmi_clients[i].next[cpu] = __machine_timer_nmi_now() +
+			machine_timer_nmi_clients[i].period;
+		__machine_timer_nmi_program(cpu);
+		sysreg_write(daif, flags);
+		return KERN_RETURN_SUCCESS;
+	}
+	return KERN_RETURN_FAIL;
+}
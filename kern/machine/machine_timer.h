@@ -32,19 +32,32 @@
 #include <tinylibc/stdint.h>
 
 #include <libkern/types.h>
+#include <kern/machine/machine-irq.h>
+#include <kern/cpu.h>
 
 /**
  * Interrupt IDs for ARM generic timers
 */
 #define MACHINE_TIMER_EL1PHYS_IRQ_ID		30
-#define MACHINE_TIMER_EL1VIRT_IRQ_ID		30
-
-#define MACHINE_TIMER_RESET_VALUE			0x5000000
+#define MACHINE_TIMER_EL1VIRT_IRQ_ID		27
 
 /**
  * Machine timer API
 */
 extern kern_return_t machine_init_timers();
-extern kern_return_t machine_timer_reset(uint64_t reset);
+extern uint64_t machine_timer_get_ticks(cpu_number_t cpu);
+extern void machine_timer_program(uint64_t cval);
+
+/**
+ * The EL1 virtual timer is reserved as a pseudo-NMI source, shared by anything
+ * that needs to sample a CPU while it has interrupts disabled. Each client is
+ * called at its own rate.
+*/
+#define MACHINE_TIMER_NMI_MAX_CLIENTS		4
+
+extern kern_return_t machine_timer_register_nmi(nmi_handler_t handler,
+	void *data, uint64_t hz);
+extern kern_return_t machine_timer_nmi_set_rate(nmi_handler_t handler,
+	uint64_t hz);
 
 #endif /* __machine_timer_h__ */
\ No newline at end of file
@@ -43,13 +43,25 @@
 #include <kern/machine.h>
 #include <kern/machine/machine-irq.h>
 #include <kern/machine/machine_timer.h>
+#include <kern/machine/machine_pmu.h>
+#include <kern/machine/machine_fpsimd.h>
+#include <kern/watchdog.h>
+#include <kern/ipi.h>
+#include <kern/clock.h>
+#include <kern/bench/bench.h>
 #include <kern/trace/printk.h>
+#include <kern/trace/tracepoint.h>
+#include <kern/trace/dyndbg.h>
+#include <kern/trace/fgraph.h>
+#include <kern/trace/profile.h>
+#include <kern/static_key.h>
 #include <kern/vm/vm.h>
 #include <kern/vm/pmap.h>
 #include <kern/vm/vm_page.h>
 #include <kern/mm/zalloc.h>
 #include <kern/processor.h>
 #include <kern/task.h>
+#include <kern/sched.h>
 
 /* platform */
 #include <platform/devicetree.h>
@@ -99,6 +111,9 @@ void kernel_init(struct boot_args *boot_args, uint64_t x1, uint64_t x2)
 	cpu_create(&boot_cpu, (vm_address_t) &intstack_top,
 		(vm_address_t) &excepstack_top);
 
+	/* start the clock first, so every log message has a timestamp */
+	clock_init();
+
 	/* verify the boot parameters */
 	if (boot_args->version != BOOT_ARGS_VERSION_1_1)
 		panic("boot_args version mismatch\n");
@@ -120,9 +135,16 @@ void kernel_init(struct boot_args *boot_args, uint64_t x1, uint64_t x2)
 	platform_get_memory (&membase, &memsize);
 	arm_vm_init (boot_args, membase, memsize);
 
+	/* memset can zero with DC ZVA from here, if the data cache is on */
+	memset_zva_init();
+
 	/* initialise the console */
 	console_setup();
 
+	/* patch in static keys that start enabled, and enable debug messages */
+	static_key_init();
+	dyndbg_init();
+
 	/* now we have logs, verify the device tree */
 	DeviceTreeVerify();
 
@@ -139,6 +161,9 @@ void kernel_init(struct boot_args *boot_args, uint64_t x1, uint64_t x2)
 	/* cpu initialisation */
 	cpu_init();
 
+	/* kernel-mode NEON, which the string routines use from here */
+	machine_fpsimd_init();
+
 	/* boot banner */
 	kprintf("Booting Monix on Physical CPU: 0x%08llx [0x%llx]\n", boot_cpu.cpu_num, kernel_init);
 	kprintf("Monix Kernel Version %s; %s; %s:%s/%s_%s\n", KERNEL_BUILD_VERSION, __TIMESTAMP__,
@@ -158,6 +183,9 @@ void kernel_init(struct boot_args *boot_args, uint64_t x1, uint64_t x2)
 	/* enable interrupts */
 	machine_init_interrupts();
 
+	/* inter-processor interrupts for this cpu */
+	ipi_init();
+
 	/* processor init */
 	processor_init();
 
@@ -167,11 +195,17 @@ void kernel_init(struct boot_args *boot_args, uint64_t x1, uint64_t x2)
 	/* thread init */
 	thread_init();
 
-	/* create the main kernel thread */
+	/**
+	 * create the main kernel thread. it never sleeps, so it runs at the same
+	 * priority as the console and test threads to share the cpu with them.
+	*/
 	thread_t *thread = kernel_thread_create((thread_entry_t)kernel_thread_main,
-				THREAD_PRIORITY_MAX, THREAD_NULL);
+				THREAD_PRIORITY_LOW, THREAD_NULL);
 	kprintf("kthread created\n");
 
+	/* scheduler init, creates the idle thread */
+	sched_init();
+
 	// testing
 	_dump_tasks();
 	vm_pagetable_walk_ttbr1();
@@ -204,6 +238,17 @@ void kernel_thread_main(const void *arg1)
 	/* allow cpu_active_thread to be accessed */
 	cpu_set_flag(boot_cpu_id, CPU_FLAG_THREADING_ENABLED);
 
+	/* move console output off the logging path */
+	console_thread_init();
+
+	/* start the trace buffer export, and enable events if configured */
+	trace_init();
+
+#if DEFAULTS_SET(DEFAULTS_KERNEL_FGRAPH)
+	/* write out the function graph of the boot so far */
+	fgraph_export();
+#endif
+
 	/* create dummy threads */
 	thread_t *test_thread = 
 		thread_create(kernel_task, THREAD_PRIORITY_LOW, (thread_entry_t)test_thread_1, "test_thread_1");
@@ -212,6 +257,13 @@ void kernel_thread_main(const void *arg1)
 
 	/* initialise timers to allow for scheduling */
 	machine_init_timers();
+	machine_pmu_init();
+	watchdog_init();
+	profile_init();
+
+#if DEFAULTS_SET(DEFAULTS_KERNEL_BENCH)
+	bench_run();
+#endif
 
 	cpu_t *cpu = cpu_get_current();
 	thread_t *thread = cpu->cpu_active_thread;
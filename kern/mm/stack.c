@@ -55,8 +55,9 @@ void stack_alloc(thread_t *thread)
 			VM_ALLOC_GUARD_FIRST | VM_ALLOC_GUARD_LAST);
 	list_add_tail(&stack->siblings, &stacks);
 
+	/* stacks grow down, so the thread starts at the top of the allocation */
 	thread->stack_base = stack->stack_base;
-	thread->stack = stack->stack_base;
+	thread->stack = stack->stack_base + THREAD_STACK_DEFAULT_SIZE;
 }
 
 void stack_free(thread_t *thread)
@@ -26,6 +26,7 @@
 #include <kern/vm/vm_page.h>
 #include <kern/vm/vm_map.h>
 #include <kern/mm/zalloc.h>
+#include <kern/trace/events.h>
 
 #include <libkern/panic.h>
 #include <tinylibc/string.h>
@@ -35,6 +36,9 @@ unsigned int	num_zones_used;
 #define MAX_NUM_ZONES	12
 static zone_t	zone_array[MAX_NUM_ZONES];
 
+/* serialises finding a free zone descriptor */
+DEFINE_SPINLOCK(zone_array_lock);
+
 void zone_dump_all()
 {
 	pr_debug("dumping '%d' zones:\n", num_zones_used);
@@ -168,15 +172,22 @@ zone_t *zone_create(vm_size_t size, vm_size_t max, const char *name)
 	pr_debug("creating zone '%s' for alloc size '%d', and max size '%d'\n",
 		name, size, max);
 
-	/* find the first available zone descriptor */
+	/**
+	 * find the first available zone descriptor, and claim it before dropping
+	 * the lock. it isn't used until zone_create() returns it.
+	*/
+	spin_lock(&zone_array_lock);
 	for (zidx = 0; zidx < MAX_NUM_ZONES; zidx++) {
 		zone = &(zone_array[zidx]);
-		if (zone->state == ZONE_STATE_UNUSED)
+		if (zone->state == ZONE_STATE_UNUSED) {
+			zone->state = ZONE_STATE_USED;
 			break;
+		}
 
 		/* if one wasn't found, reset the zone to ZONE_NULL */
 		zone = ZONE_NULL;
 	}
+	spin_unlock(&zone_array_lock);
 
 	/* ensure that a zone was found */
 	if (zone == ZONE_NULL) {
@@ -229,6 +240,7 @@ zone_t *zone_create(vm_size_t size, vm_size_t max, const char *name)
 
 	zone->index = zidx;
 	zone->name = name;
+	spin_lock_init(&zone->lock);
 
 	/* allocate enough pages for this zone */
 	zone_page_base = vm_map_alloc(vm_get_kernel_map(),
@@ -249,10 +261,8 @@ zone_t *zone_create(vm_size_t size, vm_size_t max, const char *name)
 
 	pr_info("created new zone '%s' with alloc size '%d' and max size '%d\n",
 		zone->name, zone->size, zone->max_size);
-	num_zones_used += 1;
+	atomic_fetch_add_32(&num_zones_used, 1);
 
-	/* set the zone state, and return it */
-	zone->state = ZONE_STATE_USED;
 	return zone;
 }
 
@@ -271,17 +281,19 @@ void *zalloc(zone_t *zone)
 	 * it to the used list, update the counters and return the address of the
 	 * element (exactly after the zone metadata).
 	*/
+	spin_lock(&zone->lock);
 	meta = list_first_entry(&zone->free_elems, struct zone_alloc_metadata, alloc);
 	list_move(&meta->alloc, &zone->used_elems);
 
 	zone->count += 1;
 	zone->count_free -= 1;
+	spin_unlock(&zone->lock);
 
+	addr = (vm_address_t)meta + sizeof(struct zone_alloc_metadata);
+	trace_zalloc(zone, addr);
 
-	addr = (vm_address_t)meta;
-	pr_debug("allocated element in zone '%s': 0x%lx\n", zone->name,
-		addr + sizeof(struct zone_alloc_metadata));
-	return (void *) (addr + sizeof(struct zone_alloc_metadata));
+	pr_debug("allocated element in zone '%s': 0x%lx\n", zone->name, addr);
+	return (void *) addr;
 }
 
 /**
@@ -301,7 +313,9 @@ void zfree(zone_t *zone, vm_address_t addr)
 	 * free list.
 	*/
 	meta_addr = addr - sizeof(struct zone_alloc_metadata);
+	trace_zfree(zone, addr);
 
+	spin_lock(&zone->lock);
 	list_for_each_entry(meta, &zone->used_elems, alloc) {
 		if ((vm_address_t)meta == meta_addr) {
 			memset(addr, '\0', zone->elem_size);
@@ -318,4 +332,5 @@ void zfree(zone_t *zone, vm_address_t addr)
 				addr, zone->name);
 		}
 	}
+	spin_unlock(&zone->lock);
 }
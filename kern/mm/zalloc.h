@@ -37,6 +37,7 @@
 
 #include <kern/trace/printk.h>
 #include <kern/vm/vm_types.h>
+#include <kern/spinlock.h>
 
 #define ZONE_NULL					NULL
 
@@ -76,6 +77,8 @@ typedef struct zone {
 	integer_t	index;			/* Zone index */
 	const char	*name;			/* Zone name */
 
+	spinlock_t	lock;			/* Protects the lists and counters */
+
 	uint32_t	
 
 #define ZONE_STATE_UNUSED		(0x0)
@@ -0,0 +1,350 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#define pr_fmt(fmt)	"mutex: " fmt
+
+#include <kern/mutex.h>
+#include <kern/sched.h>
+#include <kern/cpu.h>
+
+#include <libkern/panic.h>
+
+/**
+ * Protects the priority inheritance state: every thread's sched_pri, blocked_on
+ * and mutexes_contended. Mutex wait queues are changed with both their wait
+ * lock and this held, so the priority of a mutex's top waiter can be read with
+ * just this. Always taken inside a wait lock.
+ */
+DEFINE_SPINLOCK(mutex_pi_lock);
+
+void __mutex_init(mutex_t *mutex, struct lock_class *class)
+{
+	mutex->owner = 0;
+	__spin_lock_init(&mutex->wait_lock, class);
+	INIT_LIST_HEAD(&mutex->waiters);
+	INIT_LIST_HEAD(&mutex->contended);
+}
+
+/*******************************************************************************
+ * Priority inheritance
+*******************************************************************************/
+
+/**
+ * __mutex_boost
+ *
+ * Raise the effective priority of a mutex owner to that of a new waiter, and
+ * follow the chain of mutexes the owner is itself blocked on.
+ */
+static void __mutex_boost(thread_t *owner, integer_t pri)
+{
+	while (owner != THREAD_NULL && owner->sched_pri < pri) {
+		owner->sched_pri = pri;
+		if (owner->blocked_on == NULL)
+			break;
+
+		owner = mutex_owner(owner->blocked_on);
+	}
+}
+
+/**
+ * __mutex_inherited_pri
+ *
+ * The effective priority of a thread, its own or that of the highest priority
+ * waiter on any mutex it holds.
+ */
+static integer_t __mutex_inherited_pri(thread_t *thread)
+{
+	thread_t *waiter;
+	mutex_t *mutex;
+	integer_t pri;
+
+	pri = thread->priority;
+	list_for_each_entry(mutex, &thread->mutexes_contended, contended) {
+		waiter = thread_wait_queue_first(&mutex->waiters);
+		if (waiter != THREAD_NULL && waiter->sched_pri > pri)
+			pri = waiter->sched_pri;
+	}
+	return pri;
+}
+
+/*******************************************************************************
+ * Mutex
+*******************************************************************************/
+
+static inline int __mutex_trylock_fast(mutex_t *mutex, thread_t *self)
+{
+	return atomic_cmpxchg_64(&mutex->owner, 0, (uint64_t) self) == 0;
+}
+
+#if DEFAULTS_SET(DEFAULTS_KERNEL_MUTEX_SPIN)
+/**
+ * __mutex_spin
+ *
+ * While the owner is running on another CPU it's likely to release the mutex
+ * before we'd have finished going to sleep, so spin for it. Give up once the
+ * owner is switched out, or this CPU has something else to run.
+ */
+static int __mutex_spin(mutex_t *mutex, thread_t *self)
+{
+	thread_t *owner;
+	cpu_t *cpu;
+
+	cpu = cpu_get_current();
+	for (unsigned long i = 0; i < DEFAULTS_KERNEL_MUTEX_SPIN_MAX; i++) {
+		owner = mutex_owner(mutex);
+		if (owner == THREAD_NULL) {
+			if (__mutex_trylock_fast(mutex, self))
+				return 1;
+			continue;
+		}
+
+		if (!owner->on_cpu || cpu_read_flag(cpu->cpu_num, CPU_FLAG_NEED_RESCHED))
+			return 0;
+
+		cpu_relax();
+	}
+	return 0;
+}
+#endif
+
+static void __mutex_lock_slow(mutex_t *mutex, thread_t *self)
+{
+	uint64_t flags, old, prev;
+	thread_t *owner;
+
+	flags = spin_lock_irqsave(&mutex->wait_lock);
+
+	/* take it if it's been released, otherwise flag that there's a waiter */
+	old = __atomic_load_n(&mutex->owner, __ATOMIC_RELAXED);
+	for (;;) {
+		if ((old & MUTEX_OWNER_MASK) == 0) {
+			prev = atomic_cmpxchg_64(&mutex->owner, old, old | (uint64_t) self);
+			if (prev == old) {
+				spin_unlock_irqrestore(&mutex->wait_lock, flags);
+				return;
+			}
+		} else {
+			if (old & MUTEX_HAS_WAITERS)
+				break;
+
+			prev = atomic_cmpxchg_64(&mutex->owner, old, old | MUTEX_HAS_WAITERS);
+			if (prev == old)
+				break;
+		}
+		old = prev;
+	}
+
+	/* with the waiters flag set, only the wait lock holder changes the owner */
+	owner = (thread_t *) (old & MUTEX_OWNER_MASK);
+
+	__spin_lock(&mutex_pi_lock);
+	if (list_empty(&mutex->waiters))
+		list_add_tail(&mutex->contended, &owner->mutexes_contended);
+
+	thread_wait_queue_add(&mutex->waiters, self);
+	self->blocked_on = mutex;
+	__mutex_boost(owner, self->sched_pri);
+	__spin_unlock(&mutex_pi_lock);
+
+	/* sleep until the owner hands it over */
+	while (mutex_owner(mutex) != self) {
+		spin_unlock_irqrestore(&mutex->wait_lock, flags);
+		thread_wait();
+		flags = spin_lock_irqsave(&mutex->wait_lock);
+	}
+
+	spin_unlock_irqrestore(&mutex->wait_lock, flags);
+}
+
+/**
+ * mutex_lock
+ *
+ * Take the mutex, sleeping until it's available.
+ */
+void mutex_lock(mutex_t *mutex)
+{
+	thread_t *self;
+
+	might_sleep();
+	self = thread_get_current();
+
+	if (__mutex_trylock_fast(mutex, self))
+		return;
+
+#if DEFAULTS_SET(DEFAULTS_KERNEL_MUTEX_SPIN)
+	if (__mutex_spin(mutex, self))
+		return;
+#endif
+
+	__mutex_lock_slow(mutex, self);
+}
+
+/**
+ * mutex_trylock
+ *
+ * Take the mutex if it's available, returning whether it was taken.
+ */
+int mutex_trylock(mutex_t *mutex)
+{
+	return __mutex_trylock_fast(mutex, thread_get_current());
+}
+
+static void __mutex_unlock_slow(mutex_t *mutex, thread_t *self)
+{
+	thread_t *next;
+	uint64_t flags, owner;
+
+	flags = spin_lock_irqsave(&mutex->wait_lock);
+	__spin_lock(&mutex_pi_lock);
+
+	/* hand it to the highest priority waiter, along with any left waiting */
+	list_del_init(&mutex->contended);
+	owner = 0;
+
+	next = thread_wait_queue_pop(&mutex->waiters);
+	if (next != THREAD_NULL) {
+		next->blocked_on = NULL;
+		owner = (uint64_t) next;
+
+		if (!list_empty(&mutex->waiters)) {
+			owner |= MUTEX_HAS_WAITERS;
+			list_add_tail(&mutex->contended, &next->mutexes_contended);
+		}
+		next->sched_pri = __mutex_inherited_pri(next);
+	}
+
+	/* drop any priority that was lent to us through this mutex */
+	self->sched_pri = __mutex_inherited_pri(self);
+
+	__atomic_store_n(&mutex->owner, owner, __ATOMIC_RELEASE);
+	__spin_unlock(&mutex_pi_lock);
+
+	if (next != THREAD_NULL)
+		thread_wakeup(next);
+
+	spin_unlock_irqrestore(&mutex->wait_lock, flags);
+
+	/* let the new owner run now if it outranks us */
+	if (next != THREAD_NULL && next->sched_pri > self->sched_pri &&
+			preemptible() && !machine_irq_disabled())
+		sched_yield();
+}
+
+/**
+ * mutex_unlock
+ *
+ * Release the mutex, which must be held by the calling thread.
+ */
+void mutex_unlock(mutex_t *mutex)
+{
+	thread_t *self;
+
+	self = thread_get_current();
+	if (mutex_owner(mutex) != self)
+		panic("mutex_unlock: mutex not held by '%s'\n", self->name);
+
+	if (atomic_cmpxchg_64(&mutex->owner, (uint64_t) self, 0) == (uint64_t) self)
+		return;
+
+	__mutex_unlock_slow(mutex, self);
+}
+
+/*******************************************************************************
+ * Condition variables
+*******************************************************************************/
+
+void __cond_init(condvar_t *cond, struct lock_class *class)
+{
+	__spin_lock_init(&cond->lock, class);
+	INIT_LIST_HEAD(&cond->waiters);
+}
+
+/**
+ * cond_wait
+ *
+ * Release the mutex and sleep until the condition variable is signalled, then
+ * take the mutex again. The thread is queued before the mutex is released, so
+ * a signal sent in between isn't lost.
+ */
+void cond_wait(condvar_t *cond, mutex_t *mutex)
+{
+	thread_t *self;
+	uint64_t flags;
+
+	might_sleep();
+	self = thread_get_current();
+
+	flags = spin_lock_irqsave(&cond->lock);
+	thread_wait_queue_add(&cond->waiters, self);
+	spin_unlock_irqrestore(&cond->lock, flags);
+
+	mutex_unlock(mutex);
+
+	/* a signal takes us off the queue before waking us */
+	flags = spin_lock_irqsave(&cond->lock);
+	while (!list_empty(&self->wait_node)) {
+		spin_unlock_irqrestore(&cond->lock, flags);
+		thread_wait();
+		flags = spin_lock_irqsave(&cond->lock);
+	}
+	spin_unlock_irqrestore(&cond->lock, flags);
+
+	mutex_lock(mutex);
+}
+
+/**
+ * cond_signal
+ *
+ * Wake the highest priority thread waiting on the condition variable. Safe to
+ * call from interrupt context.
+ */
+void cond_signal(condvar_t *cond)
+{
+	thread_t *thread;
+	uint64_t flags;
+
+	flags = spin_lock_irqsave(&cond->lock);
+
+	thread = thread_wait_queue_pop(&cond->waiters);
+	if (thread != THREAD_NULL)
+		thread_wakeup(thread);
+
+	spin_unlock_irqrestore(&cond->lock, flags);
+}
+
+/**
+ * cond_broadcast
+ *
+ * Wake every thread waiting on the condition variable.
+ */
+void cond_broadcast(condvar_t *cond)
+{
+	thread_t *thread;
+	uint64_t flags;
+
+	flags = spin_lock_irqsave(&cond->lock);
+
+	while ((thread = thread_wait_queue_pop(&cond->waiters)) != THREAD_NULL)
+		thread_wakeup(thread);
+
+	spin_unlock_irqrestore(&cond->lock, flags);
+}
@@ -0,0 +1,136 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	mutex.h
+ * Desc:	Sleeping locks. A mutex spins for a while if its owner is running on
+ * 			another CPU, as it's likely to be released soon, and otherwise puts
+ * 			the caller to sleep until it's handed the mutex. Waiters lend their
+ * 			priority to the owner, and anything it's blocked on in turn, so a
+ * 			low priority owner can't hold up a high priority waiter.
+ *
+ * 			Condition variables wait for a change to state protected by a mutex.
+ * 			Counting semaphores are in semaphore.h.
+ *
+ * 			None of these can be taken from interrupt context, or while holding a
+ * 			spinlock, as they may sleep.
+*/
+
+#ifndef __KERN_MUTEX_H__
+#define __KERN_MUTEX_H__
+
+#include <tinylibc/stdint.h>
+
+#include <libkern/types.h>
+#include <libkern/list.h>
+#include <kern/spinlock.h>
+#include <kern/thread.h>
+
+/**
+ * Mutex. The owner word is the owning thread, with MUTEX_HAS_WAITERS set while
+ * any thread is waiting, so an uncontended lock and unlock is a single
+ * compare-and-swap each. Once there are waiters, the owner word only changes
+ * under the wait lock, and the mutex is handed directly to the highest priority
+ * waiter on unlock.
+*/
+typedef struct mutex {
+	volatile uint64_t	owner;
+	spinlock_t			wait_lock;
+	list_t				waiters;		/* threads, by wait_node */
+	list_node_t			contended;		/* on the owner's mutexes_contended */
+} mutex_t;
+
+#define MUTEX_HAS_WAITERS		(1UL << 0)
+#define MUTEX_OWNER_MASK		(~MUTEX_HAS_WAITERS)
+
+#define __MUTEX_INIT(__name, __class)										\
+	{																		\
+		.owner = 0,															\
+		.wait_lock = __SPINLOCK_INIT(__class),								\
+		.waiters = LIST_HEAD_INIT((__name).waiters),					\
+		.contended = LIST_HEAD_INIT((__name).contended),				\
+	}
+
+/* Define a global mutex */
+#define DEFINE_MUTEX(__name)												\
+	__LOCK_CLASS(__lock_class_##__name, #__name);							\
+	mutex_t __name = __MUTEX_INIT(__name, __LOCK_CLASS_PTR(__lock_class_##__name))
+
+/* Initialise a mutex at runtime */
+#define mutex_init(__mutex)													\
+	do {																	\
+		__LOCK_CLASS(__lock_class, #__mutex);								\
+		__mutex_init((__mutex), __LOCK_CLASS_PTR(__lock_class));			\
+	} while (0)
+
+extern void __mutex_init(mutex_t *mutex, struct lock_class *class);
+
+/* Mutex API */
+extern void mutex_lock(mutex_t *mutex);
+extern int mutex_trylock(mutex_t *mutex);
+extern void mutex_unlock(mutex_t *mutex);
+
+static inline thread_t *mutex_owner(mutex_t *mutex)
+{
+	return (thread_t *) (__atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) &
+		MUTEX_OWNER_MASK);
+}
+
+static inline int mutex_is_locked(mutex_t *mutex)
+{
+	return mutex_owner(mutex) != THREAD_NULL;
+}
+
+/**
+ * Condition variable. cond_wait() releases the mutex and sleeps until it's
+ * signalled, then takes the mutex again before returning. As another thread
+ * can get in first, callers recheck their condition in a loop.
+*/
+typedef struct condvar {
+	spinlock_t			lock;
+	list_t				waiters;		/* threads, by wait_node */
+} condvar_t;
+
+#define __CONDVAR_INIT(__name, __class)										\
+	{																		\
+		.lock = __SPINLOCK_INIT(__class),									\
+		.waiters = LIST_HEAD_INIT((__name).waiters),					\
+	}
+
+#define DEFINE_CONDVAR(__name)												\
+	__LOCK_CLASS(__lock_class_##__name, #__name);							\
+	condvar_t __name = __CONDVAR_INIT(__name, __LOCK_CLASS_PTR(__lock_class_##__name))
+
+#define cond_init(__cond)													\
+	do {																	\
+		__LOCK_CLASS(__lock_class, #__cond);								\
+		__cond_init((__cond), __LOCK_CLASS_PTR(__lock_class));				\
+	} while (0)
+
+extern void __cond_init(condvar_t *cond, struct lock_class *class);
+
+/* Condition variable API */
+extern void cond_wait(condvar_t *cond, mutex_t *mutex);
+extern void cond_signal(condvar_t *cond);
+extern void cond_broadcast(condvar_t *cond);
+
+#endif /* __kern_mutex_h__ */
@@ -27,7 +27,9 @@
 
 #include <kern/trace/printk.h>
 #include <kern/machine.h>
+#include <kern/ksym.h>
 #include <kern/task.h>
+#include <kern/ipi.h>
 
 extern void kernel_init(struct boot_args *boot_args, uint64_t x1, uint64_t x2);
 
@@ -36,6 +38,9 @@ static void __print_backtrace(cpu_t *panic_cpu);
 
 static int panic_active = 0;
 
+/* symbolised addresses, static as the panicking stack may be short on space */
+static char panic_sym[KSYM_STRING_MAX];
+
 #define PANIC_FLAG_NONE		0
 #define PANIC_FLAG_CPUTRACE	1
 
@@ -78,9 +83,19 @@ static void __panic(int flags, void *frame, const char *fmt, ...)
 
 	/**
 	 * Disable interrupts, the kernel cannot recover from this state and the
-	 * panic handler needs to be able to complete and then halt the cpu.
+	 * panic handler needs to be able to complete and then halt the cpu. This
+	 * includes pseudo-NMIs, which would otherwise still be taken.
+	 */
+	machine_irq_mask_all();
+
+	/* park the other cpus, so they don't carry on underneath the panic */
+	smp_send_stop();
+
+	/**
+	 * The console thread won't run again, so write out what's already been
+	 * logged and have the rest of the panic go straight to the uart.
 	 */
-	machine_irq_disable();
+	console_panic_flush();
 
 	/**
 	 * We assume that it's the currently active CPU that has panicked, so obtain
@@ -129,6 +144,10 @@ static void __panic(int flags, void *frame, const char *fmt, ...)
 			_frame->regs[24], _frame->regs[25], _frame->regs[26], _frame->regs[27]);
 		kprintf(" x28: 0x%016llx   fp: 0x%016llx   lr: 0x%016llx   sp: 0x%016llx\n",
 			_frame->regs[28], _frame->fp, _frame->lr, _frame->sp);
+		ksym_snprint(panic_sym, sizeof (panic_sym), _frame->elr);
+		kprintf("  pc: %s\n", panic_sym);
+		ksym_snprint(panic_sym, sizeof (panic_sym), _frame->lr);
+		kprintf("  lr: %s\n", panic_sym);
 		kprintf("\n");
 
 		elx = (sysreg_read(currentel) >> 2);
@@ -181,7 +200,10 @@ static void __print_backtrace(cpu_t *panic_cpu)
 		if (fr == NULL || fr->parent == NULL)
 			break;
 
-		kprintf("\t%d: 0x%lx\n", i, fr->return_addr);
+		/* the address itself if it can't be named */
+		ksym_snprint(panic_sym, sizeof (panic_sym),
+			(vm_address_t) fr->return_addr);
+		kprintf("\t%d: %s\n", i, panic_sym);
 		fr = fr->parent;
 	}
 	kprintf("\n");
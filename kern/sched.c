@@ -23,80 +23,265 @@
 #define pr_fmt(fmt)	"sched: " fmt
 
 #include <kern/machine.h>
+#include <kern/machine/machine_pmu.h>
+#include <kern/machine/machine_fpsimd.h>
 #include <kern/sched.h>
 #include <kern/task.h>
+#include <kern/clock.h>
+#include <kern/trace/events.h>
 
+#include <libkern/panic.h>
+
+DEFINE_STATIC_KEY(sched_debug_msg, DEFAULTS_SET(DEFAULTS_KERNEL_SCHED_DEBUG_MSG));
+
+/**
+ * Protects the global `threads` list and thread state. It's held across the
+ * context switch, and released by the thread being switched to, either on its
+ * way back out of __sched_switch() or in sched_tail() if it's new.
+ */
+DEFINE_SPINLOCK(sched_lock);
+
+/**
+ * sched_idle
+ *
+ * Idle thread. Only selected when no other thread on the processor is able to
+ * run, and sleeps the cpu until the next interrupt.
+ */
+static void sched_idle(void *arg)
+{
+	while (1)
+		__asm__ volatile ("wfi");
+}
+
+/**
+ * sched_init
+ *
+ * Create the idle thread for the boot processor. Must be called once the
+ * kernel thread has been created, as that must have thread_id 0.
+ */
 void sched_init(void)
 {
-	// nothing to do here, yet.
+	processor_t *processor;
+
+	processor = cpu_get_current()->processor;
+	processor->idle_thread = thread_create(kernel_task, THREAD_PRIORITY_LOW,
+		(thread_entry_t) sched_idle, "idle");
+
+	pr_info("sched_init complete\n");
+}
+
+/**
+ * preempt_disable
+ *
+ * Stop the current thread being switched out on the way out of an interrupt,
+ * until the matching preempt_enable(). Nests.
+ */
+void preempt_disable(void)
+{
+	thread_t *thread;
+
+	thread = cpu_get_current()->cpu_active_thread;
+	if (thread != THREAD_NULL)
+		thread->preempt += 1;
+
+	__asm__ volatile("" : : : "memory");
+}
+
+/**
+ * preempt_enable
+ *
+ * Allow preemption again, and take any reschedule that was held off while it
+ * was disabled. That's left for the next interrupt if this one is nested in an
+ * interrupt or in a region with interrupts disabled.
+ */
+void preempt_enable(void)
+{
+	thread_t *thread;
+	cpu_t *cpu;
+
+	__asm__ volatile("" : : : "memory");
+
+	cpu = cpu_get_current();
+	thread = cpu->cpu_active_thread;
+	if (thread == THREAD_NULL)
+		return;
+
+	thread->preempt -= 1;
+	if (thread->preempt != 0 || cpu->interrupt_nesting != 0)
+		return;
+
+	if (cpu_read_flag(cpu->cpu_num, CPU_FLAG_NEED_RESCHED) &&
+			!machine_irq_disabled()) {
+		cpu_clear_flag(cpu->cpu_num, CPU_FLAG_NEED_RESCHED);
+		sched_yield();
+	}
+}
+
+/**
+ * preemptible
+ *
+ * Whether the active thread can be switched out on the way out of an interrupt.
+ */
+int preemptible(void)
+{
+	thread_t *thread;
+
+	thread = cpu_get_current()->cpu_active_thread;
+	return thread == THREAD_NULL || thread->preempt == 0;
+}
+
+/**
+ * __might_sleep
+ *
+ * Panic if the caller can't sleep, i.e. it's an interrupt handler, it holds a
+ * spinlock, or there's no thread to put to sleep yet.
+ */
+void __might_sleep(const char *func)
+{
+	cpu_t *cpu;
+
+	cpu = cpu_get_current();
+	if (cpu->cpu_active_thread == THREAD_NULL)
+		panic("%s: called before threading has started\n", func);
+
+	if (cpu->interrupt_nesting != 0 || !preemptible() || machine_irq_disabled())
+		panic("%s: sleeping in atomic context\n", func);
 }
 
 /**
  * __select_thread
  * 
- * Logic for selecting the next thread to switch to. Currently, the next thread
- * is simply the next one in the global `threads` list, however eventually we'd
- * like to select them based on some kind of priority.
+ * Logic for selecting the next thread to switch to. The active thread with the
+ * highest effective priority runs, and threads of equal priority take turns,
+ * as the global `threads` list is searched starting after the current thread.
+ * The current thread is only picked again if nothing else of its priority can
+ * run, and the processor's idle thread if nothing at all can.
  */
 static thread_t *__select_thread(thread_t *active_thread)
 {
-	if (list_is_last(&active_thread->threads, &threads)) {
-		return (thread_t *) list_first_entry(&threads, struct thread, threads);
-	}
-	return (thread_t *) container_of(active_thread->threads.next, thread_t, threads);
+	thread_t *idle, *next, *best;
+
+	idle = cpu_get_current()->processor->idle_thread;
+	next = active_thread;
+	best = THREAD_NULL;
+
+	do {
+		if (list_is_last(&next->threads, &threads))
+			next = list_first_entry(&threads, struct thread, threads);
+		else
+			next = container_of(next->threads.next, thread_t, threads);
+
+		if (next == idle || next->state != THREAD_STATE_ACTIVE)
+			continue;
+
+		if (best == THREAD_NULL || next->sched_pri > best->sched_pri)
+			best = next;
+
+	} while (next != active_thread);
+
+	if (best != THREAD_NULL)
+		return best;
+
+	if (idle == THREAD_NULL)
+		panic("sched: no runnable thread and no idle thread\n");
+	return idle;
 }
 
 /**
- * __schedule
- * 
- * Thread scheduler. Called when the timer interrupt is fired, and determines
- * the next task to switch to, and then managing that context switch.
-*/
-void __schedule(arm64_exception_frame_t *frame)
+ * __sched_switch
+ *
+ * Select the next thread and switch to it. Must be called with interrupts
+ * masked, and returns once the calling thread is selected again.
+ */
+static void __sched_switch(void)
 {
 	thread_t *thread, *next_thread;
+	uint64_t now;
 	cpu_t *cpu;
 
-	machine_irq_disable();
 	cpu = cpu_get_current();
-
-	/**
-	 * the next thread is selected via __select_thread, and then we verify if
-	 * that thread is active. if it is, we can switch to it, otherwise we continue
-	 * to select a thread until an active one is found.
-	 */
 	thread = cpu->cpu_active_thread;
 
+	__spin_lock(&sched_lock);
+
 	next_thread = __select_thread(thread);
-	while (next_thread->state != THREAD_STATE_ACTIVE) {
-		pr_debug("failed to select an active thread: %s.%d: %d\n",
-			next_thread->task->name, next_thread->thread_id,
-			next_thread->state);
-		next_thread = __select_thread(thread);
+	if (next_thread == thread) {
+		__spin_unlock(&sched_lock);
+		return;
 	}
 
+	/* charge the outgoing thread for the time since it was switched in */
+	now = ktime_get_ns();
+	if (thread != THREAD_NULL)
+		thread->total_time += now - thread->current_time;
+	next_thread->current_time = now;
+
+	trace_sched_switch(thread, next_thread);
+	machine_pmu_switch(thread, next_thread);
+	machine_fpsimd_switch(thread, next_thread);
+
 	pr_debug("switching to thread: %s.%d\n", next_thread->task->name,
 		next_thread->thread_id);
 
+	if (thread != THREAD_NULL)
+		thread->on_cpu = 0;
+	next_thread->on_cpu = 1;
+
 	set_current_task(next_thread->task);
-	thread_save_context(thread, frame);
-	thread_load_context(next_thread);
+	cpu_set_active_thread(cpu->cpu_num, next_thread);
+	cpu_set_active_stack(cpu->cpu_num, next_thread->stack);
+
+	thread_switch_context(thread, next_thread);
+
+	/* switched back to, the lock was taken by whoever switched to us */
+	__spin_unlock(&sched_lock);
 }
 
 /**
- * sched_tail
+ * __schedule
  * 
- * Scheduler tail. Called when returning from a context switch. Sets the new
- * active thread, enables preemption and unmasks interrupts.
+ * Thread scheduler. Called on the way out of an interrupt when a handler has
+ * requested a reschedule, i.e. the timer tick. The interrupted thread's full
+ * register state is in the exception frame on its own stack, so only the
+ * callee-saved context needs switching here. When this thread is switched back
+ * to, __schedule returns and the exception frame is restored.
 */
-void sched_tail(thread_t *thread)
+void __schedule(arm64_exception_frame_t *frame)
 {
-	/* idk why this needs to be done, but it does. for some fucking reason */
-	vm_address_t stack = thread->stack;
+	machine_irq_disable();
+	__sched_switch();
+}
 
+/**
+ * sched_yield
+ *
+ * Voluntarily give up the cpu. If the current thread is no longer active, i.e.
+ * it's waiting, it will not be selected again until it has been woken up.
+ */
+void sched_yield(void)
+{
+	uint64_t flags;
+
+	flags = machine_irq_save();
+	__sched_switch();
+	machine_irq_restore(flags);
+}
+
+/**
+ * sched_tail
+ * 
+ * Scheduler tail. Called when a new thread is entered for the first time. Sets
+ * the new active thread, releases the scheduler lock taken by the thread that
+ * switched to it, unmasks interrupts and returns the thread's argument for
+ * __fork64_return to pass to the entry point.
+*/
+void *sched_tail(thread_t *thread)
+{
 	cpu_set_active_thread(machine_get_cpu_num(), thread);
-	cpu_set_active_stack(machine_get_cpu_num(), stack);
+	cpu_set_active_stack(machine_get_cpu_num(), thread->stack);
 
-	//thread_preempt_enable(thread);
+	__spin_unlock(&sched_lock);
 	machine_irq_enable();
+
+	return thread->args;
 }
@@ -29,14 +29,36 @@
 #define __KERN_SCHED_H__
 
 #include <kern/thread.h>
+#include <kern/spinlock.h>
+#include <kern/static_key.h>
 #include <kern/trace/printk.h>
 
 #include <arch/arch.h>
 
 extern uint64_t	__fork64_exec();
+extern void __fork64_switch(thread_t *thread, thread_t *next);
 extern void __fork64_return();
 
+extern void sched_init(void);
+extern void sched_yield(void);
+extern void *sched_tail(thread_t *thread);
+
 extern void __schedule(arm64_exception_frame_t *frame);
 
+/* Preemption, see spinlock.h */
+extern void preempt_disable(void);
+extern void preempt_enable(void);
+extern int preemptible(void);
+
+/* Check the caller is able to block */
+extern void __might_sleep(const char *func);
+#define might_sleep()		__might_sleep(__func__)
+
+/* Protects the thread list and thread state, taken with interrupts masked */
+extern spinlock_t sched_lock;
+
+/* Log every interrupt and timer tick, defaults to DEFAULTS_KERNEL_SCHED_DEBUG_MSG */
+extern struct static_key sched_debug_msg;
+
 
 #endif /* __kern_sched_h__ */
\ No newline at end of file
@@ -0,0 +1,106 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#define pr_fmt(fmt)	"sema: " fmt
+
+#include <kern/semaphore.h>
+#include <kern/sched.h>
+
+void __sema_init(semaphore_t *sema, uint32_t count, struct lock_class *class)
+{
+	__spin_lock_init(&sema->lock, class);
+	sema->count = count;
+	INIT_LIST_HEAD(&sema->waiters);
+}
+
+/**
+ * sema_wait
+ *
+ * Take a unit from the semaphore, sleeping until one is posted if there are
+ * none left.
+ */
+void sema_wait(semaphore_t *sema)
+{
+	thread_t *self;
+	uint64_t flags;
+
+	might_sleep();
+	self = thread_get_current();
+
+	flags = spin_lock_irqsave(&sema->lock);
+	if (sema->count > 0) {
+		sema->count -= 1;
+		spin_unlock_irqrestore(&sema->lock, flags);
+		return;
+	}
+
+	/* sema_post() takes us off the queue when it gives us the unit */
+	thread_wait_queue_add(&sema->waiters, self);
+	while (!list_empty(&self->wait_node)) {
+		spin_unlock_irqrestore(&sema->lock, flags);
+		thread_wait();
+		flags = spin_lock_irqsave(&sema->lock);
+	}
+
+	spin_unlock_irqrestore(&sema->lock, flags);
+}
+
+/**
+ * sema_trywait
+ *
+ * Take a unit from the semaphore if there is one, returning whether it did.
+ */
+int sema_trywait(semaphore_t *sema)
+{
+	uint64_t flags;
+	int taken;
+
+	flags = spin_lock_irqsave(&sema->lock);
+
+	taken = sema->count > 0;
+	if (taken)
+		sema->count -= 1;
+
+	spin_unlock_irqrestore(&sema->lock, flags);
+	return taken;
+}
+
+/**
+ * sema_post
+ *
+ * Return a unit to the semaphore, or give it to the highest priority waiter.
+ */
+void sema_post(semaphore_t *sema)
+{
+	thread_t *thread;
+	uint64_t flags;
+
+	flags = spin_lock_irqsave(&sema->lock);
+
+	thread = thread_wait_queue_pop(&sema->waiters);
+	if (thread != THREAD_NULL)
+		thread_wakeup(thread);
+	else
+		sema->count += 1;
+
+	spin_unlock_irqrestore(&sema->lock, flags);
+}
@@ -0,0 +1,75 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	semaphore.h
+ * Desc:	Counting semaphores. sema_wait() takes a unit, sleeping until one is
+ * 			available, and sema_post() returns one, handing it straight to the
+ * 			highest priority waiter if there is one. Posting is safe from
+ * 			interrupt context, so a handler can wake a thread with one.
+*/
+
+#ifndef __KERN_SEMAPHORE_H__
+#define __KERN_SEMAPHORE_H__
+
+#include <tinylibc/stdint.h>
+
+#include <libkern/types.h>
+#include <libkern/list.h>
+#include <kern/spinlock.h>
+#include <kern/thread.h>
+
+typedef struct semaphore {
+	spinlock_t			lock;
+	uint32_t			count;
+	list_t				waiters;		/* threads, by wait_node */
+} semaphore_t;
+
+#define __SEMAPHORE_INIT(__name, __count, __class)							\
+	{																		\
+		.lock = __SPINLOCK_INIT(__class),									\
+		.count = (__count),													\
+		.waiters = LIST_HEAD_INIT((__name).waiters),						\
+	}
+
+/* Define a global semaphore with `count` units */
+#define DEFINE_SEMAPHORE(__name, __count)									\
+	__LOCK_CLASS(__lock_class_##__name, #__name);							\
+	semaphore_t __name = __SEMAPHORE_INIT(__name, __count,					\
+		__LOCK_CLASS_PTR(__lock_class_##__name))
+
+/* Initialise a semaphore at runtime */
+#define sema_init(__sema, __count)											\
+	do {																	\
+		__LOCK_CLASS(__lock_class, #__sema);								\
+		__sema_init((__sema), (__count), __LOCK_CLASS_PTR(__lock_class));	\
+	} while (0)
+
+extern void __sema_init(semaphore_t *sema, uint32_t count,
+		struct lock_class *class);
+
+/* Semaphore API */
+extern void sema_wait(semaphore_t *sema);
+extern int sema_trywait(semaphore_t *sema);
+extern void sema_post(semaphore_t *sema);
+
+#endif /* __kern_semaphore_h__ */
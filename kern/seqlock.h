@@ -0,0 +1,141 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	seqlock.h
+ * Desc:	Sequence counters and locks. Readers never block the writer, they
+ * 			take a copy of the protected data and retry if the sequence
+ * 			changed while they were reading.
+ *
+ * 			The latch variant keeps two copies of the data, and readers use the
+ * 			one that isn't being written, so a reader that interrupts the
+ * 			writer, i.e. from a pseudo-NMI, never has to wait for it.
+*/
+
+#ifndef __KERN_SEQLOCK_H__
+#define __KERN_SEQLOCK_H__
+
+#include <tinylibc/stdint.h>
+#include <kern/machine/machine-irq.h>
+#include <arch/arch.h>
+
+typedef struct seqcount {
+	volatile uint32_t	sequence;
+} seqcount_t;
+
+#define SEQCOUNT_INIT		{ .sequence = 0 }
+
+/* Readers */
+static inline uint32_t read_seqcount_begin(const seqcount_t *s)
+{
+	uint32_t seq;
+
+	/* an odd sequence means a write is in progress */
+	while ((seq = s->sequence) & 1)
+		;
+	dmbishld();
+	return seq;
+}
+
+static inline int read_seqcount_retry(const seqcount_t *s, uint32_t start)
+{
+	dmbishld();
+	return s->sequence != start;
+}
+
+/* Writers, which must be serialised */
+static inline void write_seqcount_begin(seqcount_t *s)
+{
+	s->sequence++;
+	dmbishst();
+}
+
+static inline void write_seqcount_end(seqcount_t *s)
+{
+	dmbishst();
+	s->sequence++;
+}
+
+/**
+ * Latch. Readers use copy (sequence & 1), and the writer updates each copy in
+ * turn, bumping the sequence first to steer readers to the other one:
+ *
+ *		write_seqcount_latch(&seq);		readers move to copy 1
+ *		data[0] = new;
+ *		write_seqcount_latch(&seq);		readers move to copy 0
+ *		data[1] = new;
+*/
+static inline uint32_t read_seqcount_latch(const seqcount_t *s)
+{
+	uint32_t seq = s->sequence;
+
+	dmbishld();
+	return seq;
+}
+
+static inline int read_seqcount_latch_retry(const seqcount_t *s, uint32_t start)
+{
+	return read_seqcount_retry(s, start);
+}
+
+static inline void write_seqcount_latch(seqcount_t *s)
+{
+	dmbishst();
+	s->sequence++;
+	dmbishst();
+}
+
+/**
+ * Seqlock. A sequence counter with the writers serialised by disabling
+ * interrupts, there being only one CPU to exclude.
+*/
+typedef struct seqlock {
+	seqcount_t			seqcount;
+} seqlock_t;
+
+#define SEQLOCK_INIT		{ .seqcount = SEQCOUNT_INIT }
+
+static inline uint32_t read_seqbegin(const seqlock_t *sl)
+{
+	return read_seqcount_begin(&sl->seqcount);
+}
+
+static inline int read_seqretry(const seqlock_t *sl, uint32_t start)
+{
+	return read_seqcount_retry(&sl->seqcount, start);
+}
+
+static inline uint64_t write_seqlock_irqsave(seqlock_t *sl)
+{
+	uint64_t flags = machine_irq_save();
+
+	write_seqcount_begin(&sl->seqcount);
+	return flags;
+}
+
+static inline void write_sequnlock_irqrestore(seqlock_t *sl, uint64_t flags)
+{
+	write_seqcount_end(&sl->seqcount);
+	machine_irq_restore(flags);
+}
+
+#endif /* __kern_seqlock_h__ */
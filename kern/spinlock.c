@@ -0,0 +1,446 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#define pr_fmt(fmt)	"lock: " fmt
+
+#include <kern/spinlock.h>
+#include <kern/sched.h>
+#include <kern/clock.h>
+#include <kern/trace/printk.h>
+
+/*******************************************************************************
+ * Lock statistics
+*******************************************************************************/
+
+#if DEFAULTS_SET(DEFAULTS_KERNEL_LOCK_STAT)
+
+/* lock classes, in the .lock_classes section */
+extern struct lock_class __lock_classes_start[];
+extern struct lock_class __lock_classes_end[];
+
+/* count an acquisition, and timestamp it if it's exclusive */
+static void lock_stat_acquired(struct lock_class *class, uint64_t *acquired,
+		uint64_t spins)
+{
+	if (class == NULL)
+		return;
+
+	atomic_fetch_add_64(&class->acquisitions, 1);
+	if (spins) {
+		atomic_fetch_add_64(&class->contended, 1);
+		atomic_fetch_add_64(&class->spins, spins);
+	}
+
+	if (acquired)
+		*acquired = clock_get_counter();
+}
+
+/* account the hold time, called by the holder before releasing the lock */
+static void lock_stat_released(struct lock_class *class, uint64_t acquired)
+{
+	uint64_t held, max, prev;
+
+	if (class == NULL)
+		return;
+
+	held = clock_get_counter() - acquired;
+	atomic_fetch_add_64(&class->hold_total, held);
+
+	for (max = class->hold_max; held > max; max = prev) {
+		prev = atomic_cmpxchg_64(&class->hold_max, max, held);
+		if (prev == max)
+			break;
+	}
+}
+
+#define LOCK_STAT_ACQUIRED(__lock, __spins)									\
+	lock_stat_acquired((__lock)->class, &(__lock)->acquired, (__spins))
+#define LOCK_STAT_ACQUIRED_SHARED(__lock, __spins)							\
+	lock_stat_acquired((__lock)->class, NULL, (__spins))
+#define LOCK_STAT_RELEASED(__lock)											\
+	lock_stat_released((__lock)->class, (__lock)->acquired)
+#define LOCK_STAT_INIT(__lock, __class)										\
+	do {																	\
+		(__lock)->class = (__class);										\
+		(__lock)->acquired = 0;												\
+	} while (0)
+
+#else
+
+#define LOCK_STAT_ACQUIRED(__lock, __spins)			((void) (__spins))
+#define LOCK_STAT_ACQUIRED_SHARED(__lock, __spins)	((void) (__spins))
+#define LOCK_STAT_RELEASED(__lock)
+#define LOCK_STAT_INIT(__lock, __class)				((void) (__class))
+
+#endif
+
+/**
+ * lock_stat_dump
+ *
+ * Print the statistics of every lock class that has been taken.
+ */
+void lock_stat_dump(void)
+{
+#if DEFAULTS_SET(DEFAULTS_KERNEL_LOCK_STAT)
+	struct lock_class *class;
+	uint64_t avg;
+
+	for (class = __lock_classes_start; class < __lock_classes_end; class++) {
+		if (class->acquisitions == 0)
+			continue;
+
+		avg = class->hold_total / class->acquisitions;
+		pr_info("%s: %lld acquisitions, %lld contended, %lld spins, "
+			"hold avg: %lld max: %lld ns\n", class->name,
+			class->acquisitions, class->contended, class->spins,
+			clock_cycles_to_ns(avg), clock_cycles_to_ns(class->hold_max));
+	}
+#else
+	pr_info("lock statistics are disabled\n");
+#endif
+}
+
+/**
+ * lock_stat_reset
+ *
+ * Zero the statistics of every lock class. Locks held at the time still
+ * account their hold time when they're released.
+ */
+void lock_stat_reset(void)
+{
+#if DEFAULTS_SET(DEFAULTS_KERNEL_LOCK_STAT)
+	struct lock_class *class;
+
+	for (class = __lock_classes_start; class < __lock_classes_end; class++) {
+		class->acquisitions = 0;
+		class->contended = 0;
+		class->spins = 0;
+		class->hold_max = 0;
+		class->hold_total = 0;
+	}
+#endif
+}
+
+/*******************************************************************************
+ * Ticket spinlock
+*******************************************************************************/
+
+void __spin_lock_init(spinlock_t *lock, struct lock_class *class)
+{
+	lock->val = 0;
+	LOCK_STAT_INIT(lock, class);
+}
+
+void __spin_lock(spinlock_t *lock)
+{
+	uint16_t ticket, owner;
+	uint64_t spins = 0;
+	uint32_t val;
+
+	/* take a ticket, the acquire covers the uncontended case */
+	val = atomic_fetch_add_32(&lock->val, SPINLOCK_TICKET_INC);
+	ticket = val >> SPINLOCK_TICKET_SHIFT;
+
+	if (ticket != (uint16_t) val) {
+		/* the holder's release store to `owner` wakes us to look again */
+		while ((owner = __atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE))
+				!= ticket) {
+			__cmpwait_16(&lock->owner, owner);
+			spins++;
+		}
+	}
+
+	LOCK_STAT_ACQUIRED(lock, spins);
+}
+
+void __spin_unlock(spinlock_t *lock)
+{
+	LOCK_STAT_RELEASED(lock);
+
+	/* only the holder writes `owner`, so this needs no read-modify-write */
+	__atomic_store_n(&lock->owner, (uint16_t) (lock->owner + 1),
+		__ATOMIC_RELEASE);
+}
+
+int __spin_trylock(spinlock_t *lock)
+{
+	uint32_t val;
+
+	val = __atomic_load_n(&lock->val, __ATOMIC_RELAXED);
+	if ((val >> SPINLOCK_TICKET_SHIFT) != (val & 0xffff))
+		return 0;
+
+	if (atomic_cmpxchg_32(&lock->val, val, val + SPINLOCK_TICKET_INC) != val)
+		return 0;
+
+	LOCK_STAT_ACQUIRED(lock, 0);
+	return 1;
+}
+
+void spin_lock(spinlock_t *lock)
+{
+	preempt_disable();
+	__spin_lock(lock);
+}
+
+void spin_unlock(spinlock_t *lock)
+{
+	__spin_unlock(lock);
+	preempt_enable();
+}
+
+int spin_trylock(spinlock_t *lock)
+{
+	preempt_disable();
+	if (__spin_trylock(lock))
+		return 1;
+
+	preempt_enable();
+	return 0;
+}
+
+/*******************************************************************************
+ * MCS queue lock
+*******************************************************************************/
+
+void __mcs_lock_init(mcs_lock_t *lock, struct lock_class *class)
+{
+	lock->tail = NULL;
+	LOCK_STAT_INIT(lock, class);
+}
+
+void __mcs_lock(mcs_lock_t *lock, mcs_node_t *node)
+{
+	mcs_node_t *prev;
+	uint64_t spins = 0;
+
+	node->next = NULL;
+	node->locked = 0;
+
+	/* join the queue, the release half publishes the node's initial state */
+	prev = (mcs_node_t *) atomic_xchg_64((volatile uint64_t *) &lock->tail,
+		(uint64_t) node);
+
+	/* wait for the previous holder to hand the lock over */
+	if (prev != NULL) {
+		__atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+
+		while (!__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE)) {
+			__cmpwait_32(&node->locked, 0);
+			spins++;
+		}
+	}
+
+	LOCK_STAT_ACQUIRED(lock, spins);
+}
+
+void __mcs_unlock(mcs_lock_t *lock, mcs_node_t *node)
+{
+	mcs_node_t *next;
+
+	LOCK_STAT_RELEASED(lock);
+
+	next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+	if (next == NULL) {
+		/* nobody is queued behind us, so the lock is free */
+		if (atomic_cmpxchg_64((volatile uint64_t *) &lock->tail,
+				(uint64_t) node, 0) == (uint64_t) node)
+			return;
+
+		/* someone has swapped in as the tail, but not linked in yet */
+		while ((next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) == NULL)
+			__cmpwait_64((volatile uint64_t *) &node->next, 0);
+	}
+
+	__atomic_store_n(&next->locked, 1, __ATOMIC_RELEASE);
+}
+
+int __mcs_trylock(mcs_lock_t *lock, mcs_node_t *node)
+{
+	node->next = NULL;
+	node->locked = 0;
+
+	if (atomic_cmpxchg_64((volatile uint64_t *) &lock->tail, 0,
+			(uint64_t) node) != 0)
+		return 0;
+
+	LOCK_STAT_ACQUIRED(lock, 0);
+	return 1;
+}
+
+void mcs_lock(mcs_lock_t *lock, mcs_node_t *node)
+{
+	preempt_disable();
+	__mcs_lock(lock, node);
+}
+
+void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node)
+{
+	__mcs_unlock(lock, node);
+	preempt_enable();
+}
+
+int mcs_trylock(mcs_lock_t *lock, mcs_node_t *node)
+{
+	preempt_disable();
+	if (__mcs_trylock(lock, node))
+		return 1;
+
+	preempt_enable();
+	return 0;
+}
+
+/*******************************************************************************
+ * Reader-writer spinlock
+*******************************************************************************/
+
+void __rwlock_init(rwlock_t *lock, struct lock_class *class)
+{
+	lock->val = 0;
+	LOCK_STAT_INIT(lock, class);
+}
+
+static int __read_trylock(rwlock_t *lock, uint32_t *val)
+{
+	uint32_t old;
+
+	old = *val;
+	if (old & RWLOCK_WRITER)
+		return 0;
+
+	*val = atomic_cmpxchg_32(&lock->val, old, old + 1);
+	return *val == old;
+}
+
+void __read_lock(rwlock_t *lock)
+{
+	uint64_t spins = 0;
+	uint32_t val;
+
+	val = __atomic_load_n(&lock->val, __ATOMIC_RELAXED);
+	while (!__read_trylock(lock, &val)) {
+		/* only wait while a writer has it, a failed cmpxchg just retries */
+		if (val & RWLOCK_WRITER) {
+			__cmpwait_32(&lock->val, val);
+			spins++;
+			val = __atomic_load_n(&lock->val, __ATOMIC_RELAXED);
+		}
+	}
+
+	LOCK_STAT_ACQUIRED_SHARED(lock, spins);
+}
+
+void __read_unlock(rwlock_t *lock)
+{
+	atomic_fetch_add_32(&lock->val, (uint32_t) -1);
+}
+
+void __write_lock(rwlock_t *lock)
+{
+	uint64_t spins = 0;
+	uint32_t val, old;
+
+	/* claim the writer bit, which holds off new readers */
+	val = __atomic_load_n(&lock->val, __ATOMIC_RELAXED);
+	for (;;) {
+		if (val & RWLOCK_WRITER) {
+			__cmpwait_32(&lock->val, val);
+			spins++;
+			val = __atomic_load_n(&lock->val, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		old = atomic_cmpxchg_32(&lock->val, val, val | RWLOCK_WRITER);
+		if (old == val)
+			break;
+		val = old;
+	}
+
+	/* then wait for the readers already in to leave */
+	while ((val = __atomic_load_n(&lock->val, __ATOMIC_ACQUIRE))
+			!= RWLOCK_WRITER) {
+		__cmpwait_32(&lock->val, val);
+		spins++;
+	}
+
+	LOCK_STAT_ACQUIRED(lock, spins);
+}
+
+void __write_unlock(rwlock_t *lock)
+{
+	LOCK_STAT_RELEASED(lock);
+
+	/* readers can't get in while the writer bit is set, so this is all of it */
+	__atomic_store_n(&lock->val, 0, __ATOMIC_RELEASE);
+}
+
+void read_lock(rwlock_t *lock)
+{
+	preempt_disable();
+	__read_lock(lock);
+}
+
+void read_unlock(rwlock_t *lock)
+{
+	__read_unlock(lock);
+	preempt_enable();
+}
+
+int read_trylock(rwlock_t *lock)
+{
+	uint32_t val;
+
+	preempt_disable();
+
+	val = __atomic_load_n(&lock->val, __ATOMIC_RELAXED);
+	if (__read_trylock(lock, &val)) {
+		LOCK_STAT_ACQUIRED_SHARED(lock, 0);
+		return 1;
+	}
+
+	preempt_enable();
+	return 0;
+}
+
+void write_lock(rwlock_t *lock)
+{
+	preempt_disable();
+	__write_lock(lock);
+}
+
+void write_unlock(rwlock_t *lock)
+{
+	__write_unlock(lock);
+	preempt_enable();
+}
+
+int write_trylock(rwlock_t *lock)
+{
+	preempt_disable();
+	if (atomic_cmpxchg_32(&lock->val, 0, RWLOCK_WRITER) == 0) {
+		LOCK_STAT_ACQUIRED(lock, 0);
+		return 1;
+	}
+
+	preempt_enable();
+	return 0;
+}
@@ -0,0 +1,280 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	spinlock.h
+ * Desc:	Spinlocks for exclusion across CPUs. Ticket locks hand the lock out
+ * 			in the order it was asked for, MCS locks queue each waiter on its
+ * 			own node so a contended lock doesn't have every CPU hammering the
+ * 			same cache line, and reader-writer locks let readers share.
+ *
+ * 			Waiters sleep in WFE until the holder's release store wakes them,
+ * 			see __cmpwait in atomic.h. The plain variants disable preemption
+ * 			while held, the _irqsave variants also mask interrupts and must be
+ * 			used for any lock that's taken from an interrupt handler.
+*/
+
+#ifndef __KERN_SPINLOCK_H__
+#define __KERN_SPINLOCK_H__
+
+#include <tinylibc/stdint.h>
+
+#include <libkern/types.h>
+#include <kern/machine/machine-irq.h>
+#include <kern/defaults.h>
+#include <kern/atomic.h>
+
+/**
+ * Lock statistics. With DEFAULTS_KERNEL_LOCK_STAT every lock points at a lock
+ * class, one for each DEFINE_*() and each *_init() call site, so all the zone
+ * locks, for example, are counted together. Times are in counter cycles.
+*/
+struct lock_class {
+	const char			*name;
+	volatile uint64_t	acquisitions;
+	volatile uint64_t	contended;		/* acquisitions that had to wait */
+	volatile uint64_t	spins;			/* wakeups while waiting */
+	volatile uint64_t	hold_max;
+	volatile uint64_t	hold_total;
+};
+
+#if DEFAULTS_SET(DEFAULTS_KERNEL_LOCK_STAT)
+#define __LOCK_CLASS(__var, __name)											\
+	static struct lock_class __var											\
+		__attribute__((section(".lock_classes"), used, aligned(8))) = {		\
+		.name = (__name),													\
+	}
+#define __LOCK_CLASS_PTR(__var)		(&(__var))
+#define __LOCK_STAT_INIT(__class)	.class = (__class), .acquired = 0,
+#else
+#define __LOCK_CLASS(__var, __name)											\
+	extern struct lock_class __var __attribute__((unused))
+#define __LOCK_CLASS_PTR(__var)		NULL
+#define __LOCK_STAT_INIT(__class)
+#endif
+
+extern void lock_stat_dump(void);
+extern void lock_stat_reset(void);
+
+/**
+ * Ticket spinlock. Taking the lock atomically increments `next` and waits for
+ * `owner` to reach the old value, releasing it increments `owner`. Both halves
+ * are 16 bits, so up to 65535 CPUs can wait at once.
+*/
+typedef struct spinlock {
+	union {
+		volatile uint32_t		val;
+		struct {
+			volatile uint16_t	owner;		/* ticket being served */
+			volatile uint16_t	next;		/* next ticket to hand out */
+		};
+	};
+#if DEFAULTS_SET(DEFAULTS_KERNEL_LOCK_STAT)
+	struct lock_class	*class;
+	uint64_t			acquired;		/* counter when it was taken */
+#endif
+} spinlock_t;
+
+#define SPINLOCK_TICKET_SHIFT		(16)
+#define SPINLOCK_TICKET_INC			(1U << SPINLOCK_TICKET_SHIFT)
+
+#define __SPINLOCK_INIT(__class)	{ .val = 0, __LOCK_STAT_INIT(__class) }
+
+/* Define a global spinlock */
+#define DEFINE_SPINLOCK(__name)												\
+	__LOCK_CLASS(__lock_class_##__name, #__name);							\
+	spinlock_t __name = __SPINLOCK_INIT(__LOCK_CLASS_PTR(__lock_class_##__name))
+
+/* Initialise a spinlock at runtime */
+#define spin_lock_init(__lock)												\
+	do {																	\
+		__LOCK_CLASS(__lock_class, #__lock);								\
+		__spin_lock_init((__lock), __LOCK_CLASS_PTR(__lock_class));			\
+	} while (0)
+
+extern void __spin_lock_init(spinlock_t *lock, struct lock_class *class);
+
+/* Take and release the lock without touching preemption or interrupts */
+extern void __spin_lock(spinlock_t *lock);
+extern void __spin_unlock(spinlock_t *lock);
+extern int __spin_trylock(spinlock_t *lock);
+
+/* Spinlock API */
+extern void spin_lock(spinlock_t *lock);
+extern void spin_unlock(spinlock_t *lock);
+extern int spin_trylock(spinlock_t *lock);
+
+static inline int spin_is_locked(spinlock_t *lock)
+{
+	uint32_t val = __atomic_load_n(&lock->val, __ATOMIC_RELAXED);
+
+	return (val >> SPINLOCK_TICKET_SHIFT) != (val & 0xffff);
+}
+
+/**
+ * Masking interrupts also stops this CPU from being preempted, so the
+ * preemption count is left alone.
+*/
+static inline uint64_t spin_lock_irqsave(spinlock_t *lock)
+{
+	uint64_t flags = machine_irq_save();
+
+	__spin_lock(lock);
+	return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *lock, uint64_t flags)
+{
+	__spin_unlock(lock);
+	machine_irq_restore(flags);
+}
+
+/**
+ * MCS queue lock. Each CPU waiting for the lock adds its own node to the tail
+ * of the queue and spins on that, and the holder hands the lock directly to the
+ * next node on release. The node is supplied by the caller, usually on its
+ * stack, and must stay put until the lock is released.
+*/
+typedef struct mcs_node {
+	struct mcs_node * volatile	next;
+	volatile uint32_t			locked;
+} mcs_node_t;
+
+typedef struct mcs_lock {
+	mcs_node_t * volatile		tail;
+#if DEFAULTS_SET(DEFAULTS_KERNEL_LOCK_STAT)
+	struct lock_class			*class;
+	uint64_t					acquired;
+#endif
+} mcs_lock_t;
+
+#define __MCS_LOCK_INIT(__class)	{ .tail = NULL, __LOCK_STAT_INIT(__class) }
+
+#define DEFINE_MCS_LOCK(__name)												\
+	__LOCK_CLASS(__lock_class_##__name, #__name);							\
+	mcs_lock_t __name = __MCS_LOCK_INIT(__LOCK_CLASS_PTR(__lock_class_##__name))
+
+#define mcs_lock_init(__lock)												\
+	do {																	\
+		__LOCK_CLASS(__lock_class, #__lock);								\
+		__mcs_lock_init((__lock), __LOCK_CLASS_PTR(__lock_class));			\
+	} while (0)
+
+extern void __mcs_lock_init(mcs_lock_t *lock, struct lock_class *class);
+
+extern void __mcs_lock(mcs_lock_t *lock, mcs_node_t *node);
+extern void __mcs_unlock(mcs_lock_t *lock, mcs_node_t *node);
+extern int __mcs_trylock(mcs_lock_t *lock, mcs_node_t *node);
+
+/* MCS lock API */
+extern void mcs_lock(mcs_lock_t *lock, mcs_node_t *node);
+extern void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node);
+extern int mcs_trylock(mcs_lock_t *lock, mcs_node_t *node);
+
+static inline uint64_t mcs_lock_irqsave(mcs_lock_t *lock, mcs_node_t *node)
+{
+	uint64_t flags = machine_irq_save();
+
+	__mcs_lock(lock, node);
+	return flags;
+}
+
+static inline void mcs_unlock_irqrestore(mcs_lock_t *lock, mcs_node_t *node,
+		uint64_t flags)
+{
+	__mcs_unlock(lock, node);
+	machine_irq_restore(flags);
+}
+
+/**
+ * Reader-writer spinlock. The low bits count the readers holding the lock, and
+ * RWLOCK_WRITER is set by a writer. A writer sets it as soon as there's no
+ * other writer, which stops new readers, then waits for the existing readers
+ * to drain, so a steady stream of readers can't starve it.
+*/
+typedef struct rwlock {
+	volatile uint32_t	val;
+#if DEFAULTS_SET(DEFAULTS_KERNEL_LOCK_STAT)
+	struct lock_class	*class;
+	uint64_t			acquired;		/* by the writer */
+#endif
+} rwlock_t;
+
+#define RWLOCK_WRITER				(1U << 31)
+#define RWLOCK_READERS_MASK			(RWLOCK_WRITER - 1)
+
+#define __RWLOCK_INIT(__class)		{ .val = 0, __LOCK_STAT_INIT(__class) }
+
+#define DEFINE_RWLOCK(__name)												\
+	__LOCK_CLASS(__lock_class_##__name, #__name);							\
+	rwlock_t __name = __RWLOCK_INIT(__LOCK_CLASS_PTR(__lock_class_##__name))
+
+#define rwlock_init(__lock)													\
+	do {																	\
+		__LOCK_CLASS(__lock_class, #__lock);								\
+		__rwlock_init((__lock), __LOCK_CLASS_PTR(__lock_class));			\
+	} while (0)
+
+extern void __rwlock_init(rwlock_t *lock, struct lock_class *class);
+
+extern void __read_lock(rwlock_t *lock);
+extern void __read_unlock(rwlock_t *lock);
+extern void __write_lock(rwlock_t *lock);
+extern void __write_unlock(rwlock_t *lock);
+
+/* Reader-writer lock API */
+extern void read_lock(rwlock_t *lock);
+extern void read_unlock(rwlock_t *lock);
+extern int read_trylock(rwlock_t *lock);
+extern void write_lock(rwlock_t *lock);
+extern void write_unlock(rwlock_t *lock);
+extern int write_trylock(rwlock_t *lock);
+
+static inline uint64_t read_lock_irqsave(rwlock_t *lock)
+{
+	uint64_t flags = machine_irq_save();
+
+	__read_lock(lock);
+	return flags;
+}
+
+static inline void read_unlock_irqrestore(rwlock_t *lock, uint64_t flags)
+{
+	__read_unlock(lock);
+	machine_irq_restore(flags);
+}
+
+static inline uint64_t write_lock_irqsave(rwlock_t *lock)
+{
+	uint64_t flags = machine_irq_save();
+
+	__write_lock(lock);
+	return flags;
+}
+
+static inline void write_unlock_irqrestore(rwlock_t *lock, uint64_t flags)
+{
+	__write_unlock(lock);
+	machine_irq_restore(flags);
+}
+
+#endif /* __kern_spinlock_h__ */
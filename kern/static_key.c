@@ -0,0 +1,85 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	static_key.c
+ * Desc:	Static key branch patching. See static_key.h.
+*/
+
+#include <kern/static_key.h>
+#include <kern/machine/machine_patch.h>
+
+/* branch sites, from the linker script */
+extern struct static_key_site __static_key_sites_start[];
+extern struct static_key_site __static_key_sites_end[];
+
+/**
+ * patch every branch site of a key to match its state
+ */
+static void __static_key_update(struct static_key *key)
+{
+	struct static_key_site *site;
+	uint32_t insn;
+
+	for (site = __static_key_sites_start; site < __static_key_sites_end; site++) {
+		if (site->key != key)
+			continue;
+
+		insn = key->enabled ? machine_insn_branch(site->code, site->target) :
+			MACHINE_INSN_NOP;
+		machine_patch_text((uint32_t *) site->code, insn);
+	}
+}
+
+/**
+ * static_key_init
+ *
+ * Every site is assembled as a NOP, so patch in the branches for keys that
+ * start out enabled. Should be called as early as possible.
+ */
+void static_key_init(void)
+{
+	struct static_key_site *site;
+
+	for (site = __static_key_sites_start; site < __static_key_sites_end; site++)
+		if (site->key->enabled)
+			machine_patch_text((uint32_t *) site->code,
+				machine_insn_branch(site->code, site->target));
+}
+
+void static_key_enable(struct static_key *key)
+{
+	if (static_key_enabled(key))
+		return;
+
+	__atomic_store_n(&key->enabled, 1, __ATOMIC_RELAXED);
+	__static_key_update(key);
+}
+
+void static_key_disable(struct static_key *key)
+{
+	if (!static_key_enabled(key))
+		return;
+
+	__atomic_store_n(&key->enabled, 0, __ATOMIC_RELAXED);
+	__static_key_update(key);
+}
@@ -0,0 +1,104 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	static_key.h
+ * Desc:	Static keys. A branch on a static key is a single instruction, a
+ * 			NOP while the key is disabled, patched into a branch to the
+ * 			guarded code when it's enabled. Reading a key costs nothing, and
+ * 			changing one is slow, so they're meant for rarely-enabled checks
+ * 			on hot paths, such as debugging and tracing.
+ *
+ * 			if (static_branch_unlikely(&key))
+ * 				rarely_enabled_thing();
+*/
+
+#ifndef __KERN_STATIC_KEY_H__
+#define __KERN_STATIC_KEY_H__
+
+#include <tinylibc/stdint.h>
+
+#include <libkern/types.h>
+#include <kern/vm/vm_types.h>
+
+struct static_key {
+	uint32_t	enabled;
+};
+
+/**
+ * Branch site, one per use of a key, placed in .static_key_sites. `code` is
+ * the NOP, and `target` is where it branches to when the key is enabled.
+ */
+struct static_key_site {
+	vm_address_t		code;
+	vm_address_t		target;
+	struct static_key	*key;
+};
+
+#define STATIC_KEY_INIT(__enabled)		{ .enabled = (__enabled) }
+#define DEFINE_STATIC_KEY(__name, __enabled)								\
+	struct static_key __name = STATIC_KEY_INIT(__enabled)
+
+/* Static key API */
+extern void static_key_init(void);
+extern void static_key_enable(struct static_key *key);
+extern void static_key_disable(struct static_key *key);
+
+static inline int static_key_enabled(struct static_key *key)
+{
+	return __atomic_load_n(&key->enabled, __ATOMIC_RELAXED);
+}
+
+/**
+ * The branch site. Emits a NOP, and records where it is, where to branch to,
+ * and the key. The key must be a constant address, i.e. a global or static.
+ */
+#define __STATIC_KEY_SITE(__key, __label)									\
+	__asm__ goto(															\
+		"1:	nop\n"															\
+		"	.pushsection .static_key_sites, \"aw\"\n"						\
+		"	.balign 8\n"													\
+		"	.quad 1b, %l[" #__label "], %c0\n"								\
+		"	.popsection\n"													\
+		: : "i" (__key) : : __label)
+
+/**
+ * static_branch_unlikely(key)
+ *
+ * True if the key is enabled. The guarded code is placed out of the way, and
+ * skipped by a NOP while the key is disabled. Sites are only patched to match
+ * a key that starts enabled once static_key_init() has run.
+ */
+#define static_branch_unlikely(__key)										\
+	({																		\
+		__label__ __static_key_true;										\
+		int __static_key_ret = 0;											\
+																			\
+		__STATIC_KEY_SITE(__key, __static_key_true);						\
+		if (0) {															\
+	__static_key_true:														\
+			__static_key_ret = 1;											\
+		}																	\
+		__static_key_ret;													\
+	})
+
+#endif /* __kern_static_key_h__ */
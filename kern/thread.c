@@ -78,6 +78,7 @@ thread_t *thread_create(task_t *parent_task, integer_t priority,
 {
 	vm_address_t stack;
 	thread_t *thread;
+	uint64_t flags;
 
 	/**
 	 * Thread structures are allocated within the thread_zone in kernel memory,
@@ -87,13 +88,31 @@ thread_t *thread_create(task_t *parent_task, integer_t priority,
 	thread = (thread_t *) zalloc(thread_zone);
 
 	/* initial state is inactive */
-	thread->stack = THREAD_STATE_INACTIVE;
+	thread->state = THREAD_STATE_INACTIVE;
+	thread->wakeup = 0;
+	thread->neon = 0;
+	thread->args = NULL;
+	thread->pmu.nr = 0;
+
+#if DEFAULTS_SET(DEFAULTS_KERNEL_FGRAPH)
+	fgraph_stack_init(&thread->fgraph);
+#endif
 
 	/**
 	 * initial values for the thread: references, preemption, and thread_id.
 	*/
 	thread->ref_count = 2;
 	thread->preempt = 0;
+
+	if (priority > THREAD_PRIORITY_MAX)
+		priority = THREAD_PRIORITY_MAX;
+	thread->priority = priority;
+	thread->sched_pri = priority;
+	thread->on_cpu = 0;
+
+	INIT_LIST_HEAD(&thread->wait_node);
+	thread->blocked_on = NULL;
+	INIT_LIST_HEAD(&thread->mutexes_contended);
 	
 	thread->thread_id = thread_id_max;
 	thread_id_max+=1;
@@ -108,7 +127,9 @@ thread_t *thread_create(task_t *parent_task, integer_t priority,
 	task_assign_thread(parent_task, thread);
 
 	/* assign thread to global list */
+	flags = spin_lock_irqsave(&sched_lock);
 	list_add_tail(&thread->threads, &threads);
+	spin_unlock_irqrestore(&sched_lock, flags);
 
 	/* set the threads name */
 	thread_set_name(thread, name);
@@ -149,7 +170,9 @@ kern_return_t thread_destroy(thread_t *thread)
 
 	/* remove the thread from the siblings and global lists */
 	list_del(&thread->siblings);
+	__spin_lock(&sched_lock);
 	list_del(&thread->threads);
+	__spin_unlock(&sched_lock);
 
 	/* free the thread's stack in the stack_zone */
 	stack_free(thread);
@@ -186,6 +209,104 @@ kern_return_t thread_unblock()
 	machine_irq_enable();
 }
 
+/**
+ * thread_wait
+ *
+ * Put the current thread to sleep until thread_wakeup() is called on it. If a
+ * wakeup was already delivered while the thread was running, return straight
+ * away so it isn't lost.
+ */
+void thread_wait(void)
+{
+	thread_t *thread;
+	uint64_t flags;
+
+	flags = machine_irq_save();
+	thread = thread_get_current();
+
+	if (!thread->wakeup) {
+		thread->state = THREAD_STATE_WAITING;
+		sched_yield();
+	}
+	thread->wakeup = 0;
+
+	machine_irq_restore(flags);
+}
+
+/**
+ * thread_wakeup
+ *
+ * Make a waiting thread runnable again. This is safe to call from interrupt
+ * context, the thread will run the next time the scheduler is invoked.
+ */
+void thread_wakeup(thread_t *thread)
+{
+	uint64_t flags;
+
+	flags = machine_irq_save();
+
+	if (thread->state == THREAD_STATE_WAITING)
+		thread->state = THREAD_STATE_ACTIVE;
+	else
+		thread->wakeup = 1;
+
+	machine_irq_restore(flags);
+}
+
+/**
+ * thread_wait_queue_add
+ *
+ * Add a thread to a wait queue. The caller serialises access to the queue.
+ */
+void thread_wait_queue_add(list_t *queue, thread_t *thread)
+{
+	list_add_tail(&thread->wait_node, queue);
+}
+
+/**
+ * thread_wait_queue_first
+ *
+ * Return the thread in the queue with the highest effective priority, the one
+ * that's been waiting longest if several share it, or THREAD_NULL.
+ */
+thread_t *thread_wait_queue_first(list_t *queue)
+{
+	thread_t *thread, *first;
+
+	first = THREAD_NULL;
+	list_for_each_entry(thread, queue, wait_node) {
+		if (first == THREAD_NULL || thread->sched_pri > first->sched_pri)
+			first = thread;
+	}
+	return first;
+}
+
+/**
+ * thread_wait_queue_pop
+ *
+ * Remove and return the first thread in the queue, as thread_wait_queue_first.
+ * Its wait_node is left empty, so a woken thread can tell it was dequeued.
+ */
+thread_t *thread_wait_queue_pop(list_t *queue)
+{
+	thread_t *thread;
+
+	thread = thread_wait_queue_first(queue);
+	if (thread != THREAD_NULL)
+		list_del_init(&thread->wait_node);
+	return thread;
+}
+
+/**
+ * thread_get_current
+ *
+ * Return the thread running on the current cpu.
+ */
+thread_t *thread_get_current()
+{
+	return cpu_get_current()->cpu_active_thread;
+}
+
 /**
  * kernel_thread_create
  *
@@ -207,7 +328,7 @@ thread_t *kernel_thread_create(thread_entry_t entry, integer_t priority,
 	if (thread->thread_id != THREAD_ID_KERN_THREAD)
 		panic("kernel_thread_create: kernel thread not created first\n");
 
-	/* set the thread arguments */
+	/* set the thread arguments, these are passed in x0 on first entry */
 	thread->args = args;
 	thread->state = THREAD_STATE_ACTIVE;
 
@@ -223,82 +344,62 @@ thread_t *kernel_thread_create(thread_entry_t entry, integer_t priority,
  */
 void thread_set_name(thread_t *thread, const char *name)
 {
-	size_t len;
-
-	len = (len < THREAD_NAME_MAX_LEN) ? len : THREAD_NAME_MAX_LEN;
-	strlcpy(thread->name, name, len);
+	strlcpy(thread->name, name, THREAD_NAME_MAX_LEN);
 }
 
-// todo: sets up the threads context, prep the entry point and args
+/**
+ * thread_init_context
+ *
+ * Set up the initial cpu context of a new thread, so the first switch to it
+ * enters at __fork64_return on the top of its own stack. x19 holds the entry
+ * point, which __fork64_return branches to once sched_tail has completed.
+ */
 static kern_return_t thread_init_context(thread_t *thread,
 		thread_entry_t *entry)
 {
+	memset(&thread->context, '\0', sizeof(cpu_context_t));
+
 	thread->entry = (thread_entry_t) entry;
-	// todo: work out how thread entry will work, what needs to be in which
-	// registers
+
+	thread->context.x19 = (uint64_t) thread->entry;
+	thread->context.sp = (uint64_t) thread->stack;
+	thread->context.lr = (uint64_t) __fork64_return;
+
+	return KERN_RETURN_SUCCESS;
 }
 
 /**
  * thread_load_context
  * 
  * Load the context of a given thread onto the current cpu. Calling this
- * function will have the affect of switching to the given thread.
+ * function will have the affect of switching to the given thread, and is only
+ * used to enter the first thread, as there is no current context to save.
 */
 void thread_load_context(thread_t *thread)
 {
 	pr_debug("load_context: address: 0x%lx, stack: 0x%lx\n",
 		thread->context.lr, thread->stack);
 
-	/**
-	 * Restore specific registers to prepare the thread context to be copied to
-	 * the cpu registers. x19 holds the entry point upon re-entering the thread,
-	 * therefore should contain the ELR_EL1 value of the thread before it was
-	 * interrupted. x20 holds any arguments that need to be passed to the thread,
-	 * typically only used on first execution.
-	 * 
-	 * The stack is saved in thread->stack, and is restored. __fork64_return
-	 * handles entering the thread when it's first executed, when re-entering an
-	 * active thread, this is just ignored.
-	*/
-	thread->context.x19 = (uint64_t) thread->entry;
-	thread->context.x20 = (uint64_t) thread->args;
-	thread->context.sp = (uint64_t) thread->stack;
-	thread->context.lr = (uint64_t) __fork64_return;
-
 	/**
 	 * __fork64_exec will complete the scheduler process, and jump to the address
-	 * in x19.
+	 * in x19. sched_tail() releases the scheduler lock, as it would if another
+	 * thread had switched to this one.
 	*/
+	machine_irq_disable();
+	__spin_lock(&sched_lock);
+	thread->on_cpu = 1;
 	__fork64_exec(thread);
 
 	/*NOTRETURN*/
 }
 
 /**
- * thread_save_context
- * 
- * Saves the current cpu context to the currently active thread, using the frame
- * generated by the exception handler.
+ * thread_switch_context
+ *
+ * Save the callee-saved context of the current thread and load the context of
+ * the next one. This returns once `thread` is switched back to.
 */
-void thread_save_context(thread_t *thread, arm64_exception_frame_t *frame)
+void thread_switch_context(thread_t *thread, thread_t *next)
 {
-	/* save the callee registers from the exception frame */
-	thread->context.x19 = frame->regs[19];
-	thread->context.x20 = frame->regs[20];
-	thread->context.x21 = frame->regs[21];
-	thread->context.x22 = frame->regs[22];
-	thread->context.x23 = frame->regs[23];
-	thread->context.x24 = frame->regs[24];
-	thread->context.x25 = frame->regs[25];
-	thread->context.x26 = frame->regs[26];
-	thread->context.x27 = frame->regs[27];
-	thread->context.x28 = frame->regs[28];
-
-	/* save the frame pointer and stack pointer from the exception frame */
-	thread->context.fp = frame->fp;
-	thread->context.sp = frame->sp;
-
-	/* read the ELR_EL1 to determine the re-entry point for this thread */
-	thread->entry = sysreg_read(elr_el1);
-	thread->stack = thread->context.sp;
+	__fork64_switch(thread, next);
 }
@@ -30,6 +30,9 @@
 
 #include <arch/arch.h>
 #include <kern/task.h>
+#include <kern/trace/fgraph.h>
+#include <kern/machine/machine_pmu.h>
+#include <kern/machine/machine_fpsimd.h>
 
 #include <libkern/list.h>
 
@@ -44,8 +47,11 @@ typedef vm_address_t				thread_entry_t;
 /* maximum length of a threads name */
 #define THREAD_NAME_MAX_LEN			64
 
-/* default size of a stack */
-#define THREAD_STACK_DEFAULT_SIZE	VM_PAGE_SIZE
+/**
+ * default size of a stack. interrupts are taken on the stack of the thread they
+ * interrupt, and can nest once per priority class, so leave room for that.
+*/
+#define THREAD_STACK_DEFAULT_SIZE	(VM_PAGE_SIZE * 4)
 
 #define THREAD_NULL					NULL
 
@@ -96,14 +102,33 @@ typedef struct thread {
 	/* Preemption */
 	integer_t		preempt;
 
+	/**
+	 * Scheduling priority, and the effective priority the scheduler uses,
+	 * raised while the thread holds a mutex a higher priority thread wants.
+	*/
+	integer_t		priority;
+	integer_t		sched_pri;
+
+	/* Set while the thread is running, for mutexes spinning on their owner */
+	volatile uint32_t	on_cpu;
+
+	/* Blocking, see kern/mutex.h */
+	list_node_t		wait_node;			// on a wait queue
+	struct mutex	*blocked_on;		// mutex being waited for
+	list_t			mutexes_contended;	// held mutexes with waiters
+
 	/* Flags */
 	uint32_t
 	
 #define THREAD_STATE_INACTIVE	(0x0)
 #define THREAD_STATE_ACTIVE		(0x1)
-	/* boolean_t */	state		:1,		/* thread state */
+#define THREAD_STATE_WAITING	(0x2)
+	/* integer_t */	state		:2,		/* thread state */
 
-	/* future */	reserved	:30;	/* reserved */
+	/* boolean_t */	wakeup		:1,		/* wakeup arrived while running */
+	/* boolean_t */	neon		:1,		/* in a kernel_neon_begin() section */
+
+	/* future */	reserved	:27;	/* reserved */
 
 	/* Reference counter */
 	integer_t		ref_count;
@@ -118,6 +143,17 @@ typedef struct thread {
 	/* thread name */
 	char		name[THREAD_NAME_MAX_LEN];
 
+	/* performance counters following this thread */
+	struct pmu_thread	pmu;
+
+	/* FP/SIMD registers, while switched out in a kernel-mode NEON section */
+	struct fpsimd_state	fpsimd;
+
+#if DEFAULTS_SET(DEFAULTS_KERNEL_FGRAPH)
+	/* function graph tracer shadow stack */
+	struct fgraph_stack	fgraph;
+#endif
+
 } thread_t;
 
 extern list_t threads;
@@ -134,10 +170,18 @@ extern kern_return_t thread_destroy(thread_t *thread);
 extern kern_return_t thread_block();
 extern kern_return_t thread_unblock();
 
+extern void thread_wait(void);
+extern void thread_wakeup(thread_t *thread);
+
+/* Wait queues of threads, ordered by effective priority when woken */
+extern void thread_wait_queue_add(list_t *queue, thread_t *thread);
+extern thread_t *thread_wait_queue_first(list_t *queue);
+extern thread_t *thread_wait_queue_pop(list_t *queue);
+
 extern void thread_set_name(thread_t *thread, const char *name);
 
 extern void thread_load_context(thread_t *thread);
-extern void thread_save_context(thread_t *thread, arm64_exception_frame_t *frame);
+extern void thread_switch_context(thread_t *thread, thread_t *next);
 extern kern_return_t task_assign_thread(task_t *task, thread_t *thread);
 
 extern thread_t *thread_get_current();
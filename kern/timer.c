@@ -0,0 +1,573 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	timer.c
+ * Desc:	High-resolution kernel timers.
+ *
+ * 			Each CPU has a timer base, made up of a hierarchical timing wheel
+ * 			and a min-heap. Time on the wheel is counted in granules of about a
+ * 			millisecond. Level n has 64 slots, each covering 64^n granules, so
+ * 			inserting or cancelling a timer is a list operation on one slot. As
+ * 			the wheel turns, a slot on a higher level is cascaded down once it
+ * 			comes round, and the timers in it are re-inserted.
+ *
+ * 			The wheel is only used to hold timers that are far away. Once a
+ * 			timer's deadline is within a level-0 lap it's moved to the heap,
+ * 			which is ordered by the latest time each timer may fire, and the
+ * 			EL1 physical timer is programmed with CNTP_CVAL_EL0 for whichever
+ * 			of the heap and wheel need attention first. Inserting into or
+ * 			cancelling from the heap is O(log n). There is no periodic tick,
+ * 			an interrupt is only taken when something is due.
+ *
+ * 			When the interrupt is taken, every heap timer whose deadline has
+ * 			passed is run, not just the one that was due, so timers with
+ * 			overlapping slack share an interrupt.
+*/
+
+#define pr_fmt(fmt)	"timer: " fmt
+
+#include <kern/timer.h>
+#include <kern/clock.h>
+#include <kern/machine.h>
+#include <kern/machine/machine_timer.h>
+#include <kern/trace/printk.h>
+
+#include <tinylibc/string.h>
+
+/* Wheel geometry */
+#define TIMER_WHEEL_LEVELS			4
+#define TIMER_WHEEL_SLOT_BITS		6
+#define TIMER_WHEEL_SLOTS			(1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_SLOT_MASK		(TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVEL_SHIFT(l)	((l) * TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_MAX_DELTA		\
+	((1ULL << TIMER_WHEEL_LEVEL_SHIFT(TIMER_WHEEL_LEVELS)) - 1)
+
+/* Timers due within this many granules are kept in the heap */
+#define TIMER_NEAR_GRANULES			TIMER_WHEEL_SLOTS
+
+/* Index of a timer's wheel slot, in timer->index */
+#define TIMER_WHEEL_INDEX(l, s)		(((l) << TIMER_WHEEL_SLOT_BITS) | (s))
+
+/* Target granule size, rounded down to a power of two of counter cycles */
+#define TIMER_GRANULE_NS			UL(1000000)
+
+struct timer_base {
+	uint64_t			clk;		/* next granule to be processed */
+	uint64_t			pending[TIMER_WHEEL_LEVELS];
+	struct list_head	wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+
+	timer_t				*heap[DEFAULTS_KERNEL_TIMER_HEAP_SIZE];
+	unsigned int		heap_size;
+
+	/* due timers waiting to be run, in deadline order */
+	struct list_head	expired;
+};
+
+static struct timer_base	timer_bases[DEFAULTS_MACHINE_MAX_CPUS];
+static unsigned int			timer_granule_shift;
+static uint64_t				timer_default_slack;
+
+/*----------------------------------------------------------------------------*/
+// expired list
+
+/* add a due timer to the expired list, which is kept in deadline order */
+static void __expired_add(struct timer_base *base, timer_t *timer)
+{
+	timer_t *pos;
+
+	list_for_each_entry_reverse(pos, &base->expired, entry)
+		if (pos->deadline <= timer->deadline)
+			break;
+
+	list_add(&timer->entry, &pos->entry);
+	timer->state = TIMER_STATE_EXPIRED;
+}
+
+/*----------------------------------------------------------------------------*/
+// near-deadline heap
+
+static void __heap_set(struct timer_base *base, unsigned int i, timer_t *timer)
+{
+	base->heap[i] = timer;
+	timer->index = i;
+}
+
+static void __heap_sift_up(struct timer_base *base, unsigned int i)
+{
+	timer_t *timer = base->heap[i];
+	unsigned int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (base->heap[parent]->latest <= timer->latest)
+			break;
+
+		__heap_set(base, i, base->heap[parent]);
+		i = parent;
+	}
+	__heap_set(base, i, timer);
+}
+
+static void __heap_sift_down(struct timer_base *base, unsigned int i)
+{
+	timer_t *timer = base->heap[i];
+	unsigned int child;
+
+	while ((child = 2 * i + 1) < base->heap_size) {
+		if (child + 1 < base->heap_size &&
+				base->heap[child + 1]->latest < base->heap[child]->latest)
+			child += 1;
+		if (timer->latest <= base->heap[child]->latest)
+			break;
+
+		__heap_set(base, i, base->heap[child]);
+		i = child;
+	}
+	__heap_set(base, i, timer);
+}
+
+static int __heap_insert(struct timer_base *base, timer_t *timer)
+{
+	if (base->heap_size >= DEFAULTS_KERNEL_TIMER_HEAP_SIZE)
+		return 0;
+
+	base->heap[base->heap_size] = timer;
+	__heap_sift_up(base, base->heap_size++);
+
+	timer->state = TIMER_STATE_HEAP;
+	return 1;
+}
+
+/**
+ * __heap_collect_expired
+ *
+ * Move every heap timer whose deadline has passed to the expired list. The
+ * heap is ordered by `latest`, which says nothing about where the due timers
+ * are, so the whole heap is scanned. The timers left are compacted to the
+ * front of the array and the heap rebuilt bottom-up, in O(n).
+*/
+static void __heap_collect_expired(struct timer_base *base, uint64_t now)
+{
+	unsigned int i, kept = 0;
+	timer_t *timer;
+
+	for (i = 0; i < base->heap_size; i++) {
+		timer = base->heap[i];
+		if (timer->deadline <= now)
+			__expired_add(base, timer);
+		else
+			__heap_set(base, kept++, timer);
+	}
+
+	if (kept == base->heap_size)
+		return;
+
+	base->heap_size = kept;
+	for (i = kept / 2; i-- > 0; )
+		__heap_sift_down(base, i);
+}
+
+static void __heap_remove(struct timer_base *base, timer_t *timer)
+{
+	unsigned int i = timer->index;
+
+	timer_t *last;
+
+	base->heap_size -= 1;
+	if (i == base->heap_size)
+		return;
+
+	/* fill the hole with the last timer, which may need to go either way */
+	last = base->heap[base->heap_size];
+	__heap_set(base, i, last);
+	__heap_sift_down(base, i);
+	__heap_sift_up(base, last->index);
+}
+
+/*----------------------------------------------------------------------------*/
+// timing wheel
+
+static void __wheel_insert(struct timer_base *base, timer_t *timer)
+{
+	uint64_t expires, delta;
+	unsigned int level, slot;
+
+	/* anything already due goes in the next slot to be processed */
+	expires = timer->deadline >> timer_granule_shift;
+	if (expires < base->clk)
+		expires = base->clk;
+
+	/* too far away for the wheel, it's cascaded again when this comes round */
+	delta = expires - base->clk;
+	if (delta > TIMER_WHEEL_MAX_DELTA) {
+		delta = TIMER_WHEEL_MAX_DELTA;
+		expires = base->clk + delta;
+	}
+
+	for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++)
+		if (delta < (1ULL << TIMER_WHEEL_LEVEL_SHIFT(level + 1)))
+			break;
+
+	slot = (expires >> TIMER_WHEEL_LEVEL_SHIFT(level)) & TIMER_WHEEL_SLOT_MASK;
+
+	list_add_tail(&timer->entry, &base->wheel[level][slot]);
+	base->pending[level] |= (1ULL << slot);
+
+	timer->index = TIMER_WHEEL_INDEX(level, slot);
+	timer->state = TIMER_STATE_WHEEL;
+}
+
+static void __wheel_remove(struct timer_base *base, timer_t *timer)
+{
+	unsigned int level, slot;
+
+	level = timer->index >> TIMER_WHEEL_SLOT_BITS;
+	slot = timer->index & TIMER_WHEEL_SLOT_MASK;
+
+	list_del(&timer->entry);
+	if (list_empty(&base->wheel[level][slot]))
+		base->pending[level] &= ~(1ULL << slot);
+}
+
+/* put a timer wherever it belongs, given the current time */
+static void __timer_enqueue(struct timer_base *base, timer_t *timer,
+		uint64_t now)
+{
+	if (timer->deadline <= now) {
+		__expired_add(base, timer);
+		return;
+	}
+
+	if (((timer->deadline - now) >> timer_granule_shift) < TIMER_NEAR_GRANULES &&
+			__heap_insert(base, timer))
+		return;
+
+	__wheel_insert(base, timer);
+}
+
+/* move every timer in a slot onto a list, and re-insert them */
+static void __wheel_requeue(struct timer_base *base, unsigned int level,
+		unsigned int slot, uint64_t now)
+{
+	struct list_head work;
+	timer_t *timer;
+
+	INIT_LIST_HEAD(&work);
+	list_splice_init(&base->wheel[level][slot], &work);
+	base->pending[level] &= ~(1ULL << slot);
+
+	while (!list_empty(&work)) {
+		timer = list_first_entry(&work, timer_t, entry);
+		list_del(&timer->entry);
+		__timer_enqueue(base, timer, now);
+	}
+}
+
+/**
+ * __wheel_run
+ *
+ * Advance the wheel up to the current time. Each granule, the level-0 slot is
+ * processed, and on every 64th the slot on the level above is cascaded, which
+ * repeats upwards while the index on that level is also zero. Granules where
+ * no level has anything to do are skipped over.
+*/
+static void __wheel_run(struct timer_base *base, uint64_t now)
+{
+	uint64_t now_g, mask, next;
+	unsigned int level, index;
+
+	now_g = now >> timer_granule_shift;
+
+	while (base->clk <= now_g) {
+		for (level = 0; level < TIMER_WHEEL_LEVELS; level++)
+			if (base->pending[level])
+				break;
+
+		if (level == TIMER_WHEEL_LEVELS) {
+			base->clk = now_g + 1;
+			break;
+		}
+
+		/* nothing below this level, jump to where it's next cascaded */
+		if (level > 0) {
+			mask = (1ULL << TIMER_WHEEL_LEVEL_SHIFT(level)) - 1;
+			next = (base->clk + mask) & ~mask;
+			if (next > now_g) {
+				base->clk = now_g + 1;
+				break;
+			}
+			base->clk = next;
+		}
+
+		index = base->clk & TIMER_WHEEL_SLOT_MASK;
+		if (index == 0) {
+			for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+				index = (base->clk >> TIMER_WHEEL_LEVEL_SHIFT(level)) &
+					TIMER_WHEEL_SLOT_MASK;
+				__wheel_requeue(base, level, index, now);
+				if (index != 0)
+					break;
+			}
+			index = 0;
+		}
+
+		/* advance first, so anything re-inserted lands in a later slot */
+		base->clk += 1;
+		__wheel_requeue(base, 0, index, now);
+	}
+}
+
+/* rotate right, so that bit `n` becomes bit 0 */
+static inline uint64_t __ror64(uint64_t x, unsigned int n)
+{
+	return n ? (x >> n) | (x << (64 - n)) : x;
+}
+
+/**
+ * __wheel_next_event
+ *
+ * Find the counter value at which the wheel next has something to do, either
+ * a level-0 slot to process, or a slot to cascade. Returns UINT64_MAX if the
+ * wheel is empty.
+*/
+static uint64_t __wheel_next_event(struct timer_base *base)
+{
+	uint64_t next, start, event;
+	unsigned int level, shift;
+
+	next = UINT64_MAX;
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		if (!base->pending[level])
+			continue;
+
+		/* the first index on this level that hasn't been processed yet */
+		shift = TIMER_WHEEL_LEVEL_SHIFT(level);
+		start = (base->clk + (1ULL << shift) - 1) >> shift;
+
+		event = start + __builtin_ctzll(__ror64(base->pending[level],
+			start & TIMER_WHEEL_SLOT_MASK));
+		event = (event << shift) << timer_granule_shift;
+
+		if (event < next)
+			next = event;
+	}
+	return next;
+}
+
+/*----------------------------------------------------------------------------*/
+// timer base
+
+/* program the hardware timer for the next thing due on this base */
+static void __timer_program(struct timer_base *base)
+{
+	uint64_t next, wheel;
+
+	if (!list_empty(&base->expired))
+		next = 0;
+	else if (base->heap_size)
+		next = base->heap[0]->latest;
+	else
+		next = UINT64_MAX;
+
+	wheel = __wheel_next_event(base);
+	if (wheel < next)
+		next = wheel;
+
+	machine_timer_program(next);
+}
+
+static void __timer_dequeue(struct timer_base *base, timer_t *timer)
+{
+	switch (timer->state) {
+		case TIMER_STATE_WHEEL:
+			__wheel_remove(base, timer);
+			break;
+		case TIMER_STATE_HEAP:
+			__heap_remove(base, timer);
+			break;
+		case TIMER_STATE_EXPIRED:
+			list_del(&timer->entry);
+			break;
+	}
+	timer->state = TIMER_STATE_IDLE;
+}
+
+static timer_t *__timer_next_expired(struct timer_base *base)
+{
+	timer_t *timer;
+
+	if (list_empty(&base->expired))
+		return NULL;
+
+	timer = list_first_entry(&base->expired, timer_t, entry);
+	list_del(&timer->entry);
+	return timer;
+}
+
+/*----------------------------------------------------------------------------*/
+// timer api
+
+/**
+ * timer_init
+ *
+ * Set up the timer bases. The granule is the largest power of two of counter
+ * cycles that fits in TIMER_GRANULE_NS.
+*/
+void timer_init(void)
+{
+	uint64_t granule;
+	unsigned int cpu, level, slot;
+
+	timer_default_slack = clock_ns_to_cycles(DEFAULTS_KERNEL_TIMER_SLACK_NS);
+
+	granule = clock_ns_to_cycles(TIMER_GRANULE_NS);
+	for (timer_granule_shift = 0; (2ULL << timer_granule_shift) <= granule;
+			timer_granule_shift++)
+		;
+
+	for (cpu = 0; cpu < DEFAULTS_MACHINE_MAX_CPUS; cpu++) {
+		struct timer_base *base = &timer_bases[cpu];
+
+		memset(base, 0, sizeof(*base));
+		for (level = 0; level < TIMER_WHEEL_LEVELS; level++)
+			for (slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+				INIT_LIST_HEAD(&base->wheel[level][slot]);
+		INIT_LIST_HEAD(&base->expired);
+
+		base->clk = clock_get_counter() >> timer_granule_shift;
+	}
+
+	pr_info("wheel granule: %d cycles\n", 1 << timer_granule_shift);
+}
+
+void timer_setup(timer_t *timer)
+{
+	memset(timer, 0, sizeof(*timer));
+	timer->state = TIMER_STATE_IDLE;
+}
+
+/**
+ * timer_arm_slack
+ *
+ * Arm a timer on the current CPU, to call `func` once `deadline` has passed,
+ * and no more than `slack` nanoseconds after it. The callback is run from the
+ * timer interrupt. If the timer is already armed, it's moved.
+*/
+kern_return_t timer_arm_slack(timer_t *timer, uint64_t deadline,
+		uint64_t slack, timer_func_t func, void *arg)
+{
+	struct timer_base *base;
+	uint64_t flags, now;
+
+	if (timer == NULL || func == NULL)
+		return KERN_RETURN_FAIL;
+
+	flags = machine_irq_save();
+
+	if (timer->state != TIMER_STATE_IDLE)
+		__timer_dequeue(&timer_bases[timer->cpu], timer);
+
+	timer->cpu = machine_get_cpu_num();
+	timer->func = func;
+	timer->arg = arg;
+	timer->deadline = clock_ktime_to_counter(deadline);
+	timer->latest = timer->deadline + ((slack == TIMER_SLACK_DEFAULT) ?
+		timer_default_slack : clock_ns_to_cycles(slack));
+
+	base = &timer_bases[timer->cpu];
+	now = clock_get_counter();
+
+	__wheel_run(base, now);
+	__timer_enqueue(base, timer, now);
+	__timer_program(base);
+
+	machine_irq_restore(flags);
+	return KERN_RETURN_SUCCESS;
+}
+
+kern_return_t timer_arm(timer_t *timer, uint64_t deadline, timer_func_t func,
+		void *arg)
+{
+	return timer_arm_slack(timer, deadline, TIMER_SLACK_DEFAULT, func, arg);
+}
+
+/**
+ * timer_cancel
+ *
+ * Disarm a timer. Returns 1 if it was pending, or 0 if it had already run or
+ * was never armed.
+*/
+int timer_cancel(timer_t *timer)
+{
+	uint64_t flags;
+	int pending;
+
+	flags = machine_irq_save();
+
+	pending = (timer->state != TIMER_STATE_IDLE);
+	if (pending)
+		__timer_dequeue(&timer_bases[timer->cpu], timer);
+
+	/* the hardware timer is left alone, an early interrupt is harmless */
+	machine_irq_restore(flags);
+	return pending;
+}
+
+int timer_pending(timer_t *timer)
+{
+	return timer->state != TIMER_STATE_IDLE;
+}
+
+/**
+ * timer_interrupt
+ *
+ * Called from the timer interrupt. Turn the wheel, run everything that has
+ * expired and program the next interrupt. Callbacks are run with the base
+ * unlocked, so are free to re-arm or cancel timers.
+*/
+void timer_interrupt(void)
+{
+	struct timer_base *base;
+	uint64_t flags, now;
+	timer_t *timer;
+
+	base = &timer_bases[machine_get_cpu_num()];
+	flags = machine_irq_save();
+
+	now = clock_get_counter();
+	__wheel_run(base, now);
+	__heap_collect_expired(base, now);
+
+	/* timers re-armed by a callback that are already due join the batch */
+	while ((timer = __timer_next_expired(base)) != NULL) {
+		timer->state = TIMER_STATE_IDLE;
+
+		machine_irq_restore(flags);
+		timer->func(timer, timer->arg);
+		flags = machine_irq_save();
+	}
+
+	__timer_program(base);
+	machine_irq_restore(flags);
+}
@@ -0,0 +1,89 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	timer.h
+ * Desc:	High-resolution kernel timers. Each CPU keeps its pending timers
+ * 			in a hierarchical timing wheel, with those that are close to
+ * 			expiring moved to a min-heap, and the EL1 physical timer is
+ * 			programmed for whichever is due first.
+*/
+
+#ifndef __KERN_TIMER_H__
+#define __KERN_TIMER_H__
+
+#include <tinylibc/stdint.h>
+
+#include <libkern/types.h>
+#include <libkern/list.h>
+
+#include <kern/defaults.h>
+#include <kern/clock.h>
+
+typedef struct timer timer_t;
+typedef void (*timer_func_t) (timer_t *timer, void *arg);
+
+/* Timer states */
+#define TIMER_STATE_IDLE		0	/* Not armed */
+#define TIMER_STATE_WHEEL		1	/* Pending in the timing wheel */
+#define TIMER_STATE_HEAP		2	/* Pending in the near-deadline heap */
+#define TIMER_STATE_EXPIRED		3	/* Expired, waiting to be run */
+
+/* Special slack value, use DEFAULTS_KERNEL_TIMER_SLACK_NS */
+#define TIMER_SLACK_DEFAULT		((uint64_t) -1)
+
+/**
+ * Timer
+ *
+ * Embedded by the user, and owned by the timer code while it's armed. Times are
+ * kept in counter cycles. A timer fires no earlier than its deadline, and no
+ * later than deadline + slack, which lets timers that are close together be
+ * run from a single interrupt.
+*/
+struct timer {
+	struct list_head	entry;		/* wheel slot or expired list */
+	unsigned int		index;		/* heap index, or wheel level and slot */
+	unsigned int		state;
+	unsigned int		cpu;
+
+	uint64_t			deadline;	/* earliest expiry, in cycles */
+	uint64_t			latest;		/* deadline + slack */
+
+	timer_func_t		func;
+	void				*arg;
+};
+
+/* Timer API, deadlines are absolute ktime_get_ns() values */
+extern void timer_init(void);
+extern void timer_setup(timer_t *timer);
+
+extern kern_return_t timer_arm(timer_t *timer, uint64_t deadline,
+							   timer_func_t func, void *arg);
+extern kern_return_t timer_arm_slack(timer_t *timer, uint64_t deadline,
+									 uint64_t slack, timer_func_t func,
+									 void *arg);
+extern int timer_cancel(timer_t *timer);
+extern int timer_pending(timer_t *timer);
+
+extern void timer_interrupt(void);
+
+#endif /* __kern_timer_h__ */
@@ -0,0 +1,100 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	blog.c
+ * Desc:	Binary log writer. A record's payload is the index of its call site
+ * 			in .blog_sites, followed by each argument in order: a 64-bit word,
+ * 			or for a string, a 16-bit length and the characters.
+*/
+
+#include <kern/trace/blog.h>
+#include <kern/trace/printk.h>
+#include <kern/trace/printk_ringbuffer.h>
+#include <kern/clock.h>
+
+#include <tinylibc/string.h>
+
+/* call site table, from the linker script */
+extern const struct blog_site __blog_sites_start[];
+
+/* a record must fit in a console line once written in hex */
+#define BLOG_RECORD_MAX		\
+	(sizeof (uint32_t) + BLOG_ARGS_MAX * (sizeof (uint16_t) + BLOG_STRING_MAX))
+_Static_assert(BLOG_RECORD_MAX <= PRINTK_LINE_MAX, "blog record too large");
+_Static_assert(sizeof (struct blog_site) == 24, "blog_site layout changed");
+
+static inline int __blog_arg_is_string(const struct blog_site *site, int i)
+{
+	return site->strmask & (1 << (site->nargs - 1 - i));
+}
+
+/**
+ * __blog_write
+ *
+ * Backend for blog(). Works out the size of the record, then copies the raw
+ * arguments into it. Strings longer than BLOG_STRING_MAX are truncated.
+ */
+void __blog_write(const struct blog_site *site, const uint64_t *args)
+{
+	uint16_t strlens[BLOG_ARGS_MAX];
+	printk_record_t *rec;
+	uint32_t id;
+	size_t len;
+	char *p;
+	int i;
+
+	len = sizeof (id);
+	for (i = 0; i < site->nargs; i++) {
+		if (__blog_arg_is_string(site, i)) {
+			strlens[i] = args[i] ?
+				strnlen((const char *) args[i], BLOG_STRING_MAX) : 0;
+			len += sizeof (uint16_t) + strlens[i];
+		} else {
+			len += sizeof (uint64_t);
+		}
+	}
+
+	rec = printk_record_reserve(site->level, PRB_RECORD_BINARY,
+		ktime_get_ns(), len);
+	if (rec == NULL)
+		return;
+
+	/* the record isn't necessarily aligned for the arguments, so copy them */
+	id = site - __blog_sites_start;
+	p = rec->text;
+	memcpy(p, &id, sizeof (id));
+	p += sizeof (id);
+
+	for (i = 0; i < site->nargs; i++) {
+		if (__blog_arg_is_string(site, i)) {
+			memcpy(p, &strlens[i], sizeof (uint16_t));
+			memcpy(p + sizeof (uint16_t), (const char *) args[i], strlens[i]);
+			p += sizeof (uint16_t) + strlens[i];
+		} else {
+			memcpy(p, &args[i], sizeof (uint64_t));
+			p += sizeof (uint64_t);
+		}
+	}
+
+	printk_record_commit(rec);
+}
@@ -0,0 +1,128 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	blog.h
+ * Desc:	Binary log. Instead of formatting a message, a binary log call
+ * 			records which call site it came from, the time, and its raw
+ * 			arguments. The format string lives in the .blog_sites section of
+ * 			the kernel image, and scripts/blog_decode.py puts the message back
+ * 			together on the host, so a log call costs a handful of stores.
+ *
+ * 			Records go into the printk buffers alongside text messages, and the
+ * 			console writes them out as "#blog" lines in hex.
+*/
+
+#ifndef __KERN_BLOG_H__
+#define __KERN_BLOG_H__
+
+#include <tinylibc/stdint.h>
+#include <kern/defaults.h>
+
+/* arguments per call site, and bytes of each string argument kept */
+#define BLOG_ARGS_MAX		8
+#define BLOG_STRING_MAX		24
+
+/**
+ * Call site descriptor, one per blog() call, placed in .blog_sites. The layout
+ * is read by the host-side decoder, so it must not change without updating
+ * scripts/blog_decode.py to match.
+ */
+struct blog_site {
+	const char	*fmt;
+	const char	*file;
+	uint32_t	line;
+	uint8_t		level;
+	uint8_t		nargs;
+	uint16_t	strmask;	/* arguments that are strings */
+};
+
+extern void __blog_write(const struct blog_site *site, const uint64_t *args);
+
+/* argument counting and mapping, for up to BLOG_ARGS_MAX arguments */
+#define __BLOG_NARGS(...)	\
+	__BLOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define __BLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, N, ...)	N
+
+#define __BLOG_CAT(a, b)	__BLOG_CAT_(a, b)
+#define __BLOG_CAT_(a, b)	a##b
+
+#define __BLOG_MAP(m, ...)	\
+	__BLOG_CAT(__BLOG_MAP_, __BLOG_NARGS(__VA_ARGS__))(m, ##__VA_ARGS__)
+#define __BLOG_MAP_0(m)
+#define __BLOG_MAP_1(m, a)		m(a, 0)
+#define __BLOG_MAP_2(m, a, ...)	m(a, 1) __BLOG_MAP_1(m, __VA_ARGS__)
+#define __BLOG_MAP_3(m, a, ...)	m(a, 2) __BLOG_MAP_2(m, __VA_ARGS__)
+#define __BLOG_MAP_4(m, a, ...)	m(a, 3) __BLOG_MAP_3(m, __VA_ARGS__)
+#define __BLOG_MAP_5(m, a, ...)	m(a, 4) __BLOG_MAP_4(m, __VA_ARGS__)
+#define __BLOG_MAP_6(m, a, ...)	m(a, 5) __BLOG_MAP_5(m, __VA_ARGS__)
+#define __BLOG_MAP_7(m, a, ...)	m(a, 6) __BLOG_MAP_6(m, __VA_ARGS__)
+#define __BLOG_MAP_8(m, a, ...)	m(a, 7) __BLOG_MAP_7(m, __VA_ARGS__)
+
+/**
+ * Strings are copied into the record, as they may not be in the kernel image.
+ * Everything else is stored as a 64-bit word. The index counts down, so the
+ * mask bit for the first argument is the highest.
+ */
+#define __blog_is_string(x)		\
+	_Generic((x), char *: 1, const char *: 1, default: 0)
+#define __blog_word(x)			\
+	_Generic((x), char *: (uint64_t) (uintptr_t) (x),	\
+		const char *: (uint64_t) (uintptr_t) (x),		\
+		default: (uint64_t) (x))
+
+#define __BLOG_STRBIT(x, i)		| (__blog_is_string(x) << (i))
+#define __BLOG_WORD(x, i)		, __blog_word(x)
+
+/**
+ * blog(level, fmt, ...)
+ *
+ * Log a message in binary form. Takes the same arguments as printk, with at
+ * most BLOG_ARGS_MAX of them, and messages above DEFAULTS_KERNEL_LOGLEVEL are
+ * compiled out. __blog() skips the loglevel check, for messages that have been
+ * enabled some other way.
+ */
+#define blog(__level, __fmt, ...)											\
+	({																		\
+		if ((__level) <= DEFAULTS_KERNEL_LOGLEVEL)							\
+			__blog(__level, __fmt, ##__VA_ARGS__);							\
+		0;																	\
+	})
+
+#define __blog(__level, __fmt, ...)											\
+	({																		\
+		static const struct blog_site __blog_site							\
+			__attribute__((section(".blog_sites"), used, aligned(8))) = {	\
+			.fmt = (__fmt),													\
+			.file = __FILE__,												\
+			.line = __LINE__,												\
+			.level = (__level),												\
+			.nargs = __BLOG_NARGS(__VA_ARGS__),								\
+			.strmask = 0 __BLOG_MAP(__BLOG_STRBIT, ##__VA_ARGS__),			\
+		};																	\
+		const uint64_t __blog_args[] =										\
+			{ 0 __BLOG_MAP(__BLOG_WORD, ##__VA_ARGS__) };					\
+		__blog_write(&__blog_site, &__blog_args[1]);						\
+		0;																	\
+	})
+
+#endif /* __kern_blog_h__ */
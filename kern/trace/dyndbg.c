@@ -0,0 +1,118 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	dyndbg.c
+ * Desc:	Dynamic debug call site control. See dyndbg.h.
+*/
+
+#define pr_fmt(fmt)	"dyndbg: " fmt
+
+#include <kern/trace/dyndbg.h>
+#include <kern/trace/printk.h>
+
+#include <tinylibc/string.h>
+
+/* call sites, from the linker script */
+extern struct dyndbg_site __dyndbg_sites_start[];
+extern struct dyndbg_site __dyndbg_sites_end[];
+
+/**
+ * a site's prefix is its pr_fmt(), so "zalloc" matches "zalloc: "
+ */
+static int __dyndbg_match(struct dyndbg_site *site, const char *prefix,
+		size_t len)
+{
+	if (prefix == NULL)
+		return 1;
+
+	return strncmp(site->prefix, prefix, len) == 0 && site->prefix[len] == ':';
+}
+
+/**
+ * switch the key of every site matching `len` characters of `prefix`, returning
+ * the number of sites that matched
+ */
+static int __dyndbg_set(const char *prefix, size_t len, int enabled)
+{
+	struct dyndbg_site *site;
+	int count = 0;
+
+	for (site = __dyndbg_sites_start; site < __dyndbg_sites_end; site++) {
+		if (!__dyndbg_match(site, prefix, len))
+			continue;
+
+		if (enabled)
+			static_key_enable(&site->key);
+		else
+			static_key_disable(&site->key);
+		count += 1;
+	}
+	return count;
+}
+
+kern_return_t dyndbg_enable(const char *prefix)
+{
+	size_t len = prefix ? strlen(prefix) : 0;
+
+	return __dyndbg_set(prefix, len, 1) ? KERN_RETURN_SUCCESS :
+		KERN_RETURN_FAIL;
+}
+
+kern_return_t dyndbg_disable(const char *prefix)
+{
+	size_t len = prefix ? strlen(prefix) : 0;
+
+	return __dyndbg_set(prefix, len, 0) ? KERN_RETURN_SUCCESS :
+		KERN_RETURN_FAIL;
+}
+
+/**
+ * dyndbg_init
+ *
+ * Enable the debug messages selected at build time. DEFAULTS_KERNEL_DYNDBG is a
+ * comma-separated list of prefixes, and a loglevel that includes debug messages
+ * enables all of them. Must be called after static_key_init().
+ */
+void dyndbg_init(void)
+{
+	const char *list = DEFAULTS_KERNEL_DYNDBG;
+	const char *end;
+	size_t len;
+
+	if (DEFAULTS_KERNEL_LOGLEVEL >= LOGLEVEL_DEBUG) {
+		__dyndbg_set(NULL, 0, 1);
+		return;
+	}
+
+	while (*list) {
+		end = strchr(list, ',');
+		len = end ? (size_t) (end - list) : strlen(list);
+
+		if (len && !__dyndbg_set(list, len, 1))
+			pr_warn("no call sites for '%.*s'\n", (int) len, list);
+
+		list += len;
+		if (*list == ',')
+			list++;
+	}
+}
@@ -0,0 +1,71 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	dyndbg.h
+ * Desc:	Dynamic debug. Every pr_debug() call site has its own static key,
+ * 			so a disabled debug message costs a single NOP. Messages are
+ * 			switched on and off at runtime by the pr_fmt() prefix of the file
+ * 			they're in, e.g. dyndbg_enable("zalloc").
+*/
+
+#ifndef __KERN_DYNDBG_H__
+#define __KERN_DYNDBG_H__
+
+#include <tinylibc/stdint.h>
+
+#include <libkern/types.h>
+#include <kern/static_key.h>
+
+/* Call site descriptor, one per pr_debug(), placed in .dyndbg_sites */
+struct dyndbg_site {
+	struct static_key	key;
+	uint32_t			line;
+	const char			*prefix;	/* pr_fmt(""), e.g. "zalloc: " */
+	const char			*file;
+	const char			*fmt;
+};
+
+/* Dynamic debug API, a NULL prefix matches every call site */
+extern void dyndbg_init(void);
+extern kern_return_t dyndbg_enable(const char *prefix);
+extern kern_return_t dyndbg_disable(const char *prefix);
+
+/**
+ * dyndbg_enabled(prefix, fmt)
+ *
+ * Define a call site, and evaluate to whether it's enabled.
+ */
+#define dyndbg_enabled(__prefix, __fmt)										\
+	({																		\
+		static struct dyndbg_site __dyndbg_site								\
+			__attribute__((section(".dyndbg_sites"), used, aligned(8))) = {	\
+			.key = STATIC_KEY_INIT(0),										\
+			.line = __LINE__,												\
+			.prefix = (__prefix),											\
+			.file = __FILE__,												\
+			.fmt = (__fmt),													\
+		};																	\
+		static_branch_unlikely(&__dyndbg_site.key);							\
+	})
+
+#endif /* __kern_dyndbg_h__ */
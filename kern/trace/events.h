@@ -0,0 +1,129 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	events.h
+ * Desc:	Kernel trace events. See tracepoint.h.
+*/
+
+#ifndef __KERN_TRACE_EVENTS_H__
+#define __KERN_TRACE_EVENTS_H__
+
+#include <kern/trace/tracepoint.h>
+
+struct thread;
+struct zone;
+
+/* scheduler: a context switch, from the outgoing thread's side */
+TRACE_EVENT(sched_switch,
+	TP_PROTO(struct thread *prev, struct thread *next),
+	TP_ARGS(prev, next),
+	TP_FIELDS(
+		__field(int32_t, prev_tid),
+		__field(int32_t, next_tid),
+		__field(uint32_t, prev_state)
+	),
+	TP_ASSIGN(
+		__entry->prev_tid = prev ? prev->thread_id : -1;
+		__entry->next_tid = next->thread_id;
+		__entry->prev_state = prev ? prev->state : 0;
+	)
+);
+
+/* interrupts: handler entry and exit, nested interrupts pair up in order */
+TRACE_EVENT(irq_entry,
+	TP_PROTO(unsigned int intid),
+	TP_ARGS(intid),
+	TP_FIELDS(
+		__field(uint32_t, intid)
+	),
+	TP_ASSIGN(
+		__entry->intid = intid;
+	)
+);
+
+TRACE_EVENT(irq_exit,
+	TP_PROTO(unsigned int intid, int ret),
+	TP_ARGS(intid, ret),
+	TP_FIELDS(
+		__field(uint32_t, intid),
+		__field(int32_t, ret)
+	),
+	TP_ASSIGN(
+		__entry->intid = intid;
+		__entry->ret = ret;
+	)
+);
+
+/* zone allocator */
+TRACE_EVENT(zalloc,
+	TP_PROTO(struct zone *zone, vm_address_t addr),
+	TP_ARGS(zone, addr),
+	TP_FIELDS(
+		__field(uint64_t, addr),
+		__field(uint32_t, zone),
+		__field(uint32_t, elem_size)
+	),
+	TP_ASSIGN(
+		__entry->addr = addr;
+		__entry->zone = zone->index;
+		__entry->elem_size = zone->elem_size;
+	)
+);
+
+TRACE_EVENT(zfree,
+	TP_PROTO(struct zone *zone, vm_address_t addr),
+	TP_ARGS(zone, addr),
+	TP_FIELDS(
+		__field(uint64_t, addr),
+		__field(uint32_t, zone)
+	),
+	TP_ASSIGN(
+		__entry->addr = addr;
+		__entry->zone = zone->index;
+	)
+);
+
+/* physical page allocator */
+TRACE_EVENT(vm_page_alloc,
+	TP_PROTO(uint64_t paddr),
+	TP_ARGS(paddr),
+	TP_FIELDS(
+		__field(uint64_t, paddr)
+	),
+	TP_ASSIGN(
+		__entry->paddr = paddr;
+	)
+);
+
+TRACE_EVENT(vm_page_free,
+	TP_PROTO(uint64_t paddr),
+	TP_ARGS(paddr),
+	TP_FIELDS(
+		__field(uint64_t, paddr)
+	),
+	TP_ASSIGN(
+		__entry->paddr = paddr;
+	)
+);
+
+#endif /* __kern_trace_events_h__ */
@@ -0,0 +1,308 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	fgraph.c
+ * Desc:	Function graph tracer. See fgraph.h.
+ *
+ * 			This file, and everything the hooks call (cpu.c and machine.c),
+ * 			must not be built with instrumentation, see the Makefile.
+*/
+
+#define pr_fmt(fmt)	"fgraph: " fmt
+
+#include <kern/trace/fgraph.h>
+#include <kern/trace/printk.h>
+#include <kern/trace/printk_ringbuffer.h>
+#include <kern/machine.h>
+#include <kern/thread.h>
+#include <kern/sched.h>
+#include <kern/clock.h>
+#include <kern/cpu.h>
+
+#include <arch/arch.h>
+#include <tinylibc/string.h>
+
+#if DEFAULTS_SET(DEFAULTS_KERNEL_FGRAPH)
+
+#define FGRAPH_ENTRIES		DEFAULTS_KERNEL_FGRAPH_ENTRIES
+
+/* shadow stacks for each cpu until threads are running */
+static struct fgraph_stack fgraph_boot_stack[CPU_NUMBER_MAX];
+
+/* completed calls, recording stops once a cpu's buffer is full */
+static struct fgraph_record fgraph_records[CPU_NUMBER_MAX][FGRAPH_ENTRIES];
+static unsigned int fgraph_count[CPU_NUMBER_MAX];
+static uint32_t fgraph_dropped[CPU_NUMBER_MAX];
+
+/* set while a cpu is in a hook, so an interrupt taken there isn't traced */
+static uint8_t fgraph_busy[CPU_NUMBER_MAX];
+
+/**
+ * Whether completed calls are recorded. The shadow stacks are kept up to date
+ * regardless, so they stay balanced while recording is stopped.
+ */
+static int fgraph_recording = 1;
+
+static vm_address_t fgraph_filter[FGRAPH_FILTER_MAX];
+static unsigned int fgraph_nr_filters = 0;
+
+static inline __notrace uint64_t __fgraph_counter(void)
+{
+	isb();
+	return sysreg_read(cntpct_el0);
+}
+
+/**
+ * the shadow stack of whatever is running on `cpu`, and its thread id
+ */
+static __notrace struct fgraph_stack *__fgraph_stack(cpu_number_t cpu,
+		int32_t *tid)
+{
+	thread_t *thread;
+	cpu_t *data;
+
+	data = cpu_get_cpu(cpu);
+	thread = data->cpu_active_thread;
+	if ((data->cpu_flags & CPU_FLAG_THREADING_ENABLED) && thread != THREAD_NULL) {
+		*tid = thread->thread_id;
+		return &thread->fgraph;
+	}
+
+	*tid = -1;
+	return &fgraph_boot_stack[cpu];
+}
+
+/* with no filters every function is traced */
+static __notrace int __fgraph_filtered(vm_address_t fn)
+{
+	if (fgraph_nr_filters == 0)
+		return 1;
+
+	for (unsigned int i = 0; i < fgraph_nr_filters; i++)
+		if (fgraph_filter[i] == fn)
+			return 1;
+	return 0;
+}
+
+static __notrace cpu_number_t __fgraph_cpu(void)
+{
+	cpu_number_t cpu;
+
+	cpu = machine_get_cpu_num();
+	if (cpu < 0 || cpu >= CPU_NUMBER_MAX)
+		cpu = 0;
+	return cpu;
+}
+
+/**
+ * __cyg_profile_func_enter
+ *
+ * Called on entry to every instrumented function. Push the call onto the
+ * shadow stack, taking the time last so the hook isn't charged to it.
+ */
+void __cyg_profile_func_enter(void *fn, void *call_site)
+{
+	struct fgraph_stack *stack;
+	struct fgraph_frame *frame;
+	cpu_number_t cpu;
+	int32_t tid;
+
+	cpu = __fgraph_cpu();
+	if (fgraph_busy[cpu])
+		return;
+	fgraph_busy[cpu] = 1;
+
+	stack = __fgraph_stack(cpu, &tid);
+	if (stack->depth < FGRAPH_DEPTH) {
+		frame = &stack->frames[stack->depth];
+		frame->fn = (vm_address_t) fn;
+		frame->child = 0;
+		frame->traced = __fgraph_filtered(frame->fn) ||
+			(stack->depth > 0 && stack->frames[stack->depth - 1].traced);
+		frame->start = __fgraph_counter();
+	}
+	stack->depth += 1;
+
+	fgraph_busy[cpu] = 0;
+}
+
+/**
+ * __cyg_profile_func_exit
+ *
+ * Called on return from every instrumented function. Pop the call, charge it
+ * to its caller, and record it. If the top of the stack isn't this function,
+ * e.g. it was entered while the hooks were busy, or its callees never
+ * returned, unwind to where it is, or ignore it if it isn't there at all.
+ */
+void __cyg_profile_func_exit(void *fn, void *call_site)
+{
+	struct fgraph_stack *stack;
+	struct fgraph_frame *frame;
+	struct fgraph_record *rec;
+	uint64_t now, total;
+	cpu_number_t cpu;
+	unsigned int idx;
+	int32_t tid;
+	int i;
+
+	now = __fgraph_counter();
+
+	cpu = __fgraph_cpu();
+	if (fgraph_busy[cpu])
+		return;
+	fgraph_busy[cpu] = 1;
+
+	stack = __fgraph_stack(cpu, &tid);
+	if (stack->depth == 0)
+		goto out;
+
+	/* too deep to have been timed */
+	if (stack->depth > FGRAPH_DEPTH) {
+		stack->depth -= 1;
+		goto out;
+	}
+
+	for (i = stack->depth - 1; i >= 0; i--)
+		if (stack->frames[i].fn == (vm_address_t) fn)
+			break;
+	if (i < 0)
+		goto out;
+
+	frame = &stack->frames[i];
+	stack->depth = i;
+
+	total = now - frame->start;
+	if (i > 0)
+		stack->frames[i - 1].child += total;
+
+	if (!frame->traced || !__atomic_load_n(&fgraph_recording, __ATOMIC_RELAXED))
+		goto out;
+
+	idx = fgraph_count[cpu];
+	if (idx >= FGRAPH_ENTRIES) {
+		fgraph_dropped[cpu] += 1;
+		goto out;
+	}
+
+	rec = &fgraph_records[cpu][idx];
+	rec->fn = frame->fn;
+	rec->start = frame->start;
+	rec->total = total;
+	rec->self = (frame->child < total) ? total - frame->child : 0;
+	rec->depth = i;
+	rec->cpu = cpu;
+	rec->tid = tid;
+	fgraph_count[cpu] = idx + 1;
+
+out:
+	fgraph_busy[cpu] = 0;
+}
+
+void fgraph_stack_init(struct fgraph_stack *stack)
+{
+	stack->depth = 0;
+}
+
+void fgraph_start(void)
+{
+	__atomic_store_n(&fgraph_recording, 1, __ATOMIC_RELAXED);
+}
+
+void fgraph_stop(void)
+{
+	__atomic_store_n(&fgraph_recording, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * fgraph_filter_function
+ *
+ * Only record calls to `fn`, and the calls it makes. Filters only apply to
+ * calls made after they're added.
+ */
+kern_return_t fgraph_filter_function(void *fn)
+{
+	if (fgraph_nr_filters >= FGRAPH_FILTER_MAX)
+		return KERN_RETURN_FAIL;
+
+	fgraph_filter[fgraph_nr_filters] = (vm_address_t) fn;
+	__atomic_store_n(&fgraph_nr_filters, fgraph_nr_filters + 1, __ATOMIC_RELEASE);
+	return KERN_RETURN_SUCCESS;
+}
+
+void fgraph_filter_clear(void)
+{
+	__atomic_store_n(&fgraph_nr_filters, 0, __ATOMIC_RELEASE);
+}
+
+/* convert a counter value to time since boot */
+static uint64_t __fgraph_ktime(uint64_t cycles)
+{
+	uint64_t boot = clock_ktime_to_counter(0);
+
+	return (cycles > boot) ? clock_cycles_to_ns(cycles - boot) : 0;
+}
+
+/**
+ * fgraph_export
+ *
+ * Write every recorded call out to the console, and empty the buffers. There
+ * are far more records than fit in the log at once, so this waits for the
+ * console to catch up, and must be called from a thread. Recording is stopped
+ * meanwhile, so the export doesn't trace itself.
+ */
+void fgraph_export(void)
+{
+	struct fgraph_record out, *rec;
+	printk_record_t *log;
+	int recording;
+
+	recording = __atomic_exchange_n(&fgraph_recording, 0, __ATOMIC_RELAXED);
+
+	for (int cpu = 0; cpu < CPU_NUMBER_MAX; cpu++) {
+		if (fgraph_dropped[cpu])
+			pr_warn("cpu %d: %u calls dropped\n", cpu, fgraph_dropped[cpu]);
+		fgraph_dropped[cpu] = 0;
+
+		for (unsigned int i = 0; i < fgraph_count[cpu]; i++) {
+			rec = &fgraph_records[cpu][i];
+
+			out = *rec;
+			out.start = __fgraph_ktime(rec->start);
+			out.total = clock_cycles_to_ns(rec->total);
+			out.self = clock_cycles_to_ns(rec->self);
+
+			while ((log = printk_record_reserve(LOGLEVEL_DEFAULT,
+					PRB_RECORD_BINARY | PRB_RECORD_FGRAPH, ktime_get_ns(),
+					sizeof (out))) == NULL)
+				sched_yield();
+
+			memcpy(log->text, &out, sizeof (out));
+			printk_record_commit(log);
+		}
+		fgraph_count[cpu] = 0;
+	}
+
+	__atomic_store_n(&fgraph_recording, recording, __ATOMIC_RELAXED);
+}
+
+#endif /* DEFAULTS_KERNEL_FGRAPH */
@@ -0,0 +1,92 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	fgraph.h
+ * Desc:	Function graph tracer. With the FGRAPH build option, instrumented
+ * 			functions call into the tracer on entry and exit. Each thread
+ * 			keeps a shadow stack of the calls it's in, and when a call
+ * 			returns its total and exclusive time are recorded into a per-CPU
+ * 			buffer. The buffers are exported to the console as "#fgraph"
+ * 			lines, and scripts/fgraph_report.py turns them into a profile.
+*/
+
+#ifndef __KERN_FGRAPH_H__
+#define __KERN_FGRAPH_H__
+
+#include <tinylibc/stdint.h>
+
+#include <libkern/types.h>
+#include <kern/defaults.h>
+#include <kern/vm/vm_types.h>
+
+/* calls tracked per thread, deeper calls are counted but not timed */
+#define FGRAPH_DEPTH			DEFAULTS_KERNEL_FGRAPH_DEPTH
+
+/* function filters */
+#define FGRAPH_FILTER_MAX		8
+
+/* keep a function, and anything it calls, out of the tracer */
+#define __notrace				__attribute__((no_instrument_function))
+
+/* A call in progress */
+struct fgraph_frame {
+	vm_address_t	fn;
+	uint64_t		start;		/* counter cycles at entry */
+	uint64_t		child;		/* cycles spent in traced callees */
+	uint32_t		traced;		/* passes the function filter */
+	uint32_t		reserved;
+};
+
+/* Shadow stack, one per thread, and one per cpu for before threads start */
+struct fgraph_stack {
+	unsigned int		depth;
+	struct fgraph_frame	frames[FGRAPH_DEPTH];
+};
+
+/**
+ * A completed call. The layout is read by scripts/fgraph_report.py, so must not
+ * change without updating it to match. Times are in nanoseconds once exported.
+ */
+struct fgraph_record {
+	uint64_t	fn;
+	uint64_t	start;
+	uint64_t	total;		/* inclusive */
+	uint64_t	self;		/* exclusive */
+	uint16_t	depth;
+	uint16_t	cpu;
+	int32_t		tid;
+};
+
+/* Function graph API */
+extern void fgraph_stack_init(struct fgraph_stack *stack);
+extern void fgraph_start(void);
+extern void fgraph_stop(void);
+extern kern_return_t fgraph_filter_function(void *fn);
+extern void fgraph_filter_clear(void);
+extern void fgraph_export(void);
+
+/* compiler instrumentation hooks */
+extern void __cyg_profile_func_enter(void *fn, void *call_site) __notrace;
+extern void __cyg_profile_func_exit(void *fn, void *call_site) __notrace;
+
+#endif /* __kern_fgraph_h__ */
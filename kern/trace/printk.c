@@ -20,22 +20,55 @@
 //
 //===----------------------------------------------------------------------===//
 
+#define pr_fmt(fmt)	"console: " fmt
+
 #include <drivers/pl011/pl011.h>
 #include <kern/trace/printk.h>
+#include <kern/trace/printk_ringbuffer.h>
+#include <kern/machine/machine-irq.h>
+#include <kern/machine.h>
+#include <kern/thread.h>
+#include <kern/clock.h>
+#include <kern/cpu.h>
+
+#include <tinylibc/stdio.h>
+
+/* the uart interrupt comes from the platform header, when there is one */
+#if DEFAULTS_SET(DEFAULTS_PLAT_STATIC)
+#include <platform/platform_static.h>
+#define PRINTK_UART_IRQ		PLATFORM_STATIC_UART_IRQ
+#else
+#define PRINTK_UART_IRQ		DEFAULTS_KERNEL_DEBUG_UART_IRQ
+#endif
+
+/**
+ * printk log buffers, one per cpu. Messages are formatted into the buffer of
+ * the cpu they are logged on, and written out to the uart later by the console
+ * thread, so logging never waits on the uart.
+ */
+static printk_ringbuffer_t printk_rb[CPU_NUMBER_MAX];
 
-/* printk formatting */
-#define POPT_LONG		(1 << 1)
-#define POPT_LONGLONG	(1 << 2)
-#define POPT_PADRIGHT	(1 << 3)
+/**
+ * Until the console thread is running the buffers are flushed by printk itself.
+ * Once a panic starts, messages bypass the buffers and go straight out.
+ */
+static thread_t *console_thread = THREAD_NULL;
+static int console_sync = 0;
+static int console_owner = 0;
 
-/* longlong to string & hex */
-static char *llstr (char *buf, unsigned long long n, int len);
-static char *llhex (char *buf, unsigned long long u, int len);
+/* room for the "[    s.uuuuuu] " prefix, with seconds up to 20 digits */
+#define CONSOLE_TIMESTAMP_MAX	32
+
+/* longest line the console writes, a binary record is written in hex */
+#define CONSOLE_LINE_MAX		(PRINTK_LINE_MAX * 2 + CONSOLE_TIMESTAMP_MAX)
 
 /* internal console api */
 static int console_initialised = 0;
-static int __console_emits(const char *fmt, va_list list);
-static int __console_emit_stdout(char c);
+static void __console_write(const char *buf, size_t len);
+static size_t __console_timestamp(char *out, uint64_t ns);
+static size_t __console_binary(char *out, printk_record_t *rec);
+static void __console_tx_ready(void *arg);
+static void __console_wakeup(void);
 
 /* printk api */
 static int __vprintk(int level, int flags, const char *fmt, va_list args);
@@ -56,36 +89,88 @@ int _printk(int level, int flags, const char *fmt, ...)
 	return res;
 }
 
-/* exposed vprintk */
+/* exposed vprintk, continues the current line */
 int vprintk(const char *fmt, va_list args)
 {
-	return __vprintk(LOGLEVEL_DEFAULT, 0, fmt, args);
+	return __vprintk(LOGLEVEL_DEFAULT, PK_FLAGS_CONT, fmt, args);
 }
 
 static int __vprintk(int level, int flags, const char *fmt, va_list args)
 {
-	uint64_t sec;
+	char line[PRINTK_LINE_MAX], stamp[CONSOLE_TIMESTAMP_MAX];
+	printk_record_t *rec;
+	uint64_t ts;
+	int len;
 
 	/* check whether the loglevel permits us to continue */
-	if (level > DEFAULTS_KERNEL_LOGLEVEL)
+	if (level > DEFAULTS_KERNEL_LOGLEVEL && !(flags & PK_FLAGS_DYNDBG))
 		return 0;
 
-	/* check for certains flags */
-	if (flags & PK_FLAGS_CONT)
-		return __console_emits(fmt, args);
+	ts = ktime_get_ns();
+	len = vsnprintf(line, sizeof (line), fmt, args);
+	if (len >= (int) sizeof (line))
+		len = sizeof (line) - 1;
+
+	/* during a panic, nothing else is going to drain the buffers */
+	if (console_sync) {
+		if (!(flags & PK_FLAGS_CONT))
+			__console_write(stamp, __console_timestamp(stamp, ts));
+		__console_write(line, len);
+		return len;
+	}
+
+	rec = printk_record_reserve(level,
+		(flags & PK_FLAGS_CONT) ? PRB_RECORD_CONT : 0, ts, len);
+	if (rec != NULL) {
+		memcpy(rec->text, line, len);
+		printk_record_commit(rec);
+	}
+	return len;
+}
+
+/**
+ * printk_record_reserve
+ *
+ * Reserve a record with `len` bytes of payload in the current cpu's log
+ * buffer. This is how printk stores messages, and is also used by the binary
+ * log. Returns NULL if the buffer is full.
+ */
+printk_record_t *printk_record_reserve(int level, int flags, uint64_t ts,
+		size_t len)
+{
+	printk_record_t *rec;
+	cpu_number_t cpu;
 
 	/**
-	 * TODO: ringbuffer
-	 * 
-	 * need to fetch the uptime value, and then write the format string into a
-	 * buffer and create a ringbuffer entry, storing the uptime within that rb
-	 * entry. the rb entries would then get printed.
-	 * 
-	 * would need to rethink the PK_FLAGS_CONT, as we don't want a pr_cont to be
-	 * printed outside of the ringbuffer.
+	 * This can run before the cpu has been registered, so use the hardware cpu
+	 * number rather than the cpu_t.
 	 */
+	cpu = machine_get_cpu_num();
+	if (cpu < 0 || cpu >= CPU_NUMBER_MAX)
+		cpu = 0;
+
+	rec = prb_reserve(&printk_rb[cpu], len);
+	if (rec != NULL) {
+		rec->ts_nsec = ts;
+		rec->level = level;
+		rec->flags = flags;
+	}
+	return rec;
+}
+
+/**
+ * printk_record_commit
+ *
+ * Publish a reserved record and get it to the console.
+ */
+void printk_record_commit(printk_record_t *rec)
+{
+	prb_commit(rec);
 
-	return __console_emits(fmt, args);
+	if (console_sync)
+		console_flush();
+	else
+		__console_wakeup();
 }
 
 /**
@@ -99,150 +184,224 @@ void console_setup()
 	pl011_puts("\n");
 
 	console_initialised = 1;
+
+	/* write out anything logged before the uart was available */
+	console_flush();
+}
+
+/**
+ * console_thread_main
+ *
+ * Body of the console thread. Sleeps until a message is logged, and then
+ * drains the log buffers to the uart.
+ */
+static void console_thread_main(void *arg)
+{
+	while (1) {
+		thread_wait();
+		console_flush();
+	}
+}
+
+/**
+ * console_thread_init
+ *
+ * Start the console thread. From here on printk only writes messages into the
+ * log buffers, and the uart is driven at the console thread's pace rather than
+ * the caller's. Must be called once threads are available.
+ */
+kern_return_t console_thread_init(void)
+{
+	thread_t *thread;
+
+	thread = thread_create(kernel_task, THREAD_PRIORITY_LOW,
+		(thread_entry_t) console_thread_main, "console");
+	if (thread == THREAD_NULL)
+		return KERN_RETURN_FAIL;
+
+	/* let the uart buffer output, and wake the thread when there's room */
+	pl011_set_tx_callback(__console_tx_ready, thread);
+	if (pl011_irq_init(PRINTK_UART_IRQ))
+		pr_warn("no uart interrupt, output will be polled\n");
+
+	console_flush();
+	__atomic_store_n(&console_thread, thread, __ATOMIC_RELEASE);
+	return KERN_RETURN_SUCCESS;
 }
 
 /**
- * emit a single character on the pl011 uart console
+ * __console_wakeup
+ *
+ * Get a newly committed record written out. Waking a thread isn't safe from a
+ * pseudo-NMI, so a message logged there waits for the next wakeup, or a panic.
  */
-static int __console_emit_stdout(char c)
+static void __console_wakeup(void)
 {
-	if (c != '\0')
-		pl011_putc(c);
-	return 0;
+	thread_t *thread;
+
+	if (machine_irq_in_nmi())
+		return;
+
+	thread = __atomic_load_n(&console_thread, __ATOMIC_ACQUIRE);
+	if (thread != THREAD_NULL)
+		thread_wakeup(thread);
+	else
+		console_flush();
 }
 
 /**
- * emit a formatted string and va_list args to the console, using
- * __console_emit_stdout
+ * console_flush
+ *
+ * Drain every cpu's log buffer to the uart, oldest message first. Only one
+ * context drains the buffers at a time, anyone else arriving while a flush is
+ * in progress leaves their message for it to pick up.
  */
-static int __console_emits(const char *fmt, va_list ap)
+void console_flush(void)
 {
-	unsigned long long n;
-	const char *str;
-	uint32_t opts;
-	int width = 0, len = 0;
-	char buf[64];
-	char c;
+	char line[CONSOLE_LINE_MAX];
+	printk_record_t *rec, *oldest;
+	printk_ringbuffer_t *rb;
+	uint32_t dropped;
+	size_t len;
 
 	if (!console_initialised)
-		return -1;
+		return;
+
+	if (__atomic_exchange_n(&console_owner, 1, __ATOMIC_ACQUIRE))
+		return;
 
 	for (;;) {
-		/**
-		 *  Output normal characters over serial, but break if the formatter
-		 *  '%' is found.
-		 */
-		while ((c = *fmt++) != 0) {
-			if (c == '%') break;
-			__console_emit_stdout(c);
+		oldest = NULL;
+		rb = NULL;
+
+		for (int cpu = 0; cpu < CPU_NUMBER_MAX; cpu++) {
+			/* report anything lost since the last flush */
+			dropped = prb_take_dropped(&printk_rb[cpu]);
+			if (dropped) {
+				len = __console_timestamp(line, ktime_get_ns());
+				len += snprintf(&line[len], sizeof (line) - len,
+					"** %u printk messages dropped **\n", dropped);
+				__console_write(line, len);
+			}
+
+			rec = prb_peek(&printk_rb[cpu]);
+			if (rec != NULL && (oldest == NULL || rec->ts_nsec < oldest->ts_nsec)) {
+				oldest = rec;
+				rb = &printk_rb[cpu];
+			}
 		}
 
-		/* check that the character is not NULL */
-		if (c == 0) break;
-
-next:
-		/* next character */
-		c = *fmt++;
-		if (c == 0) break;
-
-		switch (c) {
-			case '0':
-			case '1':
-			case '2':
-			case '3':
-			case '4':
-			case '5':
-			case '6':
-			case '7':
-			case '8':
-			case '9':
-				width = (width * 10) + c - '0';
-				goto next;
-
-			case '%':
-				__console_emit_stdout('%');
-				break;
-
-			case '-':
-				opts |= POPT_PADRIGHT;
-				goto next;
-
-			case 'c':
-				c = va_arg(ap, unsigned int);
-				__console_emit_stdout(c);
-				break;
-
-			case 'l':
-				if (opts & POPT_LONG)
-					opts |= POPT_LONGLONG;
-				opts |= POPT_LONG;
-				goto next;
-
-			case 'i':
-			case 'd':
-				n = va_arg(ap, unsigned int);
-				str = llstr(buf, n, sizeof (buf));
-				goto output;
-
-			case 'p':
-			case 'x':
-				n = va_arg(ap, long long);
-
-				str = llhex(buf, n, sizeof (buf));
-				goto output;
-
-			case 's':
-				str = va_arg(ap, const char *);
-				goto output;
+		if (oldest == NULL)
+			break;
+
+		/* format the line and release the record before writing it */
+		if (oldest->flags & PRB_RECORD_BINARY) {
+			len = __console_binary(line, oldest);
+		} else {
+			len = 0;
+			if (!(oldest->flags & PRB_RECORD_CONT))
+				len = __console_timestamp(line, oldest->ts_nsec);
+			memcpy(&line[len], oldest->text, oldest->text_len);
+			len += oldest->text_len;
 		}
+		prb_consume(rb, oldest);
+
+		__console_write(line, len);
+	}
 
-		continue;
+	__atomic_store_n(&console_owner, 0, __ATOMIC_RELEASE);
+}
 
-output:
-		width -= strlen(str);
-		if (!(opts & POPT_PADRIGHT))
-			while (width-- > 0)
-				__console_emit_stdout('0');
+/**
+ * console_panic_flush
+ *
+ * Called by the panic handler once everything else has been stopped. Takes the
+ * console from whoever had it, writes out everything that was logged before
+ * the panic, and makes every following message go straight to the uart.
+ */
+void console_panic_flush(void)
+{
+	pl011_set_polled();
 
-		while (*str != 0)
-			__console_emit_stdout(*str++);
+	__atomic_store_n(&console_owner, 0, __ATOMIC_RELAXED);
+	console_flush();
+	console_sync = 1;
+}
 
-		if (opts & POPT_PADRIGHT)
-			while (width-- > 0)
-				__console_emit_stdout(' ');
+/**
+ * called from the uart interrupt once there's room to write again
+ */
+static void __console_tx_ready(void *arg)
+{
+	thread_wakeup((thread_t *) arg);
+}
 
-		width = 0;
-		continue;
+/**
+ * write a buffer to the uart. the console thread hands it to the uart driver
+ * and sleeps while the transmit buffer is full, anyone else writes it out
+ * synchronously.
+ */
+static void __console_write(const char *buf, size_t len)
+{
+	thread_t *thread;
+	size_t n;
+
+	thread = __atomic_load_n(&console_thread, __ATOMIC_ACQUIRE);
+	if (!console_sync && thread != THREAD_NULL && thread_get_current() == thread) {
+		while (len > 0) {
+			n = pl011_write(buf, len);
+			buf += n;
+			len -= n;
+			if (len > 0)
+				thread_wait();
+		}
+		return;
 	}
-	return width;
+
+	for (n = 0; n < len; n++)
+		pl011_putc(buf[n]);
 }
 
-static char *llstr (char *buf, unsigned long long n, int len)
+/**
+ * format a binary log record as a "#blog <ts> <level> <payload>" line, with the
+ * payload in hex, for scripts/blog_decode.py to turn back into a message. Trace
+ * events are written as "#trace <ts> <payload>", for scripts/trace_decode.py,
+ * function graph records as "#fgraph <ts> <payload>", and profiler samples as
+ * "#profile <ts> <payload>".
+ */
+static size_t __console_binary(char *out, printk_record_t *rec)
 {
-	int digit, pos = len, neg = 0;
-
-	buf[--pos] = 0;
-	while (n >= 10) {
-		digit = n % 10;
-		n /= 10;
-		buf[--pos] = digit + '0';
+	static const char hex[] = "0123456789abcdef";
+	size_t len;
+	uint8_t c;
+
+	if (rec->flags & PRB_RECORD_TRACE)
+		len = snprintf(out, CONSOLE_TIMESTAMP_MAX, "#trace %llx ",
+			rec->ts_nsec);
+	else if (rec->flags & PRB_RECORD_FGRAPH)
+		len = snprintf(out, CONSOLE_TIMESTAMP_MAX, "#fgraph %llx ",
+			rec->ts_nsec);
+	else if (rec->flags & PRB_RECORD_PROFILE)
+		len = snprintf(out, CONSOLE_TIMESTAMP_MAX, "#profile %llx ",
+			rec->ts_nsec);
+	else
+		len = snprintf(out, CONSOLE_TIMESTAMP_MAX, "#blog %llx %x ",
+			rec->ts_nsec, rec->level);
+
+	for (int i = 0; i < rec->text_len && i < PRINTK_LINE_MAX; i++) {
+		c = rec->text[i];
+		out[len++] = hex[c >> 4];
+		out[len++] = hex[c & 0xf];
 	}
-	buf[--pos] = n + '0';
-	return &buf[pos];
+	out[len++] = '\n';
+	return len;
 }
 
-static char *llhex (char *buf, unsigned long long u, int len)
+/**
+ * format the "[    s.uuuuuu] " prefix for a new line, returning its length
+ */
+static size_t __console_timestamp(char *out, uint64_t ns)
 {
-	static const char hextable[] = { '0', '1', '2', '3', '4', '5', '6', '7',
-									 '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
-	unsigned int d;
-	int pos = len;
-
-	buf[--pos] = 0;
-	do {
-		d = u % 16;
-		u /= 16;
-		buf[--pos] = hextable[d];
-	} while (u != 0);
-	return &buf[pos];
+	return snprintf(out, CONSOLE_TIMESTAMP_MAX, "[%5llu.%06llu] ",
+		ns / NSEC_PER_SEC, (ns % NSEC_PER_SEC) / NSEC_PER_USEC);
 }
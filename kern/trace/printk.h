@@ -38,6 +38,7 @@
 #include <tinylibc/stddef.h>
 
 #include <kern/defaults.h>
+#include <libkern/types.h>
 
 #define KERN_SOH	"\001"
 #define KERN_TEST	KERN_SOH "0"
@@ -63,13 +64,34 @@
 /* printk flags */
 #define PK_FLAGS_NONE		0
 #define PK_FLAGS_CONT		1	/* continue on the same line */
+#define PK_FLAGS_DYNDBG		2	/* enabled by dynamic debug, see dyndbg.h */
+
+/* longest single message, anything longer is truncated */
+#define PRINTK_LINE_MAX		256
 
 /* printk api */
 extern int _printk(int level, int flags, const char *fmt, ...);
 extern int vprintk(const char *fmt, va_list args);
 
-// tmp
-#define __strfmt(fmt)	"[   0.0000] " fmt
+/* log record api, for log formats other than text */
+struct printk_record;
+extern struct printk_record *printk_record_reserve(int level, int flags,
+		uint64_t ts, size_t len);
+extern void printk_record_commit(struct printk_record *rec);
+
+/**
+ * Console. Messages are stored in per-cpu log buffers and written to the uart
+ * by the console thread once it's running, or by printk itself before then.
+ * The panic handler flushes the buffers and switches the console to writing
+ * messages out immediately.
+ */
+extern void console_setup(void);
+extern kern_return_t console_thread_init(void);
+extern void console_flush(void);
+extern void console_panic_flush(void);
+
+/* messages are prefixed with a timestamp by printk itself */
+#define __strfmt(fmt)	fmt
 
 /**
  * printk, kprintf: print a kernel message
@@ -80,7 +102,7 @@ extern int vprintk(const char *fmt, va_list args);
  * information - for that, please use pr_info or pr_debug.
  * 
  * These are also not expected to have a interface prefix, they'll simply print
- * what's passed to them, prefixed by the timestamp.
+ * what's passed to them, prefixed by the time since boot.
  */
 #define printk(fmt, ...)	\
 	_printk(LOGLEVEL_DEFAULT, PK_FLAGS_NONE, __strfmt(fmt), ##__VA_ARGS__)
@@ -94,10 +116,36 @@ extern int vprintk(const char *fmt, va_list args);
 	_printk(LOGLEVEL_CRITICAL, PK_FLAGS_NONE, __strfmt(pr_fmt(fmt)), ##__VA_ARGS__)
 #define pr_warn(fmt, ...)	\
 	_printk(LOGLEVEL_WARNING, PK_FLAGS_NONE, __strfmt(pr_fmt(fmt)), ##__VA_ARGS__)
+
+/**
+ * With DEFAULTS_KERNEL_PRINTK_BINARY, informational and debug messages are
+ * logged in binary form (see blog.h) and decoded on the host, which keeps them
+ * cheap enough to leave enabled. They can take at most BLOG_ARGS_MAX arguments.
+ */
+#if DEFAULTS_SET(DEFAULTS_KERNEL_PRINTK_BINARY)
+#include <kern/trace/blog.h>
+#define pr_info(fmt, ...)	\
+	blog(LOGLEVEL_INFO, __strfmt(pr_fmt(fmt)), ##__VA_ARGS__)
+#define __pr_debug(fmt, ...)	\
+	__blog(LOGLEVEL_DEBUG, __strfmt(fmt), ##__VA_ARGS__)
+#else
 #define pr_info(fmt, ...)	\
 	_printk(LOGLEVEL_INFO, PK_FLAGS_NONE, __strfmt(pr_fmt(fmt)), ##__VA_ARGS__)
+#define __pr_debug(fmt, ...)	\
+	_printk(LOGLEVEL_DEBUG, PK_FLAGS_DYNDBG, __strfmt(fmt), ##__VA_ARGS__)
+#endif
+
+/**
+ * Debug messages are off until they're switched on with dynamic debug, by the
+ * pr_fmt() prefix of their file, and cost a NOP while they are.
+ */
+#include <kern/trace/dyndbg.h>
 #define pr_debug(fmt, ...)	\
-	_printk(LOGLEVEL_DEBUG, PK_FLAGS_NONE, __strfmt(pr_fmt(fmt)), ##__VA_ARGS__)
+	({																		\
+		if (dyndbg_enabled(pr_fmt(""), pr_fmt(fmt)))						\
+			__pr_debug(pr_fmt(fmt), ##__VA_ARGS__);							\
+		0;																	\
+	})
 
 /**
  * Print on the same line, without a uptime tag
@@ -0,0 +1,178 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	printk_ringbuffer.c
+ * Desc:	Lock-free log record buffer. Producers claim space by advancing the
+ * 			head with a compare-and-swap, fill the record in, and then commit it
+ * 			by publishing its logical position. A producer that interrupts
+ * 			another on the same CPU simply reserves the space after it, so
+ * 			records stay in order and nothing ever spins.
+*/
+
+#include <kern/trace/printk_ringbuffer.h>
+#include <kern/atomic.h>
+
+#define PRB_HDR_SIZE		sizeof (printk_record_t)
+
+static inline printk_record_t *__prb_record(printk_ringbuffer_t *rb,
+		uint64_t lpos)
+{
+	return (printk_record_t *) &rb->data[lpos & PRB_MASK];
+}
+
+/**
+ * prb_reserve
+ *
+ * Reserve a record with room for `text_len` bytes of text. Records never wrap
+ * around the end of the buffer, if there isn't room left before the end the
+ * reservation skips to the start, leaving a padding record behind. If the
+ * buffer is full the message is dropped and counted, as there is no way to
+ * wait for the console from every context printk can be called from.
+ */
+printk_record_t *prb_reserve(printk_ringbuffer_t *rb, size_t text_len)
+{
+	uint64_t head, tail, begin, next, prev;
+	printk_record_t *rec;
+	size_t size, room;
+
+	size = (PRB_HDR_SIZE + text_len + PRB_ALIGN - 1) & ~(PRB_ALIGN - 1);
+	if (size > PRB_SIZE / 2 || size > UINT16_MAX)
+		goto dropped;
+
+	head = __atomic_load_n(&rb->head, __ATOMIC_RELAXED);
+	for (;;) {
+		tail = __atomic_load_n(&rb->tail, __ATOMIC_ACQUIRE);
+
+		begin = head;
+		room = PRB_SIZE - (head & PRB_MASK);
+		if (room < size)
+			begin += room;
+
+		next = begin + size;
+		if (next - tail > PRB_SIZE)
+			goto dropped;
+
+		prev = atomic_cmpxchg_64(&rb->head, head, next);
+		if (prev == head)
+			break;
+		head = prev;
+	}
+
+	/**
+	 * Mark the skipped space at the end of the buffer. If it's too small for a
+	 * header, the reader knows to skip it without one.
+	 */
+	if (begin != head && room >= PRB_HDR_SIZE) {
+		rec = __prb_record(rb, head);
+		rec->size = room;
+		rec->text_len = 0;
+		rec->flags = PRB_RECORD_PAD;
+		__atomic_store_n(&rec->lpos, head, __ATOMIC_RELEASE);
+	}
+
+	/**
+	 * Until it's committed, the record holds the inverse of its position, which
+	 * can never match the tail the reader is waiting on.
+	 */
+	rec = __prb_record(rb, begin);
+	rec->lpos = ~begin;
+	rec->size = size;
+	rec->text_len = text_len;
+	rec->level = 0;
+	rec->flags = 0;
+	return rec;
+
+dropped:
+	atomic_fetch_add_32(&rb->dropped, 1);
+	return NULL;
+}
+
+/**
+ * prb_commit
+ *
+ * Publish a reserved record to the reader. The record must not be touched by
+ * the producer afterwards.
+ */
+void prb_commit(printk_record_t *rec)
+{
+	__atomic_store_n(&rec->lpos, ~rec->lpos, __ATOMIC_RELEASE);
+}
+
+/**
+ * prb_peek
+ *
+ * Return the oldest record in the buffer, or NULL if the buffer is empty or
+ * the oldest record hasn't been committed yet. There can only be one reader of
+ * a buffer at a time, the caller is responsible for that.
+ */
+printk_record_t *prb_peek(printk_ringbuffer_t *rb)
+{
+	printk_record_t *rec;
+	uint64_t head, tail;
+	size_t room;
+
+	for (;;) {
+		tail = rb->tail;
+		head = __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE);
+		if (tail == head)
+			return NULL;
+
+		/* no room for a header, so the producer skipped to the start */
+		room = PRB_SIZE - (tail & PRB_MASK);
+		if (room < PRB_HDR_SIZE) {
+			__atomic_store_n(&rb->tail, tail + room, __ATOMIC_RELEASE);
+			continue;
+		}
+
+		rec = __prb_record(rb, tail);
+		if (__atomic_load_n(&rec->lpos, __ATOMIC_ACQUIRE) != tail)
+			return NULL;
+
+		if (rec->flags & PRB_RECORD_PAD) {
+			__atomic_store_n(&rb->tail, tail + rec->size, __ATOMIC_RELEASE);
+			continue;
+		}
+
+		return rec;
+	}
+}
+
+/**
+ * prb_consume
+ *
+ * Release a record returned by prb_peek() back to the producers.
+ */
+void prb_consume(printk_ringbuffer_t *rb, printk_record_t *rec)
+{
+	__atomic_store_n(&rb->tail, rec->lpos + rec->size, __ATOMIC_RELEASE);
+}
+
+/**
+ * prb_take_dropped
+ *
+ * Return the number of records dropped since the last call, and reset it.
+ */
+uint32_t prb_take_dropped(printk_ringbuffer_t *rb)
+{
+	return atomic_xchg_32(&rb->dropped, 0);
+}
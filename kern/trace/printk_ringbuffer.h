@@ -0,0 +1,92 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	printk_ringbuffer.h
+ * Desc:	Lock-free log record buffer. Each CPU owns one ringbuffer, and any
+ * 			context on that CPU, including pseudo-NMIs, may reserve space in it
+ * 			without taking a lock. A single consumer, the console, reads the
+ * 			committed records back in order.
+*/
+
+#ifndef __KERN_PRINTK_RINGBUFFER_H__
+#define __KERN_PRINTK_RINGBUFFER_H__
+
+#include <tinylibc/stdint.h>
+#include <tinylibc/stddef.h>
+
+#include <kern/defaults.h>
+
+/* size of each per-cpu buffer, must be a power of two */
+#define PRB_SIZE				DEFAULTS_KERNEL_PRINTK_RB_SIZE
+#define PRB_MASK				(PRB_SIZE - 1)
+
+/* records are kept 8-byte aligned */
+#define PRB_ALIGN				8
+
+/* record flags */
+#define PRB_RECORD_CONT			(1 << 0)	/* continues the previous line */
+#define PRB_RECORD_PAD			(1 << 1)	/* fills the end of the buffer */
+#define PRB_RECORD_BINARY		(1 << 2)	/* binary log record, see blog.h */
+#define PRB_RECORD_TRACE		(1 << 3)	/* binary trace event, see tracepoint.h */
+#define PRB_RECORD_FGRAPH		(1 << 4)	/* function graph record, see fgraph.h */
+#define PRB_RECORD_PROFILE		(1 << 5)	/* profiler sample, see profile.h */
+
+/**
+ * A single log record. The record is only valid once `lpos` matches the
+ * logical position it was reserved at; the producer writes it last, so a
+ * reader never sees a partially written record, or a stale one left behind
+ * from a previous pass around the buffer.
+ */
+typedef struct printk_record {
+	uint64_t	lpos;		/* logical position, written on commit */
+	uint64_t	ts_nsec;	/* ktime_get_ns() when logged */
+	uint16_t	size;		/* total size, including this header */
+	uint16_t	text_len;
+	uint8_t		level;
+	uint8_t		flags;
+	uint16_t	reserved;
+	char		text[];
+} printk_record_t;
+
+/**
+ * `head` and `tail` are logical positions, they only ever increase and are
+ * masked to find the offset in `data`. Space between tail and head is owned by
+ * producers, and everything else is free.
+ */
+typedef struct printk_ringbuffer {
+	uint64_t	head;		/* next position to reserve */
+	uint64_t	tail;		/* oldest record not yet consumed */
+	uint32_t	dropped;	/* records lost to a full buffer */
+	char		data[PRB_SIZE] __attribute__((aligned(PRB_ALIGN)));
+} printk_ringbuffer_t;
+
+/* producer */
+extern printk_record_t *prb_reserve(printk_ringbuffer_t *rb, size_t text_len);
+extern void prb_commit(printk_record_t *rec);
+
+/* consumer */
+extern printk_record_t *prb_peek(printk_ringbuffer_t *rb);
+extern void prb_consume(printk_ringbuffer_t *rb, printk_record_t *rec);
+extern uint32_t prb_take_dropped(printk_ringbuffer_t *rb);
+
+#endif /* __kern_printk_ringbuffer_h__ */
@@ -0,0 +1,287 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	profile.c
+ * Desc:	Statistical sampling profiler. See profile.h.
+*/
+
+#define pr_fmt(fmt)	"profile: " fmt
+
+#include <kern/trace/profile.h>
+#include <kern/trace/printk.h>
+#include <kern/trace/printk_ringbuffer.h>
+#include <kern/machine/machine_timer.h>
+#include <kern/machine/machine_pmu.h>
+#include <kern/machine.h>
+#include <kern/vm/vm_page.h>
+#include <kern/thread.h>
+#include <kern/sched.h>
+#include <kern/clock.h>
+#include <kern/cpu.h>
+
+#include <arch/arch.h>
+#include <tinylibc/stddef.h>
+#include <tinylibc/string.h>
+
+#if DEFAULTS_SET(DEFAULTS_KERNEL_PROFILE)
+
+#define PROFILE_SAMPLES		DEFAULTS_KERNEL_PROFILE_SAMPLES
+
+/* how far above the interrupted sp a frame record can be, i.e. a stack's size */
+#define PROFILE_STACK_SPAN	THREAD_STACK_DEFAULT_SIZE
+
+/* samples taken, sampling stops once a cpu's buffer is full until the export */
+static struct profile_sample profile_samples[CPU_NUMBER_MAX][PROFILE_SAMPLES];
+static unsigned int profile_count[CPU_NUMBER_MAX];
+static uint32_t profile_dropped[CPU_NUMBER_MAX];
+
+/* set while the buffers are being exported */
+static int profile_paused = 0;
+static int profile_registered = 0;
+
+/* sampling on PMU overflow instead of the timer, see profile_start_pmu() */
+static pmu_counter_t profile_pmu_counter = { .idx = -1 };
+
+/**
+ * Walk the frame records from the interrupted frame pointer. The NMI can land
+ * anywhere, including a prologue or assembly that doesn't keep x29 as a frame
+ * pointer, so each record must be further up the stack than the last, and
+ * within a stack's size of the interrupted sp, to be followed.
+ */
+static unsigned int __profile_unwind(arm64_exception_frame_t *frame,
+		uint64_t *pc, unsigned int max)
+{
+	struct frame_record *fr;
+	vm_address_t lo, hi;
+	unsigned int n;
+
+	fr = (struct frame_record *) frame->fp;
+	lo = frame->sp;
+	hi = frame->sp + PROFILE_STACK_SPAN;
+
+	for (n = 0; n < max; n++) {
+		if ((vm_address_t) fr < lo || (vm_address_t) fr >= hi ||
+				((vm_address_t) fr & 0x7))
+			break;
+		if (fr->return_addr == NULL)
+			break;
+
+		pc[n] = (uint64_t) fr->return_addr;
+		lo = (vm_address_t) fr + sizeof (*fr);
+		fr = fr->parent;
+	}
+	return n;
+}
+
+static void __profile_sample(arm64_exception_frame_t *frame)
+{
+	struct profile_sample *sample;
+	cpu_number_t cpu;
+	thread_t *thread;
+	unsigned int idx;
+	cpu_t *cpu_data;
+
+	if (__atomic_load_n(&profile_paused, __ATOMIC_RELAXED))
+		return;
+
+	cpu = machine_get_cpu_num();
+	idx = profile_count[cpu];
+	if (idx >= PROFILE_SAMPLES) {
+		profile_dropped[cpu] += 1;
+		return;
+	}
+
+	sample = &profile_samples[cpu][idx];
+	sample->cpu = cpu;
+	sample->tid = -1;
+
+	cpu_data = cpu_get_cpu(cpu);
+	thread = cpu_data->cpu_active_thread;
+	if ((cpu_data->cpu_flags & CPU_FLAG_THREADING_ENABLED) && thread != THREAD_NULL)
+		sample->tid = thread->thread_id;
+
+	sample->pc[0] = frame->elr;
+	sample->depth = 1 + __profile_unwind(frame, &sample->pc[1],
+		PROFILE_DEPTH - 1);
+
+	profile_count[cpu] = idx + 1;
+}
+
+static void profile_nmi_handler(intid_t intid, arm64_exception_frame_t *frame,
+		void *data)
+{
+	__profile_sample(frame);
+}
+
+/* only a pseudo-NMI overflow has the interrupted frame to sample */
+static void profile_pmu_overflow(pmu_counter_t *counter,
+		arm64_exception_frame_t *frame, void *arg)
+{
+	if (frame != NULL)
+		__profile_sample(frame);
+}
+
+#endif /* DEFAULTS_KERNEL_PROFILE */
+
+/**
+ * profile_start
+ *
+ * Start sampling every CPU `hz` times a second, or change the rate if it's
+ * already running.
+ */
+kern_return_t profile_start(uint64_t hz)
+{
+#if DEFAULTS_SET(DEFAULTS_KERNEL_PROFILE)
+	if (!profile_registered || hz == 0)
+		return KERN_RETURN_FAIL;
+
+	if (machine_timer_nmi_set_rate(profile_nmi_handler, hz) !=
+			KERN_RETURN_SUCCESS)
+		return KERN_RETURN_FAIL;
+
+	pr_info("sampling at %dHz\n", (int) hz);
+	return KERN_RETURN_SUCCESS;
+#else
+	return KERN_RETURN_FAIL;
+#endif
+}
+
+/**
+ * profile_start_pmu
+ *
+ * Sample this CPU every `period` PMU events rather than on the timer, e.g.
+ * every so many cycles, or cache refills to see where they happen.
+ */
+kern_return_t profile_start_pmu(uint16_t event, uint64_t period)
+{
+#if DEFAULTS_SET(DEFAULTS_KERNEL_PROFILE)
+	if (!profile_registered || profile_pmu_counter.idx >= 0)
+		return KERN_RETURN_FAIL;
+
+	if (pmu_counter_init(&profile_pmu_counter, event, PMU_COUNTER_SYSTEM) !=
+			KERN_RETURN_SUCCESS ||
+		pmu_counter_set_overflow(&profile_pmu_counter, period,
+			profile_pmu_overflow, NULL) != KERN_RETURN_SUCCESS ||
+		pmu_counter_start(&profile_pmu_counter) != KERN_RETURN_SUCCESS)
+		return KERN_RETURN_FAIL;
+
+	machine_timer_nmi_set_rate(profile_nmi_handler, 0);
+	pr_info("sampling every %lld of PMU event 0x%x\n", period, event);
+	return KERN_RETURN_SUCCESS;
+#else
+	return KERN_RETURN_FAIL;
+#endif
+}
+
+void profile_stop(void)
+{
+#if DEFAULTS_SET(DEFAULTS_KERNEL_PROFILE)
+	if (profile_registered)
+		machine_timer_nmi_set_rate(profile_nmi_handler, 0);
+	if (profile_pmu_counter.idx >= 0)
+		pmu_counter_stop(&profile_pmu_counter);
+#endif
+}
+
+/**
+ * profile_export
+ *
+ * Write the samples out to the console, followed by the name of each thread so
+ * they can be told apart, and empty the buffers. Like the function graph
+ * export, this waits for the console to catch up, so must be called from a
+ * thread. Sampling is paused meanwhile, so the export doesn't profile itself.
+ */
+void profile_export(void)
+{
+#if DEFAULTS_SET(DEFAULTS_KERNEL_PROFILE)
+	struct profile_sample *sample;
+	printk_record_t *log;
+	unsigned int total = 0;
+	thread_t *thread;
+	size_t len;
+
+	__atomic_store_n(&profile_paused, 1, __ATOMIC_RELAXED);
+
+	for (int cpu = 0; cpu < CPU_NUMBER_MAX; cpu++) {
+		if (profile_dropped[cpu])
+			pr_warn("cpu %d: %u samples dropped\n", cpu, profile_dropped[cpu]);
+		profile_dropped[cpu] = 0;
+
+		for (unsigned int i = 0; i < profile_count[cpu]; i++) {
+			sample = &profile_samples[cpu][i];
+			len = offsetof(struct profile_sample, pc) +
+				sample->depth * sizeof (sample->pc[0]);
+
+			while ((log = printk_record_reserve(LOGLEVEL_DEFAULT,
+					PRB_RECORD_BINARY | PRB_RECORD_PROFILE, ktime_get_ns(),
+					len)) == NULL)
+				sched_yield();
+
+			memcpy(log->text, sample, len);
+			printk_record_commit(log);
+		}
+		total += profile_count[cpu];
+		profile_count[cpu] = 0;
+	}
+
+	if (total) {
+		list_for_each_entry(thread, &threads, threads)
+			pr_info("thread %d: %s\n", thread->thread_id, thread->name);
+	}
+
+	__atomic_store_n(&profile_paused, 0, __ATOMIC_RELAXED);
+#endif
+}
+
+/**
+ * profile_init
+ *
+ * Register the profiler's pseudo-NMI, and with DEFAULTS_KERNEL_PROFILE, start
+ * sampling at DEFAULTS_KERNEL_PROFILE_HZ, or every DEFAULTS_KERNEL_PROFILE_CYCLES
+ * cycles where there's a PMU. An ordinary interrupt would never sample code
+ * running with interrupts disabled, so without pseudo-NMIs the profiler is
+ * unavailable.
+ */
+kern_return_t profile_init(void)
+{
+#if DEFAULTS_SET(DEFAULTS_KERNEL_PROFILE)
+	if (!machine_irq_nmi_enabled()) {
+		pr_info("pseudo-NMI disabled, profiling unavailable\n");
+		return KERN_RETURN_FAIL;
+	}
+
+	if (machine_timer_register_nmi(profile_nmi_handler, NULL, 0) !=
+			KERN_RETURN_SUCCESS) {
+		pr_err("failed to register NMI handler\n");
+		return KERN_RETURN_FAIL;
+	}
+	profile_registered = 1;
+
+	if (DEFAULTS_KERNEL_PROFILE_CYCLES && profile_start_pmu(PMU_EVENT_CPU_CYCLES,
+			DEFAULTS_KERNEL_PROFILE_CYCLES) == KERN_RETURN_SUCCESS)
+		return KERN_RETURN_SUCCESS;
+	return profile_start(DEFAULTS_KERNEL_PROFILE_HZ);
+#else
+	return KERN_RETURN_SUCCESS;
+#endif
+}
@@ -0,0 +1,64 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	profile.h
+ * Desc:	Statistical sampling profiler. A pseudo-NMI fires at a fixed rate,
+ * 			or every so many PMU events, even with interrupts disabled, and
+ * 			records where the CPU was: the interrupted pc, the running thread,
+ * 			and the call stack unwound through the frame records. Samples
+ * 			are kept per CPU, exported to the console as "#profile" lines,
+ * 			and scripts/profile_fold.py turns them into folded stacks for a
+ * 			flame graph.
+*/
+
+#ifndef __KERN_PROFILE_H__
+#define __KERN_PROFILE_H__
+
+#include <tinylibc/stdint.h>
+
+#include <libkern/types.h>
+#include <kern/defaults.h>
+
+/* frames recorded per sample, including the interrupted pc */
+#define PROFILE_DEPTH			DEFAULTS_KERNEL_PROFILE_DEPTH
+
+/**
+ * A sample. The layout is read by scripts/profile_fold.py, so must not change
+ * without updating it to match. Only the first `depth` entries of `pc` are
+ * exported, the interrupted pc first, then each return address going up.
+ */
+struct profile_sample {
+	uint16_t	depth;
+	uint16_t	cpu;
+	int32_t		tid;		/* -1 before threads start */
+	uint64_t	pc[PROFILE_DEPTH];
+};
+
+/* Profiler API */
+extern kern_return_t profile_init(void);
+extern kern_return_t profile_start(uint64_t hz);
+extern kern_return_t profile_start_pmu(uint16_t event, uint64_t period);
+extern void profile_stop(void);
+extern void profile_export(void);
+
+#endif /* __kern_profile_h__ */
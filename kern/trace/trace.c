@@ -0,0 +1,295 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	trace.c
+ * Desc:	Tracepoint control and the trace buffers. Events are recorded into
+ * 			a per-CPU buffer, using the same lock-free ringbuffer as printk,
+ * 			and the trace thread periodically moves them into the log to be
+ * 			written out as "#trace" lines.
+*/
+
+#define pr_fmt(fmt)	"trace: " fmt
+
+#include <kern/trace/tracepoint.h>
+#include <kern/trace/printk.h>
+#include <kern/trace/printk_ringbuffer.h>
+#include <kern/trace/fgraph.h>
+#include <kern/trace/profile.h>
+#include <kern/static_key.h>
+#include <kern/machine.h>
+#include <kern/thread.h>
+#include <kern/timer.h>
+#include <kern/clock.h>
+#include <kern/task.h>
+#include <kern/cpu.h>
+
+#include <tinylibc/string.h>
+
+/* tracepoints and their patch sites, from the linker script */
+extern struct tracepoint __trace_events_start[];
+extern struct tracepoint __trace_events_end[];
+
+_Static_assert(TRACE_EVENT_MAX <= PRINTK_LINE_MAX, "trace event too large");
+_Static_assert(sizeof (struct tracepoint) == 24, "tracepoint layout changed");
+_Static_assert(sizeof (struct trace_field) == 16, "trace_field layout changed");
+
+#define TRACE_EXPORT_NS		(DEFAULTS_KERNEL_TRACE_EXPORT_MS * NSEC_PER_MSEC)
+
+/* per-cpu trace buffers */
+static printk_ringbuffer_t trace_rb[CPU_NUMBER_MAX];
+
+/* the export thread, and the timer that wakes it while tracing is on */
+static thread_t *trace_thread = THREAD_NULL;
+static timer_t trace_timer;
+static unsigned int trace_nr_enabled = 0;
+static int trace_export_owner = 0;
+
+/**
+ * trace_reserve
+ *
+ * Reserve room for an event in the current cpu's trace buffer, and fill in
+ * its header. Returns NULL if the buffer is full, in which case the event is
+ * dropped and counted.
+ */
+void *trace_reserve(struct tracepoint *tp, size_t size)
+{
+	struct trace_entry *ent;
+	printk_record_t *rec;
+	cpu_number_t cpu;
+	thread_t *thread;
+
+	cpu = machine_get_cpu_num();
+	if (cpu < 0 || cpu >= CPU_NUMBER_MAX)
+		cpu = 0;
+
+	rec = prb_reserve(&trace_rb[cpu], size);
+	if (rec == NULL)
+		return NULL;
+
+	rec->ts_nsec = ktime_get_ns();
+	rec->level = LOGLEVEL_DEFAULT;
+	rec->flags = PRB_RECORD_BINARY | PRB_RECORD_TRACE;
+
+	thread = THREAD_NULL;
+	if (cpu_read_flag(cpu, CPU_FLAG_THREADING_ENABLED))
+		thread = thread_get_current();
+
+	ent = (struct trace_entry *) rec->text;
+	ent->id = tp - __trace_events_start;
+	ent->cpu = cpu;
+	ent->tid = (thread != THREAD_NULL) ? thread->thread_id : -1;
+	return ent;
+}
+
+/**
+ * trace_commit
+ *
+ * Publish an event filled in after trace_reserve(). It sits in the trace
+ * buffer until the next export.
+ */
+void trace_commit(void *entry)
+{
+	prb_commit((printk_record_t *)
+		((char *) entry - offsetof(printk_record_t, text)));
+}
+
+/**
+ * trace_export
+ *
+ * Move every recorded event into the log, oldest first across all cpus, for
+ * the console to write out. Stops early if the log buffer fills up, leaving
+ * the rest for the next export.
+ */
+void trace_export(void)
+{
+	printk_record_t *rec, *oldest, *out;
+	printk_ringbuffer_t *rb;
+	uint32_t dropped;
+
+	if (__atomic_exchange_n(&trace_export_owner, 1, __ATOMIC_ACQUIRE))
+		return;
+
+	for (int cpu = 0; cpu < CPU_NUMBER_MAX; cpu++) {
+		dropped = prb_take_dropped(&trace_rb[cpu]);
+		if (dropped)
+			pr_warn("cpu %d: %u events dropped\n", cpu, dropped);
+	}
+
+	for (;;) {
+		oldest = NULL;
+		rb = NULL;
+
+		for (int cpu = 0; cpu < CPU_NUMBER_MAX; cpu++) {
+			rec = prb_peek(&trace_rb[cpu]);
+			if (rec != NULL && (oldest == NULL || rec->ts_nsec < oldest->ts_nsec)) {
+				oldest = rec;
+				rb = &trace_rb[cpu];
+			}
+		}
+
+		if (oldest == NULL)
+			break;
+
+		out = printk_record_reserve(oldest->level, oldest->flags,
+			oldest->ts_nsec, oldest->text_len);
+		if (out == NULL)
+			break;
+
+		memcpy(out->text, oldest->text, oldest->text_len);
+		prb_consume(rb, oldest);
+		printk_record_commit(out);
+	}
+
+	__atomic_store_n(&trace_export_owner, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * switch a tracepoint's key, which patches every site of the tracepoint to
+ * either branch to its recording code, or fall through
+ */
+static void __trace_set_enabled(struct tracepoint *tp, int enabled)
+{
+	if (static_key_enabled(&tp->key) == enabled)
+		return;
+
+	if (enabled) {
+		static_key_enable(&tp->key);
+		trace_nr_enabled += 1;
+	} else {
+		static_key_disable(&tp->key);
+		trace_nr_enabled -= 1;
+	}
+
+	/* the trace thread arms the export timer when it sees the change */
+	if (trace_thread != THREAD_NULL)
+		thread_wakeup(trace_thread);
+}
+
+static struct tracepoint *__trace_event_find(const char *name)
+{
+	struct tracepoint *tp;
+
+	for (tp = __trace_events_start; tp < __trace_events_end; tp++)
+		if (strcmp(tp->name, name) == 0)
+			return tp;
+	return NULL;
+}
+
+kern_return_t trace_event_enable(const char *name)
+{
+	struct tracepoint *tp;
+
+	tp = __trace_event_find(name);
+	if (tp == NULL)
+		return KERN_RETURN_FAIL;
+
+	__trace_set_enabled(tp, 1);
+	return KERN_RETURN_SUCCESS;
+}
+
+kern_return_t trace_event_disable(const char *name)
+{
+	struct tracepoint *tp;
+
+	tp = __trace_event_find(name);
+	if (tp == NULL)
+		return KERN_RETURN_FAIL;
+
+	__trace_set_enabled(tp, 0);
+	return KERN_RETURN_SUCCESS;
+}
+
+void trace_enable_all(void)
+{
+	for (struct tracepoint *tp = __trace_events_start; tp < __trace_events_end; tp++)
+		__trace_set_enabled(tp, 1);
+}
+
+void trace_disable_all(void)
+{
+	for (struct tracepoint *tp = __trace_events_start; tp < __trace_events_end; tp++)
+		__trace_set_enabled(tp, 0);
+}
+
+/**
+ * wake the trace thread for the next export, from the timer interrupt
+ */
+static void __trace_timer_fn(timer_t *timer, void *arg)
+{
+	thread_wakeup((thread_t *) arg);
+}
+
+/**
+ * trace_thread_main
+ *
+ * Body of the trace thread. While any event is enabled, export the trace
+ * buffers every DEFAULTS_KERNEL_TRACE_EXPORT_MS. Once everything has been
+ * disabled, export what's left and go back to sleep. A kernel built with the
+ * function graph tracer, or the profiler, has its records exported the same
+ * way.
+ */
+static void trace_thread_main(void *arg)
+{
+	int periodic;
+
+	while (1) {
+		periodic = trace_nr_enabled || DEFAULTS_SET(DEFAULTS_KERNEL_FGRAPH) ||
+			DEFAULTS_SET(DEFAULTS_KERNEL_PROFILE);
+		if (periodic && !timer_pending(&trace_timer))
+			timer_arm(&trace_timer, ktime_get_ns() + TRACE_EXPORT_NS,
+				__trace_timer_fn, trace_thread);
+
+		thread_wait();
+		trace_export();
+#if DEFAULTS_SET(DEFAULTS_KERNEL_FGRAPH)
+		fgraph_export();
+#endif
+		profile_export();
+	}
+}
+
+/**
+ * trace_init
+ *
+ * Start the trace thread, and with DEFAULTS_KERNEL_TRACE, enable every event.
+ * Must be called once threads are available.
+ */
+kern_return_t trace_init(void)
+{
+	thread_t *thread;
+
+	timer_setup(&trace_timer);
+
+	thread = thread_create(kernel_task, THREAD_PRIORITY_LOW,
+		(thread_entry_t) trace_thread_main, "trace");
+	if (thread == THREAD_NULL)
+		return KERN_RETURN_FAIL;
+	trace_thread = thread;
+
+	pr_info("%d events\n", (int) (__trace_events_end - __trace_events_start));
+
+#if DEFAULTS_SET(DEFAULTS_KERNEL_TRACE)
+	trace_enable_all();
+#endif
+	return KERN_RETURN_SUCCESS;
+}
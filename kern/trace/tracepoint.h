@@ -0,0 +1,195 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	tracepoint.h
+ * Desc:	Static tracepoints. A tracepoint is a branch on a static key, so
+ * 			a disabled tracepoint is a single NOP in the code that calls it.
+ * 			Enabling the event patches each of its NOPs into a branch to the
+ * 			out-of-line code that records it.
+ *
+ * 			Events are defined with TRACE_EVENT() in kern/trace/events.h, and
+ * 			recorded into per-CPU binary trace buffers which are exported to
+ * 			the console as "#trace" lines, to be decoded and analysed on the
+ * 			host by scripts/trace_decode.py.
+*/
+
+#ifndef __KERN_TRACEPOINT_H__
+#define __KERN_TRACEPOINT_H__
+
+#include <tinylibc/stdint.h>
+#include <tinylibc/stddef.h>
+
+#include <kern/defaults.h>
+#include <libkern/types.h>
+#include <kern/static_key.h>
+
+/* largest event, including its trace_entry header */
+#define TRACE_EVENT_MAX			64
+
+/**
+ * Field descriptor, one per member of an event. The descriptors, and the
+ * tracepoints themselves, are read from the kernel image by the host-side
+ * decoder, so their layout must not change without updating
+ * scripts/trace_decode.py to match.
+ */
+struct trace_field {
+	const char	*name;
+	uint16_t	offset;
+	uint8_t		size;
+	uint8_t		is_signed;
+	uint32_t	reserved;
+};
+
+/* A tracepoint, placed in .trace_events. Its id is its index in the section */
+struct tracepoint {
+	const char					*name;
+	const struct trace_field	*fields;
+	uint16_t					nfields;
+	uint16_t					size;		/* of the event, with header */
+	struct static_key			key;		/* enables the event */
+};
+
+/* Each recorded event starts with this header */
+struct trace_entry {
+	uint16_t	id;
+	uint16_t	cpu;
+	int32_t		tid;		/* running thread, or -1 */
+};
+
+/* Trace API */
+extern kern_return_t trace_init(void);
+extern kern_return_t trace_event_enable(const char *name);
+extern kern_return_t trace_event_disable(const char *name);
+extern void trace_enable_all(void);
+extern void trace_disable_all(void);
+extern void trace_export(void);
+
+/* used by the generated event functions */
+extern void *trace_reserve(struct tracepoint *tp, size_t size);
+extern void trace_commit(void *entry);
+
+/* argument lists passed through a macro intact */
+#define PARAMS(...)			__VA_ARGS__
+#define TP_PROTO(...)		__VA_ARGS__
+#define TP_ARGS(...)		__VA_ARGS__
+#define TP_FIELDS(...)		__VA_ARGS__
+#define TP_ASSIGN(...)		__VA_ARGS__
+
+/* an event member, integers only */
+#define __field(__type, __name)	(__type, __name)
+
+/* field iteration, for up to 8 fields */
+#define __TRACE_NARGS(...)													\
+	__TRACE_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define __TRACE_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, N, ...)	N
+
+#define __TRACE_CAT(a, b)	__TRACE_CAT_(a, b)
+#define __TRACE_CAT_(a, b)	a##b
+
+#define __TRACE_MAP(m, ev, ...)												\
+	__TRACE_CAT(__TRACE_MAP_, __TRACE_NARGS(__VA_ARGS__))(m, ev, ##__VA_ARGS__)
+#define __TRACE_MAP_1(m, ev, f)			m(ev, PARAMS f)
+#define __TRACE_MAP_2(m, ev, f, ...)	m(ev, PARAMS f) __TRACE_MAP_1(m, ev, __VA_ARGS__)
+#define __TRACE_MAP_3(m, ev, f, ...)	m(ev, PARAMS f) __TRACE_MAP_2(m, ev, __VA_ARGS__)
+#define __TRACE_MAP_4(m, ev, f, ...)	m(ev, PARAMS f) __TRACE_MAP_3(m, ev, __VA_ARGS__)
+#define __TRACE_MAP_5(m, ev, f, ...)	m(ev, PARAMS f) __TRACE_MAP_4(m, ev, __VA_ARGS__)
+#define __TRACE_MAP_6(m, ev, f, ...)	m(ev, PARAMS f) __TRACE_MAP_5(m, ev, __VA_ARGS__)
+#define __TRACE_MAP_7(m, ev, f, ...)	m(ev, PARAMS f) __TRACE_MAP_6(m, ev, __VA_ARGS__)
+#define __TRACE_MAP_8(m, ev, f, ...)	m(ev, PARAMS f) __TRACE_MAP_7(m, ev, __VA_ARGS__)
+
+#define __TRACE_FIELD_DECL(ev, ...)		__TRACE_FIELD_DECL_(ev, __VA_ARGS__)
+#define __TRACE_FIELD_DECL_(ev, __type, __name)	__type __name;
+
+#define __TRACE_FIELD_DESC(ev, ...)		__TRACE_FIELD_DESC_(ev, __VA_ARGS__)
+#define __TRACE_FIELD_DESC_(ev, __type, __name)								\
+	{																		\
+		.name = #__name,													\
+		.offset = offsetof(struct trace_event_##ev, __name),				\
+		.size = sizeof (__type),											\
+		.is_signed = ((__type) -1 < (__type) 0),							\
+	},
+
+/**
+ * The event record, the out-of-line recording function, and trace_<name>()
+ * itself, which branches to it while the event is enabled.
+ */
+#define __TRACE_EVENT_DECLARE(__name, __proto, __args, __fields)			\
+	struct trace_event_##__name {											\
+		struct trace_entry ent;												\
+		__TRACE_MAP(__TRACE_FIELD_DECL, __name, __fields)					\
+	};																		\
+	extern struct tracepoint __tracepoint_##__name;							\
+	extern void __trace_##__name(__proto);									\
+	static inline __attribute__((always_inline)) void trace_##__name(__proto)	\
+	{																		\
+		if (static_branch_unlikely(&__tracepoint_##__name.key))				\
+			__trace_##__name(__args);										\
+	}
+
+/**
+ * The tracepoint and its field descriptors, and the recording function. `assign`
+ * fills in the fields of `__entry` from the tracepoint's arguments.
+ */
+#define __TRACE_EVENT_DEFINE(__name, __proto, __fields, __assign)			\
+	static const struct trace_field __trace_fields_##__name[] = {			\
+		__TRACE_MAP(__TRACE_FIELD_DESC, __name, __fields)					\
+	};																		\
+	_Static_assert(sizeof (struct trace_event_##__name) <= TRACE_EVENT_MAX,	\
+		"trace event " #__name " is too large");							\
+	struct tracepoint __tracepoint_##__name									\
+		__attribute__((section(".trace_events"), used, aligned(8))) = {		\
+		.name = #__name,													\
+		.fields = __trace_fields_##__name,									\
+		.nfields = sizeof (__trace_fields_##__name) /						\
+			sizeof (__trace_fields_##__name[0]),							\
+		.size = sizeof (struct trace_event_##__name),						\
+		.key = STATIC_KEY_INIT(0),											\
+	};																		\
+	void __trace_##__name(__proto)											\
+	{																		\
+		struct trace_event_##__name *__entry;								\
+																			\
+		__entry = trace_reserve(&__tracepoint_##__name, sizeof (*__entry));	\
+		if (__entry == NULL)												\
+			return;															\
+		__assign															\
+		trace_commit(__entry);												\
+	}
+
+/**
+ * TRACE_EVENT(name, TP_PROTO(...), TP_ARGS(...), TP_FIELDS(...), TP_ASSIGN(...))
+ *
+ * Define a tracepoint, called as trace_<name>(). Every file sees the
+ * declarations, and kern/trace/trace_events.c defines CREATE_TRACE_POINTS to
+ * generate the definitions once.
+ */
+#ifdef CREATE_TRACE_POINTS
+#define TRACE_EVENT(__name, __proto, __args, __fields, __assign)			\
+	__TRACE_EVENT_DECLARE(__name, PARAMS(__proto), PARAMS(__args), PARAMS(__fields))	\
+	__TRACE_EVENT_DEFINE(__name, PARAMS(__proto), PARAMS(__fields), PARAMS(__assign))
+#else
+#define TRACE_EVENT(__name, __proto, __args, __fields, __assign)			\
+	__TRACE_EVENT_DECLARE(__name, PARAMS(__proto), PARAMS(__args), PARAMS(__fields))
+#endif
+
+#endif /* __kern_tracepoint_h__ */
@@ -27,6 +27,8 @@
 #include <kern/defaults.h>
 #include <kern/vm/pmap.h>
 #include <kern/vm/vm.h>
+#include <kern/alternative.h>
+#include <arch/arch.h>
 
 /* pagetable region state */
 static int ptregion_initialised = 0;
@@ -92,6 +94,97 @@ vm_address_t pmap_ptregion_alloc()
 	return vaddr;
 }
 
+/******************************************************************************
+ * TLB maintenance
+ ******************************************************************************/
+
+/**
+ * TLBI range operand, for a 4KB granule. A range covers (NUM + 1) << (5 *
+ * SCALE + 1) pages from BaseADDR, VA[48:12], with TTL left as unknown.
+ */
+#define TLBI_RANGE_TG_4K			(UL(1) << 46)
+#define TLBI_RANGE_SCALE_SHIFT		44
+#define TLBI_RANGE_NUM_SHIFT		39
+#define TLBI_RANGE_NUM_MAX			31
+#define TLBI_RANGE_BADDR_MASK		((UL(1) << 37) - 1)
+#define TLBI_RANGE_PAGES(__num, __scale)	\
+	((uint64_t) ((__num) + 1) << (5 * (__scale) + 1))
+
+/**
+ * TLBI by VA operand, VA[55:12] in bits [43:0]. The bits above are RES0 and
+ * the TTL hint, which must be left as 0 (unknown level), so the sign bits of
+ * a TTBR1 address mustn't be shifted into them.
+ */
+#define TLBI_VA_MASK				((UL(1) << 44) - 1)
+
+/* TLBI VAAE1IS, any ASID, inner shareable */
+static inline void __tlbi_vaae1is(vm_address_t va)
+{
+	uint64_t arg = (va >> TT_L3_SHIFT) & TLBI_VA_MASK;
+
+	__asm__ __volatile__("tlbi vaae1is, %0" : : "r" (arg) : "memory");
+}
+
+/* TLBI RVAAE1IS, by encoding as it's an ARMv8.4 name */
+static inline void __tlbi_rvaae1is(vm_address_t va, uint64_t num, int scale)
+{
+	uint64_t arg = TLBI_RANGE_TG_4K |
+		((uint64_t) scale << TLBI_RANGE_SCALE_SHIFT) |
+		(num << TLBI_RANGE_NUM_SHIFT) |
+		((va >> TT_L3_SHIFT) & TLBI_RANGE_BADDR_MASK);
+
+	__asm__ __volatile__("sys #0, c8, c2, #3, %0" : : "r" (arg) : "memory");
+}
+
+/**
+ *	Name:	pmap_tlb_flush_range
+ *	Desc:	Invalidate the TLB entries for a range of kernel virtual addresses
+ *			on every CPU, after its translation table entries have changed.
+ *			With FEAT_TLBIRANGE, patched in as an alternative, the range is
+ *			covered by a few range operations, growing the scale as the
+ *			remaining count allows, with odd pages done singly. Otherwise it
+ *			is a page at a time. Past DEFAULTS_KERNEL_VM_TLB_FLUSH_MAX pages
+ *			without ranges, it's cheaper to drop everything.
+ */
+void pmap_tlb_flush_range(vm_address_t va, vm_size_t size)
+{
+	uint64_t pages, num;
+	int range, scale = 0;
+
+	va &= ~(TT_L3_SIZE - 1);
+	pages = (size + TT_L3_SIZE - 1) >> TT_L3_SHIFT;
+	range = alternative_has_feature(CPU_FEATURE_TLBIRANGE);
+
+	/* make the table updates visible to the walker first */
+	dsbishst();
+
+	if ((!range && pages > DEFAULTS_KERNEL_VM_TLB_FLUSH_MAX) ||
+			pages >= TLBI_RANGE_PAGES(TLBI_RANGE_NUM_MAX, 3)) {
+		__asm__ __volatile__("tlbi vmalle1is" : : : "memory");
+		pages = 0;
+	}
+
+	while (pages) {
+		if (!range || (pages & 1)) {
+			__tlbi_vaae1is(va);
+			va += TT_L3_SIZE;
+			pages--;
+			continue;
+		}
+
+		num = ((pages >> (5 * scale + 1)) & TLBI_RANGE_NUM_MAX);
+		if (num) {
+			__tlbi_rvaae1is(va, num - 1, scale);
+			va += TLBI_RANGE_PAGES(num - 1, scale) << TT_L3_SHIFT;
+			pages -= TLBI_RANGE_PAGES(num - 1, scale);
+		}
+		scale++;
+	}
+
+	dsbish();
+	isb();
+}
+
 /******************************************************************************
  * General translation table management
  ******************************************************************************/
@@ -169,6 +262,9 @@ pmap_return_t pmap_tt_create_tte(tt_table_t *table, phys_addr_t pbase,
 		map_address += TT_L1_SIZE;
 	}
 
+	/* anything previously mapped here may still be cached */
+	pmap_tlb_flush_range(vbase, size);
+
 	pr_debug("mapped 0x%llx -> 0x%llx to phys 0x%llx\n", vbase, vend, pbase);
 	return PMAP_RETURN_SUCCESS;
 }
@@ -116,6 +116,9 @@ extern pmap_return_t	pmap_tt_create_tte(tt_table_t *, phys_addr_t,
 											vm_flags_t);
 extern pmap_return_t	pmap_map_page(pmap_t *, phys_addr_t);
 
+/* TLB maintenance */
+extern void				pmap_tlb_flush_range(vm_address_t, vm_size_t);
+
 /* pmap */
 extern int				pmap_create_kernel_pmap(pmap_t *kernel_pmap);
 
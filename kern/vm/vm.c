@@ -119,7 +119,7 @@ static void __vm_debug_dump_map(vm_map_t *map)
 	kprintf("         min: 0x%lx\n", map->min);
 	kprintf("         max: 0x%lx\n", map->max);
 	kprintf("alloc'd size: 0x%lx\n", map->size);
-	kprintf("       flags: lock: %d\n", map->lock);
+	kprintf("       flags: lock: %d\n", spin_is_locked(&map->lock));
 	kprintf("     entries: %d\n", map->nentries);
 
 	vm_map_entry_t *entry;
@@ -36,14 +36,11 @@
  * 			expected that this has already been done.
 *******************************************************************************/
 
-void vm_map_entry_create(vm_map_t *map, vm_address_t base, vm_size_t size,
-	vm_flags_t flags)
+static void __vm_map_entry_create(vm_map_t *map, vm_address_t base,
+	vm_size_t size, vm_flags_t flags)
 {
 	vm_map_entry_t *entry;
 
-	/* lock the map while we make critical changes */
-	vm_map_lock(map);
-
 	/* determine the base address of the next map entry */
 	if (list_empty(&map->entries)) {
 		entry = (vm_map_entry_t *) (map + sizeof(vm_map_t));
@@ -63,25 +60,33 @@ void vm_map_entry_create(vm_map_t *map, vm_address_t base, vm_size_t size,
 
 	/* add the entry to the map's list */
 	list_add_tail(&entry->siblings, &map->entries);
+}
 
+void vm_map_entry_create(vm_map_t *map, vm_address_t base, vm_size_t size,
+	vm_flags_t flags)
+{
+	/* lock the map while we make critical changes */
+	vm_map_lock(map);
+	__vm_map_entry_create(map, base, size, flags);
 	vm_map_unlock(map);
 }
 
 /*******************************************************************************
  * Locking for vm_map_t
  * 
- * TODO: These don't have any actual functionality yet. Need to research how
- * locking is used in the kernel to understand what we actually need to do here.
+ * The map lock protects the entries list and the allocated size, and is held
+ * across the whole of an allocation, as the next one is placed after the last
+ * entry.
 *******************************************************************************/
 
 void vm_map_lock(vm_map_t *map)
 {
-	map->lock = 1;
+	spin_lock(&map->lock);
 }
 
 void vm_map_unlock(vm_map_t *map)
 {
-	map->lock = 0;
+	spin_unlock(&map->lock);
 }
 
 /*******************************************************************************
@@ -99,8 +104,7 @@ static void __vm_map_init(vm_map_t *map, pmap_t *pmap, vm_address_t min,
 	map->max = max;
 	map->size = 0;
 
-	/* TODO: implement locking */
-	map->lock = 1;
+	spin_lock_init(&map->lock);
 
 	INIT_LIST_HEAD(&map->entries);
 
@@ -121,7 +125,6 @@ void vm_map_create(vm_map_t *map, pmap_t *pmap, vm_address_t min,
 						vm_address_t max)
 {
 	__vm_map_init(map, pmap, min, max);
-	vm_map_unlock(map);
 
 	/* TODO: check that `map` is on a page boundary */
 
@@ -149,7 +152,7 @@ vm_map_t *vm_map_create_new(pmap_t *pmap, vm_address_t min, vm_address_t max)
 	map.min = min;
 	map.max = max;
 	map.size = 0;
-	map.lock = 1;
+	spin_lock_init(&map.lock);
 	map.nentries = 0;
 
 	INIT_LIST_HEAD(&map.entries);
@@ -183,6 +186,8 @@ vm_address_t vm_map_alloc(vm_map_t *map, vm_size_t size, vm_flags_t flags)
 
 	pmap = (pmap_t *) &map->pmap;
 
+	vm_map_lock(map);
+
 	/* use the last entry to calculate the base virtual address for this one */
 	last_entry = list_last_entry(&map->entries, vm_map_entry_t, siblings);
 
@@ -194,7 +199,7 @@ vm_address_t vm_map_alloc(vm_map_t *map, vm_size_t size, vm_flags_t flags)
 	if (flags & VM_ALLOC_GUARD_FIRST) {
 		pmap_tt_create_tte((tt_table_t*)&pmap->tte, vm_page_alloc(), vcursor, VM_PAGE_SIZE,
 			PMAP_ACCESS_NOACCESS);
-		vm_map_entry_create(map, vcursor, VM_PAGE_SIZE, VM_MAP_ENTRY_GUARD_PAGE);
+		__vm_map_entry_create(map, vcursor, VM_PAGE_SIZE, VM_MAP_ENTRY_GUARD_PAGE);
 		vm_guard_page_fill((vm_address_t*)vcursor);
 		vbase = vcursor += VM_PAGE_SIZE;
 	}
@@ -210,7 +215,7 @@ vm_address_t vm_map_alloc(vm_map_t *map, vm_size_t size, vm_flags_t flags)
 	}
 
 	/* create the map entry for the allocated pages */
-	vm_map_entry_create(map, vbase, (vm_size_t) (page_count * VM_PAGE_SIZE),
+	__vm_map_entry_create(map, vbase, (vm_size_t) (page_count * VM_PAGE_SIZE),
 		VM_NULL);
 
 	/* check if we need a guard page after the allocation */
@@ -218,9 +223,10 @@ vm_address_t vm_map_alloc(vm_map_t *map, vm_size_t size, vm_flags_t flags)
 		pmap_tt_create_tte((tt_table_t*)&pmap->tte, vm_page_alloc(), vcursor, VM_PAGE_SIZE,
 			PMAP_ACCESS_NOACCESS);
 		vm_guard_page_fill((vm_address_t*) vcursor);
-		vm_map_entry_create(map, vcursor, VM_PAGE_SIZE, VM_MAP_ENTRY_GUARD_PAGE);
+		__vm_map_entry_create(map, vcursor, VM_PAGE_SIZE, VM_MAP_ENTRY_GUARD_PAGE);
 	}
 
+	vm_map_unlock(map);
 	return vbase;
 }
 
@@ -35,6 +35,7 @@
 #include <kern/vm/vm_types.h>
 #include <kern/vm/pmap.h>
 #include <kern/vm/vm.h>
+#include <kern/spinlock.h>
 
 /* Align an address to a 4-byte boundary */
 #define VM_ALIGN_ADDR(_addr)		((_addr + (4 - 1)) & -4)
@@ -68,9 +69,8 @@ typedef struct vm_map {
 	/* Current allocated size */
 	vm_size_t		size;
 
-	/* Flags */
-	unsigned int	lock:1,
-					__unused_bits:31;
+	/* Protects the entries and size */
+	spinlock_t		lock;
 
 	uint32_t		nentries;
 	list_t			entries;
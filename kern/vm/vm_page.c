@@ -26,6 +26,8 @@
 #include <kern/vm/vm_page.h>
 #include <kern/vm/pmap.h>
 #include <kern/trace/printk.h>
+#include <kern/trace/events.h>
+#include <kern/spinlock.h>
 
 #include <libkern/panic.h>
 
@@ -50,6 +52,9 @@ static uint64_t 	vm_page_idx;
 /* Page list */
 static list_t		page_list;
 
+/* Protects the state of every page */
+DEFINE_SPINLOCK(vm_page_lock);
+
 /* fetch the page at given index */
 #define __vm_page_get_idx(__idx)		((vm_page_t *) &vm_page_region[__idx])
 
@@ -104,6 +109,8 @@ phys_addr_t vm_page_alloc()
 {
 	vm_page_t *last;
 
+	spin_lock(&vm_page_lock);
+
 	/* find the next free page */
 	for (unsigned int i = 0; i < vm_page_idx; i++) {
 		last = __vm_page_get_idx(i);
@@ -117,7 +124,9 @@ phys_addr_t vm_page_alloc()
 
 	/* allocate the last page */
 	last->state = VM_PAGE_STATE_ALLOC;
+	spin_unlock(&vm_page_lock);
 
+	trace_vm_page_alloc(last->paddr);
 	return last->paddr;
 }
 
@@ -140,8 +149,11 @@ void vm_page_free(phys_addr_t paddr)
 	idx = (paddr - memory_phys_base) / VM_PAGE_SIZE;
 	page = __vm_page_get_idx(idx);
 
+	spin_lock(&vm_page_lock);
 	page->state = VM_PAGE_STATE_FREE;
+	spin_unlock(&vm_page_lock);
 
+	trace_vm_page_free(paddr);
 	pr_debug("free'd page '%d': 0x%lx\n", idx, page->paddr);
 }
 
@@ -0,0 +1,99 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * Name:	watchdog.c
+ * Desc:	Hard lockup detector. The scheduler tick is taken as a heartbeat,
+ * 			and is checked from the virtual timer pseudo-NMI. If a CPU stops
+ * 			taking ticks, i.e. it's spinning with interrupts disabled, the NMI
+ * 			still arrives and can report where it's stuck.
+*/
+
+#define pr_fmt(fmt)	"watchdog: " fmt
+
+#include <kern/watchdog.h>
+#include <kern/machine.h>
+#include <kern/machine/machine_timer.h>
+#include <kern/defaults.h>
+#include <kern/ksym.h>
+
+#include <libkern/panic.h>
+
+/* NMIs without a tick before a CPU is considered locked up */
+#define WATCHDOG_THRESH_NMIS												\
+	(DEFAULTS_KERNEL_WATCHDOG_THRESH * DEFAULTS_MACHINE_TIMER_NMI_HZ)
+
+/* Per-CPU tick count at the last NMI, and NMIs taken since it changed */
+static uint64_t watchdog_last_ticks[DEFAULTS_MACHINE_MAX_CPUS];
+static uint64_t watchdog_stalled[DEFAULTS_MACHINE_MAX_CPUS];
+
+/* the locked up pc, symbolised */
+static char watchdog_sym[KSYM_STRING_MAX];
+
+static void watchdog_nmi_handler(intid_t intid, arm64_exception_frame_t *frame,
+		void *data)
+{
+	cpu_number_t cpu = machine_get_cpu_num();
+	uint64_t ticks;
+
+	ticks = machine_timer_get_ticks(cpu);
+	if (ticks != watchdog_last_ticks[cpu]) {
+		watchdog_last_ticks[cpu] = ticks;
+		watchdog_stalled[cpu] = 0;
+		return;
+	}
+
+	if (++watchdog_stalled[cpu] < WATCHDOG_THRESH_NMIS)
+		return;
+
+	ksym_snprint(watchdog_sym, sizeof (watchdog_sym), frame->elr);
+	pr_err("hard lockup on cpu %d: no timer tick for %ds, pc: %s\n", cpu,
+		(int) DEFAULTS_KERNEL_WATCHDOG_THRESH, watchdog_sym);
+	panic_with_thread_state(frame, "watchdog: hard lockup");
+}
+
+/**
+ * watchdog_init
+ *
+ * Start the hard lockup detector. This needs pseudo-NMIs, as an ordinary
+ * interrupt would be masked along with the timer it's meant to be watching,
+ * and must be called once the scheduler tick is running.
+*/
+kern_return_t watchdog_init(void)
+{
+#if DEFAULTS_SET(DEFAULTS_KERNEL_WATCHDOG)
+	if (!machine_irq_nmi_enabled()) {
+		pr_info("pseudo-NMI disabled, hard lockup detection unavailable\n");
+		return KERN_RETURN_FAIL;
+	}
+
+	if (machine_timer_register_nmi(watchdog_nmi_handler, NULL,
+			DEFAULTS_MACHINE_TIMER_NMI_HZ) != KERN_RETURN_SUCCESS) {
+		pr_err("failed to register NMI handler\n");
+		return KERN_RETURN_FAIL;
+	}
+
+	pr_info("hard lockup detector enabled, threshold: %ds\n",
+		(int) DEFAULTS_KERNEL_WATCHDOG_THRESH);
+#endif
+	return KERN_RETURN_SUCCESS;
+}
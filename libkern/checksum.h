@@ -0,0 +1,42 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * 	Name:	checksum.h
+ * 	Desc:	CRC-32 (IEEE 802.3, as zlib) and Adler-32. Both take the running
+ * 			value so a buffer can be checksummed in pieces, starting from
+ * 			zero for crc32() and one for adler32().
+ */
+
+#ifndef __LIBKERN_CHECKSUM_H__
+#define __LIBKERN_CHECKSUM_H__
+
+#include <tinylibc/stdint.h>
+#include <tinylibc/stddef.h>
+
+extern uint32_t crc32(uint32_t crc, const void *buf, size_t len);
+extern uint32_t adler32(uint32_t adler, const void *buf, size_t len);
+
+/* crc32_hw.S, on an already inverted crc, where the CPU has the instructions */
+extern uint32_t __crc32_hw(uint32_t crc, const void *buf, size_t len);
+
+#endif /* __libkern_checksum_h__ */
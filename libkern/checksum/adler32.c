@@ -0,0 +1,66 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//                             The Monix Kernel
+//
+// 	This program is free software: you can redistribute it and/or modify
+// 	it under the terms of the GNU General Public License as published by
+// 	the Free Software Foundation, either version 3 of the License, or
+// 	(at your option) any later version.
+//
+// 	This program is distributed in the hope that it will be useful,
+// 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+// 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// 	GNU General Public License for more details.
+//
+// 	You should have received a copy of the GNU General Public License
+//	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ * 	Name:	adler32.c
+ * 	Desc:	Adler-32, as zlib. The modulo is only taken every ADLER32_NMAX
+ * 			bytes, the most that can be summed before the second sum could
+ * 			overflow 32 bits.
+ */
+
+#include <libkern/checksum.h>
+
+#define ADLER32_BASE	65521
+#define ADLER32_NMAX	5552
+
+uint32_t adler32(uint32_t adler, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint32_t a = adler & 0xffff;
+	uint32_t b = adler >> 16;
+	size_t n;
+
+	while (len) {
+		n = (len < ADLER32_NMAX) ? len : ADLER32_NMAX;
+		len -= n;
+
+		for (; n >= 8; n -= 8) {
+			a += p[0]; b += a;
+			a += p[1]; b += a;
+			a += p[2]; b += a;
+			a += p[3]; b += a;
+			a += p[4]; b += a;
+			a += p[5]; b += a;
+			a += p[6]; b += a;
+			a += p[7]; b += a;
+			p += 8;
+		}
+		while (n--) {
+			a += *p++;
+			b += a;
+		}
+
+		a %= ADLER32_BASE;
+		b %= ADLER32_BASE;
+	}
+	return (b << 16) | a;
+}
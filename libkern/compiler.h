@@ -64,5 +64,10 @@
 #define BIT_32(nr)		((int) 1 << (nr))
 #define BIT_64(nr)		((long) 1 << (nr))
 
+/* Compiler barrier, stops memory accesses being reordered across it */
+#if !defined(__ASSEMBLER__)
+# define barrier()		__asm__ __volatile__("" : : : "memory")
+#endif
+
 
 #endif /* __libkern_compiler_h__ */
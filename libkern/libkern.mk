@@ -22,7 +22,10 @@
 
 # Tinylibc sources
 KERNEL_SOURCES	+=	libkern/tinylibc/string/memchr.o	\
+					libkern/tinylibc/string/memchr_neon.o	\
 					libkern/tinylibc/string/memcmp.o	\
+					libkern/tinylibc/string/memcmp_generic.o	\
+					libkern/tinylibc/string/memcmp_neon.o	\
 					libkern/tinylibc/string/memcpy.o	\
 					libkern/tinylibc/string/memmove.o	\
 					libkern/tinylibc/string/memset.o	\
@@ -30,10 +33,17 @@ KERNEL_SOURCES	+=	libkern/tinylibc/string/memchr.o	\
 					libkern/tinylibc/string/strcmp.o	\
 					libkern/tinylibc/string/strlcpy.o	\
 					libkern/tinylibc/string/strlen.o	\
+					libkern/tinylibc/string/strlen_neon.o	\
 					libkern/tinylibc/string/strncmp.o	\
 					libkern/tinylibc/string/strnlen.o	\
 					libkern/tinylibc/string/strrchr.o	\
-					libkern/tinylibc/string/strtoul.o
+					libkern/tinylibc/string/strtoul.o	\
+					libkern/tinylibc/stdio/vsnprintf.o
+
+# Checksums
+KERNEL_SOURCES	+=	libkern/checksum/adler32.o	\
+					libkern/checksum/crc32.o	\
+					libkern/checksum/crc32_hw.o
 
 # Libfdt sources
 KERNEL_SOURCES	+=	libkern/libfdt/fdt.o					\
@@ -17,4 +17,17 @@
 //
 //	Copyright (C) 2024, Harry Moulton <me@h3adsh0tzz.com>
 //
-//===----------------------------------------------------------------------===//
\ No newline at end of file
+//===----------------------------------------------------------------------===//
+
+#ifndef __STDIO_H__
+#define __STDIO_H__
+
+#include <tinylibc/_types.h>
+#include <tinylibc/stddef.h>
+
+/* formatted output */
+extern int      vsnprintf   (char *buf, size_t size, const char *fmt, va_list ap);
+extern int      snprintf    (char *buf, size_t size, const char *fmt, ...)
+                    __attribute__((format(printf, 3, 4)));
+
+#endif /* __stdio_h__ */
@@ -0,0 +1,388 @@
+//===----------------------------------------------------------------------===//
+//
+//                                  tinyOS
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+//	Copyright (C) 2024, Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <tinylibc/stdio.h>
+#include <tinylibc/stdint.h>
+#include <tinylibc/string.h>
+
+/**
+ * Format flags
+ */
+#define FMT_LEFT        (1 << 0)    /* '-', pad on the right */
+#define FMT_ZERO        (1 << 1)    /* '0', pad numbers with zeros */
+#define FMT_PLUS        (1 << 2)    /* '+', always print the sign */
+#define FMT_SPACE       (1 << 3)    /* ' ', space in place of a '+' */
+#define FMT_ALT         (1 << 4)    /* '#', 0x/0 prefix */
+#define FMT_UPPER       (1 << 5)    /* upper case hex digits */
+#define FMT_SIGNED      (1 << 6)    /* signed conversion */
+
+/* longest number: 64-bit octal, 22 digits */
+#define FMT_NUM_MAX     24
+
+static const char fmt_digits_lower[] = "0123456789abcdef";
+static const char fmt_digits_upper[] = "0123456789ABCDEF";
+
+/* "00" through "99", to convert decimal numbers two digits at a time */
+static const char fmt_digit_pairs[] =
+	"00010203040506070809" "10111213141516171819"
+	"20212223242526272829" "30313233343536373839"
+	"40414243444546474849" "50515253545556575859"
+	"60616263646566676869" "70717273747576777879"
+	"80818283848586878889" "90919293949596979899";
+
+/**
+ * Output state. Characters beyond the end of the buffer are counted but not
+ * stored, so the caller can find out how much room was needed.
+ */
+struct fmt_out {
+	char        *buf;
+	size_t      size;
+	size_t      len;
+};
+
+static inline void
+fmt_putc (struct fmt_out *out, char c)
+{
+	if (out->len + 1 < out->size)
+		out->buf[out->len] = c;
+	out->len++;
+}
+
+static void
+fmt_pad (struct fmt_out *out, char c, int count)
+{
+	while (count-- > 0)
+		fmt_putc (out, c);
+}
+
+static void
+fmt_write (struct fmt_out *out, const char *s, size_t len)
+{
+	size_t room;
+
+	/* copy whatever fits in one go, and count the rest */
+	if (out->len + 1 < out->size) {
+		room = out->size - 1 - out->len;
+		memcpy (&out->buf[out->len], s, len < room ? len : room);
+	}
+	out->len += len;
+}
+
+/**
+ * Divide by 100 with a multiply by the reciprocal, as the hardware divider is
+ * slow. The result is exact for every 64-bit value.
+ */
+static inline uint64_t
+fmt_div100 (uint64_t n)
+{
+	return (uint64_t) (((unsigned __int128) (n >> 2) * 0x28f5c28f5c28f5c3ULL) >> 66);
+}
+
+/**
+ * Convert a number into the end of `buf`, returning the first digit. Decimal
+ * numbers are converted two digits per step, powers of two by shifting.
+ */
+static char *
+fmt_number (char *end, uint64_t n, int base, int flags)
+{
+	const char *digits = (flags & FMT_UPPER) ? fmt_digits_upper : fmt_digits_lower;
+	char *p = end;
+	uint64_t q;
+	int shift;
+
+	if (base == 10) {
+		while (n >= 100) {
+			q = fmt_div100 (n);
+			p -= 2;
+			memcpy (p, &fmt_digit_pairs[(n - q * 100) * 2], 2);
+			n = q;
+		}
+		if (n >= 10) {
+			p -= 2;
+			memcpy (p, &fmt_digit_pairs[n * 2], 2);
+		} else {
+			*--p = '0' + n;
+		}
+		return p;
+	}
+
+	shift = (base == 16) ? 4 : 3;
+	do {
+		*--p = digits[n & (base - 1)];
+		n >>= shift;
+	} while (n != 0);
+	return p;
+}
+
+/**
+ * Output a number with its sign, prefix, precision and padding.
+ */
+static void
+fmt_integer (struct fmt_out *out, uint64_t n, int base, int flags, int width,
+			 int precision)
+{
+	char num[FMT_NUM_MAX], prefix[2];
+	int len, plen = 0, zeros = 0;
+	char *p;
+
+	if ((flags & FMT_SIGNED) && (int64_t) n < 0) {
+		prefix[plen++] = '-';
+		n = -n;
+	} else if (flags & FMT_PLUS) {
+		prefix[plen++] = '+';
+	} else if (flags & FMT_SPACE) {
+		prefix[plen++] = ' ';
+	}
+
+	/* a precision of zero prints nothing for zero */
+	if (n == 0 && precision == 0) {
+		p = &num[FMT_NUM_MAX];
+		len = 0;
+	} else {
+		p = fmt_number (&num[FMT_NUM_MAX], n, base, flags);
+		len = &num[FMT_NUM_MAX] - p;
+	}
+
+	if ((flags & FMT_ALT) && n != 0) {
+		if (base == 16) {
+			prefix[plen++] = '0';
+			prefix[plen++] = (flags & FMT_UPPER) ? 'X' : 'x';
+		} else if (base == 8 && precision <= len) {
+			precision = len + 1;
+		}
+	}
+
+	if (precision > len)
+		zeros = precision - len;
+	else if (precision < 0 && (flags & (FMT_ZERO | FMT_LEFT)) == FMT_ZERO)
+		zeros = width - plen - len;
+
+	width -= plen + (zeros > 0 ? zeros : 0) + len;
+
+	if (!(flags & FMT_LEFT))
+		fmt_pad (out, ' ', width);
+	fmt_write (out, prefix, plen);
+	fmt_pad (out, '0', zeros);
+	fmt_write (out, p, len);
+	if (flags & FMT_LEFT)
+		fmt_pad (out, ' ', width);
+}
+
+/**
+ * Format a string into `buf`, writing at most `size` bytes including the
+ * terminating NUL. Returns the length the formatted string would have had if
+ * `buf` were large enough, so a return value of `size` or more means the
+ * output was truncated.
+ *
+ * Supports the flags "-+ #0", width and precision (including '*'), the length
+ * modifiers hh, h, l, ll, z, t and j, and the conversions d, i, u, x, X, o, p,
+ * c, s and %.
+ */
+int
+vsnprintf (char *buf, size_t size, const char *fmt, va_list ap)
+{
+	struct fmt_out out = { .buf = buf, .size = size, .len = 0 };
+	int flags, width, precision, length, base;
+	const char *start, *s;
+	uint64_t n;
+	size_t len;
+	char c;
+
+	for (;;) {
+		/* copy runs of plain characters in one go */
+		start = fmt;
+		while (*fmt != '\0' && *fmt != '%')
+			fmt++;
+		if (fmt != start)
+			fmt_write (&out, start, fmt - start);
+		if (*fmt == '\0')
+			break;
+		fmt++;
+
+		/* flags */
+		flags = 0;
+		for (;; fmt++) {
+			if (*fmt == '-')
+				flags |= FMT_LEFT;
+			else if (*fmt == '0')
+				flags |= FMT_ZERO;
+			else if (*fmt == '+')
+				flags |= FMT_PLUS;
+			else if (*fmt == ' ')
+				flags |= FMT_SPACE;
+			else if (*fmt == '#')
+				flags |= FMT_ALT;
+			else
+				break;
+		}
+
+		/* width */
+		width = 0;
+		if (*fmt == '*') {
+			width = va_arg (ap, int);
+			if (width < 0) {
+				flags |= FMT_LEFT;
+				width = -width;
+			}
+			fmt++;
+		} else {
+			while (*fmt >= '0' && *fmt <= '9')
+				width = width * 10 + (*fmt++ - '0');
+		}
+
+		/* precision */
+		precision = -1;
+		if (*fmt == '.') {
+			fmt++;
+			precision = 0;
+			if (*fmt == '*') {
+				precision = va_arg (ap, int);
+				fmt++;
+			} else {
+				while (*fmt >= '0' && *fmt <= '9')
+					precision = precision * 10 + (*fmt++ - '0');
+			}
+		}
+
+		/* length, in bytes of the argument */
+		length = sizeof (int);
+		switch (*fmt) {
+			case 'h':
+				length = sizeof (short);
+				if (*++fmt == 'h') {
+					length = sizeof (char);
+					fmt++;
+				}
+				break;
+			case 'l':
+				length = sizeof (long);
+				if (*++fmt == 'l') {
+					length = sizeof (long long);
+					fmt++;
+				}
+				break;
+			case 'z':
+			case 't':
+			case 'j':
+				length = sizeof (uint64_t);
+				fmt++;
+				break;
+		}
+
+		c = *fmt++;
+		base = 10;
+		switch (c) {
+			case 'd':
+			case 'i':
+				flags |= FMT_SIGNED;
+				if (length == sizeof (uint64_t))
+					n = va_arg (ap, int64_t);
+				else if (length == sizeof (short))
+					n = (short) va_arg (ap, int);
+				else if (length == sizeof (char))
+					n = (signed char) va_arg (ap, int);
+				else
+					n = va_arg (ap, int);
+				fmt_integer (&out, n, base, flags, width, precision);
+				break;
+
+			case 'X':
+				flags |= FMT_UPPER;
+				/* fallthrough */
+			case 'x':
+				base = 16;
+				goto unsigned_number;
+			case 'o':
+				base = 8;
+				/* fallthrough */
+			case 'u':
+unsigned_number:
+				flags &= ~(FMT_PLUS | FMT_SPACE);
+				if (length == sizeof (uint64_t))
+					n = va_arg (ap, uint64_t);
+				else if (length == sizeof (short))
+					n = (unsigned short) va_arg (ap, unsigned int);
+				else if (length == sizeof (char))
+					n = (unsigned char) va_arg (ap, unsigned int);
+				else
+					n = va_arg (ap, unsigned int);
+				fmt_integer (&out, n, base, flags, width, precision);
+				break;
+
+			case 'p':
+				n = (uintptr_t) va_arg (ap, void *);
+				fmt_integer (&out, n, 16, flags | FMT_ALT, width, precision);
+				break;
+
+			case 'c':
+				if (!(flags & FMT_LEFT))
+					fmt_pad (&out, ' ', width - 1);
+				fmt_putc (&out, (char) va_arg (ap, int));
+				if (flags & FMT_LEFT)
+					fmt_pad (&out, ' ', width - 1);
+				break;
+
+			case 's':
+				s = va_arg (ap, const char *);
+				if (s == NULL)
+					s = "(null)";
+				len = (precision >= 0) ? strnlen (s, precision) : strlen (s);
+				if (!(flags & FMT_LEFT))
+					fmt_pad (&out, ' ', width - (int) len);
+				fmt_write (&out, s, len);
+				if (flags & FMT_LEFT)
+					fmt_pad (&out, ' ', width - (int) len);
+				break;
+
+			case '%':
+				fmt_putc (&out, '%');
+				break;
+
+			case '\0':
+				/* a trailing '%', stop at the end of the string */
+				fmt--;
+				break;
+
+			default:
+				/* unknown conversion, print it as it was written */
+				fmt_putc (&out, '%');
+				fmt_putc (&out, c);
+				break;
+		}
+	}
+
+	if (size > 0)
+		buf[out.len < size ? out.len : size - 1] = '\0';
+	return out.len;
+}
+
+int
+snprintf (char *buf, size_t size, const char *fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	va_start (ap, fmt);
+	len = vsnprintf (buf, size, fmt, ap);
+	va_end (ap);
+
+	return len;
+}
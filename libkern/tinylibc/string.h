@@ -43,5 +43,14 @@ extern void *   memchr      (const void *s, int c, size_t n);
 extern void *   memmove     (void *dest, const void *src, size_t count);
 extern int      memcmp      (const void *cs, const void *ct, size_t count);
 
+/* let memset zero with DC ZVA, once memory is cacheable, see memset.S */
+extern size_t   memset_zva_init (void);
+
+/* scalar and Advanced SIMD variants, the latter inside kernel_neon_begin() */
+extern int      __memcmp_generic (const void *cs, const void *ct, size_t count);
+extern int      __memcmp_neon   (const void *cs, const void *ct, size_t count);
+extern void *   __memchr_neon   (const void *s, int c, size_t n);
+extern size_t   __strlen_neon   (const char *str);
+
 
 #endif /* __string_h__ */
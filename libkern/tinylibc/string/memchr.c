@@ -22,10 +22,25 @@
 #include <tinylibc/string.h>
 #include <tinylibc/stdint.h>
 
+#include <kern/defaults.h>
+#include <kern/machine/machine_fpsimd.h>
+
 void *
 memchr (const void *s, int c, size_t n)
 {
     const unsigned char *p = s;
+
+#if DEFAULTS_SET(DEFAULTS_MACHINE_KERNEL_NEON)
+    if (n >= DEFAULTS_MACHINE_KERNEL_NEON_MIN && kernel_neon_usable ()) {
+        void *ret;
+
+        kernel_neon_begin ();
+        ret = __memchr_neon (s, c, n);
+        kernel_neon_end ();
+        return ret;
+    }
+#endif
+
     while (n-- != 0) {
         if ((unsigned char) c == *p++)
             return (void *) (p - 1);
@@ -22,14 +22,22 @@
 #include <tinylibc/string.h>
 #include <tinylibc/stdint.h>
 
+#include <kern/defaults.h>
+#include <kern/machine/machine_fpsimd.h>
+
 int
 memcmp (const void *cs, const void *ct, size_t count)
 {
-    const unsigned char *su1, *su2;
-    int res = 0;
+#if DEFAULTS_SET(DEFAULTS_MACHINE_KERNEL_NEON)
+    if (count >= DEFAULTS_MACHINE_KERNEL_NEON_MIN && kernel_neon_usable ()) {
+        int ret;
+
+        kernel_neon_begin ();
+        ret = __memcmp_neon (cs, ct, count);
+        kernel_neon_end ();
+        return ret;
+    }
+#endif
 
-    for (su1 = cs, su2 = ct; 0 < count; ++su1, ++su2, count--)
-        if ((res = *su1 - *su2) != 0)
-            break;
-    return res;
+    return __memcmp_generic (cs, ct, count);
 }
\ No newline at end of file
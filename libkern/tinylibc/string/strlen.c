@@ -22,10 +22,31 @@
 #include <tinylibc/string.h>
 #include <tinylibc/stdint.h>
 
+#include <kern/defaults.h>
+#include <kern/machine/machine_fpsimd.h>
+
+/**
+ * The length isn't known up front, so the first DEFAULTS_MACHINE_KERNEL_NEON_MIN
+ * bytes are always scanned here, and only a string longer than that pays for a
+ * NEON section.
+ */
 size_t
 strlen (const char *str)
 {
     register const char *s;
-    for (s = str; *s; ++s);
+
+    for (s = str; *s; ++s) {
+#if DEFAULTS_SET(DEFAULTS_MACHINE_KERNEL_NEON)
+        if ((size_t) (s - str) == DEFAULTS_MACHINE_KERNEL_NEON_MIN &&
+                kernel_neon_usable ()) {
+            size_t len;
+
+            kernel_neon_begin ();
+            len = __strlen_neon (s);
+            kernel_neon_end ();
+            return (s - str) + len;
+        }
+#endif
+    }
     return (s - str);
 }
\ No newline at end of file
@@ -22,7 +22,11 @@
 
 /**
  * 	Name:	devicetree.c
- * 	Desc:	Platform wrapper for the libfdt library.
+ * 	Desc:	Platform wrapper for the libfdt library. The flattened tree is
+ * 			only walked once, by DeviceTreeInit, which unflattens it into a
+ * 			tree of nodes with their properties, reg and ranges decoded, and
+ * 			indexes them by path, phandle and offset. Every other call is
+ * 			answered from that.
  */
 
 #define pr_fmt(fmt)	"devicetree: " fmt
@@ -34,9 +38,79 @@
 #include <kern/defaults.h>
 #include <kern/trace/printk.h>
 
-#include <tinylibc/byteswap.h>
 #include <tinylibc/string.h>
 
+/* Defaults for a node without #address-cells and #size-cells */
+#define DT_DEFAULT_ADDRESS_CELLS	2
+#define DT_DEFAULT_SIZE_CELLS		1
+
+/* Deepest node the unflattener handles */
+#define DT_MAX_DEPTH				16
+
+/* Buckets in each index, a power of two */
+#define DT_HASH_SIZE				DEFAULTS_PLAT_DEVICETREE_HASH_SIZE
+
+/**
+ * A property. The name and value point into the blob, which is never modified.
+*/
+struct dt_prop
+{
+	const char		*name;
+	const void		*value;
+	DTInteger		len;
+	struct dt_prop	*next;
+};
+
+/* A decoded `reg` entry, or `ranges` entry, as 64-bit values */
+struct dt_reg
+{
+	uint64_t		addr;
+	uint64_t		size;
+};
+
+struct dt_range
+{
+	uint64_t		child;
+	uint64_t		parent;
+	uint64_t		size;
+};
+
+/**
+ * An unflattened node. `addr_cells` and `size_cells` are this node's own,
+ * which apply to its children's `reg`, while its own `reg` was decoded with
+ * its parent's.
+*/
+struct dt_node
+{
+	const char		*name;
+	const char		*path;
+	DTNodeOffset	offset;
+	uint32_t		phandle;
+
+	struct dt_node	*parent;
+	struct dt_node	*child;
+	struct dt_node	*sibling;
+	struct dt_prop	*props;
+	DTInteger		nChildren;
+	DTInteger		nProperties;
+
+	uint32_t		addr_cells;
+	uint32_t		size_cells;
+
+	struct dt_reg	*reg;
+	DTInteger		nReg;
+
+	/* no `ranges` means the bus can't be translated, an empty one is 1:1 */
+	struct dt_range	*ranges;
+	DTInteger		nRanges;
+	DTInteger		hasRanges;
+
+	/* index hash chains */
+	struct dt_node	*path_next;
+	struct dt_node	*phandle_next;
+	struct dt_node	*offset_next;
+};
+
 /**
  * The boot device tree structure is kept private to this code, any components
  * of the kernel which need it have to use the getters.
@@ -52,6 +126,15 @@ struct boot_device_tree
 	const char	*compatible;
 
 	DTInteger	initialised;
+
+	/* the unflattened tree, and its indexes */
+	struct dt_node	*nodes;
+	DTInteger		nNodes;
+	DTInteger		nProperties;
+
+	struct dt_node	*by_path[DT_HASH_SIZE];
+	struct dt_node	*by_phandle[DT_HASH_SIZE];
+	struct dt_node	*by_offset[DT_HASH_SIZE];
 };
 
 /* Root device tree status */
@@ -61,43 +144,373 @@ struct boot_device_tree
 /* Private boot device tree structure */
 static struct boot_device_tree		BootDeviceTree;
 
+/**
+ * The tree is unflattened before there's any allocator, so it's built in a
+ * fixed arena. Nothing is ever freed.
+*/
+static uint8_t dt_arena[DEFAULTS_PLAT_DEVICETREE_ARENA] __attribute__((aligned(8)));
+static size_t dt_arena_used;
+
+static void *
+dt_alloc (size_t size)
+{
+	void *ptr;
+
+	size = (size + 7) & ~7UL;
+	if (dt_arena_used + size > sizeof (dt_arena))
+		return NULL;
+
+	ptr = &dt_arena[dt_arena_used];
+	dt_arena_used += size;
+	memset (ptr, 0, size);
+	return ptr;
+}
+
+/* FNV-1a */
+static uint32_t
+dt_hash_string (const char *str)
+{
+	uint32_t hash = 2166136261U;
+
+	while (*str) {
+		hash ^= (uint8_t) *str++;
+		hash *= 16777619U;
+	}
+	return hash & (DT_HASH_SIZE - 1);
+}
+
+static uint32_t
+dt_hash_int (uint32_t val)
+{
+	return (val * 2654435761U) >> (32 - __builtin_ctz (DT_HASH_SIZE));
+}
+
+/* read `cells` big-endian cells as one value, keeping the low 64 bits */
+static uint64_t
+dt_read_cells (const fdt32_t *cell, uint32_t cells)
+{
+	uint64_t val = 0;
+
+	while (cells--)
+		val = (val << 32) | fdt32_to_cpu (*cell++);
+	return val;
+}
+
+static const struct dt_prop *
+dt_find_prop (const struct dt_node *node, const char *name)
+{
+	const struct dt_prop *prop;
+
+	for (prop = node->props; prop != NULL; prop = prop->next)
+		if (!strcmp (prop->name, name))
+			return prop;
+	return NULL;
+}
+
+static const struct dt_node *
+dt_find_path (const char *path)
+{
+	const struct dt_node *node;
+
+	node = BootDeviceTree.by_path[dt_hash_string (path)];
+	for (; node != NULL; node = node->path_next)
+		if (!strcmp (node->path, path))
+			return node;
+	return NULL;
+}
 
 /**
- * 
+ * dt_walk_path
+ *
+ * Resolve a path one component at a time. As with libfdt, a component without
+ * a unit address matches the first node of that name, e.g. "/memory" matches
+ * "/memory@40000000". Only used when the path index misses.
+*/
+static const struct dt_node *
+dt_walk_path (const char *path)
+{
+	const struct dt_node *node = BootDeviceTree.nodes;
+	const char *end;
+	size_t len;
+
+	while (node != NULL && *path) {
+		while (*path == '/')
+			path++;
+		if (*path == '\0')
+			break;
+
+		end = strchr (path, '/');
+		len = end ? (size_t) (end - path) : strlen (path);
+
+		for (node = node->child; node != NULL; node = node->sibling) {
+			if (strncmp (node->name, path, len))
+				continue;
+			if (node->name[len] == '\0')
+				break;
+			if (node->name[len] == '@' && memchr (path, '@', len) == NULL)
+				break;
+		}
+		path += len;
+	}
+	return node;
+}
+
+static const struct dt_node *
+dt_find_phandle (uint32_t phandle)
+{
+	const struct dt_node *node;
+
+	node = BootDeviceTree.by_phandle[dt_hash_int (phandle)];
+	for (; node != NULL; node = node->phandle_next)
+		if (node->phandle == phandle)
+			return node;
+	return NULL;
+}
+
+static const struct dt_node *
+dt_find_offset (DTNodeOffset offset)
+{
+	const struct dt_node *node;
+
+	node = BootDeviceTree.by_offset[dt_hash_int ((uint32_t) offset)];
+	for (; node != NULL; node = node->offset_next)
+		if (node->offset == offset)
+			return node;
+	return NULL;
+}
+
+/**
+ * dt_decode_reg
+ *
+ * Decode a node's `reg` with its parent's cell sizes, and its `ranges` with
+ * its own child address and size, and its parent's address, cell sizes.
 */
 static DTInteger
-node_offset_count_children (DTNodeOffset node_offset)
+dt_decode_reg (struct dt_node *node)
+{
+	const struct dt_prop *prop;
+	const fdt32_t *cell;
+	uint32_t pa, ps, ca, cs, stride;
+	DTInteger i;
+
+	pa = node->parent ? node->parent->addr_cells : DT_DEFAULT_ADDRESS_CELLS;
+	ps = node->parent ? node->parent->size_cells : DT_DEFAULT_SIZE_CELLS;
+	ca = node->addr_cells;
+	cs = node->size_cells;
+
+	prop = dt_find_prop (node, "reg");
+	stride = (pa + ps) * sizeof (fdt32_t);
+	if (prop != NULL && stride > 0) {
+		node->nReg = prop->len / stride;
+		node->reg = dt_alloc (node->nReg * sizeof (struct dt_reg));
+		if (node->nReg && node->reg == NULL)
+			return kDeviceTreeFailure;
+
+		cell = (const fdt32_t *) prop->value;
+		for (i = 0; i < node->nReg; i++) {
+			node->reg[i].addr = dt_read_cells (cell, pa);
+			node->reg[i].size = dt_read_cells (cell + pa, ps);
+			cell += pa + ps;
+		}
+	}
+
+	prop = dt_find_prop (node, "ranges");
+	stride = (ca + pa + cs) * sizeof (fdt32_t);
+	if (prop != NULL) {
+		node->hasRanges = 1;
+		node->nRanges = stride ? prop->len / stride : 0;
+		node->ranges = dt_alloc (node->nRanges * sizeof (struct dt_range));
+		if (node->nRanges && node->ranges == NULL)
+			return kDeviceTreeFailure;
+
+		cell = (const fdt32_t *) prop->value;
+		for (i = 0; i < node->nRanges; i++) {
+			node->ranges[i].child = dt_read_cells (cell, ca);
+			node->ranges[i].parent = dt_read_cells (cell + ca, pa);
+			node->ranges[i].size = dt_read_cells (cell + ca + pa, cs);
+			cell += ca + pa + cs;
+		}
+	}
+
+	return kDeviceTreeSuccess;
+}
+
+/**
+ * dt_unflatten_node
+ *
+ * Create the node at `offset` under `parent`, with its properties, and add it
+ * to the indexes.
+*/
+static struct dt_node *
+dt_unflatten_node (DTNodeOffset offset, struct dt_node *parent,
+				   struct dt_node **last_child)
 {
-	DTNodeOffset cur;
-	DTInteger count;
+	const void *fdt = (const void *) BootDeviceTree.base;
+	struct dt_prop *prop, **tail;
+	struct dt_node *node;
+	const fdt32_t *val;
+	const char *name;
+	char *path;
+	size_t plen, nlen;
+	int poffset, len;
+	uint32_t hash;
+
+	node = dt_alloc (sizeof (struct dt_node));
+	if (node == NULL)
+		return NULL;
+
+	name = fdt_get_name (fdt, offset, &len);
+	node->name = (name && len >= 0) ? name : "";
+	node->offset = offset;
+	node->parent = parent;
+	node->addr_cells = DT_DEFAULT_ADDRESS_CELLS;
+	node->size_cells = DT_DEFAULT_SIZE_CELLS;
+
+	/* the root's name is empty, and its path is "/" */
+	if (parent == NULL) {
+		node->path = "/";
+	} else {
+		plen = (parent->parent == NULL) ? 0 : strlen (parent->path);
+		nlen = strlen (node->name);
+		path = dt_alloc (plen + nlen + 2);
+		if (path == NULL)
+			return NULL;
+		memcpy (path, parent->path, plen);
+		path[plen] = '/';
+		memcpy (path + plen + 1, node->name, nlen + 1);
+		node->path = path;
+	}
+
+	tail = &node->props;
+	fdt_for_each_property_offset (poffset, fdt, offset) {
+		prop = dt_alloc (sizeof (struct dt_prop));
+		if (prop == NULL)
+			return NULL;
+
+		prop->value = fdt_getprop_by_offset (fdt, poffset, &prop->name, &len);
+		prop->len = (DTInteger) len;
+		*tail = prop;
+		tail = &prop->next;
+		node->nProperties += 1;
+
+		val = (const fdt32_t *) prop->value;
+		if (len == sizeof (fdt32_t)) {
+			if (!strcmp (prop->name, "#address-cells"))
+				node->addr_cells = fdt32_to_cpu (*val);
+			else if (!strcmp (prop->name, "#size-cells"))
+				node->size_cells = fdt32_to_cpu (*val);
+			else if (!strcmp (prop->name, "phandle") ||
+					 !strcmp (prop->name, "linux,phandle"))
+				node->phandle = fdt32_to_cpu (*val);
+		}
+	}
+
+	if (dt_decode_reg (node) != kDeviceTreeSuccess)
+		return NULL;
+
+	/* children are kept in the order they appear in the blob */
+	if (parent != NULL) {
+		if (*last_child == NULL)
+			parent->child = node;
+		else
+			(*last_child)->sibling = node;
+		*last_child = node;
+		parent->nChildren += 1;
+	}
 
-	count = 0;
+	hash = dt_hash_string (node->path);
+	node->path_next = BootDeviceTree.by_path[hash];
+	BootDeviceTree.by_path[hash] = node;
 
-	cur = fdt_first_subnode ((const void *) BootDeviceTree.base, node_offset);
-	while (cur >= 0) {
-		count += 1;
-		cur = fdt_next_subnode ((const void *) BootDeviceTree.base, cur);
+	if (node->phandle) {
+		hash = dt_hash_int (node->phandle);
+		node->phandle_next = BootDeviceTree.by_phandle[hash];
+		BootDeviceTree.by_phandle[hash] = node;
 	}
-	return count;
+
+	hash = dt_hash_int ((uint32_t) node->offset);
+	node->offset_next = BootDeviceTree.by_offset[hash];
+	BootDeviceTree.by_offset[hash] = node;
+
+	BootDeviceTree.nNodes += 1;
+	BootDeviceTree.nProperties += node->nProperties;
+	return node;
 }
 
 /**
- * 
+ * dt_unflatten
+ *
+ * Walk the whole blob once, in order, keeping the chain of parents and the
+ * last child added to each, by depth.
 */
 static DTInteger
-node_offset_count_properties (DTNodeOffset node_offset)
+dt_unflatten (void)
 {
-	DTNodeOffset cur;
-	DTInteger count;
-
-	count = 0;
+	const void *fdt = (const void *) BootDeviceTree.base;
+	struct dt_node *parents[DT_MAX_DEPTH + 1];
+	struct dt_node *last[DT_MAX_DEPTH + 1];
+	struct dt_node *node;
+	DTNodeOffset offset;
+	int depth = 0;
+
+	memset (last, 0, sizeof (last));
+
+	offset = 0;
+	while (offset >= 0 && depth >= 0) {
+		if (depth > DT_MAX_DEPTH) {
+			pr_err("dt_unflatten: ERROR: tree deeper than %d\n", DT_MAX_DEPTH);
+			return kDeviceTreeFailure;
+		}
+
+		node = dt_unflatten_node (offset, depth ? parents[depth - 1] : NULL,
+			depth ? &last[depth - 1] : NULL);
+		if (node == NULL) {
+			pr_err("dt_unflatten: ERROR: out of space, %d bytes used\n",
+				(int) dt_arena_used);
+			return kDeviceTreeFailure;
+		}
+		if (depth == 0)
+			BootDeviceTree.nodes = node;
+
+		parents[depth] = node;
+		last[depth] = NULL;
+
+		offset = fdt_next_node (fdt, offset, &depth);
+	}
 
-	cur = fdt_first_property_offset ((const void *) BootDeviceTree.base, node_offset);
-	while (cur >= 0) {
-		count += 1;
-		cur = fdt_next_property_offset ((const void *) BootDeviceTree.base, cur);
+	if (offset < 0 && offset != -FDT_ERR_NOTFOUND) {
+		pr_err("dt_unflatten: ERROR: bad device tree: %d\n", offset);
+		return kDeviceTreeFailure;
 	}
-	return count;
+	return kDeviceTreeSuccess;
+}
+
+static void
+dt_fill_node (const struct dt_node *node, DTNode *out)
+{
+	strlcpy (out->name, node->name, kPropNameLength);
+	out->offset = node->offset;
+	out->nChildren = node->nChildren;
+	out->nProperties = node->nProperties;
+	out->node = node;
+}
+
+static const struct dt_node *
+dt_resolve (const char *path)
+{
+	const struct dt_node *node;
+	int res;
+
+	node = dt_find_path (path);
+	if (node != NULL)
+		return node;
+
+	if (path[0] == '/')
+		return dt_walk_path (path);
+
+	/* anything that isn't a full path, i.e. an alias, is left to libfdt */
+	res = fdt_path_offset ((const void *) BootDeviceTree.base, path);
+	return (res < 0) ? NULL : dt_find_offset ((DTNodeOffset) res);
 }
 
 const DTNode *
@@ -109,8 +522,7 @@ BootDeviceTreeGetRootNode ()
 DTInteger
 DeviceTreeInit (void *base, size_t size)
 {
-	int res, len;
-	const char *name;
+	int res;
 
 	BootDeviceTree.initialised = ROOT_DEVICE_TREE_DEAD;
 
@@ -123,6 +535,10 @@ DeviceTreeInit (void *base, size_t size)
 		return kDeviceTreeFailure;
 	}
 
+	res = dt_unflatten ();
+	if (res == kDeviceTreeFailure)
+		return kDeviceTreeFailure;
+
 	res = DeviceTreeLookupNode ("/", &BootDeviceTree.root);
 	if (res == kDeviceTreeFailure) {
 		pr_err("DeviceTreeInit: ERROR: failed to find root node: 0x%llx\n", res);
@@ -136,13 +552,13 @@ DeviceTreeInit (void *base, size_t size)
 DTInteger
 DeviceTreeVerify ()
 {
-	int res;
-
 	if (BootDeviceTree.initialised != ROOT_DEVICE_TREE_INIT) {
 		pr_err("DeviceTreeVerify: ERROR: BootDeviceTree is not properly initialised, base '0x%lx'\n", BootDeviceTree.base);
 		return kDeviceTreeFailure;
 	}
 
+	pr_info("%d nodes, %d properties, %d bytes\n", BootDeviceTree.nNodes,
+		BootDeviceTree.nProperties, (int) dt_arena_used);
 	pr_debug("DeviceTreeVerify: BootDeviceTree is verified\n");
 	return kDeviceTreeSuccess;
 }
@@ -150,100 +566,71 @@ DeviceTreeVerify ()
 DTInteger
 DeviceTreeNodeExists (const char *name)
 {
-	return (fdt_path_offset ((const void *) BootDeviceTree.base, name) < 0) ? 
-		kDeviceTreeFailure : kDeviceTreeSuccess;
+	return (dt_resolve (name) == NULL) ? kDeviceTreeFailure :
+		kDeviceTreeSuccess;
 }
 
 DTInteger
 DeviceTreeLookupNode (const char *lookup, DTNode *node)
 {
-	int res, len;
-	const char *name;
+	const struct dt_node *found;
 
-	res = fdt_path_offset ((const void *) BootDeviceTree.base, lookup);
-	if (res < 0) {
-		pr_err("DeviceTreeLookupNode: ERROR: failed to find node '%s': %d\n",
-			lookup, -res);
+	found = dt_resolve (lookup);
+	if (found == NULL) {
+		pr_err("DeviceTreeLookupNode: ERROR: failed to find node '%s'\n",
+			lookup);
 		return kDeviceTreeFailure;
 	}
-	
-	name = fdt_get_name ((const void *) BootDeviceTree.base, res, &len);
-	if (len < 0) {
-		pr_err("DeviceTreeLookupNode: ERROR: failed to verify name of node: '%s': %d\n",
-			lookup, len);
-		return kDeviceTreeFailure;
-	}
-
-	if (len > kPropNameLength) {
-		pr_warn("DeviceTreeLookupNode: WARNING: node name '%d' longer than max: %d, %d\n",
-			name, len, kPropNameLength);
-	}
-
-	node->offset = (DTNodeOffset) res;
-	memcpy (node->name, name, len+1);
-
-	node->nChildren = node_offset_count_children (node->offset);
-	node->nProperties = node_offset_count_properties (node->offset);
 
+	dt_fill_node (found, node);
 	return kDeviceTreeSuccess;
 }
 
 DTInteger
 DeviceTreeLookupNodeByOffset (DTNodeOffset offset, DTNode *node)
 {
-	int len;
-	const char *name;
-	node->offset = offset;
+	const struct dt_node *found;
 
-	name = fdt_get_name ((const void *) BootDeviceTree.base, offset, &len);
-	if (len < 0) {
-		pr_err("DeviceTreeLookupNodeByOffset: ERROR: failed to find name for node offset: %d: %d\n",
-			offset, len);
+	found = dt_find_offset (offset);
+	if (found == NULL) {
+		pr_err("DeviceTreeLookupNodeByOffset: ERROR: failed to find node offset: %d\n",
+			offset);
 		return kDeviceTreeFailure;
 	}
-	memcpy (node->name, name, len+1);
-
-	node->nChildren = node_offset_count_children (node->offset);
-	node->nProperties = node_offset_count_properties (node->offset);
 
+	dt_fill_node (found, node);
 	return kDeviceTreeSuccess;
 }
 
 DTInteger
 DeviceTreeNodeFirstSubnode (DTNode node, DTNode *first)
 {
-	int res;
-
-	res = fdt_first_subnode ((const void *) BootDeviceTree.base, node.offset);
-	if (res == -FDT_ERR_NOTFOUND) {
+	if (node.node == NULL || node.node->child == NULL) {
 		pr_err("DeviceTreeNodeFirstSubnode: ERROR: failed to find subnode for node '%s'\n",
 			node.name);
 		return kDeviceTreeFailure;
 	}
 
-	return DeviceTreeLookupNodeByOffset ((DTNodeOffset) res, first);
+	dt_fill_node (node.node->child, first);
+	return kDeviceTreeSuccess;
 }
 
 DTInteger
 DeviceTreeNodeNextSubnode (DTNode node, DTNode *next)
 {
-	int res;
-
-	res = fdt_next_subnode ((const void *) BootDeviceTree.base, node.offset);
-	if (res == -FDT_ERR_NOTFOUND) {
-		pr_err("DeviceTreeNodeFirstSubnode: ERROR: failed to find subnode for node '%s'\n",
+	if (node.node == NULL || node.node->sibling == NULL) {
+		pr_err("DeviceTreeNodeNextSubnode: ERROR: failed to find subnode after node '%s'\n",
 			node.name);
 		return kDeviceTreeFailure;
 	}
 
-	return DeviceTreeLookupNodeByOffset ((DTNodeOffset) res, next);
+	dt_fill_node (node.node->sibling, next);
+	return kDeviceTreeSuccess;
 }
 
 DTInteger
 DeviceTreeIteratorInit (DTNode *start, DeviceTreeIterator *iter)
 {
-	DTNode node;
-
 	if (!BootDeviceTree.initialised)
 		return kDeviceTreeFailure;
 
@@ -280,18 +667,18 @@ DeviceTreeIterateNodes (DeviceTreeIterator *iter, DTNode *next)
 DTInteger
 DeviceTreeLookupPropertyValue (DTNode node, const char *propName, char **propValue, DTInteger *propSize)
 {
-	int len;
-	char *value;
+	const struct dt_prop *prop = NULL;
 
-	value = (char *) fdt_getprop ((const void *) BootDeviceTree.base, node.offset, propName, &len);
-	if (len < 0) {
-		pr_err("DeviceTreeLookupProperty: ERROR: failed to find prop '%s' in node '%s': %d\n",
-			propName, node.name, len);
+	if (node.node != NULL)
+		prop = dt_find_prop (node.node, propName);
+	if (prop == NULL) {
+		pr_err("DeviceTreeLookupProperty: ERROR: failed to find prop '%s' in node '%s'\n",
+			propName, node.name);
 		return kDeviceTreeFailure;
 	}
-	pr_debug("DeviceTreeLookupProperty: NOTICE: found prop '%s' in node '%s': %d\n", propName, node.name, len);
-	*propValue = value;
-	*propSize = (DTInteger) len;
+	pr_debug("DeviceTreeLookupProperty: NOTICE: found prop '%s' in node '%s': %d\n", propName, node.name, prop->len);
+	*propValue = (char *) prop->value;
+	*propSize = prop->len;
 
 	return kDeviceTreeSuccess;
 }
@@ -299,69 +686,86 @@ DeviceTreeLookupPropertyValue (DTNode node, const char *propName, char **propVal
 DTInteger
 DeviceTreeLookupNodeByPhandle (uint64_t phandle, DTNode *node)
 {
-	int res, len;
-	const char *name;
+	const struct dt_node *found;
 
-	res = fdt_node_offset_by_phandle ((const void *) BootDeviceTree.base, phandle);
-	if (res < 0) {
-		pr_err("DeviceTreeLookupNodeByPhandle: ERROR: failed to find node with phandle '0x%x': 0x%llx\n",
-			phandle, res);
+	found = dt_find_phandle ((uint32_t) phandle);
+	if (found == NULL) {
+		pr_err("DeviceTreeLookupNodeByPhandle: ERROR: failed to find node with phandle '0x%x'\n",
+			phandle);
 		return kDeviceTreeFailure;
 	}
 
-	name = fdt_get_name ((const void *) BootDeviceTree.base, res, &len);
-	node->offset = (DTNodeOffset) res;
-	memcpy (node->name, name, len+1);
-
-	node->nChildren = node_offset_count_children (node->offset);
-	node->nProperties = node_offset_count_properties (node->offset);
+	dt_fill_node (found, node);
+	return kDeviceTreeSuccess;
+}
 
+/**
+ * dt_translate
+ *
+ * Translate a bus address up through each parent's `ranges` to a CPU address.
+ * An empty `ranges` is an identity mapping. A bus without `ranges` isn't memory
+ * mapped, e.g. /cpus, so the address is left as it is from there. Fails if a
+ * bus has ranges but none of them cover the address.
+*/
+static DTInteger
+dt_translate (const struct dt_node *node, uint64_t *addr)
+{
+	const struct dt_node *bus;
+	const struct dt_range *range;
+	DTInteger i;
+
+	for (bus = node->parent; bus != NULL && bus->parent != NULL; bus = bus->parent) {
+		if (!bus->hasRanges)
+			break;
+		if (bus->nRanges == 0)
+			continue;
+
+		for (i = 0; i < bus->nRanges; i++) {
+			range = &bus->ranges[i];
+			if (*addr >= range->child && *addr - range->child < range->size) {
+				*addr = *addr - range->child + range->parent;
+				break;
+			}
+		}
+
+		if (i == bus->nRanges)
+			return kDeviceTreeFailure;
+	}
 	return kDeviceTreeSuccess;
 }
 
 DTInteger
-DeviceTreeLookupReg (DTNode *node, uint32_t *reg)
+DeviceTreeLookupReg (DTNode *node, DTInteger index, uint64_t *addr, uint64_t *size)
 {
-	int res, cell_size;
+	const struct dt_node *n = node->node;
+	uint64_t cpu_addr;
 
-	reg = (uint32_t *) fdt_getprop ((const void *) BootDeviceTree.base, node->offset, "reg", &res);
-	if (res < 0) {
-		pr_err("DeviceTreeLookupReg: ERROR: failed to get prop 'reg' from node '%s': 0x%llx\n",
-			node->name, res);
+	if (n == NULL || index < 0 || index >= n->nReg) {
+		pr_err("DeviceTreeLookupReg: ERROR: no 'reg' entry %d in node '%s'\n",
+			index, node->name);
 		return kDeviceTreeFailure;
 	}
 
+	cpu_addr = n->reg[index].addr;
+	if (dt_translate (n, &cpu_addr) != kDeviceTreeSuccess) {
+		pr_err("DeviceTreeLookupReg: ERROR: 'reg' entry %d in node '%s' is outside its bus ranges\n",
+			index, node->name);
+		return kDeviceTreeFailure;
+	}
+
+	*addr = cpu_addr;
+	*size = n->reg[index].size;
 	return kDeviceTreeSuccess;
 }
 
 DTInteger
 DeviceTreeLookupRegValue (DTNode *node, uint64_t *addr, uint64_t *size)
 {
-	int res, cell_size;
-	uint32_t *reg, *cells;
-
-	reg = (uint32_t *) fdt_getprop ((const void *) BootDeviceTree.base, node->offset, "reg", &res);
-	if (res < 0) {
-		pr_err("DeviceTreeLookupRegValue: ERROR: failed to get prop 'reg' from node '%s': 0x%llx\n",
-			node->name, res);
-		return kDeviceTreeFailure;
-	}
-
-	/**
-	 * The cell size is fixed and defined in defaults.h. For now, until this is
-	 * changed, there is no need to discover the cell size.
-	*/
-	cell_size = DEFAULTS_PLAT_DEVICETREE_CELL_SIZE;
-	cells = &reg[0];
-
-	for (int i = 0; i < cell_size * 2; i++)
-		cells[i] = bswap_32 (cells[i]);
-
-	/**
-	 * The address and size values are split into two 32-bit integers. Reconstruct
-	 * this 64-bit value and write it into `addr` and `size`.
-	*/
-	*addr = ((uint64_t) cells[0] << 32) + cells[1];
-	*size = ((uint64_t) cells[2] << 32) + cells[3];
+	return DeviceTreeLookupReg (node, 0, addr, size);
 }
 
+DTInteger
+DeviceTreeLookupRegCount (DTNode *node)
+{
+	return (node->node != NULL) ? node->node->nReg : 0;
+}
@@ -44,6 +44,9 @@ enum {
 	kPropNameLength = 32,
 };
 
+/* Unflattened node, private to devicetree.c */
+struct dt_node;
+
 /**
  * Structures for Flattened Device Tree
 */
@@ -53,6 +56,7 @@ typedef struct DeviceTreeNode
 	DTNodeOffset	offset;
 	DTInteger		nChildren;
 	DTInteger		nProperties;
+	const struct dt_node	*node;
 } DeviceTreeNode, DTNode, dtnode;
 
 typedef struct DeviceTreeIterator
@@ -190,11 +194,38 @@ DeviceTreeLookupPropertyValue (DTNode node, const char *propName,
 							   char **propValue, DTInteger *propSize);
 
 
+/**
+ * DeviceTreeLookupReg
+ * 
+ * Lookup entry `index` of a nodes 'reg' field, decoded with the parents
+ * #address-cells and #size-cells, and translated to a CPU address through the
+ * 'ranges' of the buses above it.
+ * 
+ * @param	node		Node containg a `reg` field.
+ * @param	index		Index of the entry.
+ * @param	addr		Pointer to store the Address value in.
+ * @param	size		Pointer to store the Size value in.
+ * 
+ * @returns		kDeviceTreeSuccess or kDeviceTreeFailure
+*/
+extern DTInteger
+DeviceTreeLookupReg (DTNode *node, DTInteger index, uint64_t *addr,
+					 uint64_t *size);
+
+/**
+ * DeviceTreeLookupRegCount
+ * 
+ * Return the number of entries in a nodes 'reg' field.
+*/
+extern DTInteger
+DeviceTreeLookupRegCount (DTNode *node);
+
 /**
  * DeviceTreeLookupRegValue
  * 
  * Lookup the Address and Size value in a nodes 'reg' field, and store the
- * results in the `addr` and `size` parameters.
+ * results in the `addr` and `size` parameters. Same as DeviceTreeLookupReg
+ * with an index of 0.
  * 
  * @param	node		Node containg a `reg` field.
  * @param	addr		Pointer to store the Address value in.
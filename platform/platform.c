@@ -23,10 +23,21 @@
 #include <platform/platform.h>
 #include <platform/devicetree.h>
 
+#include <kern/defaults.h>
 #include <libkern/assert.h>
+#include <tinylibc/string.h>
+
+#if DEFAULTS_SET(DEFAULTS_PLAT_STATIC)
+#include <platform/platform_static.h>
+#endif
 
 kern_return_t platform_get_memory (phys_addr_t *membase, phys_size_t *mmesize)
 {
+#if DEFAULTS_SET(DEFAULTS_PLAT_STATIC)
+	*membase = PLATFORM_STATIC_MEMORY_BASE;
+	*mmesize = PLATFORM_STATIC_MEMORY_SIZE;
+	return KERN_RETURN_SUCCESS;
+#else
 	phys_addr_t addr;
 	phys_size_t size;
 	DTNode mem_node;
@@ -41,4 +52,33 @@ kern_return_t platform_get_memory (phys_addr_t *membase, phys_size_t *mmesize)
 	*membase = addr;
 
 	return KERN_RETURN_SUCCESS;
-}
\ No newline at end of file
+#endif
+}
+
+kern_return_t platform_get_gicv3 (struct platform_gicv3 *gic)
+{
+#if DEFAULTS_SET(DEFAULTS_PLAT_STATIC)
+	gic->gicd_base = PLATFORM_STATIC_GICD_BASE;
+	gic->gicd_size = PLATFORM_STATIC_GICD_SIZE;
+	gic->gicr_base = PLATFORM_STATIC_GICR_BASE;
+	gic->gicr_size = PLATFORM_STATIC_GICR_SIZE;
+	return KERN_RETURN_SUCCESS;
+#else
+	DTNode gic_node;
+	char *compat;
+	int len;
+
+	/* reg is the distributor, then the redistributor region */
+	if (DeviceTreeLookupNode ("/intc", &gic_node) != kDeviceTreeSuccess)
+		return KERN_RETURN_FAIL;
+	if (DeviceTreeLookupPropertyValue (gic_node, "compatible", &compat, &len) != kDeviceTreeSuccess ||
+		strcmp (compat, "arm,gic-v3"))
+		return KERN_RETURN_FAIL;
+
+	if (DeviceTreeLookupReg (&gic_node, 0, &gic->gicd_base, &gic->gicd_size) != kDeviceTreeSuccess ||
+		DeviceTreeLookupReg (&gic_node, 1, &gic->gicr_base, &gic->gicr_size) != kDeviceTreeSuccess)
+		return KERN_RETURN_FAIL;
+
+	return KERN_RETURN_SUCCESS;
+#endif
+}
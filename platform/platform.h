@@ -32,11 +32,30 @@
 #include <kern/vm/pmap.h>
 #include <kern/vm/vm.h>
 
+/**
+ * Platform descriptors. These are read from the device tree at boot, or with
+ * DEFAULTS_PLAT_STATIC, come from platform/platform_static.h, which is
+ * generated from the platform .dts at build time by scripts/platform_gen.py.
+*/
+struct platform_cpu
+{
+	uint32_t		phys_id;
+	uint32_t		cluster_id;
+};
+
+struct platform_gicv3
+{
+	phys_addr_t		gicd_base;
+	phys_size_t		gicd_size;
+	phys_addr_t		gicr_base;
+	phys_size_t		gicr_size;
+};
+
 /* platform memory layout */
 kern_return_t platform_get_memory (phys_addr_t *membase, phys_size_t *memsize);
 
 /* interrupt controller */
-kern_return_t platform_get_gicv3 (void);
+kern_return_t platform_get_gicv3 (struct platform_gicv3 *gic);
 
 
 #endif /* __platform_h__ */
\ No newline at end of file
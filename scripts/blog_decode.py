@@ -0,0 +1,278 @@
+##===-----------------------------------------------------------------------===//
+##
+##                                  tinyOS
+##                             The Monix Kernel
+##
+## 	This program is free software: you can redistribute it and/or modify
+## 	it under the terms of the GNU General Public License as published by
+## 	the Free Software Foundation, either version 3 of the License, or
+## 	(at your option) any later version.
+##
+## 	This program is distributed in the hope that it will be useful,
+## 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+## 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## 	GNU General Public License for more details.
+##
+## 	You should have received a copy of the GNU General Public License
+##	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+##
+##	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+##
+##===-----------------------------------------------------------------------===//
+#
+# Binary log decoder. With DEFAULTS_KERNEL_PRINTK_BINARY, the kernel writes
+# pr_info/pr_debug messages to the console as "#blog <ts> <level> <payload>"
+# lines, where the payload holds the call site index and the raw arguments.
+# This reads the call sites from the .blog_sites section of the kernel ELF,
+# and turns those lines back into ordinary log messages. Everything else is
+# passed through unchanged.
+#
+#   $ scripts/blog_decode.py kernel_elf serial.log
+#   $ qemu-system-aarch64 ... -serial stdio | scripts/blog_decode.py kernel_elf
+#
+
+from bisect import bisect_right
+from dataclasses import dataclass
+import argparse
+import re
+import struct
+import sys
+
+# Must match struct blog_site in kern/trace/blog.h
+BLOG_SITE_FORMAT    = "<QQIBBH"
+BLOG_SITE_SIZE      = struct.calcsize(BLOG_SITE_FORMAT)
+
+BLOG_LINE           = re.compile(r"^#blog ([0-9a-f]+) ([0-9a-f]+) ([0-9a-f]*)\r?$")
+
+# printf conversion, as supported by the kernel's vsnprintf
+PRINTF_SPEC         = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|z|t|j)?([diuxXopcs%])")
+
+NSEC_PER_SEC        = 1000000000
+NSEC_PER_USEC       = 1000
+
+@dataclass
+class BlogSite:
+    fmt: str
+    file: str
+    line: int
+    level: int
+    nargs: int
+    strmask: int
+
+################################################################################
+# Kernel ELF
+
+@dataclass
+class ElfSection:
+    name: str
+    addr: int
+    offset: int
+    size: int
+
+class KernelElf:
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 2 or self.data[5] != 1:
+            raise ValueError("{}: not a little-endian ELF64 file".format(path))
+
+        shoff, = struct.unpack_from("<Q", self.data, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from("<HHH", self.data, 0x3a)
+
+        headers = []
+        for i in range(shnum):
+            name, type, flags, addr, offset, size, link = struct.unpack_from(
+                "<IIQQQQI", self.data, shoff + i * shentsize)
+            headers.append((name, type, addr, offset, size, link))
+
+        strtab = headers[shstrndx]
+        self.sections = []
+        self.symtab = None
+        for name, type, addr, offset, size, link in headers:
+            # SHT_SYMTAB, linked to its string table
+            if type == 2:
+                self.symtab = (offset, size, headers[link][3])
+            # SHT_NOBITS has no file contents
+            if type == 8:
+                continue
+            self.sections.append(ElfSection(self.cstr(strtab[3] + name), addr, offset, size))
+
+    def cstr(self, offset):
+        end = self.data.index(b"\0", offset)
+        return self.data[offset:end].decode("utf-8", "replace")
+
+    def section(self, name):
+        for section in self.sections:
+            if section.name == name:
+                return section
+        return None
+
+    def read(self, addr, size):
+        for section in self.sections:
+            if section.addr and section.addr <= addr < section.addr + section.size:
+                offset = section.offset + (addr - section.addr)
+                return self.data[offset:offset + size]
+        raise ValueError("address 0x{:x} is not in the kernel image".format(addr))
+
+    def read_cstr(self, addr):
+        for section in self.sections:
+            if section.addr and section.addr <= addr < section.addr + section.size:
+                return self.cstr(section.offset + (addr - section.addr))
+        return "<0x{:x}>".format(addr)
+
+    def functions(self):
+        """Return the function symbols, as a list of (addr, size, name) sorted by address"""
+        if self.symtab is None:
+            raise ValueError("kernel has no symbol table")
+
+        offset, size, strtab = self.symtab
+        functions = []
+        for sym in range(offset, offset + size, 24):
+            name, info, other, shndx, value, symsize = struct.unpack_from("<IBBHQQ", self.data, sym)
+            # STT_FUNC
+            if info & 0xf == 2 and value:
+                functions.append((value, symsize, self.cstr(strtab + name)))
+        return sorted(functions)
+
+    def blog_sites(self):
+        section = self.section(".blog_sites")
+        if section is None:
+            raise ValueError("kernel has no .blog_sites section")
+
+        sites = []
+        for offset in range(0, section.size, BLOG_SITE_SIZE):
+            fmt, file, line, level, nargs, strmask = struct.unpack_from(
+                BLOG_SITE_FORMAT, self.data, section.offset + offset)
+            sites.append(BlogSite(self.read_cstr(fmt), self.read_cstr(file),
+                line, level, nargs, strmask))
+        return sites
+
+class Symbols:
+    """Resolve addresses to function names, from KernelElf.functions()"""
+
+    def __init__(self, functions):
+        self.functions = functions
+        self.addrs = [addr for addr, size, name in functions]
+
+    def lookup(self, addr):
+        i = bisect_right(self.addrs, addr) - 1
+        if i >= 0:
+            start, size, name = self.functions[i]
+            if addr < start + max(size, 1):
+                return name
+        return "0x{:x}".format(addr)
+
+################################################################################
+# Decoding
+
+def blog_unpack_args(site, payload):
+    args = []
+    pos = 0
+    for i in range(site.nargs):
+        # the first argument has the highest bit in the mask
+        if site.strmask & (1 << (site.nargs - 1 - i)):
+            length, = struct.unpack_from("<H", payload, pos)
+            args.append(payload[pos + 2:pos + 2 + length].decode("utf-8", "replace"))
+            pos += 2 + length
+        else:
+            args.append(struct.unpack_from("<Q", payload, pos)[0])
+            pos += 8
+    return args
+
+def printf_bits(length):
+    if length in ("l", "ll", "z", "t", "j"):
+        return 64
+    return {"h": 16, "hh": 8}.get(length, 32)
+
+def printf_format(fmt, args):
+    args = list(args)
+
+    def next_arg():
+        return args.pop(0) if args else 0
+
+    def convert(m):
+        flags, width, precision, length, conv = m.groups()
+        if conv == "%":
+            return "%"
+
+        if width == "*":
+            width = str(next_arg() & 0xffffffff)
+        if precision == "*":
+            precision = str(next_arg() & 0xffffffff)
+        spec = "%" + flags + (width or "") + ("." + precision if precision else "")
+
+        value = next_arg()
+        if conv == "s":
+            if not isinstance(value, str):
+                value = "<0x{:x}>".format(value)
+            return (spec + "s") % value
+        if isinstance(value, str):
+            return value
+
+        if conv == "c":
+            return (spec.replace("#", "") + "c") % chr(value & 0xff)
+        if conv == "p":
+            return (spec + ("#x" if value else "x")) % value
+
+        bits = printf_bits(length)
+        value &= (1 << bits) - 1
+        if conv in "di":
+            if value & (1 << (bits - 1)):
+                value -= 1 << bits
+            return (spec + "d") % value
+        if conv == "u":
+            return (spec + "d") % value
+
+        # C only prefixes non-zero values, and writes octal with a single 0
+        if "#" in flags and conv == "o" and value != 0:
+            digits = ("%" + ("." + precision if precision else "") + "o") % value
+            if not digits.startswith("0"):
+                digits = "0" + digits
+            pad = int(width or 0) - len(digits)
+            if "-" in flags:
+                return digits + " " * pad
+            return ("0" if "0" in flags and not precision else " ") * pad + digits
+        if value == 0:
+            spec = spec.replace("#", "")
+        return (spec + conv) % value
+
+    return PRINTF_SPEC.sub(convert, fmt)
+
+def blog_decode_line(sites, line):
+    m = BLOG_LINE.match(line)
+    if not m:
+        return line
+
+    ts = int(m.group(1), 16)
+    payload = bytes.fromhex(m.group(3))
+    site_id, = struct.unpack_from("<I", payload, 0)
+    if site_id >= len(sites):
+        return "[{:5d}.{:06d}] <unknown blog site {}>\n".format(ts // NSEC_PER_SEC,
+            (ts % NSEC_PER_SEC) // NSEC_PER_USEC, site_id)
+
+    site = sites[site_id]
+    message = printf_format(site.fmt, blog_unpack_args(site, payload[4:]))
+    return "[{:5d}.{:06d}] {}".format(ts // NSEC_PER_SEC,
+        (ts % NSEC_PER_SEC) // NSEC_PER_USEC, message)
+
+################################################################################
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(description="Decode Monix binary log output")
+    parser.add_argument("kernel", help="Kernel ELF the log was produced by")
+    parser.add_argument("log", nargs="?", help="Console log, defaults to stdin")
+    parser.add_argument("-s", "--sites", action="store_true", help="List the binary log call sites and exit")
+    args = parser.parse_args()
+
+    sites = KernelElf(args.kernel).blog_sites()
+
+    if args.sites:
+        for i, site in enumerate(sites):
+            print("{:4d}  {}:{}  level {}  {!r}".format(i, site.file, site.line, site.level, site.fmt))
+        sys.exit(0)
+
+    log = open(args.log, "r", errors="replace") if args.log else sys.stdin
+    for line in log:
+        sys.stdout.write(blog_decode_line(sites, line))
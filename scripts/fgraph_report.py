@@ -0,0 +1,181 @@
+##===-----------------------------------------------------------------------===//
+##
+##                                  tinyOS
+##                             The Monix Kernel
+##
+## 	This program is free software: you can redistribute it and/or modify
+## 	it under the terms of the GNU General Public License as published by
+## 	the Free Software Foundation, either version 3 of the License, or
+## 	(at your option) any later version.
+##
+## 	This program is distributed in the hope that it will be useful,
+## 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+## 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## 	GNU General Public License for more details.
+##
+## 	You should have received a copy of the GNU General Public License
+##	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+##
+##	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+##
+##===-----------------------------------------------------------------------===//
+#
+# Function graph report. A kernel built with FGRAPH writes a record to the
+# console for every instrumented call that returns, as "#fgraph <ts> <payload>"
+# lines. This resolves the functions against the kernel's symbol table and
+# reports the number of calls, and the inclusive and exclusive time of each
+# function, or of each subsystem, given the linker map.
+#
+#   $ scripts/fgraph_report.py kernel_elf serial.log
+#   $ scripts/fgraph_report.py --map kernel.map --subsystem kernel_elf serial.log
+#   $ scripts/fgraph_report.py --filter '^sched|thread_' --sort total kernel_elf serial.log
+#
+
+from bisect import bisect_right
+from collections import defaultdict
+from dataclasses import dataclass
+import argparse
+import os
+import re
+import struct
+import sys
+
+from blog_decode import KernelElf, Symbols
+
+# Must match struct fgraph_record in kern/trace/fgraph.h
+FGRAPH_RECORD_FORMAT    = "<QQQQHHi"
+FGRAPH_RECORD_SIZE      = struct.calcsize(FGRAPH_RECORD_FORMAT)
+
+FGRAPH_LINE             = re.compile(r"^#fgraph ([0-9a-f]+) ([0-9a-f]*)\r?$")
+FGRAPH_DROPPED          = re.compile(r"fgraph: cpu (\d+): (\d+) calls dropped")
+
+# an input section in the linker map, possibly with its address on the next line
+MAP_SECTION             = re.compile(r"^ \.text\S*\s*(?:0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S+\.o))?$")
+MAP_CONTINUED           = re.compile(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S+\.o)$")
+
+NSEC_PER_USEC           = 1000
+
+@dataclass
+class FgraphRecord:
+    fn: int
+    start: int
+    total: int
+    self: int
+    depth: int
+    cpu: int
+    tid: int
+
+@dataclass
+class FgraphStats:
+    calls: int = 0
+    total: int = 0
+    self: int = 0
+    max: int = 0
+
+def read_map(path):
+    """Return the .text ranges of each object file, from the linker map"""
+    ranges = []
+    pending = False
+    with open(path, "r", errors="replace") as f:
+        for line in f:
+            m = MAP_SECTION.match(line)
+            if m and m.group(1) is None:
+                pending = True
+                continue
+            if not m and pending:
+                m = MAP_CONTINUED.match(line)
+            pending = False
+            if m and int(m.group(2), 16):
+                ranges.append((int(m.group(1), 16), int(m.group(2), 16), m.group(3)))
+    return sorted(ranges)
+
+def subsystem(obj):
+    """kern/vm/vm_page.o is in kern/vm, kern/sched.o is kern/sched"""
+    path = os.path.splitext(obj)[0]
+    parts = path.split("/")
+    return "/".join(parts[:2]) if len(parts) > 2 else path
+
+def parse(log):
+    records = []
+    dropped = defaultdict(int)
+    for line in log:
+        m = FGRAPH_LINE.match(line)
+        if m:
+            payload = bytes.fromhex(m.group(2))
+            if len(payload) >= FGRAPH_RECORD_SIZE:
+                records.append(FgraphRecord(*struct.unpack_from(FGRAPH_RECORD_FORMAT, payload)))
+            continue
+        m = FGRAPH_DROPPED.search(line)
+        if m:
+            dropped[int(m.group(1))] += int(m.group(2))
+    return records, dropped
+
+def report(records, key, args):
+    stats = defaultdict(FgraphStats)
+    for rec in records:
+        name = key(rec)
+        if args.filter and not re.search(args.filter, name):
+            continue
+        s = stats[name]
+        s.calls += 1
+        s.total += rec.total
+        s.self += rec.self
+        s.max = max(s.max, rec.total)
+
+    order = {
+        "self": lambda item: -item[1].self,
+        "total": lambda item: -item[1].total,
+        "calls": lambda item: -item[1].calls,
+    }[args.sort]
+
+    width = max([len(name) for name in stats] + [8])
+    print("{:<{w}s} {:>8s} {:>12s} {:>12s} {:>10s} {:>10s}".format("function" if not args.subsystem
+        else "subsystem", "calls", "total (us)", "self (us)", "avg (us)", "max (us)", w=width))
+    for name, s in sorted(stats.items(), key=order)[:args.top]:
+        print("{:<{w}s} {:>8d} {:>12.1f} {:>12.1f} {:>10.2f} {:>10.2f}".format(name, s.calls,
+            s.total / NSEC_PER_USEC, s.self / NSEC_PER_USEC, s.total / s.calls / NSEC_PER_USEC,
+            s.max / NSEC_PER_USEC, w=width))
+
+################################################################################
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(description="Report on Monix function graph output")
+    parser.add_argument("kernel", help="Kernel ELF the trace was produced by")
+    parser.add_argument("log", nargs="?", help="Console log, defaults to stdin")
+    parser.add_argument("-m", "--map", help="Linker map, for --subsystem")
+    parser.add_argument("-S", "--subsystem", action="store_true", help="Report per subsystem, rather than per function")
+    parser.add_argument("-f", "--filter", help="Only report functions (or subsystems) matching this regex")
+    parser.add_argument("-s", "--sort", choices=("self", "total", "calls"), default="self", help="Sort order, defaults to exclusive time")
+    parser.add_argument("-n", "--top", type=int, default=40, help="Number of rows to show")
+    args = parser.parse_args()
+
+    if args.subsystem and not args.map:
+        parser.error("--subsystem needs the linker map")
+
+    symbols = Symbols(KernelElf(args.kernel).functions())
+    log = open(args.log, "r", errors="replace") if args.log else sys.stdin
+    records, dropped = parse(log)
+
+    if not records:
+        print("no function graph records")
+        sys.exit(0)
+
+    for cpu, count in sorted(dropped.items()):
+        print("cpu{}: {} calls dropped".format(cpu, count))
+
+    if args.subsystem:
+        ranges = read_map(args.map)
+        starts = [start for start, size, obj in ranges]
+
+        # a subsystem's inclusive time counts nested calls within it more than once
+        def key(rec):
+            i = bisect_right(starts, rec.fn) - 1
+            if i >= 0 and rec.fn < ranges[i][0] + ranges[i][1]:
+                return subsystem(ranges[i][2])
+            return "?"
+    else:
+        def key(rec):
+            return symbols.lookup(rec.fn)
+
+    report(records, key, args)
@@ -0,0 +1,116 @@
+##===-----------------------------------------------------------------------===//
+##
+##                                  tinyOS
+##                             The Monix Kernel
+##
+## 	This program is free software: you can redistribute it and/or modify
+## 	it under the terms of the GNU General Public License as published by
+## 	the Free Software Foundation, either version 3 of the License, or
+## 	(at your option) any later version.
+##
+## 	This program is distributed in the hope that it will be useful,
+## 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+## 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## 	GNU General Public License for more details.
+##
+## 	You should have received a copy of the GNU General Public License
+##	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+##
+##	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+##
+##===-----------------------------------------------------------------------===//
+#
+# Kernel symbol table generator, see kern/ksym.h. Reads the output of `nm -n`
+# for the first link of the kernel, and writes the assembly for the table that
+# goes into the second. With no symbols, e.g. for the first link itself, the
+# table is empty.
+#
+#   $ nm -n kernel_elf.ksym | scripts/ksym_gen.py -o kern/ksym_table.S
+#   $ scripts/ksym_gen.py --empty -o kern/ksym_table.S
+#
+
+import argparse
+import re
+import sys
+
+# Must match kern/ksym.h
+KSYM_NAME_MAX           = 128
+KSYM_MARKER_STRIDE      = 16
+
+# text symbols, global and local, including weak ones
+NM_LINE                 = re.compile(r"^([0-9a-fA-F]+) ([TtWw]) (\S+)$")
+
+def read_symbols(nm):
+    """Return the function symbols as a sorted list of (addr, name)"""
+    symbols = {}
+    for line in nm:
+        m = NM_LINE.match(line.strip())
+        if not m:
+            continue
+        name = m.group(3)
+        # assembler locals, and mapping symbols, are never useful to show
+        if name.startswith(".L") or name.startswith("$"):
+            continue
+        addr = int(m.group(1), 16)
+        # one name per address, preferring a global over a local alias
+        if addr not in symbols or m.group(2) in "TW":
+            symbols[addr] = name[:KSYM_NAME_MAX - 1]
+    return sorted(symbols.items())
+
+def compress(names):
+    """Prefix compress the names, returning the blob and marker offsets"""
+    blob = bytearray()
+    markers = []
+    prev = b""
+    for i, name in enumerate(names):
+        name = name.encode()
+        prefix = 0
+        if i % KSYM_MARKER_STRIDE == 0:
+            markers.append(len(blob))
+        else:
+            while prefix < min(len(prev), len(name), 255) and prev[prefix] == name[prefix]:
+                prefix += 1
+        suffix = name[prefix:]
+        blob += bytes([prefix, len(suffix)]) + suffix
+        prev = name
+    return blob, markers
+
+def emit(out, label, directive, values, per_line):
+    out.write("\t.globl\t{}\n{}:\n".format(label, label))
+    for i in range(0, len(values), per_line):
+        out.write("\t{}\t{}\n".format(directive, ", ".join(values[i:i + per_line])))
+
+def generate(symbols, out):
+    base = symbols[0][0] if symbols else 0
+    blob, markers = compress([name for addr, name in symbols])
+
+    out.write("/* generated by scripts/ksym_gen.py, do not edit */\n\n")
+    out.write("\t.section\t.ksym, \"a\"\n")
+    out.write("\t.balign\t8\n")
+    emit(out, "ksym_base", ".quad", ["0x{:x}".format(base)], 1)
+    emit(out, "ksym_nr", ".long", [str(len(symbols))], 1)
+    emit(out, "ksym_offsets", ".long", ["0x{:x}".format(addr - base) for addr, name in symbols], 8)
+    emit(out, "ksym_markers", ".long", [str(m) for m in markers], 8)
+    emit(out, "ksym_names", ".byte", [str(b) for b in blob], 16)
+
+################################################################################
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(description="Generate the Monix kernel symbol table")
+    parser.add_argument("nm", nargs="?", help="Output of nm -n, defaults to stdin")
+    parser.add_argument("-e", "--empty", action="store_true", help="Write an empty table")
+    parser.add_argument("-o", "--output", help="Output file, defaults to stdout")
+    args = parser.parse_args()
+
+    symbols = []
+    if not args.empty:
+        nm = open(args.nm, "r") if args.nm else sys.stdin
+        symbols = read_symbols(nm)
+
+    # offsets are 32 bits, which is plenty for the kernel's text
+    if symbols and symbols[-1][0] - symbols[0][0] > 0xffffffff:
+        sys.exit("ksym_gen: text is too large for 32-bit offsets")
+
+    out = open(args.output, "w") if args.output else sys.stdout
+    generate(symbols, out)
@@ -0,0 +1,343 @@
+##===-----------------------------------------------------------------------===//
+##
+##                                  tinyOS
+##                             The Monix Kernel
+##
+## 	This program is free software: you can redistribute it and/or modify
+## 	it under the terms of the GNU General Public License as published by
+## 	the Free Software Foundation, either version 3 of the License, or
+## 	(at your option) any later version.
+##
+## 	This program is distributed in the hope that it will be useful,
+## 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+## 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## 	GNU General Public License for more details.
+##
+## 	You should have received a copy of the GNU General Public License
+##	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+##
+##	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+##
+##===-----------------------------------------------------------------------===//
+#
+# Platform descriptor generator. Reads the device tree source for a fixed
+# platform and writes a header of constants for it, so that with
+# DEFAULTS_PLAT_STATIC the kernel can take its memory, cpu topology, GIC and
+# uart from the build rather than reading the device tree at boot.
+#
+#   $ scripts/platform_gen.py -o platform/platform_static.h arch/dts/tiny-ex1.dtsi
+#
+# Only the subset of DTS the platform files use is understood: nodes, cell
+# lists, strings, empty properties, labels and comments. No includes, no
+# expressions, and no /delete-node/.
+#
+
+import argparse
+import re
+import sys
+
+# GIC interrupt specifier types, see the arm,gic-v3 binding
+GIC_SPI                 = 0
+GIC_PPI                 = 1
+GIC_SPI_BASE            = 32
+GIC_PPI_BASE            = 16
+
+TOKEN = re.compile(r"""
+    (?P<ws>\s+|//[^\n]*|/\*.*?\*/)
+  | (?P<string>"(?:[^"\\]|\\.)*")
+  | (?P<cells><[^>]*>)
+  | (?P<bytes>\[[^\]]*\])
+  | (?P<directive>/[a-z0-9-]+/)
+  | (?P<label>[A-Za-z_][A-Za-z0-9_]*:)
+  | (?P<ref>&[A-Za-z_][A-Za-z0-9_]*)
+  | (?P<punct>[{};=,])
+  | (?P<name>[A-Za-z0-9,._+#?@-]+|/)
+""", re.VERBOSE | re.DOTALL)
+
+class Node:
+    def __init__(self, name, parent=None):
+        self.name = name
+        self.parent = parent
+        self.props = {}
+        self.children = []
+        self.labels = []
+
+    @property
+    def path(self):
+        if self.parent is None:
+            return "/"
+        if self.parent.parent is None:
+            return "/" + self.name
+        return self.parent.path + "/" + self.name
+
+    def cells(self, name, default):
+        value = self.props.get(name)
+        return value[0] if value else default
+
+    def compatible(self):
+        return self.props.get("compatible", [])
+
+    def walk(self):
+        yield self
+        for child in self.children:
+            yield from child.walk()
+
+def tokenize(text):
+    pos = 0
+    while pos < len(text):
+        m = TOKEN.match(text, pos)
+        if not m:
+            raise SyntaxError("bad input at offset {}: {!r}".format(pos, text[pos:pos + 20]))
+        pos = m.end()
+        if m.lastgroup != "ws":
+            yield m.lastgroup, m.group()
+
+def parse_value(tokens, refs):
+    """Parse a property value up to its ';', as a list of cells or strings"""
+    value = []
+    for kind, tok in tokens:
+        if kind == "punct" and tok == ";":
+            return value
+        if kind == "punct" and tok == ",":
+            continue
+        if kind == "string":
+            value.append(tok[1:-1])
+        elif kind == "cells":
+            for cell in tok[1:-1].split():
+                if cell.startswith("&"):
+                    refs.append((value, len(value), cell[1:]))
+                    value.append(0)
+                else:
+                    value.append(int(cell, 0))
+        elif kind == "bytes":
+            value.extend(int(b, 16) for b in tok[1:-1].split())
+        elif kind == "label":
+            continue
+        else:
+            raise SyntaxError("unexpected {!r} in property value".format(tok))
+    raise SyntaxError("unterminated property")
+
+def parse(text):
+    tokens = tokenize(text)
+    root = None
+    stack = []
+    labels = []
+    refs = []
+    pending = None
+
+    for kind, tok in tokens:
+        if kind == "directive":
+            # /dts-v1/; and /plugin/; carry nothing we need
+            continue
+        if kind == "label":
+            labels.append(tok[:-1])
+            continue
+        if kind == "punct" and tok == ";":
+            if pending is not None:
+                stack[-1].props[pending] = []
+                pending = None
+            continue
+        if kind == "punct" and tok == "{":
+            if pending is None:
+                raise SyntaxError("node without a name")
+            if not stack:
+                if root is None:
+                    root = Node("")
+                node = root
+            else:
+                node = Node(pending, stack[-1])
+                stack[-1].children.append(node)
+            node.labels += labels
+            labels = []
+            stack.append(node)
+            pending = None
+            continue
+        if kind == "punct" and tok == "}":
+            stack.pop()
+            continue
+        if kind == "punct" and tok == "=":
+            stack[-1].props[pending] = parse_value(tokens, refs)
+            pending = None
+            continue
+        if kind in ("name", "ref"):
+            pending = tok
+            continue
+        raise SyntaxError("unexpected {!r}".format(tok))
+
+    if root is None:
+        raise SyntaxError("no root node")
+
+    # resolve &label references to phandles, allocating any that are missing
+    by_label = {label: node for node in root.walk() for label in node.labels}
+    used = {node.cells("phandle", 0) for node in root.walk()}
+    for value, index, label in refs:
+        node = by_label[label]
+        if "phandle" not in node.props:
+            phandle = max(used) + 1
+            used.add(phandle)
+            node.props["phandle"] = [phandle]
+        value[index] = node.props["phandle"][0]
+    return root
+
+def read_cells(cells, n):
+    value = 0
+    for cell in cells[:n]:
+        value = (value << 32) | cell
+    return value
+
+def decode_reg(node):
+    """Decode `reg` into (addr, size) pairs, translated through any ranges"""
+    parent = node.parent
+    ac = parent.cells("#address-cells", 2)
+    sc = parent.cells("#size-cells", 1)
+    reg = node.props.get("reg", [])
+    entries = []
+    for i in range(0, len(reg) - (ac + sc) + 1, ac + sc):
+        addr = read_cells(reg[i:], ac)
+        size = read_cells(reg[i + ac:], sc)
+        entries.append((translate(node, addr), size))
+    return entries
+
+def translate(node, addr):
+    bus = node.parent
+    while bus is not None and bus.parent is not None:
+        if "ranges" not in bus.props:
+            break
+        ca = bus.cells("#address-cells", 2)
+        cs = bus.cells("#size-cells", 1)
+        pa = bus.parent.cells("#address-cells", 2)
+        ranges = bus.props["ranges"]
+        for i in range(0, len(ranges) - (ca + pa + cs) + 1, ca + pa + cs):
+            child = read_cells(ranges[i:], ca)
+            parent = read_cells(ranges[i + ca:], pa)
+            size = read_cells(ranges[i + ca + pa:], cs)
+            if child <= addr < child + size:
+                addr = addr - child + parent
+                break
+        bus = bus.parent
+    return addr
+
+def gic_irq(cells):
+    kind, num = cells[0], cells[1]
+    return num + (GIC_SPI_BASE if kind == GIC_SPI else GIC_PPI_BASE)
+
+def find_compatible(root, compatible):
+    for node in root.walk():
+        if any(c in compatible for c in node.compatible()):
+            return node
+    return None
+
+def describe(root):
+    """Collect what the kernel needs from the tree"""
+    desc = {}
+
+    desc["compatible"] = root.compatible()[0] if root.compatible() else ""
+
+    desc["memory"] = []
+    for node in root.children:
+        if node.props.get("device_type") == ["memory"]:
+            desc["memory"] += decode_reg(node)
+    if not desc["memory"]:
+        raise ValueError("no memory node")
+    # platform_get_memory() describes a single contiguous region
+    if len(desc["memory"]) > 1:
+        raise ValueError("{} memory banks, only one is supported".format(len(desc["memory"])))
+
+    gic = find_compatible(root, ["arm,gic-v3"])
+    if gic is None:
+        raise ValueError("no arm,gic-v3 interrupt controller")
+    reg = decode_reg(gic)
+    if len(reg) < 2:
+        raise ValueError("{}: expected GICD and GICR in reg".format(gic.path))
+    desc["gicd"], desc["gicr"] = reg[0], reg[1]
+
+    uart = find_compatible(root, ["arm,pl011"])
+    if uart is None:
+        raise ValueError("no arm,pl011 uart")
+    desc["uart"] = decode_reg(uart)[0]
+    desc["uart_irq"] = gic_irq(uart.props["interrupts"])
+    desc["uart_path"] = uart.path
+
+    # cpu-map gives the clusters, each core points at its cpu node by phandle
+    cpus = [n for n in root.walk() if n.name == "cpus"]
+    if not cpus:
+        raise ValueError("no /cpus node")
+    by_phandle = {n.cells("phandle", 0): n for n in root.walk() if "phandle" in n.props}
+    cpu_map = [n for n in cpus[0].children if n.name == "cpu-map"]
+
+    desc["cpus"] = []
+    desc["clusters"] = 0
+    if cpu_map:
+        for cluster in cpu_map[0].children:
+            for core in cluster.children:
+                cpu = by_phandle[core.props["cpu"][0]]
+                phys = read_cells(cpu.props["reg"], cpus[0].cells("#address-cells", 2))
+                desc["cpus"].append((phys, desc["clusters"], cpu.path))
+            desc["clusters"] += 1
+    else:
+        for cpu in cpus[0].children:
+            if cpu.props.get("device_type") == ["cpu"]:
+                phys = read_cells(cpu.props["reg"], cpus[0].cells("#address-cells", 2))
+                desc["cpus"].append((phys, 0, cpu.path))
+        desc["clusters"] = 1
+    return desc
+
+def emit(out, desc, source):
+    def define(name, value):
+        macro = "#define PLATFORM_STATIC_" + name
+        tabs = max(1, (44 - len(macro) + 3) // 4)
+        out.write("{}{}{}\n".format(macro, "\t" * tabs, value))
+    hexval = lambda v: "UL(0x{:x})".format(v)
+
+    out.write("/* Generated by scripts/platform_gen.py from {}, do not edit */\n\n".format(source))
+    out.write("#ifndef __PLATFORM_STATIC_H__\n#define __PLATFORM_STATIC_H__\n\n")
+    out.write("#include <platform/platform.h>\n\n")
+
+    define("COMPATIBLE", '"{}"'.format(desc["compatible"]))
+    out.write("\n/* memory */\n")
+    define("MEMORY_BASE", hexval(desc["memory"][0][0]))
+    define("MEMORY_SIZE", hexval(desc["memory"][0][1]))
+
+    out.write("\n/* gicv3 distributor and redistributors */\n")
+    define("GICD_BASE", hexval(desc["gicd"][0]))
+    define("GICD_SIZE", hexval(desc["gicd"][1]))
+    define("GICR_BASE", hexval(desc["gicr"][0]))
+    define("GICR_SIZE", hexval(desc["gicr"][1]))
+
+    out.write("\n/* {} */\n".format(desc["uart_path"]))
+    define("UART_BASE", hexval(desc["uart"][0]))
+    define("UART_SIZE", hexval(desc["uart"][1]))
+    define("UART_IRQ", "UL({})".format(desc["uart_irq"]))
+
+    out.write("\n/* cpu topology */\n")
+    define("NUM_CPUS", len(desc["cpus"]))
+    define("NUM_CLUSTERS", desc["clusters"])
+
+    out.write("\nstatic const struct platform_cpu platform_static_cpus[] = {\n")
+    for phys, cluster, path in desc["cpus"]:
+        out.write("\t{{ .phys_id = 0x{:x}, .cluster_id = {} }},\t/* {} */\n".format(phys, cluster, path))
+    out.write("};\n")
+
+    out.write("\n#endif /* __PLATFORM_STATIC_H__ */\n")
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate a static platform header from a .dts")
+    parser.add_argument("dts", help="device tree source")
+    parser.add_argument("-o", "--output", help="header to write, default stdout")
+    args = parser.parse_args()
+
+    with open(args.dts) as f:
+        text = f.read()
+    try:
+        desc = describe(parse(text))
+    except (SyntaxError, ValueError, KeyError) as e:
+        sys.exit("{}: {}".format(args.dts, e))
+
+    if args.output:
+        with open(args.output, "w") as out:
+            emit(out, desc, args.dts)
+    else:
+        emit(sys.stdout, desc, args.dts)
+
+if __name__ == "__main__":
+    main()
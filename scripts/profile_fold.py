@@ -0,0 +1,119 @@
+##===-----------------------------------------------------------------------===//
+##
+##                                  tinyOS
+##                             The Monix Kernel
+##
+## 	This program is free software: you can redistribute it and/or modify
+## 	it under the terms of the GNU General Public License as published by
+## 	the Free Software Foundation, either version 3 of the License, or
+## 	(at your option) any later version.
+##
+## 	This program is distributed in the hope that it will be useful,
+## 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+## 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## 	GNU General Public License for more details.
+##
+## 	You should have received a copy of the GNU General Public License
+##	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+##
+##	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+##
+##===-----------------------------------------------------------------------===//
+#
+# Profiler stack folding. A kernel built with DEFAULTS_KERNEL_PROFILE writes
+# its samples to the console as "#profile <ts> <payload>" lines, where the
+# payload is the interrupted pc and the return addresses above it. This resolves
+# them against the kernel's symbol table, and writes one line per distinct call
+# stack, root first, with the number of samples it was seen in. That is the
+# folded format flamegraph.pl and speedscope take.
+#
+#   $ scripts/profile_fold.py kernel_elf serial.log > kernel.folded
+#   $ flamegraph.pl kernel.folded > kernel.svg
+#
+
+from collections import Counter
+import argparse
+import re
+import struct
+import sys
+
+from blog_decode import KernelElf, Symbols
+
+# Must match struct profile_sample in kern/trace/profile.h
+PROFILE_HEADER_FORMAT   = "<HHi"
+PROFILE_HEADER_SIZE     = struct.calcsize(PROFILE_HEADER_FORMAT)
+
+PROFILE_LINE            = re.compile(r"^#profile ([0-9a-f]+) ([0-9a-f]*)\r?$")
+PROFILE_THREAD          = re.compile(r"profile: thread (-?\d+): (.*?)\r?$")
+PROFILE_DROPPED         = re.compile(r"profile: cpu (\d+): (\d+) samples dropped")
+
+# size of a call instruction, so a return address resolves to its caller
+ARM64_INSN_SIZE         = 4
+
+def parse(log):
+    samples = []
+    threads = {}
+    dropped = Counter()
+    for line in log:
+        m = PROFILE_LINE.match(line)
+        if m:
+            payload = bytes.fromhex(m.group(2))
+            if len(payload) < PROFILE_HEADER_SIZE:
+                continue
+            depth, cpu, tid = struct.unpack_from(PROFILE_HEADER_FORMAT, payload)
+            depth = min(depth, (len(payload) - PROFILE_HEADER_SIZE) // 8)
+            pcs = struct.unpack_from("<{}Q".format(depth), payload, PROFILE_HEADER_SIZE)
+            samples.append((cpu, tid, pcs))
+            continue
+        m = PROFILE_THREAD.search(line)
+        if m:
+            threads[int(m.group(1))] = m.group(2)
+            continue
+        m = PROFILE_DROPPED.search(line)
+        if m:
+            dropped[int(m.group(1))] += int(m.group(2))
+    return samples, threads, dropped
+
+def fold(samples, threads, symbols, args):
+    stacks = Counter()
+    for cpu, tid, pcs in samples:
+        if args.cpu is not None and cpu != args.cpu:
+            continue
+        if args.tid is not None and tid != args.tid:
+            continue
+
+        frames = [symbols.lookup(pcs[0])] if pcs else []
+        frames += [symbols.lookup(pc - ARM64_INSN_SIZE) for pc in pcs[1:]]
+        frames.reverse()
+
+        if args.per_cpu:
+            frames.insert(0, "cpu{}".format(cpu))
+        if not args.no_threads:
+            frames.insert(0, "boot" if tid < 0 else threads.get(tid, "tid {}".format(tid)))
+
+        # ';' separates frames, and the count follows the last space
+        stacks[";".join(f.replace(";", ":").replace(" ", "_") for f in frames)] += 1
+    return stacks
+
+################################################################################
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(description="Fold Monix profiler samples into flame graph input")
+    parser.add_argument("kernel", help="Kernel ELF the samples were taken from")
+    parser.add_argument("log", nargs="?", help="Console log, defaults to stdin")
+    parser.add_argument("-c", "--cpu", type=int, help="Only samples taken on this CPU")
+    parser.add_argument("-t", "--tid", type=int, help="Only samples taken in this thread")
+    parser.add_argument("-C", "--per-cpu", action="store_true", help="Add the CPU as a frame under the thread")
+    parser.add_argument("-T", "--no-threads", action="store_true", help="Don't add the thread as the root frame")
+    args = parser.parse_args()
+
+    symbols = Symbols(KernelElf(args.kernel).functions())
+    log = open(args.log, "r", errors="replace") if args.log else sys.stdin
+    samples, threads, dropped = parse(log)
+
+    for cpu, count in sorted(dropped.items()):
+        print("cpu{}: {} samples dropped".format(cpu, count), file=sys.stderr)
+
+    for stack, count in sorted(fold(samples, threads, symbols, args).items()):
+        print("{} {}".format(stack, count))
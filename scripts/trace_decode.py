@@ -0,0 +1,250 @@
+##===-----------------------------------------------------------------------===//
+##
+##                                  tinyOS
+##                             The Monix Kernel
+##
+## 	This program is free software: you can redistribute it and/or modify
+## 	it under the terms of the GNU General Public License as published by
+## 	the Free Software Foundation, either version 3 of the License, or
+## 	(at your option) any later version.
+##
+## 	This program is distributed in the hope that it will be useful,
+## 	but WITHOUT ANY WARRANTY; without even the implied warranty of
+## 	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+## 	GNU General Public License for more details.
+##
+## 	You should have received a copy of the GNU General Public License
+##	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+##
+##	Copyright (C) 2023-2025, Harry Moulton <me@h3adsh0tzz.com>
+##
+##===-----------------------------------------------------------------------===//
+#
+# Trace decoder. The kernel exports its trace buffers to the console as
+# "#trace <ts> <payload>" lines, where the payload is the raw event record.
+# This reads the event layouts from the .trace_events section of the kernel
+# ELF, and either prints the events, or summarises them: event rates, interrupt
+# handler latency, per-thread run time and allocator activity.
+#
+#   $ scripts/trace_decode.py kernel_elf serial.log
+#   $ scripts/trace_decode.py --stats kernel_elf serial.log
+#
+
+from collections import defaultdict
+from dataclasses import dataclass
+import argparse
+import re
+import struct
+import sys
+
+from blog_decode import KernelElf
+
+# Must match struct tracepoint, trace_field and trace_entry in
+# kern/trace/tracepoint.h
+TRACEPOINT_FORMAT   = "<QQHHI"
+TRACEPOINT_SIZE     = struct.calcsize(TRACEPOINT_FORMAT)
+TRACE_FIELD_FORMAT  = "<QHBBI"
+TRACE_FIELD_SIZE    = struct.calcsize(TRACE_FIELD_FORMAT)
+TRACE_ENTRY_FORMAT  = "<HHi"
+
+TRACE_LINE          = re.compile(r"^#trace ([0-9a-f]+) ([0-9a-f]*)\r?$")
+TRACE_DROPPED       = re.compile(r"trace: cpu (\d+): (\d+) events dropped")
+
+NSEC_PER_SEC        = 1000000000
+NSEC_PER_USEC       = 1000
+
+@dataclass
+class TraceField:
+    name: str
+    offset: int
+    size: int
+    signed: bool
+
+@dataclass
+class TraceEvent:
+    name: str
+    size: int
+    fields: list
+
+@dataclass
+class TraceRecord:
+    ts: int
+    event: TraceEvent
+    cpu: int
+    tid: int
+    values: dict
+
+def trace_events(elf):
+    section = elf.section(".trace_events")
+    if section is None:
+        raise ValueError("kernel has no .trace_events section")
+
+    events = []
+    for offset in range(0, section.size, TRACEPOINT_SIZE):
+        name, fields, nfields, size, enabled = struct.unpack_from(
+            TRACEPOINT_FORMAT, elf.data, section.offset + offset)
+
+        table = elf.read(fields, nfields * TRACE_FIELD_SIZE)
+        event = TraceEvent(elf.read_cstr(name), size, [])
+        for i in range(nfields):
+            fname, foffset, fsize, fsigned, _ = struct.unpack_from(
+                TRACE_FIELD_FORMAT, table, i * TRACE_FIELD_SIZE)
+            event.fields.append(TraceField(elf.read_cstr(fname), foffset, fsize, bool(fsigned)))
+        events.append(event)
+    return events
+
+def trace_parse(events, log):
+    """Yield (record, None) for each trace line, or (None, line) for anything else"""
+    for line in log:
+        m = TRACE_LINE.match(line)
+        if not m:
+            yield None, line
+            continue
+
+        ts = int(m.group(1), 16)
+        payload = bytes.fromhex(m.group(2))
+        id, cpu, tid = struct.unpack_from(TRACE_ENTRY_FORMAT, payload, 0)
+        if id >= len(events):
+            yield None, "<unknown trace event {}>\n".format(id)
+            continue
+
+        event = events[id]
+        values = {}
+        for field in event.fields:
+            values[field.name] = int.from_bytes(payload[field.offset:field.offset + field.size],
+                "little", signed=field.signed)
+        yield TraceRecord(ts, event, cpu, tid, values), None
+
+def format_ts(ts):
+    return "{:5d}.{:06d}".format(ts // NSEC_PER_SEC, (ts % NSEC_PER_SEC) // NSEC_PER_USEC)
+
+def format_record(rec):
+    fields = " ".join("{}={}".format(name, hex(value) if name in ("addr", "paddr") else value)
+        for name, value in rec.values.items())
+    return "[{}] cpu{} tid {:<4d} {:<16s} {}\n".format(format_ts(rec.ts), rec.cpu, rec.tid,
+        rec.event.name, fields)
+
+################################################################################
+# Analysis
+
+def percentile(values, pct):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * pct / 100))]
+
+def trace_stats(records, dropped):
+    if not records:
+        print("no trace events")
+        return
+
+    records.sort(key=lambda rec: rec.ts)
+    span = records[-1].ts - records[0].ts
+    seconds = span / NSEC_PER_SEC if span else 1
+
+    counts = defaultdict(int)
+    irq_stack = defaultdict(list)
+    irq_times = defaultdict(list)
+    running = {}
+    runtime = defaultdict(int)
+    switches = defaultdict(int)
+    zone_allocs = defaultdict(int)
+    zone_frees = defaultdict(int)
+    pages = defaultdict(int)
+
+    for rec in records:
+        name, v = rec.event.name, rec.values
+        counts[name] += 1
+
+        if name == "irq_entry":
+            irq_stack[rec.cpu].append((v["intid"], rec.ts))
+        elif name == "irq_exit" and irq_stack[rec.cpu]:
+            intid, start = irq_stack[rec.cpu].pop()
+            irq_times[intid].append(rec.ts - start)
+        elif name == "sched_switch":
+            if rec.cpu in running:
+                tid, start = running[rec.cpu]
+                runtime[tid] += rec.ts - start
+            running[rec.cpu] = (v["next_tid"], rec.ts)
+            switches[v["next_tid"]] += 1
+        elif name == "zalloc":
+            zone_allocs[(v["zone"], v["elem_size"])] += 1
+        elif name == "zfree":
+            zone_frees[v["zone"]] += 1
+        elif name in ("vm_page_alloc", "vm_page_free"):
+            pages[name] += 1
+
+    # charge whatever was running at the end of the trace
+    for cpu, (tid, start) in running.items():
+        runtime[tid] += records[-1].ts - start
+
+    print("{} events over {:.6f}s".format(len(records), span / NSEC_PER_SEC))
+    for cpu, count in sorted(dropped.items()):
+        print("  cpu{}: {} events dropped".format(cpu, count))
+
+    print("\n{:<16s} {:>10s} {:>12s}".format("event", "count", "per second"))
+    for name, count in sorted(counts.items(), key=lambda x: -x[1]):
+        print("{:<16s} {:>10d} {:>12.1f}".format(name, count, count / seconds))
+
+    if irq_times:
+        print("\n{:<8s} {:>8s} {:>10s} {:>10s} {:>10s} {:>10s}  (handler time, us)".format(
+            "intid", "count", "min", "avg", "p99", "max"))
+        for intid, times in sorted(irq_times.items()):
+            print("{:<8d} {:>8d} {:>10.2f} {:>10.2f} {:>10.2f} {:>10.2f}".format(intid, len(times),
+                min(times) / NSEC_PER_USEC, sum(times) / len(times) / NSEC_PER_USEC,
+                percentile(times, 99) / NSEC_PER_USEC, max(times) / NSEC_PER_USEC))
+
+    if runtime:
+        print("\n{:<8s} {:>10s} {:>14s} {:>8s}".format("tid", "switches", "runtime (ms)", "cpu %"))
+        for tid, ns in sorted(runtime.items(), key=lambda x: -x[1]):
+            print("{:<8d} {:>10d} {:>14.3f} {:>7.1f}%".format(tid, switches[tid], ns / 1e6,
+                100.0 * ns / span if span else 0))
+
+    if zone_allocs or zone_frees:
+        print("\n{:<8s} {:>10s} {:>10s} {:>10s} {:>12s}".format("zone", "elem size", "allocs",
+            "frees", "outstanding"))
+        sizes = {zone: size for zone, size in zone_allocs}
+        for zone in sorted(set(sizes) | set(zone_frees)):
+            allocs = sum(n for (z, _), n in zone_allocs.items() if z == zone)
+            print("{:<8d} {:>10d} {:>10d} {:>10d} {:>12d}".format(zone, sizes.get(zone, 0), allocs,
+                zone_frees[zone], allocs - zone_frees[zone]))
+
+    if pages:
+        print("\nvm pages: {} allocated, {} freed, {} outstanding".format(pages["vm_page_alloc"],
+            pages["vm_page_free"], pages["vm_page_alloc"] - pages["vm_page_free"]))
+
+################################################################################
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(description="Decode and analyse Monix trace output")
+    parser.add_argument("kernel", help="Kernel ELF the trace was produced by")
+    parser.add_argument("log", nargs="?", help="Console log, defaults to stdin")
+    parser.add_argument("-l", "--list", action="store_true", help="List the trace events and exit")
+    parser.add_argument("-s", "--stats", action="store_true", help="Summarise the trace instead of printing it")
+    args = parser.parse_args()
+
+    events = trace_events(KernelElf(args.kernel))
+
+    if args.list:
+        for i, event in enumerate(events):
+            print("{:4d}  {:<16s} {}".format(i, event.name,
+                ", ".join("{}{}:{}".format("s" if f.signed else "u", f.size * 8, f.name)
+                    for f in event.fields)))
+        sys.exit(0)
+
+    log = open(args.log, "r", errors="replace") if args.log else sys.stdin
+
+    if args.stats:
+        records = []
+        dropped = defaultdict(int)
+        for rec, line in trace_parse(events, log):
+            if rec is not None:
+                records.append(rec)
+                continue
+            m = TRACE_DROPPED.search(line)
+            if m:
+                dropped[int(m.group(1))] += int(m.group(2))
+        trace_stats(records, dropped)
+        sys.exit(0)
+
+    for rec, line in trace_parse(events, log):
+        sys.stdout.write(format_record(rec) if rec is not None else line)